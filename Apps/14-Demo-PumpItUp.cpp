@@ -69,9 +69,10 @@ void Animate() {
 }
 
 void DisplaySpheres(float accumTime) {
-	GLuint program = UseMeshShader();
+	// one instanced draw for all spheres
+	static vector<mat4> transforms;
 	float dt = sphereTravelTime/(multiple*maxNSpheres);
-	SetUniform(program, "color", vec3(1, 0, 0));
+	transforms.resize(0);
 	for (int i = 0; i < nSpheres; i++) {
 		float time = accumTime-i*dt;
 		if (time >= 0) {
@@ -88,10 +89,10 @@ void DisplaySpheres(float accumTime) {
 					*s = f;
 				}
 			}
-			sphere.toWorld = Translate(.1f*p)*Scale(scale);				// move sphere to p, scale with possible stretch
-			sphere.Display(camera);
+			transforms.push_back(Translate(.1f*p)*Scale(scale));		// move sphere to p, scale with possible stretch
 		}
 	}
+	sphere.DisplayInstanced(camera, transforms);
 }
 
 void Display() {
@@ -166,6 +167,7 @@ const char *usage = R"(
 int main(int argc, char** argv) {
 	GLFWwindow* w = InitGLFW(100, 100, winW, winH, "Pump It Up");
 	sphere.Read("C:/Assets/Models/Sphere.obj");
+	sphere.color = vec3(1, 0, 0);
 	RegisterMouseButton(MouseButton);
 	RegisterMouseMove(MouseMove);
 	RegisterMouseWheel(MouseWheel);
@@ -4,81 +4,88 @@
 #include <glad.h>
 #include <glfw3.h>
 #include "GLXtras.h"
-#include <time.h>
+#include "Fractal.h"
+#include <math.h>
 #include <stdio.h>
 
-GLuint program = 0;
 int winWidth = 800, winHeight = 800;
-float cReal = -.8f, cImag = .156f;
+double cReal = -.8, cImag = .156;
+JuliaSet julia;
 
-const char* vertexShader = R"(
-	#version 130
-	void main() {
-		vec2 points[] = vec2[4](vec2(-1, -1), vec2(-1, 1), vec2(1, 1), vec2(1, -1));
-		gl_Position = vec4(points[gl_VertexID], 0, 1);
-	}
-)";
+// Mouse: left-drag pans, right-drag sets c, wheel zooms about the cursor
 
-const char* pixelShader = R"(
-	#version 130
-	out vec4 pColor;
-	uniform float cReal = -.8, cImag = .156;
-	struct Complex { float r, i; };
-	Complex Multiply(Complex a, Complex b) { return Complex(a.r*b.r-a.i*b.i, a.i*b.r+a.r*b.i); }
-	Complex Add(Complex a, Complex b) { return Complex(a.r+b.r, a.i+b.i); }
-	float Magnitude(Complex a) { return sqrt(a.r*a.r+a.i*a.i); }
-	void main() {
-		int kLimit = 1000;
-		float x = 2*gl_FragCoord.x/800-1, y = 2*gl_FragCoord.y/800-1;
-		Complex a = Complex(x, y);
-		Complex c = Complex(cReal, cImag);
-		
-		for (int k = 0; k < kLimit; k++) {
-			a = Add(Multiply(a, a), c);
-			if (Magnitude(a) > 500)  {
-			float n = float(k)/kLimit; // should be between 0 and 1
-			pColor = vec4(n, n, n, 1);
-			return;
-			}
-			}
-		pColor = vec4(1, 1, 1, 1);
-	}
-)";
+double mouseX = 0, mouseY = 0;
 
 void MouseMove(GLFWwindow* w, double x, double y) {
 	if (glfwGetMouseButton(w, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-		cReal = 2 * (float)x / winWidth - 1;
-		cImag = 2 * (float)y / winHeight - 1;
+		// whole pixels only, so computed tiles stay on the grid
+		int dx = (int) floor(x)-(int) floor(mouseX), dy = (int) floor(y)-(int) floor(mouseY);
+		julia.Pan(dx, -dy);
+	}
+	if (glfwGetMouseButton(w, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS) {
+		cReal = 2*x/winWidth-1;
+		cImag = 2*y/winHeight-1;
+		julia.SetC(cReal, cImag);
 	}
+	mouseX = x;
+	mouseY = y;
 }
 
-void Display() {
-	glUseProgram(program);
-	SetUniform(program, "cReal", cReal);
-	SetUniform(program, "cImag", cImag);
-	glDrawArrays(GL_QUADS, 0, 4);
-	glFlush();
-	
+void MouseWheel(GLFWwindow* w, double xoffset, double yoffset) {
+	julia.Zoom(pow(1.25, yoffset), (int) mouseX, winHeight-1-(int) mouseY);
+}
+
+void Keyboard(GLFWwindow* w, int key, int scancode, int action, int mods) {
+	if (action != GLFW_PRESS && action != GLFW_REPEAT)
+		return;
+	if (key == GLFW_KEY_UP)
+		julia.SetIterations(2*julia.Iterations());
+	if (key == GLFW_KEY_DOWN)
+		julia.SetIterations(julia.Iterations()/2);
+	if (key == GLFW_KEY_R)
+		julia.SetView(DoubleDouble(0), DoubleDouble(0), 2./800);
+}
+
+void Resize(GLFWwindow* w, int width, int height) {
+	glViewport(0, 0, winWidth = width, winHeight = height);
+	julia.Resize(width, height);
+}
+
+void Title(GLFWwindow* w, int missing) {
+	char buf[200];
+	snprintf(buf, sizeof(buf), "Julia Set  zoom %.3g  %i iterations%s  %.0f Miter/s%s",
+		2./800/julia.PixelSize(), julia.Iterations(), julia.Deep()? "  (perturbation)" : "",
+		julia.Seconds() > 0? julia.IterationCount()/julia.Seconds()/1e6 : 0., missing? "  ..." : "");
+	glfwSetWindowTitle(w, buf);
 }
 
 int main() {
-	// init window, build shader
+	// init window, engine
 	glfwInit();
 	GLFWwindow* w = glfwCreateWindow(winWidth, winHeight, "Julia Set", NULL, NULL);
 	glfwSetWindowPos(w, 100, 100);
 	glfwMakeContextCurrent(w);
 	glfwSetCursorPosCallback(w, MouseMove);
+	glfwSetScrollCallback(w, MouseWheel);
+	glfwSetKeyCallback(w, Keyboard);
+	glfwSetWindowSizeCallback(w, Resize);
 	gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
-	program = LinkProgramViaCode(&vertexShader, &pixelShader);
-	// event loop
+	julia.Resize(winWidth, winHeight);
+	julia.SetC(cReal, cImag);
+	printf("Usage:\n  left-drag: pan\n  wheel: zoom\n  right-drag: set c\n  Up/Down: iterations x2, /2\n  R: reset view\n");
+	// event loop: compute tiles for most of a frame, upload those that changed; sleep once the view is complete
 	glfwSwapInterval(1);
 	while (!glfwWindowShouldClose(w)) {
-		Display();
+		int missing = julia.Update(.012);
+		julia.Display();
+		if (julia.TilesComputed())
+			Title(w, missing);
 		glfwSwapBuffers(w);
-		glfwPollEvents();
+		if (missing)
+			glfwPollEvents();
+		else
+			glfwWaitEvents();
 	}
 	glfwDestroyWindow(w);
 	glfwTerminate();
 }
-
-
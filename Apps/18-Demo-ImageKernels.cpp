@@ -0,0 +1,124 @@
+// ImageKernels.cpp - throughput of Image.h kernels on 4K images, compared with per-pixel scalar loops
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Image.h"
+
+using std::vector;
+
+const int width = 3840, height = 2160, nRepeats = 5;
+
+// per-pixel reference implementations (as previously in Misc.cpp)
+
+float GetVal(unsigned char *data, int x, int y, int w, int nChannels) { return (float) data[nChannels*(y*w+x)]/255; }
+
+float Lerp(float a, float b, float t) { return a+t*(b-a); }
+
+void MergeScalar(unsigned char *image, unsigned char *matte, int mw, int mh, unsigned char *o) {
+	for (int j = 0; j < height; j++)
+		for (int i = 0; i < width; i++) {
+			unsigned char *t = image+3*(j*width+i);
+			*o++ = t[0]; *o++ = t[1]; *o++ = t[2];
+			float x = (float) i/width*mw, y = (float) j/height*mh;
+			int x0 = (int) floor(x), y0 = (int) floor(y), x1 = x0 < mw-1? x0+1 : x0, y1 = y0 < mh-1? y0+1 : y0;
+			float v1 = Lerp(GetVal(matte, x0, y0, mw, 1), GetVal(matte, x1, y0, mw, 1), x-x0);
+			float v2 = Lerp(GetVal(matte, x0, y1, mw, 1), GetVal(matte, x1, y1, mw, 1), x-x0);
+			*o++ = (unsigned char) (255.*Lerp(v1, v2, y-y0));
+		}
+}
+
+void NormalsScalar(unsigned char *depth, unsigned char *n) {
+	for (int j = 0; j < height; j++)
+		for (int i = 0; i < width; i++) {
+			int i1 = i > 0? i-1 : i, i2 = i < width-1? i+1 : i, j1 = j > 0? j-1 : j, j2 = j < height-1? j+1 : j;
+			float xs = (float) (i2-i1)/width, ys = (float) (j2-j1)/height;
+			float dzx = GetVal(depth, i2, j, width, 3)-GetVal(depth, i1, j, width, 3);
+			float dzy = GetVal(depth, i, j2, width, 3)-GetVal(depth, i, j1, width, 3);
+			float nx = -dzx*ys, ny = -dzy*xs, nz = xs*ys, r = 1/sqrt(nx*nx+ny*ny+nz*nz);
+			*n++ = (unsigned char) (127.5f*(nx*r+1));
+			*n++ = (unsigned char) (127.5f*(ny*r+1));
+			*n++ = (unsigned char) (255.f*nz*r);
+		}
+}
+
+void SwizzleScalar(unsigned char *p, int bpp) {
+	for (int i = 0; i < width*height; i++, p += bpp) {
+		unsigned char c = p[0]; p[0] = p[2]; p[2] = c;
+	}
+}
+
+void FlipScalar(unsigned char *p, int bpp) {
+	int rowBytes = width*bpp;
+	vector<unsigned char> tmp(rowBytes);
+	for (int j = 0; j < height/2; j++) {
+		memcpy(tmp.data(), p+j*rowBytes, rowBytes);
+		memcpy(p+j*rowBytes, p+(height-1-j)*rowBytes, rowBytes);
+		memcpy(p+(height-1-j)*rowBytes, tmp.data(), rowBytes);
+	}
+}
+
+// timing
+
+template<class F> double Seconds(F f) {
+	// best of nRepeats
+	double best = 1e9;
+	for (int r = 0; r < nRepeats; r++) {
+		auto t0 = std::chrono::high_resolution_clock::now();
+		f();
+		double s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now()-t0).count();
+		best = s < best? s : best;
+	}
+	return best;
+}
+
+void Report(const char *name, double megabytes, double scalar, double kernel) {
+	printf("%-16s scalar %8.1f MB/s   kernel %8.1f MB/s   (%.1fx)\n",
+		name, megabytes/scalar, megabytes/kernel, scalar/kernel);
+}
+
+int MaxDifference(vector<unsigned char> &a, vector<unsigned char> &b) {
+	int d = 0;
+	for (size_t i = 0; i < a.size(); i++)
+		d = abs(a[i]-b[i]) > d? abs(a[i]-b[i]) : d;
+	return d;
+}
+
+int main() {
+	int n = width*height, mw = width/3, mh = height/3;
+	vector<unsigned char> rgb(3*n), rgba(4*n), depth(3*n), matte(mw*mh), out1(4*n), out2(4*n);
+	for (int j = 0; j < height; j++)
+		for (int i = 0; i < width; i++) {
+			unsigned char *p = &rgb[3*(j*width+i)], *d = &depth[3*(j*width+i)];
+			p[0] = i & 255; p[1] = j & 255; p[2] = (i+j) & 255;
+			d[0] = d[1] = d[2] = (unsigned char) (127.5*(1+sin(i/40.)*cos(j/30.)));
+		}
+	for (int i = 0; i < mw*mh; i++)
+		matte[i] = rand() & 255;
+	for (int i = 0; i < 4*n; i++)
+		rgba[i] = i & 255;
+	printf("%ix%i, best of %i\n", width, height, nRepeats);
+	double mb3 = 3.*n/1e6, mb4 = 4.*n/1e6;
+	double s = Seconds([&]() { MergeScalar(rgb.data(), matte.data(), mw, mh, out1.data()); });
+	double k = Seconds([&]() { MergeMatte(rgb.data(), width, height, 3, matte.data(), mw, mh, 1, out2.data()); });
+	Report("matte merge", mb4, s, k);
+	printf("  max difference %i\n", MaxDifference(out1, out2));
+	out1.resize(3*n);
+	out2.resize(3*n);
+	s = Seconds([&]() { NormalsScalar(depth.data(), out1.data()); });
+	k = Seconds([&]() { DepthToNormals(depth.data(), width, height, 3, 1, out2.data()); });
+	Report("depth->normals", mb3, s, k);
+	printf("  max difference %i\n", MaxDifference(out1, out2));
+	Report("swizzle rgb", mb3, Seconds([&]() { SwizzleScalar(rgb.data(), 3); }), Seconds([&]() { SwizzleRB(rgb.data(), width, height, 3); }));
+	Report("swizzle rgba", mb4, Seconds([&]() { SwizzleScalar(rgba.data(), 4); }), Seconds([&]() { SwizzleRB(rgba.data(), width, height, 4); }));
+	Report("flip rgb", mb3, Seconds([&]() { FlipScalar(rgb.data(), 3); }), Seconds([&]() { FlipVertical(rgb.data(), width, height, 3); }));
+	// correctness of swizzle: two swaps restore original
+	vector<unsigned char> copy = rgb;
+	SwizzleRB(rgb.data(), width, height, 3);
+	SwizzleScalar(rgb.data(), 3);
+	printf("swizzle check: %s\n", copy == rgb? "ok" : "MISMATCH");
+	return 0;
+}
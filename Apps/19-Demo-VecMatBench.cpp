@@ -0,0 +1,151 @@
+// VecMatBench.cpp - throughput of SIMD mat4 operations and batch point kernels, compared with scalar loops
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "VecMatBatch.h"
+
+using std::vector;
+
+const int nMatrices = 1 << 16, nPoints = 1 << 20, nRepeats = 5;
+
+// scalar reference implementations (as VecMat.h without SIMD)
+
+mat4 MulScalar(const mat4 &a, const mat4 &b) {
+	mat4 m(0);
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			for (int k = 0; k < 4; k++)
+				m[i][j] += a[i][k]*b[k][j];
+	return m;
+}
+
+vec4 MulScalar(const mat4 &a, const vec4 &v) { return vec4(dot(a[0], v), dot(a[1], v), dot(a[2], v), dot(a[3], v)); }
+
+mat4 InvertScalar(mat4 m) {
+	mat4 inv;
+	InverseMatrix4x4(&m[0][0], &inv[0][0]);
+	return inv;
+}
+
+void TransformScalar(const mat4 &m, vec3 *in, vec3 *out, int n) {
+	for (int i = 0; i < n; i++) {
+		vec4 v = MulScalar(m, vec4(in[i]));
+		out[i] = vec3(v.x, v.y, v.z);
+	}
+}
+
+// timing
+
+template<class F> double Seconds(F f) {
+	// best of nRepeats
+	double best = 1e9;
+	for (int r = 0; r < nRepeats; r++) {
+		auto t0 = std::chrono::high_resolution_clock::now();
+		f();
+		double s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now()-t0).count();
+		best = s < best? s : best;
+	}
+	return best;
+}
+
+void Report(const char *name, double count, double scalar, double simd) {
+	printf("%-20s scalar %8.1f M/s   simd %8.1f M/s   (%.1fx)\n", name, count/scalar/1e6, count/simd/1e6, scalar/simd);
+}
+
+bool Same(vec3 a, vec3 b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+float Random() { return (float) rand()/RAND_MAX*2-1; }
+
+float MaxDifference(const mat4 &a, const mat4 &b) {
+	float d = 0;
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			d = fabs(a[i][j]-b[i][j]) > d? fabs(a[i][j]-b[i][j]) : d;
+	return d;
+}
+
+float MaxDifference(vector<vec3> &a, vector<vec3> &b) {
+	float d = 0;
+	for (size_t i = 0; i < a.size(); i++)
+		d = length(a[i]-b[i]) > d? length(a[i]-b[i]) : d;
+	return d;
+}
+
+int main() {
+#if defined(VECMAT_AVX)
+	const char *isa = "AVX";
+#elif defined(VECMAT_SSE)
+	const char *isa = "SSE2";
+#else
+	const char *isa = "scalar";
+#endif
+	printf("%s, %i matrices, %i points, best of %i\n", isa, nMatrices, nPoints, nRepeats);
+	vector<mat4> mats(nMatrices), out1(nMatrices), out2(nMatrices);
+	for (mat4 &m : mats)
+		m = Translate(Random(), Random(), Random())*RotateY(180*Random())*RotateX(180*Random())*Scale(1+Random()/2);
+	mat4 view = Translate(0, 0, -5)*RotateY(30);
+	double s = Seconds([&]() { for (int i = 0; i < nMatrices; i++) out1[i] = MulScalar(view, mats[i]); });
+	double k = Seconds([&]() { for (int i = 0; i < nMatrices; i++) out2[i] = view*mats[i]; });
+	Report("mat4*mat4", nMatrices, s, k);
+	float d = 0;
+	for (int i = 0; i < nMatrices; i++)
+		d = MaxDifference(out1[i], out2[i]) > d? MaxDifference(out1[i], out2[i]) : d;
+	printf("  max difference %g\n", d);
+	s = Seconds([&]() { for (int i = 0; i < nMatrices; i++) out1[i] = InvertScalar(mats[i]); });
+	k = Seconds([&]() { for (int i = 0; i < nMatrices; i++) out2[i] = Invert(mats[i]); });
+	Report("Invert", nMatrices, s, k);
+	d = 0;
+	for (int i = 0; i < nMatrices; i++)
+		d = MaxDifference(mats[i]*out2[i], mat4()) > d? MaxDifference(mats[i]*out2[i], mat4()) : d;
+	printf("  max |m*Invert(m)-I| %g\n", d);
+	vector<vec4> v4(nPoints), v4Out(nPoints);
+	for (vec4 &v : v4)
+		v = vec4(Random(), Random(), Random(), 1);
+	s = Seconds([&]() { for (int i = 0; i < nPoints; i++) v4Out[i] = MulScalar(view, v4[i]); });
+	k = Seconds([&]() { for (int i = 0; i < nPoints; i++) v4Out[i] = view*v4[i]; });
+	Report("mat4*vec4", nPoints, s, k);
+	// batch kernels
+	vector<vec3> points(nPoints), p1(nPoints), p2(nPoints);
+	vector<float> x(nPoints), y(nPoints), z(nPoints), xo(nPoints), yo(nPoints), zo(nPoints);
+	for (int i = 0; i < nPoints; i++) {
+		points[i] = vec3(Random(), Random(), Random());
+		x[i] = points[i].x; y[i] = points[i].y; z[i] = points[i].z;
+	}
+	s = Seconds([&]() { TransformScalar(view, points.data(), p1.data(), nPoints); });
+	k = Seconds([&]() { TransformPoints(view, points.data(), p2.data(), nPoints); });
+	Report("transform AoS", nPoints, s, k);
+	printf("  max difference %g\n", MaxDifference(p1, p2));
+	k = Seconds([&]() { TransformPoints(view, x.data(), y.data(), z.data(), xo.data(), yo.data(), zo.data(), nPoints); });
+	Report("transform SoA", nPoints, s, k);
+	for (int i = 0; i < nPoints; i++)
+		p2[i] = vec3(xo[i], yo[i], zo[i]);
+	printf("  max difference %g\n", MaxDifference(p1, p2));
+	vec3 min1, max1, min2, max2;
+	s = Seconds([&]() { Bounds(points.data(), nPoints, min1, max1); });
+	k = Seconds([&]() { PointBounds(points.data(), nPoints, min2, max2); });
+	Report("bounds AoS", nPoints, s, k);
+	printf("  bounds check: %s\n", Same(min1, min2) && Same(max1, max2)? "ok" : "MISMATCH");
+	k = Seconds([&]() { PointBounds(x.data(), y.data(), z.data(), nPoints, min2, max2); });
+	Report("bounds SoA", nPoints, s, k);
+	printf("  bounds check: %s\n", Same(min1, min2) && Same(max1, max2)? "ok" : "MISMATCH");
+	// planar (sprite) transforms, as Sprite::UpdateTransform
+	vector<float> degrees(nMatrices), sx(nMatrices), sy(nMatrices);
+	for (int i = 0; i < nMatrices; i++) {
+		degrees[i] = 180*Random();
+		sx[i] = 1+Random()/2;
+		sy[i] = 1+Random()/2;
+	}
+	vec2 aspect(.75f, 1.f);
+	s = Seconds([&]() { for (int i = 0; i < nMatrices; i++)
+		out1[i] = Scale(aspect.x, aspect.y, 1)*(Translate(x[i], y[i], 0)*RotateZ(degrees[i])*Scale(sx[i], sy[i], 1)); });
+	k = Seconds([&]() { PlanarTransforms(x.data(), y.data(), degrees.data(), sx.data(), sy.data(), aspect, out2.data(), nMatrices); });
+	Report("planar transforms", nMatrices, s, k);
+	d = 0;
+	for (int i = 0; i < nMatrices; i++)
+		d = MaxDifference(out1[i], out2[i]) > d? MaxDifference(out1[i], out2[i]) : d;
+	printf("  max difference %g\n", d);
+	return 0;
+}
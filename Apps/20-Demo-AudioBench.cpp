@@ -0,0 +1,104 @@
+// AudioBench.cpp - throughput and accuracy of AudioDSP resampling and sample kernels
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "AudioDSP.h"
+
+using std::vector;
+
+const int seconds = 10, nRepeats = 3, outRate = 48000;
+const double Pi = 3.14159265358979;
+
+// scalar reference kernels (as previously in Wav.cpp)
+
+void StereoToMonoScalar(const short *stereo, short *mono, int n) {
+	for (int i = 0; i < n; i++)
+		mono[i] = (short) ((stereo[2*i]+stereo[2*i+1]) >> 1);
+}
+
+void ScaleScalar(const short *in, short *out, int n, float gain) {
+	for (int i = 0; i < n; i++) {
+		float s = gain*in[i];
+		out[i] = (short) (s > 32767.f? 32767 : s < -32768.f? -32768 : s);
+	}
+}
+
+void FloatToShortScalar(const float *in, short *out, int n) {
+	for (int i = 0; i < n; i++) {
+		float s = 32767.f*in[i];
+		out[i] = (short) (s > 32767.f? 32767 : s < -32768.f? -32768 : s);
+	}
+}
+
+// timing
+
+template<class F> double Seconds(F f) {
+	double best = 1e9;
+	for (int r = 0; r < nRepeats; r++) {
+		auto t0 = std::chrono::high_resolution_clock::now();
+		f();
+		double s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now()-t0).count();
+		best = s < best? s : best;
+	}
+	return best;
+}
+
+double SNR(vector<float> &out, double frequency) {
+	// signal to noise+distortion (dB) against an ideal sine at the output rate, skipping the ends
+	double signal = 0, noise = 0;
+	int n = (int) out.size()/2;
+	for (int i = n/10; i < n-n/10; i++) {
+		double ideal = .5*sin(2*Pi*frequency*i/outRate), e = out[2*i]-ideal;
+		signal += ideal*ideal;
+		noise += e*e;
+	}
+	return 10*log10(signal/noise);
+}
+
+int main() {
+	const char *qualities[] = { "linear", "low", "medium", "high" };
+	int rates[] = { 22050, 44100, 96000 };
+	printf("resample to %i Hz, %i s stereo, best of %i\n", outRate, seconds, nRepeats);
+	for (int rate : rates) {
+		int n = seconds*rate;
+		vector<float> in(2*n), out;
+		for (int i = 0; i < n; i++)
+			in[2*i] = in[2*i+1] = (float) (.5*sin(2*Pi*1000*i/rate));
+		for (int q = 0; q < 4; q++) {
+			Resampler r;
+			double s = Seconds([&]() {
+				r.Initialize(rate, outRate, 2, (ResampleQuality) q);
+				out.clear();
+				for (int i = 0; i < n; i += 4096)
+					r.Process(&in[2*i], i+4096 <= n? 4096 : n-i, out);
+			});
+			printf("  %5i Hz %-7s %7.1f Msamples/s   1 kHz SNR %5.1f dB   %i frames out\n",
+				rate, qualities[q], out.size()/s/1e6, SNR(out, 1000), (int) out.size()/2);
+		}
+	}
+	int n = seconds*outRate;
+	vector<short> stereo(2*n), mono1(n), mono2(n), scaled1(2*n), scaled2(2*n);
+	vector<float> floats(2*n);
+	for (int i = 0; i < 2*n; i++) {
+		stereo[i] = (short) (30000*sin(i/37.));
+		floats[i] = (float) (1.2*sin(i/41.));
+	}
+	double s = Seconds([&]() { StereoToMonoScalar(stereo.data(), mono1.data(), n); });
+	double k = Seconds([&]() { StereoToMono(stereo.data(), mono2.data(), n); });
+	printf("stereo->mono   scalar %7.1f   simd %7.1f Msamples/s   %s\n", 2*n/s/1e6, 2*n/k/1e6, mono1 == mono2? "ok" : "MISMATCH");
+	s = Seconds([&]() { ScaleScalar(stereo.data(), scaled1.data(), 2*n, 1.5f); });
+	k = Seconds([&]() { ScaleSamples(stereo.data(), scaled2.data(), 2*n, 1.5f); });
+	int d = 0;
+	for (int i = 0; i < 2*n; i++)
+		d = abs(scaled1[i]-scaled2[i]) > d? abs(scaled1[i]-scaled2[i]) : d;
+	printf("gain (short)   scalar %7.1f   simd %7.1f Msamples/s   max difference %i\n", 2*n/s/1e6, 2*n/k/1e6, d);
+	s = Seconds([&]() { FloatToShortScalar(floats.data(), scaled1.data(), 2*n); });
+	k = Seconds([&]() { FloatToShort(floats.data(), scaled2.data(), 2*n); });
+	d = 0;
+	for (int i = 0; i < 2*n; i++)
+		d = abs(scaled1[i]-scaled2[i]) > d? abs(scaled1[i]-scaled2[i]) : d;
+	printf("float->short   scalar %7.1f   simd %7.1f Msamples/s   max difference %i\n", 2*n/s/1e6, 2*n/k/1e6, d);
+	return 0;
+}
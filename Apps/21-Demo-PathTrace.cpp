@@ -0,0 +1,52 @@
+// PathTrace.cpp - headless path-traced reference of the RayTrace demo scene, reporting Mrays/s per pass
+// usage: PathTrace [obj file] (mesh is placed below and in front of the chrome sphere)
+
+#include <stdio.h>
+#include "Jobs.h"
+#include "Mesh.h"
+#include "PathTrace.h"
+
+// scene of 1-Demo-RayTrace
+vec3 light(2, 0, 1);
+vec4 planes[] = { vec4(-1,0,0,-3), vec4(1,0,0,-3), vec4(0,-1,0,-3), vec4(0,1,0,-3), vec4(0,0,-1,-3), vec4(0,0,1,-3) };
+vec4 spheres[] = { vec4(-1.7f,-.3f,2,.6f), vec4(0,.1f,2,.9f), vec4(1.3f,0,2,.4f) };
+vec3 sphereCols[] = { vec3(1,1,0), vec3(0,1,0), vec3(0,0,1) };
+vec3 planeCols[] = { vec3(0,.7f,0), vec3(1,1,1), vec3(0,1,1), vec3(1,0,1), vec3(1,0,0), vec3(1,.6f,0) };
+
+int width = 640, height = 480, nPasses = 8, samplesPerPass = 4;
+const char *pngFile = "PathTrace.png";
+
+int main(int ac, char **av) {
+	RTScene scene;
+	for (int i = 0; i < 6; i++)
+		scene.AddPlane(planes[i], RTMaterial(.8f*planeCols[i]));
+	for (int i = 0; i < 3; i++)
+		// sphere[1] is chrome
+		scene.AddSphere(spheres[i], i == 1? RTMaterial(vec3(.9f), 1) : RTMaterial(.8f*sphereCols[i]));
+	// the .07 radius bulb, bright enough to light the room about as the demo's Phong shading does
+	scene.AddSphere(vec4(light.x, light.y, light.z, .07f), RTMaterial(vec3(0.f), 0, vec3(400.f)));
+	if (ac > 1) {
+		Mesh mesh;
+		mat4 place = Translate(.2f, -1.1f, 1.1f)*RotateX(-30)*Scale(.45f);
+		if (!mesh.Read(av[1], NULL, true, false))
+			return 1;
+		scene.AddMesh(mesh, RTMaterial(vec3(.8f)), &place);
+	}
+	scene.Build();
+	printf("%i triangles, %i spheres, %i threads\n", scene.NTriangles(), scene.NSpheres(), GetJobSystem().NWorkers());
+	RTCamera camera;
+	camera.up = vec3(0, (float) height/width, 0);
+	PathTracer tracer;
+	tracer.Resize(width, height);
+	long long rays = 0;
+	double seconds = 0;
+	for (int p = 0; p < nPasses; p++) {
+		tracer.Render(scene, camera, samplesPerPass);
+		rays += tracer.Rays();
+		seconds += tracer.Seconds();
+		printf("pass %i: %i spp, %.2f sec, %.2f Mrays/s\n", p+1, tracer.Samples(), tracer.Seconds(), tracer.MRaysPerSecond());
+	}
+	printf("average %.2f Mrays/s\n", rays/seconds/1e6);
+	if (tracer.SavePng(pngFile))
+		printf("wrote %s\n", pngFile);
+}
@@ -0,0 +1,96 @@
+// JuliaBench.cpp - throughput of the tiled Julia set engine, SIMD and scalar, at shallow and deep zoom
+
+#include <stdio.h>
+#include "Fractal.h"
+#include "Jobs.h"
+
+int width = 1024, height = 1024, maxIterations = 1000;
+double cReal = -.8, cImag = .156;
+
+int Escape(DoubleDouble x, DoubleDouble y) {
+	// iterations before |z| > 500, in double-double
+	DoubleDouble cr(cReal), ci(cImag);
+	for (int k = 0; k < maxIterations; k++) {
+		DoubleDouble xy = x*y;
+		x = x*x-y*y+cr;
+		y = xy+xy+ci;
+		if (x.hi*x.hi+y.hi*y.hi > 250000.)
+			return k;
+	}
+	return maxIterations;
+}
+
+void Edge(DoubleDouble &x, DoubleDouble &y) {
+	// find detail: from the slowest escaping pixel of the full view, bisect toward (2, 0) for the level set of
+	// maxIterations/2, to double-double precision
+	JuliaSet j;
+	j.Resize(width, height);
+	j.SetC(cReal, cImag);
+	j.Update(0);
+	int best = 0, bx = 0, by = 0;
+	for (int py = 0; py < height; py++)
+		for (int px = 0; px < width; px++)
+			if (j.Pixel(px, py) > best) {
+				best = j.Pixel(px, py);
+				bx = px;
+				by = py;
+			}
+	DoubleDouble x0 = j.CenterX()+DoubleDouble((bx-width/2)*j.PixelSize()), y0 = j.CenterY()+DoubleDouble((by-height/2)*j.PixelSize());
+	DoubleDouble x1(2), y1(0);
+	for (int i = 0; i < 110; i++) {
+		DoubleDouble mx = (x0+x1)*DoubleDouble(.5), my = (y0+y1)*DoubleDouble(.5);
+		bool slow = Escape(mx, my) >= maxIterations/2;
+		(slow? x0 : x1) = mx;
+		(slow? y0 : y1) = my;
+	}
+	x = x0;
+	y = y0;
+}
+
+void Run(const char *name, DoubleDouble x, DoubleDouble y, double pixelSize) {
+	double mpps[2], gips[2];
+	unsigned char check[2] = {0, 0};
+	for (int s = 0; s < 2; s++) {
+		JuliaSet j;
+		j.simd = s == 0;
+		j.Resize(width, height);
+		j.SetC(cReal, cImag);
+		j.SetIterations(maxIterations);
+		j.SetView(x, y, pixelSize);
+		j.Update(0);
+		mpps[s] = (double) width*height/j.Seconds()/1e6;
+		gips[s] = j.IterationCount()/j.Seconds()/1e9;
+		check[s] = j.Pixel(width/3, height/3);
+	}
+	printf("%-10s %s  simd %7.1f Mpixels/s %5.2f Giter/s   scalar %6.1f Mpixels/s %5.2f Giter/s   (%.1fx)\n",
+		name, check[0] == check[1]? "     " : "(!=) ", mpps[0], gips[0], mpps[1], gips[1], mpps[0]/mpps[1]);
+}
+
+int main() {
+	printf("%ix%i, %i iterations, %i threads, %s lanes\n", width, height, maxIterations, GetJobSystem().NWorkers(),
+		JuliaSet::SimdLanes());
+	DoubleDouble x, y;
+	Edge(x, y);
+	printf("detail at %.17g%+.3g, %.17g%+.3g\n", x.hi, x.lo, y.hi, y.lo);
+	Run("full view", DoubleDouble(0), DoubleDouble(0), 2./800);
+	Run("1e-6", x, y, 1e-6);
+	Run("1e-12", x, y, 1e-12);
+	Run("1e-24", x, y, 1e-24);
+	// panning recomputes only the tiles brought into view
+	JuliaSet j, fresh;
+	j.Resize(width, height);
+	j.SetView(x, y, 1e-12);
+	j.Update(0);
+	int total = j.TilesComputed();
+	j.Pan(100, -37);
+	j.Update(0);
+	fresh.Resize(width, height);
+	fresh.SetView(j.CenterX(), j.CenterY(), 1e-12);
+	fresh.Update(0);
+	int differ = 0;
+	for (int py = 0; py < height; py++)
+		for (int px = 0; px < width; px++)
+			differ += j.Pixel(px, py) != fresh.Pixel(px, py);
+	printf("pan (100, -37): %i of %i tiles recomputed in %.1f ms; %i pixels differ from a fresh render\n",
+		j.TilesComputed(), total, 1000*j.Seconds(), differ);
+}
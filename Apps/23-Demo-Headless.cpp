@@ -0,0 +1,98 @@
+// Headless.cpp - render with no window (hidden GLFW window, or surfaceless EGL on a Linux server), reporting
+// frames/s with no readback, synchronous glReadPixels each frame, and asynchronous readback each frame
+// usage: Headless [obj file]
+
+#include <glad.h>
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+#include "Camera.h"
+#include "Draw.h"
+#include "GLXtras.h"
+#include "Headless.h"
+#include "IO.h"
+#include "Mesh.h"
+
+int width = 640, height = 480, nFrames = 120;
+const char *pngFile = "Headless.png";
+Camera camera(0, 0, width, height, vec3(15, -20, 0), vec3(0, 0, -5), 30, .001f, 500);
+Mesh mesh;
+bool haveMesh = false;
+long long checksum = 0;
+
+double Now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Display(int frame) {
+	glClearColor(.2f, .2f, .25f, 1);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	if (haveMesh) {
+		camera.SetModelview(Translate(0, 0, -5)*RotateX(15)*RotateY(-20.f+3*frame));
+		mesh.Display(camera, vec3(.8f, .6f, .2f));
+	}
+	glDisable(GL_DEPTH_TEST);
+	UseDrawShader(ScreenMode());
+	for (int i = 0; i < 12; i++) {
+		float a = 3.1416f*(i/6.f+frame/60.f);
+		vec2 p(width/2+150*cos(a), height/2+150*sin(a));
+		Disk(p, 30, vec3(i/12.f, 1-i/12.f, .5f));
+		Line(vec2(width/2.f, height/2.f), p, 3, vec3(1, 1, 1));
+	}
+}
+
+void Sum(unsigned char *pixels, int w, int h, void *data) {
+	// touch the pixels, as a consumer would
+	for (int i = 0; i < 3*w*h; i += 97)
+		checksum += pixels[i];
+}
+
+double Run(int mode) {
+	// mode 0: no readback, 1: glReadPixels each frame, 2: GetDataAsync each frame
+	std::vector<unsigned char> pixels(3*width*height);
+	double t0 = Now();
+	for (int f = 0; f < nFrames; f++) {
+		Display(f);
+		if (mode == 1) {
+			// a multisampled framebuffer can't be read directly: resolve it first
+			bool resolved = HeadlessResolve();
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+			if (resolved)
+				glBindFramebuffer(GL_READ_FRAMEBUFFER, HeadlessFramebuffer());
+			Sum(pixels.data(), width, height, NULL);
+		}
+		if (mode == 2) {
+			GetDataAsync(Sum);
+			PollReadbacks();
+		}
+	}
+	FinishReadbacks();
+	glFinish();
+	return nFrames/(Now()-t0);
+}
+
+int main(int ac, char **av) {
+	if (!InitHeadless(width, height, 4)) {
+		printf("can't create headless context\n");
+		return 1;
+	}
+	printf("%s context: %s\n", HeadlessEGL()? "surfaceless EGL" : "hidden window", glGetString(GL_RENDERER));
+	if (ac > 1 && (haveMesh = mesh.Read(av[1])) == false)
+		return 1;
+	const char *names[] = { "no readback", "glReadPixels", "GetDataAsync" };
+	for (int mode = 0; mode < 3; mode++) {
+		checksum = 0;
+		double fps = Run(mode);
+		printf("%-12s %6.1f frames/s (checksum %lli)\n", names[mode], fps, checksum);
+		if (PrintGLErrors(names[mode]))
+			return 1;
+	}
+	Display(0);
+	SavePngAsync(pngFile);
+	FinishReadbacks();
+	printf("wrote %s\n", pngFile);
+	HeadlessShutdown();
+}
@@ -0,0 +1,98 @@
+// WireBench.cpp - headless frame time of filled meshes and of lines by geometry shader and by vertex pulling
+// usage: WireBench [obj file ...] (default: tori of increasing resolution)
+
+#include <glad.h>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "Camera.h"
+#include "GLXtras.h"
+#include "Headless.h"
+#include "Mesh.h"
+
+int width = 800, height = 800, nFrames = 10;
+Camera camera(0, 0, width, height, vec3(20, 30, 0), vec3(0, 0, -5), 30, .001f, 500);
+
+double Now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Torus(Mesh &m, int n) {
+	// n by n/2 vertices, standardized to +/-1
+	int n1 = n, n2 = n/2;
+	m.Clear();
+	for (int i = 0; i < n1; i++)
+		for (int j = 0; j < n2; j++) {
+			float a = 2*3.1415926f*i/n1, b = 2*3.1415926f*j/n2;
+			vec3 nrm(cos(a)*cos(b), sin(b), sin(a)*cos(b));
+			m.points.push_back(vec3(cos(a), 0, sin(a))*.7f+.3f*nrm);
+			m.normals.push_back(nrm);
+		}
+	for (int i = 0; i < n1; i++)
+		for (int j = 0; j < n2; j++) {
+			int a = i*n2+j, b = ((i+1)%n1)*n2+j, c = ((i+1)%n1)*n2+(j+1)%n2, d = i*n2+(j+1)%n2;
+			m.triangles.push_back({a, d, c});
+			m.triangles.push_back({a, c, b});
+		}
+	m.Buffer();
+}
+
+double Time(Mesh &m, bool lines, std::vector<unsigned char> *pixels = NULL) {
+	// milliseconds per frame
+	glEnable(GL_DEPTH_TEST);
+	glClearColor(.5f, .5f, .5f, 1);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	m.Display(camera, vec3(.8f, .6f, .2f), lines);		// compile shader, warm caches
+	glFinish();
+	double t0 = Now();
+	for (int f = 0; f < nFrames; f++) {
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		m.Display(camera, vec3(.8f, .6f, .2f), lines);
+	}
+	glFinish();
+	double ms = 1000*(Now()-t0)/nFrames;
+	if (pixels) {
+		pixels->resize(3*width*height);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels->data());
+	}
+	return ms;
+}
+
+void Run(Mesh &m, const char *name) {
+	std::vector<unsigned char> a, b;
+	double filled = Time(m, false);
+	SetMeshLines(MeshLines::GeometryShader);
+	double geometry = Time(m, true, &a);
+	SetMeshLines(MeshLines::VertexPulling);
+	double pulled = Time(m, true, &b);
+	int differ = 0;
+	for (size_t i = 0; i < a.size(); i += 3)
+		differ += abs(a[i]-b[i]) > 8 || abs(a[i+1]-b[i+1]) > 8 || abs(a[i+2]-b[i+2]) > 8;
+	printf("%-24s %8i triangles  filled %7.1f ms  geometry shader %7.1f ms  vertex pulling %7.1f ms  (%.1fx, %.2f%% pixels differ)\n",
+		name, (int) m.triangles.size(), filled, geometry, pulled, geometry/pulled, 100.*differ/(width*height));
+}
+
+int main(int ac, char **av) {
+	if (!InitHeadless(width, height)) {
+		printf("can't create headless context\n");
+		return 1;
+	}
+	printf("%s, %ix%i, %i frames each\n", glGetString(GL_RENDERER), width, height, nFrames);
+	Mesh mesh;
+	if (ac > 1)
+		for (int i = 1; i < ac; i++) {
+			if (mesh.Read(av[i], NULL, true, true, true))
+				Run(mesh, av[i]);
+		}
+	else
+		for (int n = 64; n <= 2048; n *= 4) {
+			char name[100];
+			Torus(mesh, n);
+			snprintf(name, sizeof(name), "torus %ix%i", n, n/2);
+			Run(mesh, name);
+		}
+	PrintGLErrors("WireBench");
+	HeadlessShutdown();
+}
@@ -0,0 +1,89 @@
+// ManyLights.cpp - headless frame time of a floor lit by many colored point lights, binned into clusters
+// (16x9 tiles by 24 depth slices) and in a single cluster (every pixel visits every light)
+// usage: ManyLights [max lights] (default 1024)
+
+#include <glad.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Camera.h"
+#include "GLXtras.h"
+#include "Headless.h"
+#include "IO.h"
+#include "Lights.h"
+#include "Mesh.h"
+
+int width = 960, height = 540, nFrames = 10;
+Camera camera(0, 0, width, height, vec3(0, 0, 0), vec3(0, 0, -1), 40, .1f, 100);
+Mesh floorMesh;
+
+double Now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Floor(int n, float size) {
+	// n by n quads in the y = 0 plane, facing up
+	for (int i = 0; i <= n; i++)
+		for (int j = 0; j <= n; j++) {
+			floorMesh.points.push_back(vec3(size*(i/(float) n-.5f), 0, size*(j/(float) n-.5f)));
+			floorMesh.normals.push_back(vec3(0, 1, 0));
+		}
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			floorMesh.quads.push_back({i*(n+1)+j, i*(n+1)+j+1, (i+1)*(n+1)+j+1, (i+1)*(n+1)+j});
+	floorMesh.Buffer();
+}
+
+float Random(float lo, float hi) { return lo+(hi-lo)*rand()/(float) RAND_MAX; }
+
+void Lights(LightClusters &clusters, int n) {
+	srand(1);
+	clusters.lights.resize(n);
+	for (PointLight &l : clusters.lights)
+		l = PointLight(vec3(Random(-20, 20), Random(.2f, 1), Random(-20, 20)), 2.5f, vec3(Random(0, 1), Random(0, 1), Random(0, 1)));
+}
+
+double Time(LightClusters &clusters) {
+	// milliseconds per frame, including binning and upload
+	GLuint program = GetMeshShader();
+	glEnable(GL_DEPTH_TEST);
+	glClearColor(0, 0, 0, 1);
+	double t0 = 0;
+	for (int f = -1; f < nFrames; f++) {
+		if (f == 0) {
+			glFinish();
+			t0 = Now();
+		}
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		clusters.Update(camera);
+		clusters.Use(program);
+		floorMesh.Display(camera, vec3(1, 1, 1));
+	}
+	glFinish();
+	clusters.Unuse(program);
+	return 1000*(Now()-t0)/nFrames;
+}
+
+int main(int ac, char **av) {
+	int maxLights = ac > 1? atoi(av[1]) : 1024;
+	if (!InitHeadless(width, height)) {
+		printf("can't create headless context\n");
+		return 1;
+	}
+	printf("%s, %ix%i, %i frames each\n", glGetString(GL_RENDERER), width, height, nFrames);
+	camera.SetModelview(Translate(0, 0, -22)*RotateX(35));
+	Floor(200, 40);
+	LightClusters clustered, single(1, 1, 1);
+	for (int n = 16; n <= maxLights; n *= 4) {
+		Lights(clustered, n);
+		Lights(single, n);
+		double c = Time(clustered), s = Time(single);
+		printf("%5i lights  clustered %8.1f ms (%6i light-cluster pairs, max %4i per cluster)  single cluster %8.1f ms  (%.1fx)\n",
+			n, c, clustered.IndexCount(), clustered.MaxPerCluster(), s, s/c);
+	}
+	Time(clustered);
+	SavePng("ManyLights.png");
+	printf("wrote ManyLights.png\n");
+	PrintGLErrors("ManyLights");
+	HeadlessShutdown();
+}
@@ -0,0 +1,84 @@
+// HierarchyBench.cpp - update time of a large transform hierarchy: recursive walk of child pointers (as
+// Mesh::SetToWorld) versus TransformHierarchy, serial and parallel, all dirty and with a few dirty subtrees
+// usage: HierarchyBench [nodes] (default 200000)
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "Hierarchy.h"
+
+using std::vector;
+
+struct Node {
+	mat4 local, world;
+	vector<Node *> children;
+};
+
+void SetToWorld(Node *n, const mat4 &parent) {
+	n->world = parent*n->local;
+	for (Node *c : n->children)
+		SetToWorld(c, n->world);
+}
+
+double Now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+float Random(float lo, float hi) { return lo+(hi-lo)*rand()/(float) RAND_MAX; }
+
+int main(int ac, char **av) {
+	int nNodes = ac > 1? atoi(av[1]) : 200000, nRuns = 20;
+	// random tree: each node's parent is one of the preceding nodes, favoring recent ones (depth ~ log n)
+	srand(1);
+	vector<Node> nodes(nNodes);
+	vector<int> parents(nNodes, -1), handles(nNodes);
+	TransformHierarchy hierarchy;
+	for (int i = 0; i < nNodes; i++) {
+		nodes[i].local = Translate(Random(-1, 1), Random(-1, 1), Random(-1, 1))*RotateZ(Random(-30, 30))*RotateX(Random(-30, 30));
+		if (i > 0 && i%16 != 0) {
+			parents[i] = i-1-(int) (pow(Random(0, 1), 4)*i);
+			nodes[parents[i]].children.push_back(&nodes[i]);
+		}
+		handles[i] = hierarchy.Add(nodes[i].local, parents[i] < 0? -1 : handles[parents[i]]);
+	}
+	hierarchy.Update();
+	printf("%i nodes, %i levels, %i roots\n", hierarchy.NNodes(), hierarchy.NLevels(), (nNodes+15)/16);
+	// all dirty
+	double t0 = Now();
+	for (int r = 0; r < nRuns; r++)
+		for (int i = 0; i < nNodes; i++)
+			if (parents[i] < 0)
+				SetToWorld(&nodes[i], mat4());
+	double recursive = 1000*(Now()-t0)/nRuns, flat[2];
+	for (int parallel = 0; parallel < 2; parallel++) {
+		t0 = Now();
+		for (int r = 0; r < nRuns; r++) {
+			for (int i = 0; i < nNodes; i += 16)
+				hierarchy.SetLocal(handles[i], nodes[i].local);
+			hierarchy.Update(parallel == 1);
+		}
+		flat[parallel] = 1000*(Now()-t0)/nRuns;
+	}
+	float maxDiff = 0;
+	for (int i = 0; i < nNodes; i++) {
+		mat4 w = hierarchy.World(handles[i]);
+		for (int k = 0; k < 16; k++)
+			maxDiff = fmax(maxDiff, fabs(((float *) &w)[k]-((float *) &nodes[i].world)[k]));
+	}
+	printf("all dirty:   recursive %7.2f ms  flattened %7.2f ms  parallel %7.2f ms  (max difference %g)\n",
+		recursive, flat[0], flat[1], maxDiff);
+	// a few dirty subtrees: recursive walk must visit everything, or know which subtrees changed
+	int nDirty = nNodes/1000;
+	t0 = Now();
+	for (int r = 0; r < nRuns; r++) {
+		for (int k = 0; k < nDirty; k++) {
+			int i = (k*7919)%nNodes;
+			hierarchy.SetLocal(handles[i], nodes[i].local);
+		}
+		hierarchy.Update();
+	}
+	double partial = 1000*(Now()-t0)/nRuns;
+	printf("%i dirty:    flattened %7.2f ms, %i nodes recomputed\n", nDirty, partial, hierarchy.NUpdated());
+}
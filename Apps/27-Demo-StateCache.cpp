@@ -0,0 +1,131 @@
+// StateCache.cpp - headless frames of sprites, letters, disks and a mesh, with the GL state cache on and off:
+// state calls made and skipped per frame, render statistics of a frame, frame time, and whether the images agree
+// frame time is the median over rounds that alternate which of cache off and on runs first
+// usage: StateCache [obj file]
+
+#include <glad.h>
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+#include "Camera.h"
+#include "Draw.h"
+#include "GLState.h"
+#include "GLXtras.h"
+#include "Headless.h"
+#include "Letters.h"
+#include "Mesh.h"
+#include "RenderStats.h"
+#include "Sprite.h"
+
+int width = 800, height = 600, nFrames = 30, nWarmup = 5, nRounds = 8, nSprites = 400;
+Camera camera(0, 0, width, height, vec3(15, -20, 0), vec3(0, 0, -5), 30, .001f, 500);
+vector<Sprite> sprites(nSprites);
+Mesh mesh;
+bool haveMesh = false;
+
+double Now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+GLuint Checker() {
+	// 8x8 rgb checkerboard
+	unsigned char pixels[8*8*3];
+	for (int i = 0; i < 64; i++)
+		for (int k = 0; k < 3; k++)
+			pixels[3*i+k] = ((i/8+i%8)%2)? 230 : 40*k;
+	GLuint t;
+	glGenTextures(1, &t);
+	glBindTexture(GL_TEXTURE_2D, t);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 8, 8, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	return t;
+}
+
+void Display(int frame) {
+	glClearColor(.2f, .2f, .25f, 1);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_DEPTH_TEST);
+	if (haveMesh)
+		mesh.Display(camera, vec3(.8f, .6f, .2f));
+	glDisable(GL_DEPTH_TEST);
+	for (int i = 0; i < nSprites; i++) {
+		sprites[i].SetRotation(3.f*(i+frame));
+		sprites[i].Display();
+	}
+	UseDrawShader(ScreenMode());
+	for (int i = 0; i < 200; i++)
+		Disk(vec2(20+(i%20)*38, 20+(i/20)*30), 12, vec3(i/200.f, .5f, 1-i/200.f));
+	for (int i = 0; i < 10; i++)
+		Letters(20, 320+25*i, "redundant state", vec3(1, 1, 1), 16);
+}
+
+double Run(bool caching, GLStateStats &perFrame, RenderStats &render, vector<unsigned char> &pixels) {
+	SetGLStateCaching(caching);
+	for (int f = 0; f < nWarmup; f++)					// warm up
+		Display(f);
+	glFinish();
+	GetGLStateStats(true);
+	double t0 = Now();
+	for (int f = 0; f < nFrames; f++) {
+		Display(f);
+		RenderStatsFrame();
+	}
+	glFinish();
+	render = GetRenderStats();
+	double ms = 1000*(Now()-t0)/nFrames;
+	GLStateStats total = GetGLStateStats(true);
+	for (int i = 0; i < (int) GLStateCall::Count; i++) {
+		perFrame.calls[i] = total.calls[i]/nFrames;
+		perFrame.skipped[i] = total.skipped[i]/nFrames;
+	}
+	pixels.resize(3*width*height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	return ms;
+}
+
+double Median(vector<double> v) {
+	std::sort(v.begin(), v.end());
+	int n = (int) v.size();
+	return n%2? v[n/2] : (v[n/2-1]+v[n/2])/2;
+}
+
+int main(int ac, char **av) {
+	if (!InitHeadless(width, height)) {
+		printf("can't create headless context\n");
+		return 1;
+	}
+	printf("%s, %ix%i, %i rounds of %i frames each\n", glGetString(GL_RENDERER), width, height, nRounds, nFrames);
+	haveMesh = ac > 1 && mesh.Read(av[1]);
+	GLuint texture = Checker();
+	for (int i = 0; i < nSprites; i++) {
+		sprites[i].Initialize(texture, -.5f);
+		sprites[i].SetScale(vec2(.03f, .03f));
+		sprites[i].SetPosition(vec2(-.95f+.1f*(i%20), -.95f+.1f*(i/20)));
+	}
+	GLStateStats on, off;
+	RenderStats renderOn, renderOff;
+	vector<unsigned char> a, b;
+	vector<double> msOff, msOn;
+	for (int r = 0; r < nRounds; r++)
+		for (int k = 0; k < 2; k++)
+			if ((r+k)%2 == 0)							// cache off first in even rounds, on first in odd
+				msOff.push_back(Run(false, off, renderOff, a));
+			else
+				msOn.push_back(Run(true, on, renderOn, b));
+	int differ = 0;
+	for (size_t i = 0; i < a.size(); i++)
+		differ += a[i] != b[i];
+	off.Print("cache off, per frame");
+	on.Print("cache on, per frame");
+	renderOff.Print("cache off, last frame");
+	renderOn.Print("cache on, last frame");
+	for (int r = 0; r < nRounds; r++)
+		printf("round %i: %.2f ms without cache, %.2f ms with\n", r, msOff[r], msOn[r]);
+	printf("frame %.2f ms without cache, %.2f ms with, median of %i rounds (%i bytes of image differ)\n",
+		Median(msOff), Median(msOn), nRounds, differ);
+	PrintGLErrors("StateCache");
+	HeadlessShutdown();
+}
@@ -25,7 +25,7 @@ void Display(GLFWwindow *w) {
 	int shader = UseMeshShader();
 	SetUniform(shader, "defaultLight", light);
 	SetUniform(shader, "twoSidedShading", false);
-	room.Display(camera);
+	room.DisplayMaterials(camera);						// one draw for all materials (mesh color if none)
 	SetUniform(shader, "twoSidedShading", true);
 	bench.Display(camera, 0);
 	UseDrawShader();
@@ -33,8 +33,9 @@ void MouseMove(float x, float y, bool leftDown, bool rightDown) {
 // Sprite Intersection
 
 void GetPts(Sprite s, vec2 *pts) {
-	vec4 x1 = s.ptTransform*vec4(-1,-1,0,1), x2 = s.ptTransform*vec4(-1,+1,0,1),
-		 x3 = s.ptTransform*vec4(+1,+1,0,1), x4 = s.ptTransform*vec4(+1,-1,0,1);
+	mat4 &m = s.GetPtTransform();
+	vec4 x1 = m*vec4(-1,-1,0,1), x2 = m*vec4(-1,+1,0,1),
+		 x3 = m*vec4(+1,+1,0,1), x4 = m*vec4(+1,-1,0,1);
 	pts[0] = vec2(x1.x, x1.y); pts[1] = vec2(x2.x, x2.y);
 	pts[2] = vec2(x3.x, x3.y); pts[3] = vec2(x4.x, x4.y);
 }
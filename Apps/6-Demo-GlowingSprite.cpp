@@ -75,7 +75,7 @@ public:
 			glBindTexture(GL_TEXTURE_2D, matName);
 			SetUniform(glowSpriteShader, "textureMat", (int) textureUnit+1);
 		}
-		SetUniform(glowSpriteShader, "view", view? *view*ptTransform : ptTransform);
+		SetUniform(glowSpriteShader, "view", view? *view*GetPtTransform() : GetPtTransform());
 		SetUniform(glowSpriteShader, "uvTransform", uvTransform);
 		glDrawArrays(GL_QUADS, 0, 4);
 	}
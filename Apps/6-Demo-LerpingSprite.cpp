@@ -47,7 +47,7 @@ public:
 		// interpolate position & scale, send transform to vertex shader
 		SetPosition((1-t)*s1->GetPosition()+t*s2->GetPosition());
 		SetScale((1-t)*s1->GetScale()+t*s2->GetScale());
-		SetUniform(lerpProgram, "view", ptTransform);
+		SetUniform(lerpProgram, "view", GetPtTransform());
 		// set texture for s1, send to pixel shader
 		glActiveTexture(GL_TEXTURE0+textureUnit1);
 		glBindTexture(GL_TEXTURE_2D, s1->textureName);
@@ -7,6 +7,7 @@
 #include "Camera.h"
 #include "Draw.h"
 #include "GLXtras.h"
+#include "Hierarchy.h"
 #include "Mesh.h"
 
 // window, camera, colors
@@ -18,6 +19,10 @@ vec3	red(1, 0, 0), org(1, .55f, 0), blk(0, 0, 0), yel(.8f, .8f, 0), gry(.5f), ol
 Mesh	tracks, cab, boom, arm, bucket;	// excavator
 Mesh	ball, tree, terrain;			// scene
 
+// transform hierarchy: tracks->cab->boom->arm, and ball when picked up
+TransformHierarchy hierarchy;
+int		tracksNode = -1, cabNode = -1, boomNode = -1, armNode = -1, ballNode = -1;
+
 // excavator control
 int		armRotation = 0, boomRotation = 0;
 vec3	excavatorVelocity(0, 0, 0), excavatorAcceleration(0, 0, 0), bucketLoc(0, -.9f, -.4f);
@@ -55,11 +60,9 @@ void PickupBall() {
 	// drop
 	if (ballPickedUp) { // if the ball has been picked up
 		if (boomRotation < -4) { // if the upper arm's rotation count is more than 3 drop the ball
-			// find the ball in the upper arm's children and remove it
-			auto iter = std::find(boom.children.begin(), boom.children.end(), &ball);
-			if (iter != boom.children.end())
-				boom.children.erase(iter);
-			ball.parent = NULL; // remove the ball's parent
+			// remove the ball from the upper arm's children (it keeps its last toWorld)
+			hierarchy.Remove(ballNode);
+			ballNode = -1;
 			ballPickedUp = false; // set the flag to false
 			// begin dropping the ball
 			DropBall();
@@ -72,9 +75,7 @@ void PickupBall() {
 		float distance = length(vec3(ballPosition)-vec3(bottomOfUpperArmPosition)); 
 		// calculate the distance between them
 		if (distance <= .2f && boomRotation > -1) {
-			boom.children.push_back(&ball); // add the ball to the children of the upper arm
-			ball.parent = &boom; //set the parent of the ball to be the upper arm
-			ball.SetWrtParent(); // update the ball's position relative to its parent
+			ballNode = hierarchy.Add(&ball, boomNode); // add the ball to the children of the upper arm
 			ballPickedUp = true; // set the flag to true
 			dropZ = vec3(bottomOfUpperArmPosition).z;
 			fallProgress = 0;  
@@ -91,40 +92,41 @@ void TestKey() {
 	if (key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT) {
 		// rotate tracks
 		float a = key == GLFW_KEY_LEFT ? 1.f: -1.f;
-		tracks.SetToWorld(tracks.toWorld*Translate(tracks.centerOfRotation)*RotateZ(a)*Translate(-tracks.centerOfRotation));
+		hierarchy.SetWorld(tracksNode, tracks.toWorld*Translate(tracks.centerOfRotation)*RotateZ(a)*Translate(-tracks.centerOfRotation));
 	}
 	if (key == 'K' || key == 'L') {
 		// rotate cab
 		float a = key == 'K' ? -1.f : 1.f;
-		cab.SetToWorld(cab.toWorld*Translate(tracks.centerOfRotation)*RotateZ(a)*Translate(-tracks.centerOfRotation));
+		hierarchy.SetWorld(cabNode, cab.toWorld*Translate(tracks.centerOfRotation)*RotateZ(a)*Translate(-tracks.centerOfRotation));
 	}
 	if (key == GLFW_KEY_UP || key == GLFW_KEY_DOWN) {
 		// move tracks
 		float speedMin = .005f, speedMax = .02f;
 		float a = keyCount/20.f, speed = speedMin+a*(speedMax-speedMin); // accelerate for 20 keystrokes
 		float dy = key == GLFW_KEY_UP ? -speed : speed;
-		tracks.SetToWorld(tracks.toWorld*Translate(0, dy, 0));
+		hierarchy.SetWorld(tracksNode, tracks.toWorld*Translate(0, dy, 0));
 	}
 	if (key == 'P' && (armRotation < 5)) {
 		// open arm
-		arm.SetToWorld(arm.toWorld*Translate(arm.centerOfRotation)*RotateX(7)*Translate(-arm.centerOfRotation));
+		hierarchy.SetWorld(armNode, arm.toWorld*Translate(arm.centerOfRotation)*RotateX(7)*Translate(-arm.centerOfRotation));
 		armRotation++;
 	}
 	if (key == 'O' && (armRotation > -5)) {
 		// close arm
-		arm.SetToWorld(arm.toWorld*Translate(arm.centerOfRotation)*RotateX(-7)*Translate(-arm.centerOfRotation));
+		hierarchy.SetWorld(armNode, arm.toWorld*Translate(arm.centerOfRotation)*RotateX(-7)*Translate(-arm.centerOfRotation));
 		armRotation--;
 	}
 	if (key == 'G' && (boomRotation < 5)) {
 		// close boom
-		boom.SetToWorld(boom.toWorld*Translate(boom.centerOfRotation)*RotateX(7)*Translate(-boom.centerOfRotation));
+		hierarchy.SetWorld(boomNode, boom.toWorld*Translate(boom.centerOfRotation)*RotateX(7)*Translate(-boom.centerOfRotation));
 		boomRotation++;
 	}
 	if (key == 'H' && (boomRotation > -5)) {
 		// open boom
-		boom.SetToWorld(boom.toWorld*Translate(boom.centerOfRotation)*RotateX(-7)*Translate(-boom.centerOfRotation));
+		hierarchy.SetWorld(boomNode, boom.toWorld*Translate(boom.centerOfRotation)*RotateX(-7)*Translate(-boom.centerOfRotation));
 		boomRotation--;
 	}
+	hierarchy.Update();									// set toWorld of moved meshes and their descendants
 	PickupBall();
 }
 
@@ -222,28 +224,30 @@ const char* usage = R"(
 	O/P:               close/open lower arm
 )";
 
-void ReadMesh(Mesh &mesh, Mesh *parent, string name, vec3 color, mat4 mat, vec3 cor = vec3(0, 0, 0)) {
+void ReadMesh(Mesh &mesh, string name, vec3 color, mat4 mat, vec3 cor = vec3(0, 0, 0)) {
 	string dir("C:/Users/Jules/Code/GG-Projects/2023/#9-Excavator/");
 	mesh.Read(dir+name, NULL, false);
 	mesh.color = color;
 	mesh.toWorld = mat;
 	mesh.centerOfRotation = cor;
-	mesh.parent = parent;
-	if (parent)
-		parent->children.push_back(&mesh);
-	mesh.SetWrtParent();
 }
 
 int main(int ac, char** av) {
 	GLFWwindow *w = InitGLFW(100, 100, winWidth, winHeight, "Excavation Simulator!");
 	// read OBJ files
-	ReadMesh(tracks,  NULL,    "Tracks.obj",  gry, Translate(0, 0, .1f), vec3(0, .4f, 0));
-	ReadMesh(cab,     &tracks, "Cab.obj",     yel, Translate(0, 0, .25f));
-	ReadMesh(boom,    &cab,    "Boom.obj",    yel, Translate(0, 0, .5f), vec3(0, .1f, -.3f));
-	ReadMesh(arm,     &boom,   "Arm.obj",     yel, Translate(0, 0, .35f), vec3(0, -1, .3f));
-	ReadMesh(terrain, NULL,    "Terrain.obj", blu, Translate(0, 0, -.5f)*Scale(5));
-	ReadMesh(ball,    NULL,    "Sphere.obj",  red, Translate(0, 0, -.4f)*Scale(ballScale));
-	ReadMesh(tree,    NULL,    "Tree.obj",    olv, Translate(0, 3, -.45f)*RotateX(90)*Scale(.06f));
+	ReadMesh(tracks,  "Tracks.obj",  gry, Translate(0, 0, .1f), vec3(0, .4f, 0));
+	ReadMesh(cab,     "Cab.obj",     yel, Translate(0, 0, .25f));
+	ReadMesh(boom,    "Boom.obj",    yel, Translate(0, 0, .5f), vec3(0, .1f, -.3f));
+	ReadMesh(arm,     "Arm.obj",     yel, Translate(0, 0, .35f), vec3(0, -1, .3f));
+	ReadMesh(terrain, "Terrain.obj", blu, Translate(0, 0, -.5f)*Scale(5));
+	ReadMesh(ball,    "Sphere.obj",  red, Translate(0, 0, -.4f)*Scale(ballScale));
+	ReadMesh(tree,    "Tree.obj",    olv, Translate(0, 3, -.45f)*RotateX(90)*Scale(.06f));
+	// excavator hierarchy
+	tracksNode = hierarchy.Add(&tracks);
+	cabNode = hierarchy.Add(&cab, tracksNode);
+	boomNode = hierarchy.Add(&boom, cabNode);
+	armNode = hierarchy.Add(&arm, boomNode);
+	hierarchy.Update();
 	// callbacks
 	RegisterMouseMove(MouseMove);
 	RegisterMouseButton(MouseButton);
@@ -0,0 +1,65 @@
+// AudioDSP.h - sample-rate conversion, channel conversion, and gain kernels
+
+#ifndef AUDIO_DSP_HDR
+#define AUDIO_DSP_HDR
+
+#include <vector>
+#include "Mixer.h"
+
+using std::vector;
+
+// Resampling
+
+enum class ResampleQuality { Linear, Low, Medium, High };
+	// Linear: two-tap interpolation (cheap, audible aliasing)
+	// Low, Medium, High: Kaiser-windowed sinc of 8, 16, 32 taps per channel at unity ratio (more when downsampling)
+
+class Resampler {
+public:
+	void Initialize(int inRate, int outRate, int nChannels, ResampleQuality quality = ResampleQuality::Medium);
+		// polyphase filter bank for the reduced ratio outRate/inRate (at most 1024 phases)
+	void Reset();
+		// clear history, as at start of stream
+	int Process(const float *in, int nFrames, vector<float> &out);
+		// append resampled frames (interleaved, nChannels) for nFrames of input to out; return frames appended
+		// history carries across calls, so a stream may be fed in blocks of any size
+	int Flush(vector<float> &out);
+		// feed silence to emit the frames still held by the filter at end of stream
+	int Latency() { return nTaps/2; }
+		// input frames held before the output aligned with them can be produced
+	int InRate() { return inRate; }
+	int OutRate() { return outRate; }
+private:
+	int inRate = 0, outRate = 0, nChannels = 0, nTaps = 0;
+	int up = 1, down = 1, phase = 0;	// output step is down/up input frames; phase counts in 1/up frames
+	bool linear = false;
+	vector<float> filters;				// up phases of nTaps coefficients
+	vector<float> history[2];			// planar input, oldest first
+	int position = 0;					// index in history of newest tap for the next output
+};
+
+void ResampleSound(Sound &sound, int rate, ResampleQuality quality = ResampleQuality::Medium);
+	// convert sound in place to rate (no-op if already at rate)
+
+// Channels and gain (SIMD with scalar fallback)
+
+void StereoToMono(const float *stereo, float *mono, int nFrames);
+	// average of left and right
+
+void MonoToStereo(const float *mono, float *stereo, int nFrames);
+
+void StereoToMono(const short *stereo, short *mono, int nFrames);
+	// average, computed at 32 bits so it can't overflow
+
+void ScaleSamples(const short *in, short *out, int n, float gain);
+	// out = in*gain, saturated to 16 bits; in and out may be the same
+
+void ScaleSamples(const float *in, float *out, int n, float gain);
+	// out = in*gain, saturated to [-1, 1]
+
+void FloatToShort(const float *in, short *out, int n);
+	// scale [-1, 1] to 16 bits, saturated
+
+void ShortToFloat(const short *in, float *out, int n);
+
+#endif
@@ -0,0 +1,45 @@
+// BVH.h - bounding volume hierarchy over axis-aligned boxes, built with the surface area heuristic
+
+#ifndef BVH_HDR
+#define BVH_HDR
+
+#include <vector>
+#include "VecMat.h"
+
+using std::vector;
+
+struct BVHNode {
+	vec3 min;
+	int first = 0;		// leaf: index in BVH::order of first primitive; interior: index of left child (right is first+1)
+	vec3 max;
+	int count = 0;		// number of primitives if leaf, else 0
+	bool Leaf() const { return count > 0; }
+};
+
+class BVH {
+public:
+	vector<BVHNode> nodes;		// nodes[0] is the root
+	vector<int> order;			// primitive indices, each leaf's contiguous
+	void Build(const vec3 *boxMin, const vec3 *boxMax, int nPrimitives, int maxLeafSize = 4);
+		// binned SAH (16 bins on each axis) over primitive boxes; leaves hold at most maxLeafSize primitives
+		// nodes deeper than 32 split at the median, so Depth() < 64 and traversal can use a fixed stack
+	void Refit(const vec3 *boxMin, const vec3 *boxMax);
+		// recompute node bounds for moved primitives, keeping the tree; quality degrades as primitives drift
+	bool Empty() const { return nodes.empty(); }
+	int Depth() const;
+};
+
+inline bool RayBox(const BVHNode &n, const vec3 &origin, const vec3 &invDir, float tMax, float &tNear, float tMin = 0) {
+	// slab test over [tMin, tMax]; invDir components may be infinite
+	float t0 = tMin, t1 = tMax;
+	for (int k = 0; k < 3; k++) {
+		float a = (n.min[k]-origin[k])*invDir[k], b = (n.max[k]-origin[k])*invDir[k];
+		if (a > b) { float t = a; a = b; b = t; }
+		t0 = a > t0? a : t0;
+		t1 = b < t1? b : t1;
+	}
+	tNear = t0;
+	return t0 <= t1;
+}
+
+#endif
@@ -0,0 +1,90 @@
+// Fractal.h - Julia set engine: tiles computed in parallel with SIMD, deep zoom by perturbation from a
+// double-double reference orbit, and only changed tiles uploaded to the texture
+
+#ifndef FRACTAL_HDR
+#define FRACTAL_HDR
+
+#include <glad.h>
+#include <vector>
+
+using std::vector;
+
+// Double-double
+
+struct DoubleDouble {
+	// unevaluated sum hi+lo, about 32 significant digits
+	double hi = 0, lo = 0;
+	DoubleDouble(double h = 0, double l = 0) : hi(h), lo(l) { }
+	double Value() const { return hi+lo; }
+};
+
+DoubleDouble operator + (DoubleDouble a, DoubleDouble b);
+DoubleDouble operator - (DoubleDouble a, DoubleDouble b);
+DoubleDouble operator * (DoubleDouble a, DoubleDouble b);
+	// exact only under strict IEEE double arithmetic (no fast-math reassociation)
+
+// Julia set
+
+class JuliaSet {
+public:
+	// gray level of a pixel is the number of iterations z = z*z+c before |z| > 500, divided by maxIterations
+	// the view is kept on a grid of whole pixels: panning shifts the grid, so tiles still in view stay valid
+	JuliaSet(int tileSize = 64);
+		// tileSize rounded up to a multiple of 8
+	~JuliaSet();
+	bool simd = true;
+		// false for the scalar reference (benchmarks)
+	static const char *SimdLanes();
+		// the SIMD path compiled in: "AVX2" (8 floats, 4 doubles), "SSE2" (4, 2) or "scalar"
+		// AVX2 requires the compiler to target it (-mavx2, or /arch:AVX2 as in the Visual Studio project)
+	void Resize(int width, int height);
+	void SetC(double cReal, double cImag);
+	void SetIterations(int maxIterations);
+	void SetView(DoubleDouble centerX, DoubleDouble centerY, double pixelSize);
+		// complex coordinate of the window center and the width of a pixel
+	void Pan(int dx, int dy);
+		// move the image by whole pixels (x right, y up); tiles still in view are kept
+	void Zoom(double factor, int x, int y);
+		// divide pixel size by factor, keeping fixed the point under window pixel (x, y) (origin lower left)
+		// pixel size is limited to 1e-28 (the precision of the reference orbit)
+	int Update(double maxSeconds = .015);
+		// compute missing tiles, nearest the window center first, in parallel batches until maxSeconds has passed
+		// (at least one batch; all tiles if maxSeconds <= 0); return number of tiles still missing
+	void Display();
+		// upload tiles computed since the last call with glTexSubImage2D, then fill the viewport
+	unsigned char Pixel(int x, int y);
+		// gray level at window pixel (x, y), valid once Update has returned 0
+	DoubleDouble CenterX(), CenterY();
+	double PixelSize() { return pixelSize; }
+	int Iterations() { return maxIterations; }
+	bool Deep();
+		// true if tiles are computed by perturbation (pixel size below about 1e-5, where float iteration breaks down)
+	// statistics of the last Update
+	int TilesComputed() { return tilesComputed; }
+	long long IterationCount() { return iterations; }
+	double Seconds() { return seconds; }
+private:
+	struct Slot { int tx = 0, ty = 0; bool valid = false; };
+	int tileSize, width = 0, height = 0;
+	int nSlotsX = 0, nSlotsY = 0, texWidth = 0, texHeight = 0;
+	vector<Slot> slots;					// tile (tx, ty) is held by slot (tx mod nSlotsX, ty mod nSlotsY)
+	vector<unsigned char> pixels;		// texWidth*texHeight gray levels, a copy of the texture
+	vector<int> changed;				// slots computed but not uploaded
+	double cReal = -.8, cImag = .156, pixelSize = 2./800;
+	int maxIterations = 1000;
+	DoubleDouble anchorX, anchorY;		// coordinate of grid pixel (0, 0)
+	int originX = 0, originY = 0;		// grid pixel at window pixel (0, 0)
+	int refX = 0, refY = 0;				// grid pixel of the perturbation reference
+	vector<double> orbitX, orbitY;		// reference orbit, then the orbit of 0, rounded to double
+	int criticalStart = 0;				// index in orbitX, orbitY of the orbit of 0
+	bool orbitValid = false;
+	int tilesComputed = 0;
+	long long iterations = 0;
+	double seconds = 0;
+	GLuint texture = 0, program = 0, vao = 0;
+	void Invalidate();
+	void ComputeOrbit();
+	long long ComputeTile(int tx, int ty, unsigned char *out);
+};
+
+#endif
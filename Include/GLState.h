@@ -0,0 +1,37 @@
+// GLState.h - cache of GL state (program, vertex array, buffer and texture bindings, blend, depth, point and
+// line size, viewport), installed in the glad entry points so library and application calls alike skip
+// redundant changes and queries of known state are answered without GL
+
+#ifndef GL_STATE_HDR
+#define GL_STATE_HDR
+
+#include <glad.h>
+
+enum class GLStateCall { Program, VertexArray, Buffer, ActiveTexture, Texture, Capability, Blend, Depth, Size, Viewport, Query, Count };
+
+struct GLStateStats {
+	int calls[(int) GLStateCall::Count] = {}, skipped[(int) GLStateCall::Count] = {};
+	int Calls();
+	int Skipped();
+	void Print(const char *title = NULL);
+		// calls and skipped per kind
+};
+
+void InitGLState();
+	// hook glUseProgram, glBindVertexArray, glBindBuffer, glActiveTexture, glBindTexture, glEnable/glDisable,
+	// glIsEnabled, glBlendFunc, glDepthFunc, glDepthMask, glPointSize, glLineWidth, glViewport, glGetIntegerv
+	// (for the cached state), and the deletes that unbind; state starts unknown
+	// called by InitGLFW and InitHeadless after loading GL (again after a reload)
+void InvalidateGLState();
+	// forget cached state, as after state is changed other than through the hooked calls
+void SetGLStateCaching(bool on);
+	// if off, every call goes to GL (still counted)
+GLStateStats GetGLStateStats(bool reset = false);
+	// calls and skipped calls since last reset, e.g. per frame
+GLStateStats GetGLStateTotals();
+	// calls and skipped calls since the program started, never reset (see RenderStats.h)
+
+// not cached: GL_ELEMENT_ARRAY_BUFFER (vertex array state), indexed buffer bindings, framebuffers; a call that
+// GL rejects with an error still updates the cache
+
+#endif
@@ -59,9 +59,17 @@ GLuint LinkProgramViaFile(const char *computeShaderFile);
 
 // Miscellany
 int CurrentProgram();
+	// answered by the GL state cache (GLState.h) once known
 void DeleteProgram(int program);
 
 // Binary Read/Write
+void SetProgramCache(const char *filename);
+	// LinkProgramViaCode keeps program binaries in filename (default "ProgramCache.bin"), keyed
+	// by a hash of all stage sources and GL vendor/renderer/version; NULL disables the cache
+	// the file holds at most 256 programs, for one driver (named in its header)
+void FlushProgramCache();
+	// write the cache file if programs were added since it was last written; called at exit,
+	// and may be called once shaders are built, eg after initialization
 void WriteProgramBinary(GLuint program, const char *filename);
 bool ReadProgramBinary(GLuint program, const char *filename);
 GLuint ReadProgramBinary(const char *filename);
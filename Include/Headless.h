@@ -0,0 +1,50 @@
+// Headless.h - offscreen rendering with no visible window (hidden GLFW window, or surfaceless EGL on
+// Linux servers with software GL), and asynchronous readback of the framebuffer
+
+#ifndef HEADLESS_HDR
+#define HEADLESS_HDR
+
+#include <glad.h>
+
+// Offscreen context
+
+bool InitHeadless(int width, int height, int samples = 0);
+	// create a GL context without a visible window, then bind an offscreen framebuffer (color and depth) and
+	// set the viewport; Sprite, Mesh, Draw, Letters etc. render into it unchanged
+	// the context is from a hidden GLFW window; on Linux, if that fails (no display), from surfaceless EGL
+	// (link with -lEGL; define HEADLESS_NO_EGL to omit)
+	// samples > 1 multisamples the framebuffer, resolved when read
+bool Headless();
+	// true after InitHeadless succeeds
+bool HeadlessEGL();
+	// true if the context is surfaceless EGL rather than a hidden GLFW window
+void HeadlessResize(int width, int height);
+	// reallocate the framebuffer and set the viewport
+GLuint HeadlessFramebuffer();
+	// rebind this (not 0) after rendering to another framebuffer
+bool HeadlessResolve();
+	// if multisampled, resolve and bind the result to GL_READ_FRAMEBUFFER, returning true; afterwards,
+	// rebind HeadlessFramebuffer() to GL_READ_FRAMEBUFFER
+void HeadlessShutdown();
+
+// Asynchronous readback
+
+typedef void (*ReadbackCallback)(unsigned char *pixels, int width, int height, void *data);
+	// pixels are rgb, rows top-down, valid only during the call
+
+void GetDataAsync(ReadbackCallback callback, void *data = NULL);
+	// copy the viewport into a pixel buffer object and return without waiting for the GPU; callback is
+	// called by a later PollReadbacks once the copy has completed
+	// at most four reads are in flight: a fifth first waits for the oldest
+
+void SavePngAsync(const char *filename);
+	// as SavePng, but the pixels are collected by a later PollReadbacks and written by a worker thread
+
+int PollReadbacks(bool wait = false);
+	// deliver completed reads, in order (all of them if wait); return number still in flight
+	// call once per frame, with the context current
+
+void FinishReadbacks();
+	// deliver all reads and wait for all files to be written
+
+#endif
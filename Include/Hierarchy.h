@@ -0,0 +1,56 @@
+// Hierarchy.h - flattened transform hierarchy: nodes held level by level (parents before children) in flat
+// arrays of local and world matrices, with dirty flags so an update recomputes only changed subtrees
+
+#ifndef HIERARCHY_HDR
+#define HIERARCHY_HDR
+
+#include <vector>
+#include "VecMat.h"
+
+using std::vector;
+
+class Mesh;
+
+class TransformHierarchy {
+public:
+	int Add(mat4 local = mat4(), int parent = -1, Mesh *mesh = NULL);
+		// new node with transform local wrt parent (-1: a root); return its handle
+		// if mesh non-null, Update sets mesh->toWorld and mesh->wrtParent whenever the node's world changes
+	int Add(Mesh *mesh, int parent = -1);
+		// as above, local such that the node's world is mesh->toWorld
+	void Remove(int node);
+		// remove node and its descendants; their meshes keep their last toWorld
+	bool SetParent(int node, int parent, bool keepWorld = true);
+		// reparent node (-1: make it a root), keeping its world transform or its local; false if parent is a descendant
+	void SetLocal(int node, mat4 m);
+		// set local, and world from the parent's current world (descendants follow at the next Update)
+	void SetWorld(int node, mat4 m);
+		// set local such that the node's world is m, given the parent's current world
+	mat4 Local(int node) { return local[slotOf[node]]; }
+	mat4 World(int node) { return world[slotOf[node]]; }
+		// as of the last Update, or the node's own Add, SetLocal or SetWorld
+	int Parent(int node) { return parentOf[node]; }
+	void Update(bool parallel = true);
+		// recompute world transforms of dirty nodes and their descendants, level by level
+		// a level of many nodes is split across the job system (see Jobs.h)
+	int NNodes() { return (int) handleOf.size(); }
+	int NLevels() { return levelStart.empty()? 0 : (int) levelStart.size()-1; }
+	int NUpdated() { return nUpdated; }
+		// nodes recomputed by the last Update
+private:
+	// per handle
+	vector<int> slotOf, parentOf, freeHandles;	// slotOf -1 if free
+	// per slot, ordered by level
+	vector<mat4> local, world;
+	vector<int> parentSlot, handleOf;
+	vector<unsigned char> dirty;
+	vector<Mesh *> meshes;
+	vector<int> levelStart;						// first slot of each level, then number of slots
+	bool reorder = false;
+	int firstDirty = 0, nUpdated = 0;			// no slot before firstDirty is dirty
+	void Reorder();
+	void MarkDirty(int slot);
+	mat4 ParentWorld(int node);
+};
+
+#endif
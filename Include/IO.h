@@ -16,6 +16,8 @@ using std::vector;
 
 GLuint ReadTexture(const char *filename, bool mipmap = true, int *nchannels = NULL, int *width = NULL, int *height = NULL);
 	// load image file; return texture name
+	// storage is immutable (glTexStorage2D) and streamed via PBO, at once or over frames if
+	// SetQueuedTextureLoads (see TextureStream.h)
 
 GLuint LoadTexture(unsigned char *pixels, int width, int height, int bpp, bool bgr = false, bool mipmap = true);
 	// load pixels (bpp: bytes per pixel), return texture name
@@ -32,6 +34,15 @@ int ReadGIF(const char *filename, vector<GLuint> &textureNames, int *nChannels =
 	// return #frames successfully read
 	// if non-null, set nChannels (bytes/pixel), set frameDurations
 
+typedef void (*GIFFrameCallback)(unsigned char *pixels, int width, int height, int frame, int nFrames, float duration, void *data);
+
+int DecodeGIF(const char *filename, GIFFrameCallback callback, void *data, int *width = NULL, int *height = NULL);
+	// decode one frame at a time (4 bytes/pixel, flipped for GL), passing each to callback
+	// only the two most recent frames are held in memory; return #frames decoded
+
+GLuint ReadGIFArray(const char *filename, int *nFrames = NULL, vector<float> *frameDurations = NULL, bool mipmap = true);
+	// return GL_TEXTURE_2D_ARRAY with one rgba layer per frame (layer selected in shader), or 0 if error
+
 // Buffer to GPU
 //    GLuint int textureName;
 //    glGenTextures(1, &textureName);
@@ -92,6 +103,7 @@ struct Group {
 struct Mtl {
 	string name;
 	vec3 ka, kd, ks;
+	string mapKd;						// diffuse texture file (relative to the obj file), if any
 	int startTriangle = 0, nTriangles = 0;
 	Mtl() {startTriangle = -1, nTriangles = 0; }
 	Mtl(int start, string n, vec3 a, vec3 d, vec3 s) : startTriangle(start), name(n), ka(a), kd(d), ks(s) { }
@@ -0,0 +1,43 @@
+// Image.h - row-parallel image kernels: swizzle, flip, matte merge, depth to normals, Targa
+
+#ifndef IMAGE_HDR
+#define IMAGE_HDR
+
+#include <functional>
+
+// Rows
+
+void ParallelRows(int nRows, std::function<void(int row0, int row1)> kernel, int minRowsPerTask = 32);
+	// partition [0, nRows) into contiguous bands, run kernel(row0, row1) on each band in parallel
+	// small images (< 2*minRowsPerTask rows) run on the calling thread
+
+// Pixel layout
+
+void SwizzleRB(unsigned char *pixels, int width, int height, int bpp);
+	// exchange red and blue in place (BGR <-> RGB, BGRA <-> RGBA); bpp 3 or 4
+
+void FlipVertical(unsigned char *pixels, int width, int height, int bpp);
+	// reverse row order in place
+
+// Matting
+
+void MergeMatte(unsigned char *image, int imageWidth, int imageHeight, int imageChannels,
+				unsigned char *matte, int matteWidth, int matteHeight, int matteChannels,
+				unsigned char *rgba);
+	// set rgba (4*imageWidth*imageHeight bytes) from image rgb and first channel of matte
+	// matte is bilinearly resampled if its size differs from image
+
+// Bump map
+
+void DepthToNormals(unsigned char *depth, int width, int height, int depthChannels, float depthIncline,
+					unsigned char *normals);
+	// set normals (3 bytes/pixel, xy in [-1,1] -> [0,255], z in [0,1] -> [0,255]) from first channel of depth
+	// central differences, one-sided at edges; depthIncline as for GetNormals
+
+// Targa
+
+unsigned char *ReadTarga(const char *filename, int *width, int *height, int *bytesPerPixel);
+	// read uncompressed or run-length encoded true-color or grayscale Targa (types 2, 3, 10, 11)
+	// pixels are BGR(A) ordered, rows bottom-up; return NULL if error, else caller should delete []
+
+#endif
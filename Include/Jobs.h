@@ -0,0 +1,53 @@
+// Jobs.h - persistent worker threads for data-parallel loops
+
+#ifndef JOBS_HDR
+#define JOBS_HDR
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+typedef std::function<void(int begin, int end, int worker)> RangeKernel;
+	// process items [begin, end); worker is 0 for the calling thread, 1..NWorkers()-1 for pool threads
+
+class JobSystem {
+public:
+	JobSystem(int nThreads = 0);
+		// nThreads includes the caller; 0 uses hardware concurrency
+	~JobSystem();
+	int NWorkers() { return (int) threads.size()+1; }
+		// distinct worker indices passed to kernels, e.g. to size per-worker scratch or random generators
+	void ParallelFor(int n, int grain, const RangeKernel &kernel);
+		// split [0, n) into chunks of grain items (the last may be short), claimed dynamically by the pool
+		// and the caller; return when all chunks are done
+		// chunk boundaries are the same however the loop runs, so a kernel may index per-chunk results by begin/grain
+		// a call made from inside a kernel, or from a second thread while a loop is running, runs its chunks
+		// serially on the calling thread as worker 0
+	static int Chunks(int n, int grain) { return grain > 0? (n+grain-1)/grain : 0; }
+private:
+	struct Job {
+		const RangeKernel *kernel = NULL;
+		int n = 0, grain = 1, nChunks = 0;
+		std::atomic<int> next{0}, done{0};
+	};
+	Job job;
+	Job *posted = NULL;				// non-NULL while workers may join the current loop
+	unsigned generation = 0;
+	std::atomic<int> active{0};		// pool threads inside RunChunks
+	std::mutex mutex, callMutex;
+	std::condition_variable wake;
+	bool quit = false;
+	vector<std::thread> threads;
+	void RunChunks(Job &j, int worker);
+	void Worker(int worker);
+};
+
+JobSystem &GetJobSystem();
+	// process-wide pool, created on first use
+
+#endif
@@ -0,0 +1,49 @@
+// Lights.h - clustered forward lighting: point lights binned each frame into screen tiles and depth slices,
+// so the mesh pixel shaders visit only the lights that reach each pixel
+
+#ifndef LIGHTS_HDR
+#define LIGHTS_HDR
+
+#include <glad.h>
+#include <vector>
+#include "Camera.h"
+#include "VecMat.h"
+
+using std::vector;
+
+struct PointLight {
+	vec3 position;				// world space
+	float radius = 1;			// light falls off to zero at radius
+	vec3 color = vec3(1, 1, 1);
+	PointLight(vec3 p = vec3(0.f), float r = 1, vec3 c = vec3(1, 1, 1)) : position(p), radius(r), color(c) { }
+};
+
+class LightClusters {
+public:
+	LightClusters(int tilesX = 16, int tilesY = 9, int slices = 24, float nearDist = .1f, float farDist = 100);
+		// slices are logarithmic in eye depth from nearDist to farDist (nearer, farther pixels use the end slices)
+	~LightClusters();
+	vector<PointLight> lights;
+	void Update(Camera &camera);
+		// transform lights to eye space, bin them into the clusters of the current viewport, upload
+		// call each frame, after lights or camera change
+	void Use(GLuint program);
+		// light program (a mesh shader, from UseMeshShader) by clusters instead of its lights uniform
+	void Unuse(GLuint program);
+	// statistics of the last Update
+	int IndexCount() { return indexCount; }
+		// light-cluster pairs
+	int MaxPerCluster() { return maxPerCluster; }
+private:
+	int nx, ny, nz;
+	float nearDist, farDist;
+	int indexCount = 0, maxPerCluster = 0;
+	GLuint buffers[3] = {0, 0, 0}, textures[3] = {0, 0, 0};	// lights, cluster ranges, light indices
+	vector<vec4> lightTexels;
+	vector<int> ranges, indices, boxes;
+};
+
+void SetClusterUnits(GLuint program);
+	// assign cluster samplers their texture units (8, 9, 10); done by the mesh shaders when linked
+
+#endif
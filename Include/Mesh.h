@@ -5,6 +5,7 @@
 
 #include <vector>
 #include "glad.h"
+#include "BVH.h"
 #include "Camera.h"
 #include "IO.h"
 #include "Quaternion.h"
@@ -17,9 +18,20 @@ using std::vector;
 
 GLuint GetMeshShader(bool lines = false);
 GLuint UseMeshShader(bool lines = false);
-	// lines true uses geometry shader to draw lines along triangle edges
+	// lines true draws lines along triangle edges, as set by SetMeshLines
 	// lines false is slightly more efficient
 
+enum class MeshLines { VertexPulling, GeometryShader };
+
+void SetMeshLines(MeshLines mode);
+	// GeometryShader (default): edge distances computed per triangle by a geometry shader; also used by
+	// DisplayInstanced
+	// VertexPulling: each vertex of a non-indexed draw fetches its triangle from texture buffer views of
+	// the vertex and element buffers (units 13-15), with no geometry stage; measured at 0.9-1.1x the
+	// geometry shader's speed on llvmpipe (24-Demo-WireBench), and may help GPUs with a costly geometry stage
+	// the two modes are separate programs: set uniforms after UseMeshShader(true) in the current mode
+MeshLines GetMeshLines();
+
 const char *GetMeshPixelShaderNoLines();
 
 struct TriInfo {
@@ -38,13 +50,34 @@ struct QuadInfo {
 	QuadInfo(vec3 p1, vec3 p2, vec3 p3, vec3 p4);
 };
 
+struct MeshHit {
+	int triangle = -1, quad = -1;	// index of the facet hit (the other is -1)
+	float alpha = 0;				// hit point is p1+alpha*(p2-p1)
+};
+
+struct MultiDraw {
+	// buffers for drawing triangle groups or materials with one glMultiDrawElementsIndirect
+	GLuint commands = 0;			// indirect draw commands
+	GLuint parameters = 0;			// per draw: rgb color, texture layer (as parameterTexture, a texture buffer)
+	GLuint parameterTexture = 0;
+	GLuint indices = 0;				// 0, 1, 2 ... per instance: draw index (if no gl_DrawIDARB)
+	int capacity = 0;
+	GLuint textures = 0;			// GL_TEXTURE_2D_ARRAY, a layer per distinct Mtl::mapKd
+	vector<string> textureFiles;	// file of each layer
+	bool texturesRead = false;
+};
+
 // Mesh Class and Operations
 
 class Mesh {
 public:
 	Mesh() { };
 	Mesh(const char *filename) { Read(string(filename)); }
-	~Mesh() { if (vbo > 0) glDeleteBuffers(1, &vbo); };
+	~Mesh() {
+		if (vbo > 0) glDeleteBuffers(1, &vbo);
+		if (instanceVbo > 0) glDeleteBuffers(1, &instanceVbo);
+		if (lineTextures[0] > 0) glDeleteTextures(3, lineTextures);
+	};
 	string objFilename, texFilename;
 	// vertices and facets
 	vector<vec3>	points;
@@ -66,6 +99,11 @@ public:
 	GLuint			vao = 0;		// vertex array object
 	GLuint			vbo = 0;		// vertex buffer]
 	GLuint			ebo = 0;		// element (triangle) buffer
+	GLuint			instanceVbo = 0;	// per-instance transforms and colors, see DisplayInstanced
+	size_t			instanceCapacity = 0;
+	GLuint			lineTextures[3] = {0, 0, 0};	// views of vbo and ebo for lines by vertex pulling
+	int				lineNormalOffset = -1, lineUvOffset = -1;
+	MultiDraw		multiDraw;
 	// texture, color
 	GLuint			textureName = 0;
 	vec3			color = vec3(1, 1, 1);
@@ -73,21 +111,25 @@ public:
 	vector<TriInfo> triInfos;
 	vector<QuadInfo> quadInfos;
 	vector<QuadInfo> bounds;
+	BVH				facetBVH;		// over object-space triangles, then quads
 	// operations
 	void Clear();
 	void Buffer();
 	void Buffer(vector<vec3> &pts, vector<vec3> *nrms = NULL, vector<vec2> *uvs = NULL);
 		// if non-null, nrms and uvs assumed same size as pts
+		// ebo holds triangles, then each quad as two triangles: call again after triangles or quads change
 	void Set(vector<vec3> &pts, vector<vec3> *nrms = NULL, vector<vec2> *tex = NULL,
 			 vector<int> *tris = NULL, vector<int> *quads = NULL);
 	void SetToWorld();
 		// for this mesh set toWorld given parent and wrtParent; recurse on children
+		// for large or often-changed hierarchies see TransformHierarchy (Hierarchy.h)
 	void SetToWorld(mat4 m);
 		// as above but first assigning toWorld
 	void SetWrtParent();
 		// for this mesh set wrtParent given parent and toWorld
 	void Display(Camera camera, bool lines = false, bool useGroupColor = false);
 		// display with assigned color
+		// useGroupColor: ungrouped triangles and quads untextured in color, triangleGroups in their colors
 	void Display(Camera camera, vec3 color, bool lines = false);
 		// display with given color
 	void Display(Camera camera, vec3 color, int textureUnit, bool lines = false);
@@ -99,14 +141,34 @@ public:
 		//     useLight, useTint, fwdFacingOnly, facetedShading
 		//     outlineColor, outlineWidth, transition
 		// see Mesh.cpp pixel shader uniform inputs for complete list
+	void DisplayMaterials(Camera camera, bool lines = false);
+		// draw each of triangleMtls in its kd, textured by its map_Kd (if uvs); other triangles and quads in color
+		// as Display with useGroupColor, all in one glMultiDrawElementsIndirect (GL 4.3, else a draw each)
+		// with lines, a draw each and no material textures
+	void DisplayInstanced(Camera camera, int nInstances, mat4 *transforms, vec3 *colors = NULL, bool lines = false);
+		// draw nInstances copies with one glDrawElementsInstanced (triangles only, no texture)
+		// copy i has modelview camera.modelview*toWorld*transforms[i] and color colors[i] (if null, color)
+		// instance data are streamed to instanceVbo each call
+	void DisplayInstanced(Camera camera, vector<mat4> &transforms, vector<vec3> *colors = NULL, bool lines = false) {
+		DisplayInstanced(camera, (int) transforms.size(), transforms.data(), colors? colors->data() : NULL, lines); }
 	bool Read(string objFile, mat4 *m = NULL, bool standardize = true, bool buffer = true, bool forceTriangles = false);
 		// read in object file (with normals, uvs), initialize matrix, build vertex buffer
 	bool Read(string objFile, string texFile, mat4 *m = NULL, bool standardize = true, bool buffer = true, bool forceTriangles = false);
 		// read in object file (with normals, uvs) and texture file, initialize matrix, build vertex buffer
 	void BuildInfos();
+		// facet infos and their hierarchy; built on first intersection if not called
+	void RefitInfos();
+		// after points move (same triangles and quads): update infos and refit the hierarchy rather than rebuild it
+		// toWorld changes need neither, as queries are mapped to object space
 	bool IntersectWithLine(vec3 p1, vec3 p2, float *alpha = NULL);
+		// p1, p2 in object space; true if line hits, alpha of hit with least alpha
 	bool IntersectWithSegment(vec3 p1, vec3 p2, float *alpha = NULL);
 		// as above but true if 0 <= alpha <= 1
+	// picking: p1, p2 in world space (mapped by inverse toWorld); segment restricts hits to 0 <= alpha <= 1
+	bool NearestHit(vec3 p1, vec3 p2, MeshHit &hit, bool segment = true);
+	bool AnyHit(vec3 p1, vec3 p2, bool segment = true);
+	int AllHits(vec3 p1, vec3 p2, vector<MeshHit> &hits, bool segment = true);
+		// hits ordered by alpha; return number of hits
 };
 
 // Intersections
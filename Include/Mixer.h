@@ -0,0 +1,165 @@
+// Mixer.h - real-time software audio mixer with pluggable output
+
+#ifndef MIXER_HDR
+#define MIXER_HDR
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+// Sound
+
+struct Sound {
+	vector<float> samples;		// interleaved by channel, nominally in [-1, 1]
+	int nChannels = 1, rate = 44100;
+	int Frames() const { return nChannels > 0? (int) samples.size()/nChannels : 0; }
+	float Duration() const { return rate > 0? (float) Frames()/rate : 0; }
+};
+	// a Sound must outlive any voice playing it; mono and stereo are mixed, extra channels ignored
+
+// Stream
+
+class AudioStream {
+public:
+	virtual ~AudioStream() { }
+	virtual int Channels() = 0;
+		// 1 or 2; frames are at the mixer rate
+	virtual int Read(float *frames, int nFrames) = 0;
+		// called on the mixer thread; must not block; return frames copied (fewer if not yet decoded)
+	virtual bool Finished() = 0;
+		// true once all frames have been read
+};
+
+class SampleRing {
+public:
+	// single-producer, single-consumer ring of floats
+	void Allocate(int nSamples);
+		// resets ring; not concurrent with Read or Write
+	int Write(const float *samples, int n);
+		// producer: copy up to n samples, limited by free space; return number copied
+	int Read(float *samples, int n);
+		// consumer: copy up to n samples; return number copied
+	int Available();
+	int Free();
+private:
+	vector<float> data;
+	std::atomic<size_t> writeCount{0}, readCount{0};
+};
+
+// Output
+
+class AudioOutput {
+public:
+	virtual ~AudioOutput() { }
+	virtual bool Open(int rate, int nChannels, int periodFrames) = 0;
+		// return false if device unavailable
+	virtual bool Write(const float *frames, int nFrames) = 0;
+		// submit nFrames interleaved float frames; block until the device accepts them (this paces the mixer)
+	virtual void Close() { }
+	virtual const char *Name() = 0;
+};
+
+enum class OutputType { Default, WaveOut, ALSA, Pulse, Null, File };
+	// Default: WaveOut on Windows; on Linux, Pulse if built with MIXER_PULSE (link pulse-simple, pulse),
+	//   else ALSA if built with MIXER_ALSA (link asound), else Null
+	// Null discards samples; File writes 16-bit WAV; both are paced to real time unless realTime is false
+
+AudioOutput *NewAudioOutput(OutputType type, const char *filename = NULL, bool realTime = true);
+	// return NULL if type is not built into this library; caller owns result
+
+// Mixer
+
+class Mixer {
+public:
+	static const int MaxVoices = 64, QueueSize = 256, ChunkFrames = 256;
+	Mixer();
+	~Mixer();
+	// device (game thread)
+	bool Open(OutputType type = OutputType::Default, int rate = 48000, int periodFrames = 256, const char *filename = NULL);
+		// start mixer thread feeding a new output; a small period (256 frames = 5.3 msec at 48 kHz) keeps latency low
+		// if the Default device can't be opened, fall back to Null so the game runs silently
+	bool Open(AudioOutput *output, int rate, int periodFrames);
+		// as above, with caller-built output; mixer takes ownership
+	void Close();
+	bool Running() { return running.load(); }
+	int Rate() { return rate; }
+	// voices (game thread)
+	// commands go through a lock-free single-producer queue and take effect at the start of the next period
+	// issue them from one thread only
+	int Play(const Sound *sound, float gain = 1, float pan = 0, float pitch = 1, bool loop = false);
+		// start a voice; pan -1 (left) to 1 (right), pitch scales playback rate (clamped to 1/64 to 64)
+		// return voice handle (> 0), or 0 if queue full; voices overlap freely, oldest is stolen past MaxVoices
+	int PlayStream(AudioStream *stream, float gain = 1, float pan = 0);
+		// as Play, from a stream that must outlive the voice; pitch is fixed at 1
+	void Stop(int voice, float fadeSeconds = .01f);
+		// fade out, then release voice
+	void Pause(int voice, bool pause = true);
+	void SetGain(int voice, float gain);
+	void SetPan(int voice, float pan);
+	void SetPitch(int voice, float pitch);
+	void SetMasterGain(float gain);
+	void StopAll(float fadeSeconds = .01f);
+	bool Playing(int voice);
+		// true if queued or sounding
+	float Position(int voice);
+		// seconds into sound, or -1 if not playing
+	int NVoicesActive();
+	int NUnderruns() { return underruns.load(); }
+		// number of periods in which a stream voice had too few frames decoded
+	// mixing (mixer thread, or caller if not Open)
+	void Render(float *stereo, int nFrames);
+		// apply queued commands, then mix nFrames of interleaved stereo, clipped to [-1, 1]
+private:
+	struct Command {
+		enum Type { Start, Stop, Pause, Gain, Pan, Pitch, Master, StopAll } type = Start;
+		int voice = 0;
+		const Sound *sound = NULL;
+		AudioStream *stream = NULL;
+		float a = 0, b = 0, c = 0;
+		bool flag = false;
+	};
+	struct Voice {
+		int id = 0;
+		const Sound *sound = NULL;
+		AudioStream *stream = NULL;
+		double position = 0;	// in source frames
+		float gain = 1, pan = 0, pitch = 1;
+		float l = 0, r = 0;		// gains applied at end of last chunk, ramped toward target to avoid clicks
+		float fade = 1, fadeRate = 0;
+		bool loop = false, paused = false, stopping = false, fresh = true;
+		bool Active() const { return sound || stream; }
+		bool Stereo() const { return stream? stream->Channels() > 1 : sound->nChannels > 1; }
+	};
+	// command queue: producer advances head, consumer advances tail
+	Command queue[QueueSize];
+	std::atomic<unsigned> head{0}, tail{0};
+	int nextVoice = 1;
+	std::atomic<int> lastStarted{0}, underruns{0};
+	// voices, written by mixer thread; slot ids and times are published for Playing and Position
+	Voice voices[MaxVoices];
+	std::atomic<int> slotIds[MaxVoices];
+	std::atomic<float> slotTimes[MaxVoices];
+	float masterGain = 1;
+	vector<float> scratch;
+	// output
+	AudioOutput *output = NULL;
+	std::thread thread;
+	std::atomic<bool> running{false};
+	int rate = 48000, periodFrames = 256;
+	bool Push(const Command &c);
+	void Apply(const Command &c);
+	void MixVoice(Voice &v, int slot, float *bus, int nFrames);
+	int Fetch(Voice &v, float *dst, int nFrames);
+	void Run();
+};
+
+Mixer &GetMixer();
+	// process-wide mixer used by Wav; not opened until first use
+
+bool MixerAlive();
+	// false once the process-wide mixer has been destroyed (at exit); objects that may outlive it,
+	// such as global Wavs, check this before calling GetMixer
+
+#endif
@@ -0,0 +1,171 @@
+// Particles.h - ballistic particles: CPU (SoA, parallel SIMD) and GPU (compute shader) simulation, single-draw rendering
+
+#ifndef PARTICLES_HDR
+#define PARTICLES_HDR
+
+#include <glad.h>
+#include <stdint.h>
+#include <vector>
+#include "VecMat.h"
+
+using std::vector;
+
+// Random numbers
+
+class FastRandom {
+public:
+	// xorshift128+, one per worker thread; much cheaper than rand() and free of its global lock
+	FastRandom(uint64_t seed = 1) { Seed(seed); }
+	void Seed(uint64_t seed);
+	uint64_t Next() {
+		uint64_t a = s[0], b = s[1];
+		s[0] = b;
+		a ^= a << 23;
+		s[1] = a ^ b ^ (a >> 17) ^ (b >> 26);
+		return s[1]+b;
+	}
+	float Uniform() { return (Next() >> 40)*(1.f/16777216.f); }
+		// in [0, 1)
+	float Uniform(float a, float b) { return a+Uniform()*(b-a); }
+private:
+	uint64_t s[2];
+};
+
+// Emitter and colliders
+
+struct ParticleEmitter {
+	vec3 position, jitter;					// particles start uniformly within position +/- jitter
+	float rate = 30;						// new particles per second
+	float minSpeed = .1f, maxSpeed = .4f;	// initial speed, in units per second
+	float minElevation = 0, maxElevation = 1.5707963f;	// radians above horizontal; azimuth is uniform
+	float minLifetime = .15f, maxLifetime = 7;			// seconds
+	float minSize = 5, maxSize = 9;			// diameter, in pixels
+	vec3 minColor = vec3(0, 0, 0), maxColor = vec3(1, 1, 1);
+	float minChildRate = 0, maxChildRate = 0;	// children per second emitted by a particle at rest on a plane
+	int maxLevel = 10;						// children of level maxLevel particles are not created
+	float levelDecay = .8f;					// lifetime, speed, and size ranges scale by this per child generation
+};
+
+struct ParticlePlane {
+	vec3 normal = vec3(0, 1, 0);			// unit length, pointing to the free side
+	float offset = 0;						// plane is dot(normal, p) == offset
+	ParticlePlane() { }
+	ParticlePlane(vec3 n, float o) : normal(n), offset(o) { }
+};
+
+struct ParticleCylinder {
+	vec3 base;								// center of bottom; axis is +y
+	float height = 0, radius = 0;
+	ParticleCylinder() { }
+	ParticleCylinder(vec3 b, float h, float r) : base(b), height(h), radius(r) { }
+};
+	// falling particles inside the cylinder bounce off its top
+
+// Configuration
+
+struct ParticleParams {
+	ParticleEmitter emitter;
+	float gravity = 1;						// units per second squared, along -y
+	float planeRestitution = 0;				// fraction of normal speed kept after hitting a plane
+	float cylinderRestitution = .5f;
+	float restSpeed = .05f;					// after a plane bounce slower than this, a particle comes to rest
+	vector<ParticlePlane> planes;
+	vector<ParticleCylinder> cylinders;
+};
+	// shared by the CPU and GPU systems, so one set of parameters drives either
+
+// CPU particle system
+
+class ParticleSystem : public ParticleParams {
+public:
+	ParticleSystem(int capacity = 1 << 20);
+	~ParticleSystem();
+	// simulation
+	void Update(float dt);
+		// emit at emitter.rate, move, collide, age, spawn children, and remove expired particles
+		// all passes are split across GetJobSystem(); the move and collide pass is SIMD
+	int Emit(int count);
+		// add count particles from emitter now; return number added (limited by capacity)
+	void Clear();
+	int Count() { return count; }
+	int Capacity() { return capacity; }
+	// rendering
+	void Draw(mat4 modelview, mat4 persp, float fadeSeconds = .5f);
+		// one glDrawArrays(GL_POINTS) of round point sprites; sizes are in pixels
+		// particles fade out over their last fadeSeconds
+private:
+	struct Arrays {
+		// one float lane per particle, in update order
+		vector<float> px, py, pz, vx, vy, vz;
+		vector<float> age, life, size;
+		vector<float> free;					// 1 in flight, 0 at rest (gravity is scaled by this)
+		vector<float> childRate, nextChild;	// seconds until next child while at rest
+		vector<uint32_t> color;				// RGBA8
+		vector<uint8_t> level;
+		void Resize(int n);
+	};
+	struct Spawn {
+		vec3 position;
+		uint32_t color;
+		int level;
+	};
+	int capacity = 0, count = 0;
+	float emitDebt = 0;						// fractional particles owed by emitter.rate
+	Arrays a;
+	vector<FastRandom> random;				// per worker
+	vector<vector<Spawn>> spawns;			// per worker, children requested this update
+	vector<vector<int>> chunkDead;			// per update chunk, indices of expired particles
+	GLuint vao = 0, vbo = 0, program = 0;
+	int vboCapacity = 0;
+	void Move(int begin, int end, float dt);
+	void Init(int i, const Spawn *parent, FastRandom &r);
+	int Compact();
+	int SpawnAll(int nEmit);
+};
+
+// GPU particle system
+
+class GPUParticleSystem : public ParticleParams {
+public:
+	static const int MaxPlanes = 8, MaxCylinders = 8;
+	GPUParticleSystem(int capacity = 1 << 20);
+	~GPUParticleSystem();
+	static bool Supported();
+		// true if the context has compute shaders (GL 4.3; not macOS)
+	// simulation
+	bool Update(float dt);
+		// as ParticleSystem::Update, by compute shaders on state kept in shader storage buffers:
+		// dead particles return to a free list and emission pops it with atomic counters, the alive list is
+		// rebuilt each update, and dispatch and draw sizes are written on the GPU, so nothing is read back
+		// return false if compute shaders are unavailable
+	void Emit(int count);
+		// add count particles at the next Update (limited by free capacity)
+	void Clear();
+	int Count() { return count; }
+		// number alive a few frames ago, from a non-blocking copy of the alive counter (for display only)
+	int Capacity() { return capacity; }
+	float GPUTime() { return gpuMsec; }
+		// msec of GPU time for a recent Update, from a timer query
+	// rendering
+	void Draw(mat4 modelview, mat4 persp, float fadeSeconds = .5f);
+		// one glDrawArraysIndirect(GL_POINTS) with the count written by Update; same sprites as ParticleSystem
+private:
+	static const int NReadback = 3;
+	int capacity = 0, spawnCapacity = 0, count = 0, pendingEmit = 0;
+	float emitDebt = 0, gpuMsec = 0;
+	unsigned frame = 0;
+	int cur = 0;								// alive[cur] holds the particles alive after the last Update
+	bool initialized = false, valid = false;
+	GLuint particles = 0, dead = 0, alive[2] = {0, 0}, spawns = 0, counts = 0;
+	GLuint control = 0, simulate = 0, emit = 0, render = 0, vao = 0;
+	GLuint readback = 0, queries[NReadback] = {0, 0, 0};
+	GLsync fences[NReadback] = {NULL, NULL, NULL};
+	bool queryPending[NReadback] = {false, false, false};
+	bool Initialize();
+	void Reset();
+	void Bind(int in);
+	void Dispatch(GLuint program, GLintptr argsOffset);
+	void Poll();
+};
+
+#endif
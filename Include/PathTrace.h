@@ -0,0 +1,118 @@
+// PathTrace.h - multithreaded CPU path tracer: planes, spheres, and triangle meshes in SAH bounding volume hierarchies
+
+#ifndef PATH_TRACE_HDR
+#define PATH_TRACE_HDR
+
+#include <stdint.h>
+#include <vector>
+#include "BVH.h"
+#include "VecMat.h"
+
+using std::vector;
+
+class Mesh;
+
+// Scene
+
+struct RTMaterial {
+	vec3 color = vec3(1.f);		// diffuse (or mirror) reflectance
+	float mirror = 0;			// probability of specular reflection, 1 for chrome
+	vec3 emission = vec3(0.f);	// radiance emitted; emissive spheres are sampled directly as lights
+	RTMaterial() { }
+	RTMaterial(vec3 c, float m = 0, vec3 e = vec3(0.f)) : color(c), mirror(m), emission(e) { }
+};
+
+struct RTRay {
+	vec3 origin, dir;			// dir unit length
+	RTRay() { }
+	RTRay(vec3 o, vec3 d) : origin(o), dir(d) { }
+};
+
+struct RTHit {
+	float t = 0;
+	vec3 point, normal;			// normal faces the incoming ray
+	int material = -1;
+};
+
+class RTScene {
+public:
+	// planes and spheres use the conventions of 1-Demo-RayTrace: plane.xyz is the normal, dot(plane.xyz, p)+plane.w = 0;
+	// sphere.xyz is the center, sphere.w the radius
+	void AddPlane(vec4 plane, const RTMaterial &m);
+	void AddSphere(vec4 sphere, const RTMaterial &m);
+	void AddTriangle(vec3 a, vec3 b, vec3 c, const RTMaterial &m);
+	void AddMesh(const Mesh &mesh, const RTMaterial &m, const mat4 *xform = NULL);
+		// triangles and quads (split in two) of mesh, transformed by xform if given, else by mesh.toWorld
+	void Clear();
+	void Build();
+		// build sphere and triangle hierarchies; call after adding geometry, before tracing
+	bool Intersect(const RTRay &ray, RTHit &hit, float tMax = 1e30f) const;
+		// nearest hit beyond a small epsilon
+	bool Occluded(const RTRay &ray, float tMax) const;
+		// any hit in (epsilon, tMax)
+	int NTriangles() const { return (int) triA.size(); }
+	int NSpheres() const { return (int) spheres.size(); }
+	const RTMaterial &Material(int i) const { return materials[i]; }
+	const vector<int> &Lights() const { return lights; }
+		// indices of emissive spheres
+	vec4 Sphere(int i) const { return spheres[i]; }
+	const RTMaterial &SphereMaterial(int i) const { return materials[sphereMaterials[i]]; }
+private:
+	struct Block {
+		// four primitives in SIMD lanes; unused lanes never hit
+		float x[4], y[4], z[4];			// triangle vertex 0, or sphere center
+		float e1x[4], e1y[4], e1z[4];	// triangle edges (sphere: e1x is squared radius)
+		float e2x[4], e2y[4], e2z[4];
+		int id[4];
+	};
+	vector<RTMaterial> materials;
+	vector<vec4> planes, spheres;
+	vector<int> planeMaterials, sphereMaterials, triMaterials, lights;
+	vector<vec3> triA, triB, triC;
+	BVH sphereBVH, triBVH;
+	vector<Block> sphereBlocks, triBlocks;	// one per leaf, indexed by leafBlock
+	vector<int> sphereLeafBlock, triLeafBlock;
+	int AddMaterial(const RTMaterial &m);
+	void BuildBlocks(bool triangles);
+	template<bool Any> bool Trace(const RTRay &ray, float &tBest, int &kind, int &id) const;
+};
+
+// Camera
+
+struct RTCamera {
+	vec3 eye = vec3(0, 0, -1), dir = vec3(0, 0, 1), up = vec3(0, 1, 0), right = vec3(1, 0, 0);
+		// as 1-Demo-RayTrace: pixel (x, y) looks along normalize(dir+xf*right+yf*up), xf, yf in [-1, 1]
+};
+
+// Renderer
+
+class PathTracer {
+public:
+	int maxDepth = 6;				// bounces; Russian roulette after the third
+	int tileSize = 16;
+	void Resize(int width, int height);
+	void Reset();
+		// discard accumulated samples (after camera or scene change)
+	void Render(const RTScene &scene, const RTCamera &camera, int samplesPerPixel = 1);
+		// add samplesPerPixel to every pixel; tiles are dealt to per-worker queues and idle workers steal from others
+		// each sample's random sequence depends only on pixel and sample number, so images repeat exactly
+	int Samples() { return nSamples; }
+	int Width() { return width; }
+	int Height() { return height; }
+	void GetImage(vector<unsigned char> &rgb, float exposure = 1, bool topDown = false);
+		// average of accumulated samples, gamma 2.2, 3 bytes/pixel; rows bottom-up unless topDown
+	bool SavePng(const char *filename, float exposure = 1);
+	// statistics of the last Render
+	long long Rays() { return rays; }
+		// camera, bounce, and shadow rays
+	double Seconds() { return seconds; }
+	double MRaysPerSecond() { return seconds > 0? rays/seconds/1e6 : 0; }
+private:
+	int width = 0, height = 0, nSamples = 0;
+	vector<float> accum;			// rgb sums
+	long long rays = 0;
+	double seconds = 0;
+	vec3 Radiance(const RTScene &scene, RTRay ray, uint32_t &rng, long long &nRays);
+};
+
+#endif
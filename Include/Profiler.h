@@ -0,0 +1,55 @@
+// Profiler.h - frame profiler: nestable CPU scopes (wall time, on any thread) and GPU scopes (GL timestamp
+// queries read back a few frames later), a rolling per-frame history of each scope, an on-screen overlay,
+// and export as Chrome trace JSON
+
+#ifndef PROFILER_HDR
+#define PROFILER_HDR
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+class ProfileScope {
+public:
+	ProfileScope(const char *name, bool gpu = false);
+		// time from construction to destruction under name, which must outlive the profiler (e.g. a literal)
+		// if gpu, also time the GL commands issued within the scope (GL thread only, closed in the same frame)
+	~ProfileScope();
+private:
+	const char *name;
+	long long start = 0;
+	int gpuEvent = -1;
+	unsigned gpuFrame = 0;
+};
+
+struct ProfileStats {
+	string name;
+	bool gpu = false;						// GPU time of the scope, else CPU
+	int depth = 0, calls = 0;				// nesting depth, and calls in the latest frame
+	float last = 0, average = 0, max = 0;	// milliseconds per frame, summed over calls (and threads)
+	vector<float> history;					// milliseconds per frame, oldest first
+};
+
+void EnableProfiler(bool on);
+bool ProfilerEnabled();
+	// off by default, when a scope costs one test
+
+void ProfilerFrame();
+	// end a frame: fold completed scopes into their histories and read back finished GPU queries
+	// (called once per frame, e.g. before swapping buffers); time between calls is recorded as scope "frame"
+
+vector<ProfileStats> GetProfileStats();
+	// one entry per scope seen so far, CPU then GPU, in the order first seen
+
+void DisplayProfiler(int x = 10, int y = -1, float ptSize = 10);
+	// overlay a line per scope (name, latest, average and maximum ms) with a graph of its history,
+	// downward from pixel (x, y) (y -1: top of the viewport); uses Letters, so names should be letters and spaces
+
+void StartProfileTrace(int maxEvents = 1000000);
+bool SaveProfileTrace(const char *filename);
+	// record every scope from start until saved as Chrome trace JSON (chrome://tracing or ui.perfetto.dev),
+	// a row per thread and one for the GPU
+
+#endif
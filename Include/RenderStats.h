@@ -0,0 +1,41 @@
+// RenderStats.h - per-frame counts of the GL work an application submits: draw calls, vertices and instances,
+// program and texture binds, bytes uploaded, synchronous readbacks, and shader compiles
+
+#ifndef RENDER_STATS_HDR
+#define RENDER_STATS_HDR
+
+#include "VecMat.h"
+
+struct RenderStats {
+	int drawCalls = 0;						// glDraw*, glMultiDraw*
+	int indirectDraws = 0;					// commands of indirect draws, whose vertices are not counted
+	long long vertices = 0;					// vertices (or indices) submitted, times instances
+	long long instances = 0;				// instances of instanced draws
+	int dispatches = 0;						// glDispatchCompute
+	int programBinds = 0, textureBinds = 0;	// issued to GL, after the state cache (see GLState.h)
+	int stateChanges = 0;					// all state calls issued to GL, binds included
+	long long bufferBytes = 0;				// glBufferData, glBufferSubData, mapped for write
+	long long textureBytes = 0;				// glTexImage, glTexSubImage, compressed or not (from memory or a pixel buffer)
+	int readbacks = 0;						// synchronous: glReadPixels to memory, glGetBufferSubData, glGetTexImage
+	long long readbackBytes = 0;
+	int shaderCompiles = 0, programLinks = 0, programBinaries = 0;
+	void Print(const char *title = NULL);
+		// one line per nonzero count
+	const char *Line();
+		// compact summary, e.g. for a HUD (valid until the next call)
+};
+
+void InitRenderStats();
+	// hook the counted GL entry points (those not hooked by GLState.h)
+	// called by InitGLFW and InitHeadless after loading GL
+
+void RenderStatsFrame();
+	// end a frame (called once per frame, e.g. before swapping buffers)
+
+RenderStats GetRenderStats(bool current = false);
+	// counts of the last completed frame, or if current, of the frame so far
+
+void DisplayRenderStats(int x = 10, int y = 10, float ptSize = 10, vec3 color = vec3(1, 1, 0));
+	// draw the last frame's Line() with Letters at pixel (x, y)
+
+#endif
@@ -34,7 +34,8 @@ public:
 	vec2 position;									// in NDC (+/-1 coords)
 	vec2 scale = vec2(1, 1);
 	float rotation = 0;								// in degrees
-	mat4 ptTransform;								// based on position, scale, rotation
+	mat4 ptTransform;								// based on position, scale, rotation (see GetPtTransform)
+	bool transformDirty = true;						// position, scale or rotation set since ptTransform computed
 	mat4 uvTransform;								// transform texture
 	// single image
 	int nTexChannels = 0;
@@ -43,6 +44,7 @@ public:
 	int frame = 0, nFrames = 0;
 	bool autoAnimate = true;						// if true and multiple images, advance frame
 	vector<ImageInfo> images;
+	GLuint frameArray = 0;							// if non-zero, frames are layers of this GL_TEXTURE_2D_ARRAY
 	time_t change;
 	// mouse
 	vec2 mouseDown, oldMouse;
@@ -54,14 +56,15 @@ public:
 	void Initialize(string imageFile, string matFile, float z = 0);
 	void Initialize(vector<string> &imageFiles, string matFile, float z = 0, float frameDuration = 1);
 	void Initialize(GLuint texName, float z = 0);
-	void InitializeGIF(string gifFile, float z = 0);
+	void InitializeGIF(string gifFile, float z = 0);	// frames loaded as one texture array
 	void Release();									// free image buffers
 	// transformation
 	void UpdateTransform();							// compute .ptTransform given scale, rotation, position
+	mat4 &GetPtTransform();							// ptTransform, first updated if dirty
 	vec2 PtTransform(vec2 p);						// return p transformed by ptTransform
 	void SetPtTransform(mat4 m);					// override UpdateTransform
 	void SetUvTransform(mat4 m);					// set texture transform
-	// geometry
+	// geometry (ptTransform is recomputed on next use, not by each call)
 	void SetScale(vec2 s);
 	void SetRotation(float angle);					// in degrees ccw
 	void SetPosition(vec2 p);						// p in +/-1 coords
@@ -88,4 +91,9 @@ public:
 int TestCollisions(vector<Sprite *> &sprites);
 	// return #pixels overlap of sprites
 
+void MoveSprites(vector<Sprite *> &sprites, const vec2 *deltas);
+	// add deltas[i] to position of sprites[i], then update all their transforms
+void UpdateTransforms(vector<Sprite *> &sprites);
+	// compute ptTransform of dirty sprites in one SIMD pass (see PlanarTransforms in VecMatBatch.h)
+
 #endif
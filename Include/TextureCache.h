@@ -0,0 +1,53 @@
+// TextureCache.h - block-compressed (BC1/BC3/BC7) texture cache
+
+#ifndef TEXTURE_CACHE_HDR
+#define TEXTURE_CACHE_HDR
+
+#include <glad.h>
+#include <vector>
+
+using std::vector;
+
+// a cache file, <image file>.bct, holds the encoded mip chain(s) for one image or GIF
+// it is keyed by source path and modification time, and rebuilt when either differs
+// or when its format can't be sampled by the current context
+
+enum class BlockFormat { Auto, BC1, BC3, BC7 };
+	// Auto: BC1 for opaque images, BC3 for images with alpha
+	// BC7: higher quality rgba at BC3 size, requires GL 4.2
+
+void SetTextureCache(bool on, const char *directory = NULL);
+bool TextureCacheEnabled();
+	// off by default, when ReadCompressed* load the source as ReadTexture, ReadGIF and ReadGIFArray do
+	// (compression is lossy); if on, cache files are kept in directory (which must exist), with the source
+	// path flattened into the name, or, if directory is NULL, beside the source
+
+bool CompressedTexturesAvailable(BlockFormat format = BlockFormat::Auto);
+	// true if the current context accepts the GL format for this block format
+
+int BlockBytes(BlockFormat format);
+	// 8 for BC1, 16 for BC3 and BC7
+
+void EncodeBlocks(unsigned char *pixels, int width, int height, int bpp, BlockFormat format, vector<unsigned char> &blocks);
+	// encode pixels (bpp 1-4) as 4x4 blocks; partial edge blocks repeat edge pixels
+	// format must not be Auto
+
+bool EncodeTextureCache(const char *filename, BlockFormat format = BlockFormat::Auto);
+	// offline (or first-run) encode of an image or GIF with full mip chain; write cache file
+	// (to the directory set by SetTextureCache, whether or not the cache is on)
+	// return false if the source can't be read or the cache can't be written
+
+GLuint ReadCompressedTexture(const char *filename, bool mipmap = true, int *nChannels = NULL,
+							 int *width = NULL, int *height = NULL, BlockFormat format = BlockFormat::Auto);
+	// as ReadTexture, but load (or build) the cache and upload blocks directly
+	// falls back to ReadTexture if the cache is off or compressed formats are unavailable
+
+int ReadCompressedGIF(const char *filename, vector<GLuint> &textureNames, int *nChannels = NULL,
+					  vector<float> *frameDurations = NULL, BlockFormat format = BlockFormat::Auto);
+	// as ReadGIF, with fallback to ReadGIF
+
+GLuint ReadCompressedGIFArray(const char *filename, int *nFrames = NULL, vector<float> *frameDurations = NULL,
+							  BlockFormat format = BlockFormat::Auto);
+	// as ReadGIFArray, with fallback to ReadGIFArray
+
+#endif
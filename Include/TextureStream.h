@@ -0,0 +1,105 @@
+// TextureStream.h - immutable texture storage, uploaded through pixel buffer objects
+
+#ifndef TEXTURE_STREAM_HDR
+#define TEXTURE_STREAM_HDR
+
+#include <glad.h>
+#include <vector>
+
+using std::vector;
+
+// Mipmaps
+
+enum class MipPolicy { None, GPU, Precomputed };
+	// None: single level, GL_NEAREST minification (as LoadTexture with mipmap false)
+	// GPU: glGenerateMipmap once all of level 0 is resident
+	// Precomputed: levels supplied by caller (or BuildMipChain), no GPU generation
+
+struct MipLevel {
+	int width = 0, height = 0;
+	vector<unsigned char> pixels;
+	MipLevel() { }
+	MipLevel(int w, int h, int bpp) : width(w), height(h), pixels((size_t) w*h*bpp) { }
+};
+
+int MipCount(int width, int height);
+	// number of levels down to 1x1
+
+void BuildMipChain(unsigned char *pixels, int width, int height, int bpp, vector<MipLevel> &levels);
+	// box-filter levels 1..n-1 from level 0 pixels (level 0 is not copied)
+	// intended for offline or worker-thread use so that no mip generation occurs on the GPU at load
+
+// Storage
+
+void TextureStorage(GLenum target, int nLevels, GLenum internalFormat, int width, int height, int depth = 1);
+	// storage for the texture bound to target (GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY, with depth layers)
+	// immutable (glTexStorage2D/3D) if GL 4.2, else each level specified with glTexImage2D/3D
+	// internalFormat is GL_R8, GL_RG8, GL_RGB8 or GL_RGBA8
+
+// Streamer
+
+class TextureStreamer {
+public:
+	TextureStreamer(int nSlots = 3, int slotBytes = 4 << 20);
+	~TextureStreamer();
+		// does not delete GL objects (the shared streamer outlives the context): call Release beforehand
+	// immediate upload: level 0 is copied through the staging ring in row bands of at most slotBytes
+	GLuint Upload(unsigned char *pixels, int width, int height, int bpp, bool bgr = false,
+				  MipPolicy mips = MipPolicy::GPU, vector<MipLevel> *levels = NULL);
+		// allocate immutable storage (glTexStorage2D), stream pixels, return texture name
+	void SubImage(GLuint textureName, int level, unsigned char *pixels, int width, int height, int bpp, bool bgr = false);
+		// stream pixels into existing storage (eg, a level of a precomputed chain, or a re-used frame)
+	void SubLayer(GLuint arrayName, int layer, unsigned char *pixels, int width, int height, int bpp, bool bgr = false);
+		// as SubImage, for level 0 of one layer of a GL_TEXTURE_2D_ARRAY
+	// deferred upload: storage allocated now, pixels streamed by Pump across later frames
+	GLuint Queue(vector<unsigned char> &pixels, int width, int height, int bpp, bool bgr = false,
+				 MipPolicy mips = MipPolicy::GPU);
+		// pixels are moved into the queue (caller's vector is emptied); return texture name
+	void QueueLayer(GLuint arrayName, int layer, vector<unsigned char> &pixels, int width, int height, int bpp,
+					bool bgr = false, bool mipmap = false);
+		// as Queue, for level 0 of one layer of an allocated GL_TEXTURE_2D_ARRAY
+		// if mipmap, the array's mipmaps are generated once its last queued layer lands
+	bool Pump(int byteBudget = 4 << 20);
+		// upload up to byteBudget bytes of queued work; call once per frame
+		// return true if queued work remains
+	int Pending();
+		// # queued textures (and array layers) not yet complete
+	bool Persistent() { return persistent; }
+		// true if staging memory is persistently mapped (GL 4.4), else orphaned per copy
+	void Release();
+		// delete the staging buffers (re-created on next use); call while the context is current
+private:
+	struct Slot { GLuint buffer = 0; GLsync fence = 0; unsigned char *mapped = NULL; };
+	struct Job {
+		GLuint textureName = 0;
+		int layer = -1, nLevels = 1;	// layer >= 0: array texture
+		int width = 0, height = 0, bpp = 0, nextRow = 0;
+		bool bgr = false;
+		MipPolicy mips = MipPolicy::None;
+		vector<unsigned char> pixels;
+	};
+	vector<Slot> slots;
+	vector<Job> jobs;
+	int slotBytes = 0, current = 0;
+	bool persistent = false, initialized = false;
+	void Initialize();
+	int Band(GLuint textureName, int level, int layer, unsigned char *pixels, int width, int height, int bpp, bool bgr, int row, int maxBytes);
+	unsigned char *Map(Slot &s, int nBytes);
+	void Unmap();
+};
+
+TextureStreamer &GetTextureStreamer();
+	// streamer shared by ReadTexture, ReadGIF, and LoadTextureStorage
+
+void SetQueuedTextureLoads(bool on);
+bool QueuedTextureLoads();
+	// if on, ReadTexture, ReadGIF and ReadGIFArray allocate storage and queue their pixels on the shared streamer
+	// rather than upload them at once; the application then calls GetTextureStreamer().Pump() each frame
+	// off by default
+
+GLuint LoadTextureStorage(unsigned char *pixels, int width, int height, int bpp, bool bgr = false,
+						  MipPolicy mips = MipPolicy::GPU, vector<MipLevel> *levels = NULL);
+	// as LoadTexture, but immutable storage uploaded via the shared streamer
+	// storage cannot be re-specified with LoadTexture(..., textureName, ...); use TextureStreamer::SubImage
+
+#endif
@@ -8,6 +8,16 @@
 #include <math.h>
 #include <iostream>
 
+// SIMD: mat4 products and Invert use AVX or SSE2 when the compiler targets them, else scalar code
+#if defined(__AVX__)
+	#include <immintrin.h>
+	#define VECMAT_AVX
+	#define VECMAT_SSE
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define VECMAT_SSE
+#endif
+
 // vector representation
 //     vec2/vec3/vec4 v;        // defaults to zero vector
 // access
@@ -308,13 +318,53 @@ public:
 	friend mat4 operator * (float s, const mat4 &m) { return m*s; }
 	mat4 operator * (const mat4 &m) const {
 		mat4 a(0);
+#if defined(VECMAT_AVX)
+		// two rows per 256-bit register: row i of result = sum over k of row[i][k]*m[k]
+		__m256 b0 = _mm256_broadcast_ps((const __m128 *) &m.row[0].x), b1 = _mm256_broadcast_ps((const __m128 *) &m.row[1].x);
+		__m256 b2 = _mm256_broadcast_ps((const __m128 *) &m.row[2].x), b3 = _mm256_broadcast_ps((const __m128 *) &m.row[3].x);
+		for (int i = 0; i < 4; i += 2) {
+			__m256 r = _mm256_loadu_ps(&row[i].x);
+			__m256 t = _mm256_mul_ps(_mm256_shuffle_ps(r, r, 0x00), b0);
+			t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_shuffle_ps(r, r, 0x55), b1));
+			t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_shuffle_ps(r, r, 0xaa), b2));
+			t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_shuffle_ps(r, r, 0xff), b3));
+			_mm256_storeu_ps(&a.row[i].x, t);
+		}
+#elif defined(VECMAT_SSE)
+		__m128 b0 = _mm_loadu_ps(&m.row[0].x), b1 = _mm_loadu_ps(&m.row[1].x);
+		__m128 b2 = _mm_loadu_ps(&m.row[2].x), b3 = _mm_loadu_ps(&m.row[3].x);
+		for (int i = 0; i < 4; i++) {
+			const vec4 &r = row[i];
+			__m128 t = _mm_mul_ps(_mm_set1_ps(r.x), b0);
+			t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(r.y), b1));
+			t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(r.z), b2));
+			t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(r.w), b3));
+			_mm_storeu_ps(&a.row[i].x, t);
+		}
+#else
 		for (int i = 0; i < 4; i++)
 			for (int j = 0; j < 4; j++)
 				for (int k = 0; k < 4; k++)
 					a[i][j] += row[i][k]*m[k][j];
+#endif
 		return a;
 	}
-	vec4 operator * (const vec4 &v) const { return vec4(dot(row[0], v), dot(row[1], v), dot(row[2], v), dot(row[3], v)); }
+	vec4 operator * (const vec4 &v) const {
+#if defined(VECMAT_SSE)
+		// columns times components, summed in the same order as dot()
+		__m128 c0 = _mm_loadu_ps(&row[0].x), c1 = _mm_loadu_ps(&row[1].x), c2 = _mm_loadu_ps(&row[2].x), c3 = _mm_loadu_ps(&row[3].x);
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+		__m128 t = _mm_mul_ps(c0, _mm_set1_ps(v.x));
+		t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_set1_ps(v.y)));
+		t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_set1_ps(v.z)));
+		t = _mm_add_ps(t, _mm_mul_ps(c3, _mm_set1_ps(v.w)));
+		vec4 a;
+		_mm_storeu_ps(&a.x, t);
+		return a;
+#else
+		return vec4(dot(row[0], v), dot(row[1], v), dot(row[2], v), dot(row[3], v));
+#endif
+	}
 };
 
 inline mat4 Scale(float x, float y, float z) {
@@ -467,9 +517,67 @@ inline bool InverseMatrix4x4(const float *m, float *out) {
 	return h.invert(out);
 }
 
+#if defined(VECMAT_SSE)
+inline bool InverseMatrix4x4SSE(const float *m, float *out) {
+	// block (2x2 sub-matrix) inverse: with M = |A B|, inverse is 1/|M| times adjugate blocks X, Y, Z, W
+	//                                         |C D|
+	// sub-matrices held row-major in one register; see "Fast 4x4 matrix inverse with SSE SIMD, explained"
+	class Helper {
+	public:
+		static __m128 Mul2(__m128 a, __m128 b) {		// 2x2 A*B
+			return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+							  _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+		}
+		static __m128 AdjMul2(__m128 a, __m128 b) {		// 2x2 adj(A)*B
+			return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+							  _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+		}
+		static __m128 MulAdj2(__m128 a, __m128 b) {		// 2x2 A*adj(B)
+			return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+							  _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+		}
+	};
+	__m128 r0 = _mm_loadu_ps(m), r1 = _mm_loadu_ps(m+4), r2 = _mm_loadu_ps(m+8), r3 = _mm_loadu_ps(m+12);
+	__m128 A = _mm_movelh_ps(r0, r1), B = _mm_movehl_ps(r1, r0), C = _mm_movelh_ps(r2, r3), D = _mm_movehl_ps(r3, r2);
+	// determinants of sub-matrices, (|A|, |B|, |C|, |D|)
+	__m128 detSub = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+	__m128 detA = _mm_shuffle_ps(detSub, detSub, 0x00), detB = _mm_shuffle_ps(detSub, detSub, 0x55);
+	__m128 detC = _mm_shuffle_ps(detSub, detSub, 0xaa), detD = _mm_shuffle_ps(detSub, detSub, 0xff);
+	__m128 D_C = Helper::AdjMul2(D, C), A_B = Helper::AdjMul2(A, B);
+	__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), Helper::Mul2(B, D_C));
+	__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), Helper::Mul2(C, A_B));
+	__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), Helper::MulAdj2(D, A_B));
+	__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), Helper::MulAdj2(A, D_C));
+	// |M| = |A||D| + |B||C| - trace(adj(A)B adj(D)C)
+	__m128 tr = _mm_mul_ps(A_B, _mm_shuffle_ps(D_C, D_C, _MM_SHUFFLE(3, 1, 2, 0)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 0, 3, 2)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(2, 3, 0, 1)));
+	__m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+	if (_mm_cvtss_f32(detM) == 0)
+		return false;
+	__m128 rDetM = _mm_div_ps(_mm_setr_ps(1, -1, -1, 1), detM);
+	X_ = _mm_mul_ps(X_, rDetM);
+	Y_ = _mm_mul_ps(Y_, rDetM);
+	Z_ = _mm_mul_ps(Z_, rDetM);
+	W_ = _mm_mul_ps(W_, rDetM);
+	// adjugate of each block and store, combined in one shuffle per row
+	_mm_storeu_ps(out, _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(1, 3, 1, 3)));
+	_mm_storeu_ps(out+4, _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(0, 2, 0, 2)));
+	_mm_storeu_ps(out+8, _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(1, 3, 1, 3)));
+	_mm_storeu_ps(out+12, _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(0, 2, 0, 2)));
+	return true;
+}
+#endif
+
 inline mat4 Invert(mat4 m) {
 	mat4 inv;
+#if defined(VECMAT_SSE)
+	InverseMatrix4x4SSE(&m[0][0], &inv[0][0]);
+#else
 	InverseMatrix4x4(&m[0][0], &inv[0][0]);
+#endif
 	return inv;
 }
 
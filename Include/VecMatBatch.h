@@ -0,0 +1,35 @@
+// VecMatBatch.h - transform and bound arrays of points at full SIMD width (AVX2 or SSE2, else scalar)
+
+#ifndef VECMAT_BATCH_HDR
+#define VECMAT_BATCH_HDR
+
+#include "VecMat.h"
+
+// results match the per-point expressions Vec3(m*vec4(p)) and Bounds() to within float rounding
+// (bitwise without FMA; AVX2 builds fuse multiply-adds)
+
+// Array of structures
+
+void TransformPoints(const mat4 &m, const vec3 *in, vec3 *out, int n);
+	// out[i] = Vec3(m*vec4(in[i])), i.e. affine transform with w = 1 and no divide
+	// in and out may be the same array
+
+float PointBounds(const vec3 *points, int n, vec3 &min, vec3 &max);
+	// as Bounds(vec3 *, ...): set min, max; return largest extent
+
+// Structure of arrays
+
+void TransformPoints(const mat4 &m, const float *x, const float *y, const float *z,
+					 float *xOut, float *yOut, float *zOut, int n);
+	// as above for separate coordinate arrays; outputs may be the same arrays as inputs
+
+float PointBounds(const float *x, const float *y, const float *z, int n, vec3 &min, vec3 &max);
+
+// Planar transforms
+
+void PlanarTransforms(const float *x, const float *y, const float *degrees, const float *sx, const float *sy,
+					  vec2 aspect, mat4 *out, int n);
+	// out[i] = Scale(aspect.x, aspect.y, 1)*Translate(x[i], y[i], 0)*RotateZ(degrees[i])*Scale(sx[i], sy[i], 1)
+	// rows assembled four matrices per step (bitwise equal to the mat4 products)
+
+#endif
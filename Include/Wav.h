@@ -1,33 +1,54 @@
-// Wav.h
+// Wav.h - WAV files played through the shared Mixer
 
 #ifndef WAV_HDR
 #define WAV_HDR
 
-#include "mmeapi.h"				// linker: include winmm.lib
+#include <string>
 #include <vector>
+#include "Mixer.h"
+#include "WavFile.h"
 
+using std::string;
 using std::vector;
 
 enum Channel { C_Left, C_Right, C_Mono };
 
 class Wav {
 public:
-	WAVEHDR wh;
-	HWAVEOUT waveOut;
-	short *source = NULL;
-	int nSamplesToPlay;
-	time_t startPlay = 0;
-	bool ReadWAV(const char *filename, vector<short> &samples, bool verbose = false);
-	void OpenDevice(bool mono, int samplingRate = 44100);
-	void CloseDevice();
+	Sound sound;
+	WavStream stream;
+	int voice = 0;				// most recent voice started by Play
+	float volume = 1, pan = 0, pitch = 1;
+	bool loop = false;
+	Wav(string filename = "", bool verbose = false);
+	~Wav();
+	bool Read(string filename, bool verbose = false);
+		// load entire file into sound; return false if file can't be read
+	bool OpenStream(string filename, bool loop = false);
+		// play from file through a decode-ahead ring instead, in constant memory (for music)
+	bool ReadWAV(const char *filename, vector<short> &samples, bool verbose = false,
+				 int *nChannels = NULL, int *samplingRate = NULL);
+	void OpenDevice();
+		// open the shared mixer now rather than at first Play, to avoid a delay
+	int Play(float volume = 1);
+		// start a new voice; voices from earlier calls keep playing and overlap
+	void Stop();
+	void Pause();
+		// toggle pause of the most recent voice
+	void SetVolume(float volume);
+	bool Playing();
+	float ElapsedTime();
+	float FractionPlayed();
+	// raw samples, copied into sound
 	void PlayStereo(short *samples, int nStereoPairs, int samplingRate = 44100);
 	void PlayMono(short *samples, int nMonoSamples, int samplingRate = 44100);
 	void PlayMonoScale(short *samples, int nMonoSamples, int samplingRate = 44100, float scale = 1);
-	float FractionPlayed();
-	int PlayState(); // WOM_CLOSE, WOM_OPEN, WOM_DONE
-	float ElapsedTime();
 private:
-	void Play(short *samples, int nSamples, int samplingRate, bool mono, WAVEHDR &w, HWAVEOUT &waveOut);
+	bool paused = false;
+	vector<int> voices;			// voices that may still be reading sound
+	void Silence();
+		// stop all voices and wait until the mixer has released sound
+	void SetSamples(short *samples, int nSamples, int nChannels, int samplingRate);
 };
 
 void StereoToMono(vector<short> &stereo, vector<short> &mono);
@@ -0,0 +1,73 @@
+// WavFile.h - RIFF/WAVE parsing, PCM decoding, and streaming playback
+
+#ifndef WAV_FILE_HDR
+#define WAV_FILE_HDR
+
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "AudioDSP.h"
+#include "Mixer.h"
+
+// Format
+
+struct WavFormat {
+	int nChannels = 0, rate = 0, bitsPerSample = 0, blockAlign = 0;
+	bool isFloat = false;
+	long dataOffset = 0;		// file offset of first sample
+	long dataBytes = 0;
+	int Frames() const { return blockAlign > 0? (int) (dataBytes/blockAlign) : 0; }
+	float Duration() const { return rate > 0? (float) Frames()/rate : 0; }
+};
+
+bool ReadWavHeader(FILE *in, WavFormat &format, const char *name = "", bool verbose = false);
+	// walk RIFF chunks to "fmt " and "data", skipping any others; leave file positioned at first sample
+	// accept integer PCM of 8, 16, 24, or 32 bits, 32- or 64-bit float, plain or WAVE_FORMAT_EXTENSIBLE, any rate
+	// return false (with message) if not a supported WAV
+
+void DecodeSamples(const unsigned char *bytes, const WavFormat &format, int nFrames, float *samples);
+	// convert nFrames of file data to interleaved float in [-1, 1]
+
+bool ReadWavFile(const char *filename, Sound &sound, bool verbose = false);
+	// load entire file
+
+// Stream
+
+class WavStream : public AudioStream {
+public:
+	~WavStream();
+	bool Open(const char *filename, int outputRate, bool loop = false, float bufferSeconds = .5f,
+			  ResampleQuality quality = ResampleQuality::Medium);
+		// open file, decode the first block on the calling thread so playback can start at the next period,
+		// then decode (and resample to outputRate) ahead on a background thread into a ring of bufferSeconds
+		// memory is constant: the ring plus one file block, regardless of file length
+	bool Restart();
+		// rewind to the first sample and refill
+	void Close();
+		// stop decoding and close file; stop any voice playing this stream first
+	bool IsOpen() { return file != NULL; }
+	WavFormat Format() { return format; }
+	// AudioStream
+	int Channels() { return nChannels; }
+	int Read(float *frames, int nFrames);
+	bool Finished();
+private:
+	std::string filename;
+	FILE *file = NULL;
+	WavFormat format;
+	int nChannels = 0, outputRate = 0, blockFrames = 4096;
+	bool loop = false;
+	long bytesLeft = 0;
+	SampleRing ring;
+	std::thread decoder;
+	std::atomic<bool> quit{false}, endOfFile{false};
+	vector<unsigned char> bytes;
+	vector<float> decoded, channels, resampled;
+	Resampler resampler;
+	bool DecodeBlock();
+	void Decode();
+	void StopDecoder();
+};
+
+#endif
@@ -0,0 +1,268 @@
+// AudioDSP.cpp - sample-rate conversion, channel conversion, and gain kernels
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include "AudioDSP.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define DSP_SSE
+#endif
+
+namespace {
+
+const double Pi = 3.14159265358979;
+const int MaxPhases = 1024;
+
+int GCD(int a, int b) { return b? GCD(b, a%b) : a; }
+
+double BesselI0(double x) {
+	// power series, converges quickly for Kaiser beta range
+	double sum = 1, term = 1;
+	for (int k = 1; k < 50 && term > 1e-12*sum; k++) {
+		term *= (x/(2*k))*(x/(2*k));
+		sum += term;
+	}
+	return sum;
+}
+
+float Dot(const float *a, const float *b, int n) {
+	// n is a multiple of 4
+#ifdef DSP_SSE
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	int i = 0;
+	for (; i+8 <= n; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a+i+4), _mm_loadu_ps(b+i+4)));
+	}
+	if (i < n)
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i)));
+	acc0 = _mm_add_ps(acc0, acc1);
+	acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+	acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+	return _mm_cvtss_f32(acc0);
+#else
+	float s = 0;
+	for (int i = 0; i < n; i++)
+		s += a[i]*b[i];
+	return s;
+#endif
+}
+
+} // end namespace
+
+// Resampling
+
+void Resampler::Initialize(int in, int out, int nc, ResampleQuality quality) {
+	inRate = in;
+	outRate = out;
+	nChannels = std::min(std::max(nc, 1), 2);
+	int g = GCD(in, out);
+	up = out/g;
+	down = in/g;
+	if (up > MaxPhases) {
+		// irregular ratio: round to MaxPhases phases, relative rate error at most 1/(2*down)
+		down = (int) floor((double) down*MaxPhases/up+.5);
+		up = MaxPhases;
+	}
+	linear = quality == ResampleQuality::Linear;
+	int baseTaps = quality == ResampleQuality::Low? 8 : quality == ResampleQuality::High? 32 : 16;
+	double beta = quality == ResampleQuality::Low? 5 : quality == ResampleQuality::High? 9 : 7;
+	// cutoff relative to input Nyquist: below output Nyquist when downsampling, with a little transition band
+	double cutoff = std::min(1., (double) up/down)*(quality == ResampleQuality::High? .95 : .9);
+	nTaps = linear? 4 : 4*(int) ceil(baseTaps/cutoff/4);	// multiple of 4 for Dot; outer linear taps are 0
+	filters.assign((size_t) up*nTaps, 0);
+	for (int p = 0; p < up; p++) {
+		float *h = &filters[(size_t) p*nTaps];
+		// tap k multiplies input frame (newest-nTaps+1+k); output lies p/up frames after frame (newest-nTaps/2)
+		double sum = 0;
+		for (int k = 0; k < nTaps; k++) {
+			double t = (k-(nTaps/2-1))-(double) p/up;	// input frames from output time to tap
+			if (linear)
+				h[k] = (float) std::max(0., 1-fabs(t));
+			else {
+				double x = cutoff*t, sinc = fabs(x) < 1e-9? 1 : sin(Pi*x)/(Pi*x);
+				double r = t/(nTaps/2.), w = fabs(r) < 1? BesselI0(beta*sqrt(1-r*r))/BesselI0(beta) : 0;
+				h[k] = (float) (sinc*w);
+			}
+			sum += h[k];
+		}
+		for (int k = 0; k < nTaps; k++)
+			h[k] = (float) (h[k]/sum);
+	}
+	Reset();
+}
+
+void Resampler::Reset() {
+	// nTaps/2-1 frames of leading silence center the first output on the first input frame
+	for (int c = 0; c < 2; c++)
+		history[c].assign(nTaps/2-1, 0);
+	position = nTaps-1;
+	phase = 0;
+}
+
+int Resampler::Process(const float *in, int nFrames, vector<float> &out) {
+	for (int c = 0; c < nChannels; c++) {
+		vector<float> &h = history[c];
+		size_t n0 = h.size();
+		h.resize(n0+nFrames);
+		for (int i = 0; i < nFrames; i++)
+			h[n0+i] = in[i*nChannels+c];
+	}
+	int nHistory = (int) history[0].size(), nOut = 0;
+	for (; position < nHistory; nOut++) {
+		const float *f = &filters[(size_t) phase*nTaps];
+		for (int c = 0; c < nChannels; c++)
+			out.push_back(Dot(f, &history[c][position-nTaps+1], nTaps));
+		phase += down;
+		position += phase/up;
+		phase %= up;
+	}
+	// drop frames no longer under the filter
+	int drop = std::max(0, std::min(position-nTaps+1, nHistory));
+	for (int c = 0; c < nChannels; c++)
+		history[c].erase(history[c].begin(), history[c].begin()+drop);
+	position -= drop;
+	return nOut;
+}
+
+int Resampler::Flush(vector<float> &out) {
+	vector<float> zeros((size_t) (nTaps/2+1)*nChannels, 0);
+	int n = Process(zeros.data(), nTaps/2+1, out);
+	Reset();
+	return n;
+}
+
+void ResampleSound(Sound &sound, int rate, ResampleQuality quality) {
+	if (sound.rate == rate || sound.rate <= 0 || rate <= 0 || !sound.Frames())
+		return;
+	int nc = std::min(sound.nChannels, 2), nFrames = sound.Frames();
+	vector<float> in, out;
+	const float *src = sound.samples.data();
+	if (nc != sound.nChannels) {
+		in.resize((size_t) nFrames*nc);
+		for (int i = 0; i < nFrames; i++)
+			for (int c = 0; c < nc; c++)
+				in[i*nc+c] = sound.samples[i*sound.nChannels+c];
+		src = in.data();
+	}
+	Resampler r;
+	r.Initialize(sound.rate, rate, nc, quality);
+	out.reserve((size_t) ((double) nFrames*rate/sound.rate+r.Latency()+2)*nc);
+	r.Process(src, nFrames, out);
+	r.Flush(out);
+	// output is aligned with input (no leading delay); trim flush tail to exact length
+	size_t outFrames = (size_t) ((double) nFrames*rate/sound.rate+.5);
+	out.resize(std::min(out.size(), outFrames*nc));
+	sound.samples.swap(out);
+	sound.nChannels = nc;
+	sound.rate = rate;
+}
+
+// Channels and gain
+
+void StereoToMono(const float *stereo, float *mono, int nFrames) {
+	int i = 0;
+#ifdef DSP_SSE
+	__m128 half = _mm_set1_ps(.5f);
+	for (; i+4 <= nFrames; i += 4) {
+		__m128 a = _mm_loadu_ps(stereo+2*i), b = _mm_loadu_ps(stereo+2*i+4);
+		__m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm_storeu_ps(mono+i, _mm_mul_ps(_mm_add_ps(l, r), half));
+	}
+#endif
+	for (; i < nFrames; i++)
+		mono[i] = .5f*(stereo[2*i]+stereo[2*i+1]);
+}
+
+void MonoToStereo(const float *mono, float *stereo, int nFrames) {
+	int i = 0;
+#ifdef DSP_SSE
+	for (; i+4 <= nFrames; i += 4) {
+		__m128 m = _mm_loadu_ps(mono+i);
+		_mm_storeu_ps(stereo+2*i, _mm_unpacklo_ps(m, m));
+		_mm_storeu_ps(stereo+2*i+4, _mm_unpackhi_ps(m, m));
+	}
+#endif
+	for (; i < nFrames; i++)
+		stereo[2*i] = stereo[2*i+1] = mono[i];
+}
+
+void StereoToMono(const short *stereo, short *mono, int nFrames) {
+	int i = 0;
+#ifdef DSP_SSE
+	// pairwise sums at 32 bits, halved, packed with saturation
+	const __m128i ones = _mm_set1_epi16(1);
+	for (; i+8 <= nFrames; i += 8) {
+		__m128i a = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (stereo+2*i)), ones);
+		__m128i b = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (stereo+2*i+8)), ones);
+		_mm_storeu_si128((__m128i *) (mono+i), _mm_packs_epi32(_mm_srai_epi32(a, 1), _mm_srai_epi32(b, 1)));
+	}
+#endif
+	for (; i < nFrames; i++)
+		mono[i] = (short) ((stereo[2*i]+stereo[2*i+1]) >> 1);
+}
+
+void ScaleSamples(const short *in, short *out, int n, float gain) {
+	int i = 0;
+#ifdef DSP_SSE
+	__m128 g = _mm_set1_ps(gain);
+	for (; i+8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (in+i));
+		// sign-extend to 32 bits, scale as float, round and pack with saturation
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16), hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), g));
+		hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), g));
+		_mm_storeu_si128((__m128i *) (out+i), _mm_packs_epi32(lo, hi));
+	}
+#endif
+	for (; i < n; i++) {
+		float s = gain*in[i];
+		out[i] = (short) (s > 32767.f? 32767 : s < -32768.f? -32768 : lrintf(s));
+	}
+}
+
+void ScaleSamples(const float *in, float *out, int n, float gain) {
+	int i = 0;
+#ifdef DSP_SSE
+	__m128 g = _mm_set1_ps(gain), lo = _mm_set1_ps(-1), hi = _mm_set1_ps(1);
+	for (; i+4 <= n; i += 4)
+		_mm_storeu_ps(out+i, _mm_min_ps(hi, _mm_max_ps(lo, _mm_mul_ps(_mm_loadu_ps(in+i), g))));
+#endif
+	for (; i < n; i++) {
+		float s = gain*in[i];
+		out[i] = s > 1? 1 : s < -1? -1 : s;
+	}
+}
+
+void FloatToShort(const float *in, short *out, int n) {
+	int i = 0;
+#ifdef DSP_SSE
+	__m128 scale = _mm_set1_ps(32767.f);
+	for (; i+8 <= n; i += 8) {
+		__m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in+i), scale));
+		__m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in+i+4), scale));
+		_mm_storeu_si128((__m128i *) (out+i), _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < n; i++) {
+		float s = 32767.f*in[i];
+		out[i] = (short) (s > 32767.f? 32767 : s < -32768.f? -32768 : lrintf(s));
+	}
+}
+
+void ShortToFloat(const short *in, float *out, int n) {
+	int i = 0;
+#ifdef DSP_SSE
+	__m128 scale = _mm_set1_ps(1/32768.f);
+	for (; i+8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (in+i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16), hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(out+i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out+i+4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = in[i]/32768.f;
+}
@@ -0,0 +1,170 @@
+// BVH.cpp - bounding volume hierarchy over axis-aligned boxes, built with the surface area heuristic
+
+#include <algorithm>
+#include <float.h>
+#include "BVH.h"
+
+namespace {
+
+const int NBins = 16, SAHDepth = 32;	// deeper nodes split at the median, so depth stays under 64
+const float TraversalCost = 1, IntersectCost = 1;
+
+struct Box {
+	vec3 min = vec3(FLT_MAX), max = vec3(-FLT_MAX);
+	void Grow(const vec3 &p) {
+		for (int k = 0; k < 3; k++) {
+			min[k] = std::min(min[k], p[k]);
+			max[k] = std::max(max[k], p[k]);
+		}
+	}
+	void Grow(const Box &b) { Grow(b.min); Grow(b.max); }
+	float Area() const {
+		vec3 d = max-min;
+		return d.x < 0? 0 : 2*(d.x*d.y+d.y*d.z+d.z*d.x);
+	}
+};
+
+} // end namespace
+
+void BVH::Build(const vec3 *boxMin, const vec3 *boxMax, int n, int maxLeafSize) {
+	nodes.clear();
+	order.resize(n);
+	if (n <= 0)
+		return;
+	maxLeafSize = std::max(1, maxLeafSize);
+	vector<vec3> centers(n);
+	for (int i = 0; i < n; i++) {
+		order[i] = i;
+		centers[i] = .5f*(boxMin[i]+boxMax[i]);
+	}
+	nodes.reserve(2*n);
+	nodes.push_back(BVHNode());
+	// pending nodes to subdivide, each with its primitive range
+	struct Task { int node, first, count, depth; };
+	vector<Task> stack = {{0, 0, n, 1}};
+	while (!stack.empty()) {
+		Task t = stack.back();
+		stack.pop_back();
+		Box bounds, centroids;
+		for (int i = t.first; i < t.first+t.count; i++) {
+			int p = order[i];
+			bounds.Grow(boxMin[p]);
+			bounds.Grow(boxMax[p]);
+			centroids.Grow(centers[p]);
+		}
+		BVHNode &node = nodes[t.node];
+		node.min = bounds.min;
+		node.max = bounds.max;
+		node.first = t.first;
+		node.count = t.count;
+		if (t.count <= 1)
+			continue;
+		// best split over all axes: cost of children relative to this node's area
+		int bestAxis = -1, bestSplit = 0;
+		float bestCost = FLT_MAX;
+		for (int axis = 0; axis < 3 && t.depth < SAHDepth; axis++) {
+			float lo = centroids.min[axis], extent = centroids.max[axis]-lo;
+			if (extent <= 0)
+				continue;
+			Box bins[NBins];
+			int counts[NBins] = {};
+			float scale = NBins/extent;
+			for (int i = t.first; i < t.first+t.count; i++) {
+				int p = order[i], b = std::min(NBins-1, (int) ((centers[p][axis]-lo)*scale));
+				counts[b]++;
+				bins[b].Grow(boxMin[p]);
+				bins[b].Grow(boxMax[p]);
+			}
+			// sweep from the right, then from the left
+			float rightArea[NBins];
+			int rightCount[NBins];
+			Box r;
+			for (int b = NBins-1, c = 0; b > 0; b--) {
+				r.Grow(bins[b]);
+				c += counts[b];
+				rightArea[b] = r.Area();
+				rightCount[b] = c;
+			}
+			Box l;
+			for (int b = 0, c = 0; b < NBins-1; b++) {
+				l.Grow(bins[b]);
+				c += counts[b];
+				if (!c || !rightCount[b+1])
+					continue;
+				float cost = l.Area()*c+rightArea[b+1]*rightCount[b+1];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+		float leafCost = IntersectCost*t.count, splitCost = FLT_MAX;
+		if (bestAxis >= 0)
+			splitCost = TraversalCost+IntersectCost*bestCost/std::max(bounds.Area(), FLT_MIN);
+		if (t.count <= maxLeafSize && leafCost <= splitCost)
+			continue;
+		int mid = t.first;
+		if (bestAxis >= 0) {
+			float lo = centroids.min[bestAxis], scale = NBins/(centroids.max[bestAxis]-lo);
+			int *split = std::partition(&order[t.first], &order[t.first]+t.count, [&](int p) {
+				return std::min(NBins-1, (int) ((centers[p][bestAxis]-lo)*scale)) <= bestSplit;
+			});
+			mid = (int) (split-&order[0]);
+		}
+		else {
+			// too deep, or coincident centers: halve the range at the median along the widest centroid axis
+			vec3 d = centroids.max-centroids.min;
+			int axis = d.x > d.y? (d.x > d.z? 0 : 2) : (d.y > d.z? 1 : 2);
+			mid = t.first+t.count/2;
+			std::nth_element(&order[t.first], &order[mid], &order[t.first]+t.count, [&](int a, int b) {
+				return centers[a][axis] < centers[b][axis];
+			});
+		}
+		int left = (int) nodes.size();
+		nodes.push_back(BVHNode());
+		nodes.push_back(BVHNode());
+		nodes[t.node].first = left;
+		nodes[t.node].count = 0;
+		stack.push_back({left, t.first, mid-t.first, t.depth+1});
+		stack.push_back({left+1, mid, t.first+t.count-mid, t.depth+1});
+	}
+}
+
+int BVH::Depth() const {
+	if (nodes.empty())
+		return 0;
+	int depth = 0;
+	vector<std::pair<int, int>> stack = {{0, 1}};
+	while (!stack.empty()) {
+		std::pair<int, int> s = stack.back();
+		stack.pop_back();
+		depth = std::max(depth, s.second);
+		const BVHNode &n = nodes[s.first];
+		if (!n.Leaf()) {
+			stack.push_back({n.first, s.second+1});
+			stack.push_back({n.first+1, s.second+1});
+		}
+	}
+	return depth;
+}
+
+void BVH::Refit(const vec3 *boxMin, const vec3 *boxMax) {
+	// children follow their parent in nodes, so a reverse sweep sees children first
+	for (int i = (int) nodes.size()-1; i >= 0; i--) {
+		BVHNode &n = nodes[i];
+		Box b;
+		if (n.Leaf())
+			for (int k = n.first; k < n.first+n.count; k++) {
+				b.Grow(boxMin[order[k]]);
+				b.Grow(boxMax[order[k]]);
+			}
+		else
+			for (int c = n.first; c <= n.first+1; c++) {
+				b.Grow(nodes[c].min);
+				b.Grow(nodes[c].max);
+			}
+		n.min = b.min;
+		n.max = b.max;
+	}
+}
@@ -338,8 +338,7 @@ mat4 GetDrawView() { return drawView; }
 void SetDrawView(mat4 m) { drawView = m; }
 
 GLuint UseDrawShader() {
-	int was = 0;
-	glGetIntegerv(GL_CURRENT_PROGRAM, &was);
+	int was = CurrentProgram();
 	bool init = !drawShader;
 	if (init) drawShader = LinkProgramViaCode(&drawVShader, &drawPShader);
 	glUseProgram(drawShader);
@@ -0,0 +1,574 @@
+// Fractal.cpp - Julia set engine: parallel SIMD tiles, double-double perturbation, incremental texture upload
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include "Fractal.h"
+#include "GLXtras.h"
+#include "Jobs.h"
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+	#define JULIA_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define JULIA_SSE
+#endif
+
+namespace {
+
+const double Bailout2 = 500.*500., DeepPixelSize = 1e-5, MinPixelSize = 1e-28;
+
+// Double-double (Dekker; Hida, Li, and Bailey)
+
+inline DoubleDouble QuickTwoSum(double a, double b) {
+	// |a| >= |b|
+	double s = a+b;
+	return DoubleDouble(s, b-(s-a));
+}
+
+inline DoubleDouble TwoSum(double a, double b) {
+	double s = a+b, v = s-a;
+	return DoubleDouble(s, (a-(s-v))+(b-v));
+}
+
+#if defined(__FMA__) || defined(__AVX2__)
+
+inline DoubleDouble TwoProduct(double a, double b) {
+	// with fused multiply-add, and where the compiler may fuse Split's t-(t-a) and break it
+	double p = a*b;
+	return DoubleDouble(p, fma(a, b, -p));
+}
+
+#else
+
+inline void Split(double a, double &hi, double &lo) {
+	double t = 134217729.*a;	// 2^27+1
+	hi = t-(t-a);
+	lo = a-hi;
+}
+
+inline DoubleDouble TwoProduct(double a, double b) {
+	double p = a*b, ah, al, bh, bl;
+	Split(a, ah, al);
+	Split(b, bh, bl);
+	return DoubleDouble(p, ((ah*bh-p)+ah*bl+al*bh)+al*bl);
+}
+
+#endif
+
+// Grid
+
+int FloorDiv(int a, int b) { return a >= 0? a/b : -((b-1-a)/b); }
+
+int Mod(int a, int b) { int m = a%b; return m < 0? m+b : m; }
+
+inline unsigned char Gray(double count, int maxIterations) { return (unsigned char) (255.*count/maxIterations); }
+
+// SIMD lanes: masks are all-ones or all-zeros per lane
+
+#ifdef JULIA_SSE
+
+struct SSEFloat {
+	typedef __m128 V;
+	enum { N = 4 };
+	static V Set(float f) { return _mm_set1_ps(f); }
+	static V Load(const float *p) { return _mm_loadu_ps(p); }
+	static void Store(float *p, V v) { _mm_storeu_ps(p, v); }
+	static V Add(V a, V b) { return _mm_add_ps(a, b); }
+	static V Sub(V a, V b) { return _mm_sub_ps(a, b); }
+	static V Mul(V a, V b) { return _mm_mul_ps(a, b); }
+	static V Greater(V a, V b) { return _mm_cmpgt_ps(a, b); }
+	static V And(V a, V b) { return _mm_and_ps(a, b); }
+	static V AndNot(V a, V b) { return _mm_andnot_ps(a, b); }
+		// ~a & b
+	static V True() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+	static bool Any(V m) { return _mm_movemask_ps(m) != 0; }
+};
+
+struct SSEDouble {
+	typedef __m128d V;
+	enum { N = 2 };
+	static V Set(double d) { return _mm_set1_pd(d); }
+	static V Load(const double *p) { return _mm_loadu_pd(p); }
+	static void Store(double *p, V v) { _mm_storeu_pd(p, v); }
+	static V Add(V a, V b) { return _mm_add_pd(a, b); }
+	static V Sub(V a, V b) { return _mm_sub_pd(a, b); }
+	static V Mul(V a, V b) { return _mm_mul_pd(a, b); }
+	static V Greater(V a, V b) { return _mm_cmpgt_pd(a, b); }
+	static V Less(V a, V b) { return _mm_cmplt_pd(a, b); }
+	static V Equal(V a, V b) { return _mm_cmpeq_pd(a, b); }
+	static V And(V a, V b) { return _mm_and_pd(a, b); }
+	static V AndNot(V a, V b) { return _mm_andnot_pd(a, b); }
+	static V Or(V a, V b) { return _mm_or_pd(a, b); }
+	static V Select(V m, V a, V b) { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+	static V True() { return _mm_castsi128_pd(_mm_set1_epi32(-1)); }
+	static bool Any(V m) { return _mm_movemask_pd(m) != 0; }
+	static V Gather(const double *base, V index) {
+		double i[2];
+		_mm_storeu_pd(i, index);
+		return _mm_set_pd(base[(int) i[1]], base[(int) i[0]]);
+	}
+};
+
+#endif
+
+#ifdef JULIA_AVX2
+
+struct AVXFloat {
+	typedef __m256 V;
+	enum { N = 8 };
+	static V Set(float f) { return _mm256_set1_ps(f); }
+	static V Load(const float *p) { return _mm256_loadu_ps(p); }
+	static void Store(float *p, V v) { _mm256_storeu_ps(p, v); }
+	static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+	static V Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+	static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+	static V Greater(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static V And(V a, V b) { return _mm256_and_ps(a, b); }
+	static V AndNot(V a, V b) { return _mm256_andnot_ps(a, b); }
+	static V True() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+	static bool Any(V m) { return _mm256_movemask_ps(m) != 0; }
+};
+
+struct AVXDouble {
+	typedef __m256d V;
+	enum { N = 4 };
+	static V Set(double d) { return _mm256_set1_pd(d); }
+	static V Load(const double *p) { return _mm256_loadu_pd(p); }
+	static void Store(double *p, V v) { _mm256_storeu_pd(p, v); }
+	static V Add(V a, V b) { return _mm256_add_pd(a, b); }
+	static V Sub(V a, V b) { return _mm256_sub_pd(a, b); }
+	static V Mul(V a, V b) { return _mm256_mul_pd(a, b); }
+	static V Greater(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+	static V Less(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+	static V Equal(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+	static V And(V a, V b) { return _mm256_and_pd(a, b); }
+	static V AndNot(V a, V b) { return _mm256_andnot_pd(a, b); }
+	static V Or(V a, V b) { return _mm256_or_pd(a, b); }
+	static V Select(V m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+	static V True() { return _mm256_castsi256_pd(_mm256_set1_epi32(-1)); }
+	static bool Any(V m) { return _mm256_movemask_pd(m) != 0; }
+	static V Gather(const double *base, V index) { return _mm256_i32gather_pd(base, _mm256_cvttpd_epi32(index), 8); }
+};
+
+typedef AVXFloat FloatLanes;
+typedef AVXDouble DoubleLanes;
+
+#elif defined(JULIA_SSE)
+
+typedef SSEFloat FloatLanes;
+typedef SSEDouble DoubleLanes;
+
+#endif
+
+// Direct iteration in float, for pixels wider than DeepPixelSize
+
+long long DirectSpan(const float *x, float y, float cr, float ci, int maxIterations, unsigned char *out, int n) {
+	// iterate n pixels at (x[i], y); return iterations performed
+	long long total = 0;
+	for (int i = 0; i < n; i++) {
+		float zx = x[i], zy = y, x2 = zx*zx, y2 = zy*zy;
+		int k = 0;
+		for (; k < maxIterations; k++) {
+			zy = (zx+zx)*zy+ci;
+			zx = x2-y2+cr;
+			x2 = zx*zx;
+			y2 = zy*zy;
+			if (x2+y2 > Bailout2)
+				break;
+		}
+		out[i] = Gray(k, maxIterations);
+		total += std::min(k+1, maxIterations);
+	}
+	return total;
+}
+
+template<class F>
+long long DirectSpan(const float *x, float y, float cr, float ci, int maxIterations, unsigned char *out, int n) {
+	// as above, F::N pixels at a time; n a multiple of F::N
+	typedef typename F::V V;
+	V cR = F::Set(cr), cI = F::Set(ci), bailout = F::Set((float) Bailout2), one = F::Set(1);
+	long long total = 0;
+	for (int i = 0; i < n; i += F::N) {
+		V zx = F::Load(x+i), zy = F::Set(y), x2 = F::Mul(zx, zx), y2 = F::Mul(zy, zy);
+		V count = F::Set(0), active = F::True();
+		for (int k = 0; k < maxIterations; k++) {
+			zy = F::Add(F::Mul(F::Add(zx, zx), zy), cI);
+			zx = F::Add(F::Sub(x2, y2), cR);
+			x2 = F::Mul(zx, zx);
+			y2 = F::Mul(zy, zy);
+			active = F::AndNot(F::Greater(F::Add(x2, y2), bailout), active);
+			if (!F::Any(active))
+				break;
+			count = F::Add(count, F::And(active, one));
+		}
+		float c[F::N];
+		F::Store(c, count);
+		for (int j = 0; j < F::N; j++) {
+			out[i+j] = Gray(c[j], maxIterations);
+			total += std::min((int) c[j]+1, maxIterations);
+		}
+	}
+	return total;
+}
+
+// Perturbation, for deep zoom
+// a pixel's z is Z[m]+d for reference orbit Z, whence d' = (2Z[m]+d)d and z' = Z[m+1]+d'; d is tiny, so double suffices
+// when |z| < |d| (Z no longer near z), or at the end of the orbit, rebase on the orbit of 0 with d = z (Zhuoran)
+
+struct Orbit {
+	const double *x, *y;
+	int end1, end2, critical;	// last indices of reference and critical orbits, index of critical Z[0] = 0
+};
+
+long long PerturbSpan(const double *dx0, double dy0, const Orbit &o, int maxIterations, unsigned char *out, int n) {
+	// iterate n pixels at Z[0]+(dx0[i], dy0); return iterations performed
+	long long total = 0;
+	for (int i = 0; i < n; i++) {
+		double dx = dx0[i], dy = dy0;
+		int m = 0, k = 0;
+		for (; k < maxIterations; k++) {
+			double ax = o.x[m]+o.x[m]+dx, ay = o.y[m]+o.y[m]+dy, t = ax*dx-ay*dy;
+			dy = ax*dy+ay*dx;
+			dx = t;
+			m++;
+			double zx = o.x[m]+dx, zy = o.y[m]+dy, r = zx*zx+zy*zy;
+			if (r > Bailout2)
+				break;
+			if (r < dx*dx+dy*dy || m == o.end1 || m == o.end2) {
+				dx = zx;
+				dy = zy;
+				m = o.critical;
+			}
+		}
+		out[i] = Gray(k, maxIterations);
+		total += std::min(k+1, maxIterations);
+	}
+	return total;
+}
+
+template<class D>
+long long PerturbSpan(const double *dx0, double dy0, const Orbit &o, int maxIterations, unsigned char *out, int n) {
+	// as above, D::N pixels at a time; lanes follow the orbits independently
+	typedef typename D::V V;
+	V bailout = D::Set(Bailout2), one = D::Set(1), end1 = D::Set(o.end1), end2 = D::Set(o.end2), critical = D::Set(o.critical);
+	V zero = D::Set(0), zx0 = D::Set(o.x[0]), zy0 = D::Set(o.y[0]);
+	long long total = 0;
+	for (int i = 0; i < n; i += D::N) {
+		V dx = D::Load(dx0+i), dy = D::Set(dy0), m = zero, Zx = zx0, Zy = zy0;
+		V count = zero, active = D::True();
+		for (int k = 0; k < maxIterations; k++) {
+			V ax = D::Add(D::Add(Zx, Zx), dx), ay = D::Add(D::Add(Zy, Zy), dy), t = D::Sub(D::Mul(ax, dx), D::Mul(ay, dy));
+			dy = D::Add(D::Mul(ax, dy), D::Mul(ay, dx));
+			dx = t;
+			m = D::Add(m, one);
+			Zx = D::Gather(o.x, m);
+			Zy = D::Gather(o.y, m);
+			V zx = D::Add(Zx, dx), zy = D::Add(Zy, dy), r = D::Add(D::Mul(zx, zx), D::Mul(zy, zy));
+			active = D::AndNot(D::Greater(r, bailout), active);
+			if (!D::Any(active))
+				break;
+			count = D::Add(count, D::And(active, one));
+			V rebase = D::Or(D::Less(r, D::Add(D::Mul(dx, dx), D::Mul(dy, dy))), D::Or(D::Equal(m, end1), D::Equal(m, end2)));
+			if (D::Any(rebase)) {
+				dx = D::Select(rebase, zx, dx);
+				dy = D::Select(rebase, zy, dy);
+				m = D::Select(rebase, critical, m);
+				Zx = D::Select(rebase, zero, Zx);
+				Zy = D::Select(rebase, zero, Zy);
+			}
+		}
+		double c[D::N];
+		D::Store(c, count);
+		for (int j = 0; j < D::N; j++) {
+			out[i+j] = Gray(c[j], maxIterations);
+			total += std::min((int) c[j]+1, maxIterations);
+		}
+	}
+	return total;
+}
+
+// Display
+
+const char *vShader = R"(
+	#version 130
+	void main() {
+		vec2 points[] = vec2[4](vec2(-1, -1), vec2(-1, 1), vec2(1, -1), vec2(1, 1));
+		gl_Position = vec4(points[gl_VertexID], 0, 1);
+	}
+)";
+
+const char *pShader = R"(
+	#version 130
+	uniform sampler2D tiles;
+	uniform ivec2 shift, size;		// window pixel (0, 0) is texel shift; the texture wraps around
+	out vec4 pColor;
+	void main() {
+		float g = texelFetch(tiles, (shift+ivec2(gl_FragCoord.xy))%size, 0).r;
+		pColor = vec4(g, g, g, 1);
+	}
+)";
+
+} // end namespace
+
+// Double-double
+
+DoubleDouble operator + (DoubleDouble a, DoubleDouble b) {
+	DoubleDouble s = TwoSum(a.hi, b.hi), t = TwoSum(a.lo, b.lo);
+	s = QuickTwoSum(s.hi, s.lo+t.hi);
+	return QuickTwoSum(s.hi, s.lo+t.lo);
+}
+
+DoubleDouble operator - (DoubleDouble a, DoubleDouble b) { return a+DoubleDouble(-b.hi, -b.lo); }
+
+DoubleDouble operator * (DoubleDouble a, DoubleDouble b) {
+	DoubleDouble p = TwoProduct(a.hi, b.hi);
+	return QuickTwoSum(p.hi, p.lo+(a.hi*b.lo+a.lo*b.hi));
+}
+
+// Julia set
+
+const char *JuliaSet::SimdLanes() {
+#if defined(JULIA_AVX2)
+	return "AVX2";
+#elif defined(JULIA_SSE)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+JuliaSet::JuliaSet(int size) : tileSize(std::max(8, (size+7)/8*8)) { }
+
+JuliaSet::~JuliaSet() {
+	if (texture)
+		glDeleteTextures(1, &texture);
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
+}
+
+void JuliaSet::Resize(int w, int h) {
+	DoubleDouble cx = width? CenterX() : DoubleDouble(), cy = height? CenterY() : DoubleDouble();
+	width = std::max(w, 1);
+	height = std::max(h, 1);
+	// a window spans at most one more tile than it holds whole
+	nSlotsX = (width+tileSize-1)/tileSize+1;
+	nSlotsY = (height+tileSize-1)/tileSize+1;
+	texWidth = nSlotsX*tileSize;
+	texHeight = nSlotsY*tileSize;
+	slots.assign(nSlotsX*nSlotsY, Slot());
+	pixels.assign((size_t) texWidth*texHeight, 0);
+	changed.clear();
+	if (texture)
+		glDeleteTextures(1, &texture);
+	texture = 0;
+	SetView(cx, cy, pixelSize);
+}
+
+void JuliaSet::Invalidate() {
+	for (Slot &s : slots)
+		s.valid = false;
+	orbitValid = false;
+}
+
+void JuliaSet::SetC(double re, double im) {
+	cReal = re;
+	cImag = im;
+	Invalidate();
+}
+
+void JuliaSet::SetIterations(int n) {
+	maxIterations = std::max(1, n);
+	Invalidate();
+}
+
+void JuliaSet::SetView(DoubleDouble cx, DoubleDouble cy, double size) {
+	pixelSize = std::max(size, MinPixelSize);
+	originX = originY = 0;
+	refX = width/2;
+	refY = height/2;
+	anchorX = cx-DoubleDouble(refX*pixelSize);
+	anchorY = cy-DoubleDouble(refY*pixelSize);
+	Invalidate();
+}
+
+void JuliaSet::Pan(int dx, int dy) {
+	originX -= dx;
+	originY -= dy;
+}
+
+void JuliaSet::Zoom(double factor, int x, int y) {
+	DoubleDouble px = anchorX+DoubleDouble((double) (originX+x)*pixelSize);
+	DoubleDouble py = anchorY+DoubleDouble((double) (originY+y)*pixelSize);
+	pixelSize = std::max(pixelSize/factor, MinPixelSize);
+	originX = originY = 0;
+	anchorX = px-DoubleDouble(x*pixelSize);
+	anchorY = py-DoubleDouble(y*pixelSize);
+	refX = width/2;
+	refY = height/2;
+	Invalidate();
+}
+
+DoubleDouble JuliaSet::CenterX() { return anchorX+DoubleDouble((originX+.5*width)*pixelSize); }
+
+DoubleDouble JuliaSet::CenterY() { return anchorY+DoubleDouble((originY+.5*height)*pixelSize); }
+
+bool JuliaSet::Deep() { return pixelSize < DeepPixelSize; }
+
+unsigned char JuliaSet::Pixel(int x, int y) {
+	return pixels[(size_t) Mod(originY+y, texHeight)*texWidth+Mod(originX+x, texWidth)];
+}
+
+void JuliaSet::ComputeOrbit() {
+	// reference at grid pixel (refX, refY), then from 0, each until it escapes (at least two points)
+	DoubleDouble cr(cReal), ci(cImag);
+	orbitX.clear();
+	orbitY.clear();
+	auto Run = [&](DoubleDouble x, DoubleDouble y) {
+		for (int k = 0; k <= maxIterations; k++) {
+			orbitX.push_back(x.Value());
+			orbitY.push_back(y.Value());
+			if (k > 0 && x.hi*x.hi+y.hi*y.hi > Bailout2)
+				break;
+			DoubleDouble xy = x*y;
+			x = x*x-y*y+cr;
+			y = xy+xy+ci;
+		}
+	};
+	Run(anchorX+DoubleDouble((double) refX*pixelSize), anchorY+DoubleDouble((double) refY*pixelSize));
+	criticalStart = (int) orbitX.size();
+	Run(DoubleDouble(), DoubleDouble());
+	orbitValid = true;
+}
+
+long long JuliaSet::ComputeTile(int tx, int ty, unsigned char *out) {
+	// out is the tile's first pixel, rows texWidth apart
+	int x0 = tx*tileSize, y0 = ty*tileSize;
+	long long total = 0;
+	if (Deep()) {
+		Orbit o = { orbitX.data(), orbitY.data(), criticalStart-1, (int) orbitX.size()-1, criticalStart };
+		vector<double> dx(tileSize);
+		for (int i = 0; i < tileSize; i++)
+			dx[i] = (x0+i-refX)*pixelSize;
+		for (int j = 0; j < tileSize; j++, out += texWidth) {
+			double dy = (y0+j-refY)*pixelSize;
+#ifdef JULIA_SSE
+			if (simd) {
+				total += PerturbSpan<DoubleLanes>(dx.data(), dy, o, maxIterations, out, tileSize);
+				continue;
+			}
+#endif
+			total += PerturbSpan(dx.data(), dy, o, maxIterations, out, tileSize);
+		}
+		return total;
+	}
+	vector<float> x(tileSize);
+	for (int i = 0; i < tileSize; i++)
+		x[i] = (float) (anchorX.Value()+(x0+i)*pixelSize);
+	for (int j = 0; j < tileSize; j++, out += texWidth) {
+		float y = (float) (anchorY.Value()+(y0+j)*pixelSize);
+#ifdef JULIA_SSE
+		if (simd) {
+			total += DirectSpan<FloatLanes>(x.data(), y, (float) cReal, (float) cImag, maxIterations, out, tileSize);
+			continue;
+		}
+#endif
+		total += DirectSpan(x.data(), y, (float) cReal, (float) cImag, maxIterations, out, tileSize);
+	}
+	return total;
+}
+
+int JuliaSet::Update(double maxSeconds) {
+	auto start = std::chrono::steady_clock::now();
+	tilesComputed = 0;
+	iterations = 0;
+	seconds = 0;
+	if (slots.empty())
+		return 0;
+	if (Deep() && !orbitValid)
+		ComputeOrbit();
+	// tiles in view not held by their slots, nearest the window center first
+	struct Tile { int tx, ty, slot; float d; };
+	vector<Tile> missing;
+	float cx = originX+.5f*width, cy = originY+.5f*height;
+	for (int ty = FloorDiv(originY, tileSize); ty <= FloorDiv(originY+height-1, tileSize); ty++)
+		for (int tx = FloorDiv(originX, tileSize); tx <= FloorDiv(originX+width-1, tileSize); tx++) {
+			int slot = Mod(tx, nSlotsX)+nSlotsX*Mod(ty, nSlotsY);
+			Slot &s = slots[slot];
+			if (s.valid && s.tx == tx && s.ty == ty)
+				continue;
+			float dx = (tx+.5f)*tileSize-cx, dy = (ty+.5f)*tileSize-cy;
+			missing.push_back({tx, ty, slot, dx*dx+dy*dy});
+		}
+	std::sort(missing.begin(), missing.end(), [](const Tile &a, const Tile &b) { return a.d < b.d; });
+	JobSystem &jobs = GetJobSystem();
+	int batch = 2*jobs.NWorkers();
+	vector<long long> counts(jobs.NWorkers(), 0);
+	size_t next = 0;
+	while (next < missing.size()) {
+		int n = (int) std::min((size_t) batch, missing.size()-next);
+		jobs.ParallelFor(n, 1, [&](int b0, int b1, int worker) {
+			for (int b = b0; b < b1; b++) {
+				const Tile &t = missing[next+b];
+				size_t sx = t.slot%nSlotsX, sy = t.slot/nSlotsX;
+				counts[worker] += ComputeTile(t.tx, t.ty, &pixels[sy*tileSize*texWidth+sx*tileSize]);
+			}
+		});
+		for (int b = 0; b < n; b++) {
+			const Tile &t = missing[next+b];
+			Slot &s = slots[t.slot];
+			s.tx = t.tx;
+			s.ty = t.ty;
+			s.valid = true;
+			changed.push_back(t.slot);
+		}
+		next += n;
+		tilesComputed += n;
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+		if (maxSeconds > 0 && seconds >= maxSeconds)
+			break;
+	}
+	for (long long c : counts)
+		iterations += c;
+	return (int) (missing.size()-next);
+}
+
+void JuliaSet::Display() {
+	if (!program) {
+		program = LinkProgramViaCode(&vShader, &pShader);
+		glGenVertexArrays(1, &vao);
+	}
+	if (!texture) {
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, texWidth, texHeight, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		changed.clear();
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	if (!changed.empty()) {
+		// each tile straight from the pixel copy: rows are texWidth apart
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, texWidth);
+		for (int slot : changed) {
+			int x = (slot%nSlotsX)*tileSize, y = (slot/nSlotsX)*tileSize;
+			glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, tileSize, tileSize, GL_RED, GL_UNSIGNED_BYTE, &pixels[(size_t) y*texWidth+x]);
+		}
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		changed.clear();
+	}
+	glUseProgram(program);
+	SetUniform(program, "tiles", 0);
+	glUniform2i(glGetUniformLocation(program, "shift"), Mod(originX, texWidth), Mod(originY, texHeight));
+	glUniform2i(glGetUniformLocation(program, "size"), texWidth, texHeight);
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glBindVertexArray(0);
+}
@@ -0,0 +1,408 @@
+// GLState.cpp - cache of GL state installed in the glad entry points
+
+#include <glad.h>
+#include <stdio.h>
+#include "GLState.h"
+
+namespace {
+
+const GLuint Unknown = ~0u;
+const int NUnits = 32;					// texture units tracked; higher units pass through
+
+const GLenum textureTargets[] = { GL_TEXTURE_1D, GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY,
+								  GL_TEXTURE_BUFFER, GL_TEXTURE_2D_MULTISAMPLE, GL_TEXTURE_RECTANGLE };
+const GLenum bufferTargets[] = { GL_ARRAY_BUFFER, GL_TEXTURE_BUFFER, GL_DRAW_INDIRECT_BUFFER, GL_PIXEL_PACK_BUFFER,
+								 GL_PIXEL_UNPACK_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER };
+const GLenum capabilities[] = { GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST, GL_MULTISAMPLE,
+								GL_PROGRAM_POINT_SIZE, GL_POLYGON_OFFSET_FILL, GL_PRIMITIVE_RESTART, GL_FRAMEBUFFER_SRGB,
+								GL_LINE_SMOOTH, 0x0B10, 0x8861 };	// GL_POINT_SMOOTH, GL_POINT_SPRITE (compatibility)
+const int NTargets = sizeof(textureTargets)/sizeof(GLenum), NBuffers = sizeof(bufferTargets)/sizeof(GLenum);
+const int NCapabilities = sizeof(capabilities)/sizeof(GLenum);
+
+const char *callNames[] = { "program", "vertex array", "buffer", "active texture", "texture", "enable/disable",
+							"blend", "depth", "point/line size", "viewport", "query" };
+
+struct State {
+	GLuint program, vertexArray, activeUnit, buffers[NBuffers], textures[NUnits][NTargets];
+	int enabled[NCapabilities];			// 0, 1, or -1 if unknown
+	GLenum blendSrc, blendDst, depthFunc;
+	int depthMask;
+	float pointSize, lineWidth;
+	GLint viewport[4];
+	bool viewportKnown;
+	void Forget() {
+		program = vertexArray = activeUnit = blendSrc = blendDst = depthFunc = Unknown;
+		for (int b = 0; b < NBuffers; b++)
+			buffers[b] = Unknown;
+		for (int u = 0; u < NUnits; u++)
+			for (int t = 0; t < NTargets; t++)
+				textures[u][t] = Unknown;
+		for (int c = 0; c < NCapabilities; c++)
+			enabled[c] = -1;
+		depthMask = -1;
+		pointSize = lineWidth = -1;
+		viewportKnown = false;
+	}
+} state;
+
+bool caching = true;
+GLStateStats stats, totals;
+
+// GL entry points, as loaded by glad
+PFNGLUSEPROGRAMPROC realUseProgram;
+PFNGLBINDVERTEXARRAYPROC realBindVertexArray;
+PFNGLDELETEVERTEXARRAYSPROC realDeleteVertexArrays;
+PFNGLBINDBUFFERPROC realBindBuffer;
+PFNGLDELETEBUFFERSPROC realDeleteBuffers;
+PFNGLACTIVETEXTUREPROC realActiveTexture;
+PFNGLBINDTEXTUREPROC realBindTexture;
+PFNGLDELETETEXTURESPROC realDeleteTextures;
+PFNGLBINDTEXTUREUNITPROC realBindTextureUnit;
+PFNGLBINDTEXTURESPROC realBindTextures;
+PFNGLENABLEPROC realEnable;
+PFNGLDISABLEPROC realDisable;
+PFNGLISENABLEDPROC realIsEnabled;
+PFNGLENABLEIPROC realEnablei;
+PFNGLDISABLEIPROC realDisablei;
+PFNGLBLENDFUNCPROC realBlendFunc;
+PFNGLBLENDFUNCSEPARATEPROC realBlendFuncSeparate;
+PFNGLBLENDFUNCIPROC realBlendFunci;
+PFNGLBLENDFUNCSEPARATEIPROC realBlendFuncSeparatei;
+PFNGLDEPTHFUNCPROC realDepthFunc;
+PFNGLDEPTHMASKPROC realDepthMask;
+PFNGLPOINTSIZEPROC realPointSize;
+PFNGLLINEWIDTHPROC realLineWidth;
+PFNGLVIEWPORTPROC realViewport;
+PFNGLGETINTEGERVPROC realGetIntegerv;
+
+bool Skip(GLStateCall c, bool same) {
+	// count call; true if redundant and caching
+	stats.calls[(int) c]++;
+	totals.calls[(int) c]++;
+	if (same && caching) {
+		stats.skipped[(int) c]++;
+		totals.skipped[(int) c]++;
+		return true;
+	}
+	return false;
+}
+
+int Index(const GLenum *list, int n, GLenum e) {
+	for (int i = 0; i < n; i++)
+		if (list[i] == e)
+			return i;
+	return -1;
+}
+
+// Bindings
+
+void APIENTRY UseProgram(GLuint program) {
+	if (Skip(GLStateCall::Program, program == state.program))
+		return;
+	state.program = program;
+	realUseProgram(program);
+}
+
+void APIENTRY BindVertexArray(GLuint array) {
+	if (Skip(GLStateCall::VertexArray, array == state.vertexArray))
+		return;
+	state.vertexArray = array;
+	realBindVertexArray(array);
+}
+
+void APIENTRY DeleteVertexArrays(GLsizei n, const GLuint *arrays) {
+	for (int i = 0; i < n; i++)
+		if (arrays[i] && arrays[i] == state.vertexArray)
+			state.vertexArray = 0;				// deleting the bound array binds 0
+	realDeleteVertexArrays(n, arrays);
+}
+
+void APIENTRY BindBuffer(GLenum target, GLuint buffer) {
+	int b = Index(bufferTargets, NBuffers, target);
+	if (Skip(GLStateCall::Buffer, b >= 0 && buffer == state.buffers[b]))
+		return;
+	if (b >= 0)
+		state.buffers[b] = buffer;
+	realBindBuffer(target, buffer);
+}
+
+void APIENTRY DeleteBuffers(GLsizei n, const GLuint *buffers) {
+	for (int i = 0; i < n; i++)
+		for (int b = 0; b < NBuffers; b++)
+			if (buffers[i] && buffers[i] == state.buffers[b])
+				state.buffers[b] = 0;
+	realDeleteBuffers(n, buffers);
+}
+
+void APIENTRY ActiveTexture(GLenum texture) {
+	GLuint unit = texture-GL_TEXTURE0;
+	if (Skip(GLStateCall::ActiveTexture, unit == state.activeUnit))
+		return;
+	state.activeUnit = unit;
+	realActiveTexture(texture);
+}
+
+void APIENTRY BindTexture(GLenum target, GLuint texture) {
+	int t = Index(textureTargets, NTargets, target);
+	GLuint unit = state.activeUnit;
+	bool tracked = t >= 0 && unit < (GLuint) NUnits;
+	if (Skip(GLStateCall::Texture, tracked && texture == state.textures[unit][t]))
+		return;
+	if (tracked)
+		state.textures[unit][t] = texture;
+	realBindTexture(target, texture);
+}
+
+void APIENTRY DeleteTextures(GLsizei n, const GLuint *textures) {
+	for (int i = 0; i < n; i++)
+		for (int u = 0; u < NUnits; u++)
+			for (int t = 0; t < NTargets; t++)
+				if (textures[i] && textures[i] == state.textures[u][t])
+					state.textures[u][t] = 0;
+	realDeleteTextures(n, textures);
+}
+
+void ForgetUnits(GLuint first, GLsizei count) {
+	for (GLuint u = first; u < first+count && u < (GLuint) NUnits; u++)
+		for (int t = 0; t < NTargets; t++)
+			state.textures[u][t] = Unknown;
+}
+
+void APIENTRY BindTextureUnit(GLuint unit, GLuint texture) {
+	ForgetUnits(unit, 1);						// target of texture not known here
+	realBindTextureUnit(unit, texture);
+}
+
+void APIENTRY BindTextures(GLuint first, GLsizei count, const GLuint *textures) {
+	ForgetUnits(first, count);
+	realBindTextures(first, count, textures);
+}
+
+// Capabilities
+
+void SetCapability(GLenum cap, bool on) {
+	int c = Index(capabilities, NCapabilities, cap);
+	if (Skip(GLStateCall::Capability, c >= 0 && state.enabled[c] == (on? 1 : 0)))
+		return;
+	if (c >= 0)
+		state.enabled[c] = on? 1 : 0;
+	if (on)
+		realEnable(cap);
+	else
+		realDisable(cap);
+}
+
+void APIENTRY Enable(GLenum cap) { SetCapability(cap, true); }
+
+void APIENTRY Disable(GLenum cap) { SetCapability(cap, false); }
+
+GLboolean APIENTRY IsEnabled(GLenum cap) {
+	int c = Index(capabilities, NCapabilities, cap);
+	if (c >= 0 && Skip(GLStateCall::Query, state.enabled[c] >= 0))
+		return state.enabled[c] == 1;
+	GLboolean on = realIsEnabled(cap);
+	if (c >= 0)
+		state.enabled[c] = on? 1 : 0;
+	return on;
+}
+
+void APIENTRY Enablei(GLenum cap, GLuint index) {
+	int c = Index(capabilities, NCapabilities, cap);
+	if (c >= 0)
+		state.enabled[c] = -1;					// per draw buffer, no longer one value
+	realEnablei(cap, index);
+}
+
+void APIENTRY Disablei(GLenum cap, GLuint index) {
+	int c = Index(capabilities, NCapabilities, cap);
+	if (c >= 0)
+		state.enabled[c] = -1;
+	realDisablei(cap, index);
+}
+
+// Blend, depth, sizes, viewport
+
+void APIENTRY BlendFunc(GLenum src, GLenum dst) {
+	if (Skip(GLStateCall::Blend, src == state.blendSrc && dst == state.blendDst))
+		return;
+	state.blendSrc = src;
+	state.blendDst = dst;
+	realBlendFunc(src, dst);
+}
+
+void APIENTRY BlendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha) {
+	state.blendSrc = state.blendDst = Unknown;
+	realBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+}
+
+void APIENTRY BlendFunci(GLuint buf, GLenum src, GLenum dst) {
+	state.blendSrc = state.blendDst = Unknown;
+	realBlendFunci(buf, src, dst);
+}
+
+void APIENTRY BlendFuncSeparatei(GLuint buf, GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha) {
+	state.blendSrc = state.blendDst = Unknown;
+	realBlendFuncSeparatei(buf, srcRGB, dstRGB, srcAlpha, dstAlpha);
+}
+
+void APIENTRY DepthFunc(GLenum func) {
+	if (Skip(GLStateCall::Depth, func == state.depthFunc))
+		return;
+	state.depthFunc = func;
+	realDepthFunc(func);
+}
+
+void APIENTRY DepthMask(GLboolean flag) {
+	if (Skip(GLStateCall::Depth, state.depthMask == (flag? 1 : 0)))
+		return;
+	state.depthMask = flag? 1 : 0;
+	realDepthMask(flag);
+}
+
+void APIENTRY PointSize(GLfloat size) {
+	if (Skip(GLStateCall::Size, size == state.pointSize))
+		return;
+	state.pointSize = size;
+	realPointSize(size);
+}
+
+void APIENTRY LineWidth(GLfloat width) {
+	if (Skip(GLStateCall::Size, width == state.lineWidth))
+		return;
+	state.lineWidth = width;
+	realLineWidth(width);
+}
+
+void APIENTRY Viewport(GLint x, GLint y, GLsizei w, GLsizei h) {
+	GLint *v = state.viewport;
+	if (Skip(GLStateCall::Viewport, state.viewportKnown && v[0] == x && v[1] == y && v[2] == w && v[3] == h))
+		return;
+	v[0] = x; v[1] = y; v[2] = w; v[3] = h;
+	state.viewportKnown = true;
+	realViewport(x, y, w, h);
+}
+
+// Queries
+
+void APIENTRY GetIntegerv(GLenum pname, GLint *data) {
+	// answer from cache if known, else query GL and remember
+	GLuint *cached = NULL;
+	switch (pname) {
+		case GL_CURRENT_PROGRAM: cached = &state.program; break;
+		case GL_VERTEX_ARRAY_BINDING: cached = &state.vertexArray; break;
+		case GL_ARRAY_BUFFER_BINDING: cached = &state.buffers[0]; break;
+		case GL_PIXEL_PACK_BUFFER_BINDING: cached = &state.buffers[3]; break;
+		case GL_PIXEL_UNPACK_BUFFER_BINDING: cached = &state.buffers[4]; break;
+		case GL_ACTIVE_TEXTURE: {
+			if (Skip(GLStateCall::Query, state.activeUnit != Unknown)) {
+				*data = GL_TEXTURE0+state.activeUnit;
+				return;
+			}
+			realGetIntegerv(pname, data);
+			state.activeUnit = *data-GL_TEXTURE0;
+			return;
+		}
+		case GL_TEXTURE_BINDING_2D:
+			if (state.activeUnit < (GLuint) NUnits)
+				cached = &state.textures[state.activeUnit][1];
+			break;
+		case GL_VIEWPORT:
+			if (Skip(GLStateCall::Query, state.viewportKnown)) {
+				for (int i = 0; i < 4; i++)
+					data[i] = state.viewport[i];
+				return;
+			}
+			realGetIntegerv(pname, state.viewport);
+			state.viewportKnown = true;
+			for (int i = 0; i < 4; i++)
+				data[i] = state.viewport[i];
+			return;
+		default:
+			realGetIntegerv(pname, data);
+			return;
+	}
+	if (cached && Skip(GLStateCall::Query, *cached != Unknown)) {
+		*data = (GLint) *cached;
+		return;
+	}
+	realGetIntegerv(pname, data);
+	if (cached)
+		*cached = (GLuint) *data;
+}
+
+template<class F> void Hook(F &entry, F &real, F cached) {
+	// redirect entry to cached, unless already (as when InitGLState is called twice without a reload)
+	if (entry && entry != cached) {
+		real = entry;
+		entry = cached;
+	}
+}
+
+} // end namespace
+
+void InitGLState() {
+	Hook(glad_glUseProgram, realUseProgram, UseProgram);
+	Hook(glad_glBindVertexArray, realBindVertexArray, BindVertexArray);
+	Hook(glad_glDeleteVertexArrays, realDeleteVertexArrays, DeleteVertexArrays);
+	Hook(glad_glBindBuffer, realBindBuffer, BindBuffer);
+	Hook(glad_glDeleteBuffers, realDeleteBuffers, DeleteBuffers);
+	Hook(glad_glActiveTexture, realActiveTexture, ActiveTexture);
+	Hook(glad_glBindTexture, realBindTexture, BindTexture);
+	Hook(glad_glDeleteTextures, realDeleteTextures, DeleteTextures);
+	Hook(glad_glBindTextureUnit, realBindTextureUnit, BindTextureUnit);
+	Hook(glad_glBindTextures, realBindTextures, BindTextures);
+	Hook(glad_glEnable, realEnable, Enable);
+	Hook(glad_glDisable, realDisable, Disable);
+	Hook(glad_glIsEnabled, realIsEnabled, IsEnabled);
+	Hook(glad_glEnablei, realEnablei, Enablei);
+	Hook(glad_glDisablei, realDisablei, Disablei);
+	Hook(glad_glBlendFunc, realBlendFunc, BlendFunc);
+	Hook(glad_glBlendFuncSeparate, realBlendFuncSeparate, BlendFuncSeparate);
+	Hook(glad_glBlendFunci, realBlendFunci, BlendFunci);
+	Hook(glad_glBlendFuncSeparatei, realBlendFuncSeparatei, BlendFuncSeparatei);
+	Hook(glad_glDepthFunc, realDepthFunc, DepthFunc);
+	Hook(glad_glDepthMask, realDepthMask, DepthMask);
+	Hook(glad_glPointSize, realPointSize, PointSize);
+	Hook(glad_glLineWidth, realLineWidth, LineWidth);
+	Hook(glad_glViewport, realViewport, Viewport);
+	Hook(glad_glGetIntegerv, realGetIntegerv, GetIntegerv);
+	state.Forget();
+}
+
+void InvalidateGLState() { state.Forget(); }
+
+void SetGLStateCaching(bool on) {
+	caching = on;
+	if (!on)
+		state.Forget();
+}
+
+GLStateStats GetGLStateStats(bool reset) {
+	GLStateStats s = stats;
+	if (reset)
+		stats = GLStateStats();
+	return s;
+}
+
+GLStateStats GetGLStateTotals() { return totals; }
+
+int GLStateStats::Calls() {
+	int n = 0;
+	for (int i = 0; i < (int) GLStateCall::Count; i++)
+		n += calls[i];
+	return n;
+}
+
+int GLStateStats::Skipped() {
+	int n = 0;
+	for (int i = 0; i < (int) GLStateCall::Count; i++)
+		n += skipped[i];
+	return n;
+}
+
+void GLStateStats::Print(const char *title) {
+	printf("%s%s%i state calls, %i skipped\n", title? title : "", title? ": " : "", Calls(), Skipped());
+	for (int i = 0; i < (int) GLStateCall::Count; i++)
+		if (calls[i])
+			printf("  %-16s %7i calls %7i skipped\n", callNames[i], calls[i], skipped[i]);
+}
@@ -2,8 +2,13 @@
 
 #include <glad.h>
 #include "GLXtras.h"
+#include "GLState.h"
+#include "RenderStats.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <map>
+#include <string>
 #include <vector>
 
 namespace {
@@ -76,13 +81,17 @@ GLFWwindow *InitGLFW(int x, int y, int width, int height, const char *title, boo
 		glfwMakeContextCurrent(w);
 		glfwSwapInterval(1);
 		gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
+		InitGLState();
+		InitRenderStats();
 	}
 	return w;
 }
 
 vec2 MouseCoords() {
-	// return mouse coords wrt lower left
+	// return mouse coords wrt lower left (origin if no window, as when headless)
 	double x, y;
+	if (!w)
+		return vec2(0, 0);
 	glfwGetCursorPos(w, &x, &y);
 #ifdef __APPLE__
 	// compensate for "retina coordinates"
@@ -279,17 +288,228 @@ GLuint CompileShaderViaCode(const char **code, GLint type) {
 	return shader;
 }
 
+// Program Cache
+
+namespace {
+
+std::string programCacheName = "ProgramCache.bin";
+bool programCacheLoaded = false, programCacheDirty = false, programCacheAtExit = false;
+std::string programCacheDriver;			// DriverId() when the dirty entries were stored (no context at exit)
+const int MaxCachedPrograms = 256;		// beyond this, least recently stored binaries are dropped
+unsigned long long programCacheStamp = 0;
+
+struct ProgramBinary {
+	GLenum format = 0;
+	unsigned long long stamp = 0;		// order stored
+	std::vector<unsigned char> data;
+};
+
+std::map<unsigned long long, ProgramBinary> programCache;
+
+unsigned long long Hash(unsigned long long h, const void *bytes, size_t n) {
+	// 64-bit FNV-1a
+	const unsigned char *b = (const unsigned char *) bytes;
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ b[i])*1099511628211ull;
+	return h;
+}
+
+unsigned long long Hash(unsigned long long h, const char *s) {
+	return s? Hash(h, s, strlen(s)+1) : h;
+}
+
+unsigned long long ProgramKey(int nStages, const char ***code, const GLenum *types) {
+	// hash driver identity and all stage sources (by stage type, so swapped stages differ)
+	unsigned long long h = 14695981039346656037ull;
+	h = Hash(h, (const char *) glGetString(GL_VENDOR));
+	h = Hash(h, (const char *) glGetString(GL_RENDERER));
+	h = Hash(h, (const char *) glGetString(GL_VERSION));
+	for (int i = 0; i < nStages; i++)
+		if (code[i]) {
+			h = Hash(h, &types[i], sizeof(GLenum));
+			h = Hash(h, *code[i]);
+		}
+	return h;
+}
+
+std::string DriverId() {
+	const char *s[] = { (const char *) glGetString(GL_VENDOR), (const char *) glGetString(GL_RENDERER),
+						(const char *) glGetString(GL_VERSION) };
+	std::string id;
+	for (const char *c : s)
+		id += std::string(c? c : "")+"\n";
+	return id;
+}
+
+bool ProgramCacheEnabled() {
+	if (programCacheName.empty())
+		return false;
+	GLint nFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats);
+	return nFormats > 0;
+}
+
+void LoadProgramCache() {
+	// file is a header (magic, driver id length, driver id) then a sequence of entries: key, binary format, size, binary
+	// a file written by another driver is ignored, and replaced on the next store
+	programCacheLoaded = true;
+	FILE *in = fopen(programCacheName.c_str(), "rb");
+	if (!in)
+		return;
+	char magic[4];
+	int idLength = 0;
+	std::string id = DriverId(), fileId;
+	bool ok = fread(magic, 4, 1, in) == 1 && !strncmp(magic, "PGC1", 4) &&
+			  fread(&idLength, sizeof(idLength), 1, in) == 1 && idLength == (int) id.size();
+	if (ok) {
+		fileId.resize(idLength);
+		ok = fread(&fileId[0], 1, idLength, in) == (size_t) idLength && fileId == id;
+	}
+	unsigned long long key;
+	GLenum format;
+	int size;
+	while (ok && fread(&key, sizeof(key), 1, in) == 1 && fread(&format, sizeof(format), 1, in) == 1 &&
+		   fread(&size, sizeof(size), 1, in) == 1 && size > 0) {
+		ProgramBinary &b = programCache[key];
+		b.format = format;
+		b.stamp = ++programCacheStamp;
+		b.data.resize(size);
+		if (fread(b.data.data(), 1, size, in) != (size_t) size) {
+			programCache.erase(key);
+			break;
+		}
+	}
+	fclose(in);
+}
+
+GLuint ReadCachedProgram(unsigned long long key) {
+	if (!programCacheLoaded)
+		LoadProgramCache();
+	auto it = programCache.find(key);
+	if (it == programCache.end())
+		return 0;
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, it->second.format, it->second.data.data(), (GLsizei) it->second.data.size());
+	GLint status;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE) {
+		// driver rejected binary (eg, updated driver with same version string): recompile
+		glDeleteProgram(program);
+		programCache.erase(it);
+		return 0;
+	}
+	return program;
+}
+
+void SaveProgramCache() {
+	// rewrite the file from the in-memory cache, via a temporary so a failed write keeps the old file
+	std::string temp = programCacheName+".tmp", &id = programCacheDriver;
+	FILE *out = fopen(temp.c_str(), "wb");
+	if (!out) {
+		printf("can't write %s\n", temp.c_str());
+		return;
+	}
+	int idLength = (int) id.size();
+	bool ok = fwrite("PGC1", 4, 1, out) == 1 && fwrite(&idLength, sizeof(idLength), 1, out) == 1 &&
+			  fwrite(id.data(), 1, idLength, out) == (size_t) idLength;
+	for (auto &e : programCache) {
+		int size = (int) e.second.data.size();
+		ok = ok && fwrite(&e.first, sizeof(e.first), 1, out) == 1 &&
+			 fwrite(&e.second.format, sizeof(e.second.format), 1, out) == 1 &&
+			 fwrite(&size, sizeof(size), 1, out) == 1 &&
+			 fwrite(e.second.data.data(), 1, size, out) == (size_t) size;
+	}
+	fclose(out);
+	remove(programCacheName.c_str());
+	if (!ok || rename(temp.c_str(), programCacheName.c_str()) != 0) {
+		printf("can't write %s\n", programCacheName.c_str());
+		remove(temp.c_str());
+	}
+}
+
+void WriteCachedProgram(unsigned long long key, GLuint program) {
+	GLint status = GL_FALSE, size = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (status == GL_FALSE || size <= 0)
+		return;
+	ProgramBinary &b = programCache[key];
+	b.stamp = ++programCacheStamp;
+	b.data.resize(size);
+	glGetProgramBinary(program, size, NULL, &b.format, b.data.data());
+	while ((int) programCache.size() > MaxCachedPrograms) {
+		auto oldest = programCache.begin();
+		for (auto it = programCache.begin(); it != programCache.end(); it++)
+			if (it->second.stamp < oldest->second.stamp)
+				oldest = it;
+		programCache.erase(oldest);
+	}
+	// written once, by FlushProgramCache, rather than per program
+	programCacheDriver = DriverId();
+	programCacheDirty = true;
+	if (!programCacheAtExit) {
+		atexit(FlushProgramCache);
+		programCacheAtExit = true;
+	}
+}
+
+GLuint LinkCachedProgram(int nStages, const char ***code, const GLenum *types) {
+	// load from cache if valid, else compile, link, and cache
+	bool cache = ProgramCacheEnabled();
+	unsigned long long key = cache? ProgramKey(nStages, code, types) : 0;
+	GLuint program = cache? ReadCachedProgram(key) : 0;
+	if (program)
+		return program;
+	GLuint shaders[5] = {0, 0, 0, 0, 0};
+	bool ok = true;
+	for (int i = 0; i < nStages; i++)
+		if (code[i]) {
+			shaders[i] = CompileShaderViaCode(code[i], types[i]);
+			ok = ok && shaders[i] > 0;
+		}
+	if (ok) {
+		program = glCreateProgram();
+		if (cache)
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		for (int i = 0; i < nStages; i++)
+			if (shaders[i]) glAttachShader(program, shaders[i]);
+		glLinkProgram(program);
+		GLint status;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status == GL_FALSE)
+			PrintProgramLog(program);
+		else if (cache)
+			WriteCachedProgram(key, program);
+	}
+	for (int i = 0; i < nStages; i++)
+		if (shaders[i]) {
+			if (program) glDetachShader(program, shaders[i]);
+			glDeleteShader(shaders[i]);
+		}
+	return program;
+}
+
+} // end namespace
+
+void FlushProgramCache() {
+	if (programCacheDirty && !programCacheName.empty())
+		SaveProgramCache();
+	programCacheDirty = false;
+}
+
+void SetProgramCache(const char *filename) {
+	FlushProgramCache();
+	programCacheName = filename? filename : "";
+	programCache.clear();
+	programCacheLoaded = false;
+}
+
 // Linking
 
 GLuint LinkProgramViaCode(const char **vertexCode, const char **pixelCode) {
-	GLuint vshader = CompileShaderViaCode(vertexCode, GL_VERTEX_SHADER);
-	GLuint pshader = CompileShaderViaCode(pixelCode, GL_FRAGMENT_SHADER);
-	GLuint p = LinkProgram(vshader, pshader);
-	glDetachShader(p, vshader);
-	glDetachShader(p, pshader);
-	glDeleteShader(vshader);
-	glDeleteShader(pshader);
-	return p;
+	const char **code[] = { vertexCode, pixelCode };
+	GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	return LinkCachedProgram(2, code, types);
 }
 
 GLuint LinkProgramViaCode(const char **vertexCode,
@@ -297,18 +517,16 @@ GLuint LinkProgramViaCode(const char **vertexCode,
 						  const char **tessellationEvalCode,
 						  const char **geometryCode,
 						  const char **pixelCode) {
-	GLuint vshader = CompileShaderViaCode(vertexCode, GL_VERTEX_SHADER);
-	GLuint tcshader = 0;
-	GLuint teshader = 0;
 #ifdef GL_TESS_EVALUATION_SHADER
-	if (tessellationControlCode)
-		tcshader = CompileShaderViaCode(tessellationControlCode, GL_TESS_CONTROL_SHADER);
-	if (tessellationEvalCode)
-		teshader = CompileShaderViaCode(tessellationEvalCode, GL_TESS_EVALUATION_SHADER);
-#endif
+	const char **code[] = { vertexCode, tessellationControlCode, tessellationEvalCode, geometryCode, pixelCode };
+	GLenum types[] = { GL_VERTEX_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
+	return LinkCachedProgram(5, code, types);
+#else
+	GLuint vshader = CompileShaderViaCode(vertexCode, GL_VERTEX_SHADER);
 	GLuint gshader = geometryCode? CompileShaderViaCode(geometryCode, GL_GEOMETRY_SHADER) : 0;
 	GLuint pshader = CompileShaderViaCode(pixelCode, GL_FRAGMENT_SHADER);
-	return LinkProgram(vshader, tcshader, teshader, gshader, pshader);
+	return LinkProgram(vshader, 0, 0, gshader, pshader);
+#endif
 }
 
 #ifndef __APPLE_
@@ -326,9 +544,9 @@ void LinkProgramViaCode(GLuint computeProgram, const char **computeCode) {
 }
 
 GLuint LinkProgramViaCode(const char **computeCode) {
-	GLuint computeProgram = glCreateProgram();
-	LinkProgramViaCode(computeProgram, computeCode);
-	return computeProgram;
+	const char **code[] = { computeCode };
+	GLenum types[] = { GL_COMPUTE_SHADER };
+	return LinkCachedProgram(1, code, types);
 }
 
 GLuint LinkProgramViaFile(const char *computeShaderFile) {
@@ -0,0 +1,334 @@
+// Headless.cpp - offscreen context and framebuffer, asynchronous readback
+
+#include <glad.h>
+#include <GLFW/glfw3.h>
+#include "GLState.h"
+#include "Headless.h"
+#include "RenderStats.h"
+#include "TextureStream.h"
+#include <future>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "stb_image_write.h"
+
+#if defined(__linux__) && !defined(HEADLESS_NO_EGL)
+#define HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+using std::string;
+using std::vector;
+
+namespace {
+
+GLFWwindow *window = NULL;
+bool egl = false;
+GLuint framebuffer = 0, color = 0, depth = 0;
+GLuint resolveFramebuffer = 0, resolveColor = 0;
+int fbWidth = 0, fbHeight = 0, fbSamples = 0;
+
+#ifdef HEADLESS_EGL
+EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+EGLContext eglContext = EGL_NO_CONTEXT;
+
+bool InitEGL() {
+	// surfaceless Mesa display: no X server or GPU needed (llvmpipe renders in software)
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (eglDisplay == EGL_NO_DISPLAY)
+		eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint major, minor, nConfigs = 0;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+		printf("InitHeadless: no EGL display\n");
+		return false;
+	}
+	EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = NULL;
+	eglChooseConfig(eglDisplay, configAttributes, &config, 1, &nConfigs);
+	eglBindAPI(EGL_OPENGL_API);
+	// compatibility profile, as the GLFW window context, else core
+	EGLint compatibility[] = { EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_NONE };
+	EGLint core[] = { EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 5,
+					  EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+	EGLConfig c = nConfigs? config : (EGLConfig) 0;		// EGL_NO_CONFIG_KHR
+	eglContext = eglCreateContext(eglDisplay, c, EGL_NO_CONTEXT, compatibility);
+	if (eglContext == EGL_NO_CONTEXT)
+		eglContext = eglCreateContext(eglDisplay, c, EGL_NO_CONTEXT, core);
+	if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+		printf("InitHeadless: can't create EGL context\n");
+		eglTerminate(eglDisplay);
+		eglDisplay = EGL_NO_DISPLAY;
+		return false;
+	}
+	return gladLoadGLLoader((GLADloadproc) eglGetProcAddress) != 0;
+}
+#endif
+
+bool InitWindow() {
+	// 1x1 hidden window: its default framebuffer is not used
+	if (!glfwInit())
+		return false;
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	window = glfwCreateWindow(1, 1, "", NULL, NULL);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	if (!window) {
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(window);
+	return gladLoadGLLoader((GLADloadproc) glfwGetProcAddress) != 0;
+}
+
+void Allocate(int width, int height) {
+	fbWidth = width;
+	fbHeight = height;
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, fbSamples, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, fbSamples, GL_DEPTH24_STENCIL8, width, height);
+	if (resolveColor) {
+		glBindRenderbuffer(GL_RENDERBUFFER, resolveColor);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+}
+
+} // end namespace
+
+// Offscreen context
+
+bool InitHeadless(int width, int height, int samples) {
+	if (Headless())
+		HeadlessShutdown();
+	egl = false;
+	if (!InitWindow()) {
+#ifdef HEADLESS_EGL
+		if (!InitEGL())
+			return false;
+		egl = true;
+#else
+		printf("InitHeadless: can't create hidden window\n");
+		return false;
+#endif
+	}
+	InitGLState();
+	InitRenderStats();
+	GLint maxSamples = 0;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	fbSamples = samples > 1? (samples < maxSamples? samples : maxSamples) : 0;
+	glGenRenderbuffers(1, &color);
+	glGenRenderbuffers(1, &depth);
+	glGenFramebuffers(1, &framebuffer);
+	if (fbSamples) {
+		glGenRenderbuffers(1, &resolveColor);
+		glGenFramebuffers(1, &resolveFramebuffer);
+	}
+	Allocate(width, height);
+	if (fbSamples) {
+		glBindFramebuffer(GL_FRAMEBUFFER, resolveFramebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveColor);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("InitHeadless: incomplete framebuffer\n");
+		HeadlessShutdown();
+		return false;
+	}
+	return true;
+}
+
+bool Headless() {
+	return framebuffer != 0;
+}
+
+bool HeadlessEGL() {
+	return Headless() && egl;
+}
+
+void HeadlessResize(int width, int height) {
+	if (Headless() && (width != fbWidth || height != fbHeight))
+		Allocate(width, height);
+}
+
+GLuint HeadlessFramebuffer() {
+	return framebuffer;
+}
+
+bool HeadlessResolve() {
+	if (!Headless() || !fbSamples)
+		return false;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFramebuffer);
+	glBlitFramebuffer(0, 0, fbWidth, fbHeight, 0, 0, fbWidth, fbHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFramebuffer);
+	return true;
+}
+
+void HeadlessShutdown() {
+	if (!framebuffer && !window && !egl)
+		return;
+	FinishReadbacks();
+	GetTextureStreamer().Release();
+	GLuint fbs[] = { framebuffer, resolveFramebuffer }, rbs[] = { color, depth, resolveColor };
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(2, fbs);
+	glDeleteRenderbuffers(3, rbs);
+	framebuffer = resolveFramebuffer = color = depth = resolveColor = 0;
+	if (window) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		window = NULL;
+	}
+#ifdef HEADLESS_EGL
+	if (egl) {
+		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(eglDisplay, eglContext);
+		eglTerminate(eglDisplay);
+		eglDisplay = EGL_NO_DISPLAY;
+		eglContext = EGL_NO_CONTEXT;
+	}
+#endif
+	egl = false;
+}
+
+// Asynchronous readback
+
+namespace {
+
+struct Readback {
+	GLuint buffer = 0;
+	GLsync fence = 0;
+	int width = 0, height = 0;
+	ReadbackCallback callback = NULL;
+	void *data = NULL;
+	string filename;						// if non-empty, write png rather than call back
+};
+
+const int MaxInFlight = 4;
+
+vector<Readback> inFlight;					// oldest first
+vector<GLuint> freeBuffers;
+vector<std::future<void>> writes;			// png files being written
+
+void Deliver(Readback &r) {
+	// map the pixel buffer, flip rows to top-down, hand on; recycle the buffer
+	int rowBytes = 3*r.width;
+	vector<unsigned char> pixels(rowBytes*r.height);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.buffer);
+	unsigned char *mapped = (unsigned char *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixels.size(), GL_MAP_READ_BIT);
+	if (mapped) {
+		for (int j = 0; j < r.height; j++)
+			memcpy(pixels.data()+j*rowBytes, mapped+(r.height-1-j)*rowBytes, rowBytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else
+		printf("PollReadbacks: can't map pixel buffer\n");
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glDeleteSync(r.fence);
+	freeBuffers.push_back(r.buffer);
+	if (!mapped)
+		return;
+	if (r.filename.empty()) {
+		r.callback(pixels.data(), r.width, r.height, r.data);
+		return;
+	}
+	// png compression is the costly part: off the render thread
+	int w = r.width, h = r.height;
+	string filename = r.filename;
+	writes.push_back(std::async(std::launch::async, [w, h, filename](vector<unsigned char> p) {
+		if (!stbi_write_png(filename.c_str(), w, h, 3, p.data(), 3*w))
+			printf("SavePngAsync: can't write %s\n", filename.c_str());
+	}, std::move(pixels)));
+}
+
+void Request(ReadbackCallback callback, void *data, const char *filename) {
+	if ((int) inFlight.size() >= MaxInFlight) {
+		// wait for the oldest only
+		Readback &r = inFlight[0];
+		glClientWaitSync(r.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		Deliver(r);
+		inFlight.erase(inFlight.begin());
+	}
+	Readback r;
+	GLint vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	r.width = vp[2];
+	r.height = vp[3];
+	r.callback = callback;
+	r.data = data;
+	if (filename)
+		r.filename = filename;
+	if (freeBuffers.empty())
+		glGenBuffers(1, &r.buffer);
+	else {
+		r.buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+	}
+	bool resolved = HeadlessResolve();
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.buffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, 3*r.width*r.height, NULL, GL_STREAM_READ);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(vp[0], vp[1], r.width, r.height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+		// into the buffer: returns once the copy is queued
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	if (resolved)
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+	inFlight.push_back(r);
+}
+
+} // end namespace
+
+void GetDataAsync(ReadbackCallback callback, void *data) {
+	if (callback)
+		Request(callback, data, NULL);
+}
+
+void SavePngAsync(const char *filename) {
+	Request(NULL, NULL, filename);
+}
+
+int PollReadbacks(bool wait) {
+	size_t n = 0;
+	for (; n < inFlight.size(); n++) {
+		Readback &r = inFlight[n];
+		GLenum status = wait?
+			glClientWaitSync(r.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED) :
+			glClientWaitSync(r.fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+			break;
+		Deliver(r);
+	}
+	inFlight.erase(inFlight.begin(), inFlight.begin()+n);
+	// forget finished writes
+	for (size_t i = 0; i < writes.size(); )
+		if (writes[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			writes[i] = std::move(writes.back());
+			writes.pop_back();
+		}
+		else
+			i++;
+	return (int) inFlight.size();
+}
+
+void FinishReadbacks() {
+	PollReadbacks(true);
+	for (std::future<void> &f : writes)
+		f.wait();
+	writes.clear();
+	if (!freeBuffers.empty())
+		glDeleteBuffers((GLsizei) freeBuffers.size(), freeBuffers.data());
+	freeBuffers.clear();
+}
@@ -0,0 +1,199 @@
+// Hierarchy.cpp - flattened transform hierarchy
+
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+#include "Hierarchy.h"
+#include "Jobs.h"
+#include "Mesh.h"
+
+namespace {
+
+const int ParallelLevel = 4096;		// split levels of at least this many nodes across the job system
+const int Grain = 1024;
+
+} // end namespace
+
+// Nodes
+
+int TransformHierarchy::Add(mat4 m, int parent, Mesh *mesh) {
+	int h = (int) slotOf.size(), s = (int) handleOf.size();
+	if (!freeHandles.empty()) {
+		h = freeHandles.back();
+		freeHandles.pop_back();
+	}
+	else {
+		slotOf.push_back(-1);
+		parentOf.push_back(-1);
+	}
+	slotOf[h] = s;
+	parentOf[h] = parent;
+	local.push_back(m);
+	world.push_back(ParentWorld(h)*m);
+	parentSlot.push_back(parent < 0? -1 : slotOf[parent]);
+	handleOf.push_back(h);
+	dirty.push_back(1);
+	meshes.push_back(mesh);
+	reorder = true;									// level order restored by next Update
+	MarkDirty(s);
+	return h;
+}
+
+int TransformHierarchy::Add(Mesh *mesh, int parent) {
+	int h = Add(mat4(), parent, mesh);
+	SetWorld(h, mesh->toWorld);
+	return h;
+}
+
+void TransformHierarchy::Remove(int node) {
+	if (reorder)
+		Reorder();
+	// nodes follow their parents, so one pass in slot order finds all descendants
+	vector<unsigned char> removed(handleOf.size(), 0);
+	removed[slotOf[node]] = 1;
+	for (size_t s = slotOf[node]+1; s < handleOf.size(); s++)
+		removed[s] = parentSlot[s] >= 0 && removed[parentSlot[s]];
+	for (size_t s = 0; s < handleOf.size(); s++)
+		if (removed[s]) {
+			int h = handleOf[s];
+			slotOf[h] = parentOf[h] = -1;
+			freeHandles.push_back(h);
+		}
+	Reorder();
+}
+
+bool TransformHierarchy::SetParent(int node, int parent, bool keepWorld) {
+	for (int p = parent; p >= 0; p = parentOf[p])
+		if (p == node) {
+			printf("SetParent: node %i can't be a child of its descendant %i\n", node, parent);
+			return false;
+		}
+	mat4 w = world[slotOf[node]];
+	parentOf[node] = parent;
+	parentSlot[slotOf[node]] = parent < 0? -1 : slotOf[parent];
+	if (keepWorld)
+		SetWorld(node, w);
+	MarkDirty(slotOf[node]);
+	reorder = true;
+	return true;
+}
+
+mat4 TransformHierarchy::ParentWorld(int node) {
+	return parentOf[node] < 0? mat4() : world[slotOf[parentOf[node]]];
+}
+
+void TransformHierarchy::SetLocal(int node, mat4 m) {
+	// world kept current too, so a child added or set before the next Update composes with it
+	local[slotOf[node]] = m;
+	world[slotOf[node]] = ParentWorld(node)*m;
+	MarkDirty(slotOf[node]);
+}
+
+void TransformHierarchy::SetWorld(int node, mat4 m) {
+	SetLocal(node, parentOf[node] < 0? m : Invert(ParentWorld(node))*m);
+}
+
+void TransformHierarchy::MarkDirty(int slot) {
+	dirty[slot] = 1;
+	firstDirty = std::min(firstDirty, slot);
+}
+
+// Order
+
+void TransformHierarchy::Reorder() {
+	// sort live nodes by depth (stable in handle), carrying slot data to the new order
+	int nHandles = (int) slotOf.size();
+	vector<int> depth(nHandles, -1), chain, count(1, 0);
+	for (int h = 0; h < nHandles; h++) {
+		if (slotOf[h] < 0)
+			continue;
+		int a = h;
+		chain.clear();
+		for (; a >= 0 && depth[a] < 0; a = parentOf[a])
+			chain.push_back(a);
+		int d = a < 0? -1 : depth[a];
+		for (int k = (int) chain.size()-1; k >= 0; k--)
+			depth[chain[k]] = ++d;
+		if (depth[h] >= (int) count.size())
+			count.resize(depth[h]+1, 0);
+		count[depth[h]]++;
+	}
+	levelStart.assign(count.size()+1, 0);
+	for (size_t d = 0; d < count.size(); d++)
+		levelStart[d+1] = levelStart[d]+count[d];
+	if (levelStart.back() == 0)
+		levelStart.clear();
+	vector<int> next(levelStart), order(levelStart.empty()? 0 : levelStart.back());
+	for (int h = 0; h < nHandles; h++)
+		if (slotOf[h] >= 0)
+			order[next[depth[h]]++] = h;
+	int n = (int) order.size();
+	vector<mat4> newLocal(n), newWorld(n);
+	vector<unsigned char> newDirty(n);
+	vector<Mesh *> newMeshes(n);
+	for (int s = 0; s < n; s++) {
+		int old = slotOf[order[s]];
+		newLocal[s] = local[old];
+		newWorld[s] = world[old];
+		newDirty[s] = dirty[old];
+		newMeshes[s] = meshes[old];
+	}
+	local.swap(newLocal);
+	world.swap(newWorld);
+	dirty.swap(newDirty);
+	meshes.swap(newMeshes);
+	handleOf = order;
+	for (int s = 0; s < n; s++)
+		slotOf[order[s]] = s;
+	parentSlot.resize(n);
+	firstDirty = n;
+	for (int s = 0; s < n; s++) {
+		int p = parentOf[order[s]];
+		parentSlot[s] = p < 0? -1 : slotOf[p];
+		if (dirty[s] && firstDirty == n)
+			firstDirty = s;
+	}
+	reorder = false;
+}
+
+// Update
+
+void TransformHierarchy::Update(bool parallel) {
+	if (reorder)
+		Reorder();
+	int n = (int) handleOf.size();
+	nUpdated = 0;
+	if (firstDirty >= n)
+		return;
+	std::atomic<int> updated{0};
+	// a node is recomputed if it or its parent is dirty; parents are in earlier levels, so already final
+	RangeKernel kernel = [this, &updated](int begin, int end, int) {
+		int count = 0;
+		for (int s = begin; s < end; s++) {
+			int p = parentSlot[s];
+			if (p >= 0 && dirty[p])
+				dirty[s] = 1;
+			if (dirty[s]) {
+				world[s] = p < 0? local[s] : world[p]*local[s];
+				if (meshes[s]) {
+					meshes[s]->toWorld = world[s];
+					meshes[s]->wrtParent = local[s];
+				}
+				count++;
+			}
+		}
+		updated += count;
+	};
+	for (int l = 0; l < NLevels(); l++) {
+		int begin = std::max(levelStart[l], firstDirty), end = levelStart[l+1];
+		if (begin >= end)
+			continue;
+		if (parallel && end-begin >= ParallelLevel)
+			GetJobSystem().ParallelFor(end-begin, Grain, [&kernel, begin](int b, int e, int w) { kernel(begin+b, begin+e, w); });
+		else
+			kernel(begin, end, 0);
+	}
+	std::fill(dirty.begin()+firstDirty, dirty.end(), 0);
+	firstDirty = n;
+	nUpdated = updated;
+}
@@ -1,7 +1,10 @@
 // IO.cpp (c) 2019-2022 Jules Bloomenthal
 
 #include "Draw.h"
+#include "Headless.h"
 #include "IO.h"
+#include "TextureStream.h"
+#include "VecMatBatch.h"
 #include <fstream>
 #include <string.h>
 
@@ -66,25 +69,39 @@ GLuint ReadTexture(const char *filename, bool mipmap, int *n, int *w, int *h) {
 	if (n) *n = nChannels;
 	if (w) *w = width;
 	if (h) *h = height;
+	MipPolicy mips = mipmap? MipPolicy::GPU : MipPolicy::None;
 	GLuint textureName = 0;
-	glGenTextures(1, &textureName);
-	LoadTexture(data, width, height, nChannels, textureName, false, mipmap);
+	if (QueuedTextureLoads()) {
+		vector<unsigned char> pixels(data, data+(size_t) width*height*nChannels);
+		textureName = GetTextureStreamer().Queue(pixels, width, height, nChannels, false, mips);
+	}
+	else
+		textureName = LoadTextureStorage(data, width, height, nChannels, false, mips);
 	stbi_image_free(data);
 	return textureName;
 }
 
 unsigned char *GetData(int &width, int &height) {
-	ViewportSize(width, height);
-	int npixels = width*height;
-	unsigned char *cPixels = new unsigned char[3*npixels], *c = cPixels;
-	float *fPixels = new float[3*npixels*sizeof(float)], *f = fPixels;
-	glReadPixels(0, 0, width, height, GL_BGR, GL_FLOAT, fPixels);   // Targa is BGR ordered
-	for (int i = 0; i < npixels; i++) {
-		*c++ = (unsigned char) (255.f*(*f++));
-		*c++ = (unsigned char) (255.f*(*f++));
-		*c++ = (unsigned char) (255.f*(*f++));
+	// viewport as rgb bytes, rows top-down (a multisampled headless buffer is resolved first)
+	int vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	width = vp[2];
+	height = vp[3];
+	int rowBytes = 3*width;
+	unsigned char *cPixels = new unsigned char[rowBytes*height], *row = new unsigned char[rowBytes];
+	bool resolved = HeadlessResolve();
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(vp[0], vp[1], width, height, GL_RGB, GL_UNSIGNED_BYTE, cPixels);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	if (resolved)
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, HeadlessFramebuffer());
+	for (int j = 0; j < height/2; j++) {
+		unsigned char *a = cPixels+j*rowBytes, *b = cPixels+(height-1-j)*rowBytes;
+		memcpy(row, a, rowBytes);
+		memcpy(a, b, rowBytes);
+		memcpy(b, row, rowBytes);
 	}
-	delete [] fPixels;
+	delete [] row;
 	return cPixels;
 }
 
@@ -103,48 +120,160 @@ void SaveBmp(const char *filename) {
 }
 
 void SaveTga(const char *filename) {
+	// stbi_write_tga swaps to bgr itself
 	int width, height;
 	unsigned char *cPixels = GetData(width, height);
 	stbi_write_tga(filename, width, height, 3, cPixels);
 	delete [] cPixels;
 }
 
-int ReadGIF(const char *filename, vector<GLuint> &textureNames, int *nChannels, vector<float> *frameDurations) {
+namespace {
+
+int GIFFrameCount(unsigned char *b, int n) {
+	// walk GIF blocks without decoding: count image descriptors
+	if (n < 13)
+		return 0;
+	int p = 13, nFrames = 0;
+	if (b[10] & 0x80)
+		p += 3*(2 << (b[10] & 7));						// global color table
+	while (p < n) {
+		unsigned char c = b[p++];
+		if (c == 0x21)									// extension: label, then sub-blocks
+			p++;
+		else if (c == 0x2C) {							// image descriptor
+			if (p+9 > n)
+				break;
+			int flags = b[p+8];
+			p += 9;
+			if (flags & 0x80)
+				p += 3*(2 << (flags & 7));				// local color table
+			p++;										// LZW minimum code size
+			nFrames++;
+		}
+		else											// trailer (0x3B) or corrupt
+			break;
+		while (p < n && b[p])
+			p += b[p]+1;
+		p++;
+	}
+	return nFrames;
+}
+
+} // end namespace
+
+int DecodeGIF(const char *filename, GIFFrameCallback callback, void *data, int *width, int *height) {
 	FILE *f = fopen(filename, "rb");
 	if (!f) {
 		printf("can't open %s\n", filename);
-		return false;
+		return 0;
 	}
+	fseek(f, 0, SEEK_END);
+	vector<unsigned char> file(ftell(f));
+	fseek(f, 0, SEEK_SET);
+	bool ok = fread(file.data(), 1, file.size(), f) == file.size();
+	fclose(f);
 	stbi__context s;
-	stbi__start_file(&s, f);
-	if (!stbi__gif_test(&s)) {
+	stbi__start_mem(&s, file.data(), (int) file.size());
+	if (!ok || !stbi__gif_test(&s)) {
 		printf("%s not GIF format\n", filename);
 		return 0;
 	}
-	int width = 0, height = 0, nFrames = 0, nChan = 0;
-	int *delays; // delay[i] is display time for frame[i], in 1/100ths (or 1/1000?) of a second
-	unsigned char *pdata = (unsigned char *) stbi__load_gif_main(&s, &delays, &width, &height, &nFrames, &nChan, 0);
-	fclose(f);
-	if (!pdata) {
+	int nFrames = GIFFrameCount(file.data(), (int) file.size()), frame = 0, comp = 0;
+	// decoder needs the frame before last (disposal method 3); keep two frames, not all
+	stbi__gif g;
+	memset(&g, 0, sizeof(g));
+	vector<unsigned char> history[2], flipped;
+	unsigned char *twoBack = NULL;
+	for (;;) {
+		unsigned char *u = stbi__gif_load_next(&s, &g, &comp, 0, twoBack);
+		if (!u || u == (unsigned char *) &s)
+			break;
+		int stride = 4*g.w*g.h;
+		if (width) *width = g.w;
+		if (height) *height = g.h;
+		vector<unsigned char> &h = history[frame%2];
+		h.assign(u, u+stride);
+		twoBack = frame > 0? history[(frame+1)%2].data() : NULL;
+		flipped = h;
+		stbi__vertical_flip(flipped.data(), g.w, g.h, 4);
+		callback(flipped.data(), g.w, g.h, frame, frame < nFrames? nFrames : frame+1, (float) g.delay/1000, data);
+		frame++;
+	}
+	STBI_FREE(g.out);
+	STBI_FREE(g.history);
+	STBI_FREE(g.background);
+	if (!frame)
 		printf("error reading %s (%s)\n", filename, stbi_failure_reason());
-		return 0;
+	return frame;
+}
+
+namespace {
+
+struct GIFTextures { vector<GLuint> *textureNames; vector<float> *frameDurations; };
+
+void GIFTexture(unsigned char *pixels, int width, int height, int, int, float duration, void *data) {
+	GIFTextures *t = (GIFTextures *) data;
+	if (QueuedTextureLoads()) {
+		vector<unsigned char> v(pixels, pixels+(size_t) width*height*4);
+		t->textureNames->push_back(GetTextureStreamer().Queue(v, width, height, 4, false, MipPolicy::GPU));
 	}
-	if (nChannels)
-		*nChannels = nChan;
-	if (frameDurations) {
-		frameDurations->resize(nFrames);
-		for (int i = 0; i < nFrames; i++)
-			(*frameDurations)[i] = (float) delays[i]/1000;
+	else
+		t->textureNames->push_back(LoadTextureStorage(pixels, width, height, 4, false, MipPolicy::GPU));
+	if (t->frameDurations)
+		t->frameDurations->push_back(duration);
+}
+
+struct GIFArray { GLuint arrayName; int nLayers; bool mipmap; vector<float> *frameDurations; };
+
+void GIFLayer(unsigned char *pixels, int width, int height, int frame, int nFrames, float duration, void *data) {
+	GIFArray *a = (GIFArray *) data;
+	if (!a->arrayName) {
+		int nLevels = a->mipmap? MipCount(width, height) : 1;
+		a->nLayers = nFrames;
+		glGenTextures(1, &a->arrayName);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, a->arrayName);
+		TextureStorage(GL_TEXTURE_2D_ARRAY, nLevels, GL_RGBA8, width, height, nFrames);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, a->mipmap? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	}
-	stbi__vertical_flip_slices(pdata, width, height, nFrames, nChan);
-	textureNames.resize(nFrames);
-	glGenTextures(nFrames, textureNames.data());
-	for (int i = 0; i < nFrames; i++) {
-		unsigned char *p = pdata+i*width*height*(*nChannels);
-		LoadTexture(p, width, height, *nChannels, textureNames[i], false, true);
+	if (frame < a->nLayers && QueuedTextureLoads()) {
+		vector<unsigned char> v(pixels, pixels+(size_t) width*height*4);
+		GetTextureStreamer().QueueLayer(a->arrayName, frame, v, width, height, 4, false, a->mipmap);
 	}
-	stbi_image_free(pdata);
-	return nFrames;
+	else if (frame < a->nLayers)
+		GetTextureStreamer().SubLayer(a->arrayName, frame, pixels, width, height, 4);
+	if (a->frameDurations)
+		a->frameDurations->push_back(duration);
+}
+
+} // end namespace
+
+int ReadGIF(const char *filename, vector<GLuint> &textureNames, int *nChannels, vector<float> *frameDurations) {
+	GIFTextures t = { &textureNames, frameDurations };
+	textureNames.resize(0);
+	if (frameDurations)
+		frameDurations->resize(0);
+	if (nChannels)
+		*nChannels = 4;
+	return DecodeGIF(filename, GIFTexture, &t);
+}
+
+GLuint ReadGIFArray(const char *filename, int *nFrames, vector<float> *frameDurations, bool mipmap) {
+	GIFArray a = { 0, 0, mipmap, frameDurations };
+	if (frameDurations)
+		frameDurations->resize(0);
+	int n = DecodeGIF(filename, GIFLayer, &a);
+	n = n < a.nLayers? n : a.nLayers;
+	if (frameDurations)
+		frameDurations->resize(n);
+	if (nFrames)
+		*nFrames = n;
+	if (a.arrayName && mipmap && !QueuedTextureLoads()) {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, a.arrayName);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return a.arrayName;
 }
 
 // Normals
@@ -181,14 +310,13 @@ mat4 NDCfromMinMax(vec3 min, vec3 max, float scale = 1) {
 
 mat4 StandardizeMat(vec3 *points, int npoints, float scale) {
 	vec3 min, max;
-	Bounds(points, npoints, min, max);
+	PointBounds(points, npoints, min, max);
 	return NDCfromMinMax(min, max, scale);
 }
 
 void Standardize(vec3 *points, int npoints, float scale) {
 	mat4 m = StandardizeMat(points, npoints, scale);
-	for (int i = 0; i < npoints; i++)
-		points[i] = Vec3(m*vec4(points[i]));
+	TransformPoints(m, points, points, npoints);
 }
 
 // ASCII support
@@ -351,14 +479,28 @@ MtlMap ReadMaterial(const char *filename) {
 			Lower(word);
 			if (!strcmp(word, "newmtl") && ReadWord(ptr, word, WordLim)) {
 				key = string(word);
+				value = Mtl();
 				value.name = string(word);
 			}
-			if (!strcmp(word, "kd")) {
-				if (sscanf(ptr, "%g%g%g", &value.kd.x, &value.kd.y, &value.kd.z) != 3)
+			vec3 *k = !strcmp(word, "ka")? &value.ka : !strcmp(word, "kd")? &value.kd : !strcmp(word, "ks")? &value.ks : NULL;
+			if (k) {
+				if (sscanf(ptr, "%g%g%g", &k->x, &k->y, &k->z) != 3)
 					printf("bad line %d in material file", lineNum);
 				else
 					mtlMap[key] = value;
 			}
+			if (!strcmp(word, "map_kd")) {
+				// last word is the file (options may precede it), relative to the material file
+				string file;
+				while (ReadWord(ptr, word, WordLim))
+					file = string(word);
+				if (!file.empty() && file.back() == '\r')
+					file.pop_back();
+				const char *slash = strrchr(filename, '/');
+				bool absolute = file[0] == '/' || file[0] == '\\' || (file.size() > 1 && file[1] == ':');
+				value.mapKd = slash && !absolute? string(filename, slash+1-filename)+file : file;
+				mtlMap[key] = value;
+			}
 		}
 	// else printf("can't open %s\n", filename);
 	return mtlMap;
@@ -0,0 +1,266 @@
+// Image.cpp - row-parallel image kernels
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "Image.h"
+#include "Jobs.h"
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define IMAGE_SSSE3
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_SSE2
+#endif
+
+using std::vector;
+
+// Rows
+
+void ParallelRows(int nRows, std::function<void(int row0, int row1)> kernel, int minRowsPerTask) {
+	// one band per worker, on the shared pool rather than threads started per call
+	JobSystem &jobs = GetJobSystem();
+	int nTasks = std::min(jobs.NWorkers(), nRows/std::max(1, minRowsPerTask));
+	if (nTasks < 2) {
+		kernel(0, nRows);
+		return;
+	}
+	jobs.ParallelFor(nRows, (nRows+nTasks-1)/nTasks, [&](int row0, int row1, int) { kernel(row0, row1); });
+}
+
+// Pixel layout
+
+namespace {
+
+void SwizzleSpan(unsigned char *p, size_t nBytes, int bpp) {
+	size_t i = 0;
+#ifdef IMAGE_SSSE3
+	if (bpp == 4) {
+		const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		for (; i+16 <= nBytes; i += 16)
+			_mm_storeu_si128((__m128i *) (p+i), _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (p+i)), mask));
+	}
+	else {
+		// five pixels per 16-byte load; byte 15 is stored back unchanged and re-read next step
+		const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+		for (; i+16 <= nBytes; i += 15)
+			_mm_storeu_si128((__m128i *) (p+i), _mm_shuffle_epi8(_mm_loadu_si128((__m128i *) (p+i)), mask));
+	}
+#elif defined(IMAGE_SSE2)
+	if (bpp == 4) {
+		const __m128i ga = _mm_set1_epi32((int) 0xff00ff00), lo = _mm_set1_epi32(0xff);
+		for (; i+16 <= nBytes; i += 16) {
+			__m128i v = _mm_loadu_si128((__m128i *) (p+i));
+			__m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), lo), b = _mm_slli_epi32(_mm_and_si128(v, lo), 16);
+			_mm_storeu_si128((__m128i *) (p+i), _mm_or_si128(_mm_and_si128(v, ga), _mm_or_si128(r, b)));
+		}
+	}
+#endif
+	for (; i+bpp <= nBytes; i += bpp)
+		std::swap(p[i], p[i+2]);
+}
+
+} // end namespace
+
+void SwizzleRB(unsigned char *pixels, int width, int height, int bpp) {
+	if (bpp != 3 && bpp != 4)
+		return;
+	size_t rowBytes = (size_t) width*bpp;
+	ParallelRows(height, [=](int row0, int row1) {
+		SwizzleSpan(pixels+row0*rowBytes, (row1-row0)*rowBytes, bpp);
+	});
+}
+
+void FlipVertical(unsigned char *pixels, int width, int height, int bpp) {
+	size_t rowBytes = (size_t) width*bpp;
+	ParallelRows(height/2, [=](int row0, int row1) {
+		vector<unsigned char> tmp(rowBytes);
+		for (int j = row0; j < row1; j++) {
+			unsigned char *a = pixels+j*rowBytes, *b = pixels+(height-1-j)*rowBytes;
+			memcpy(tmp.data(), a, rowBytes);
+			memcpy(a, b, rowBytes);
+			memcpy(b, tmp.data(), rowBytes);
+		}
+	});
+}
+
+// Matting
+
+void MergeMatte(unsigned char *image, int imageWidth, int imageHeight, int imageChannels,
+				unsigned char *matte, int matteWidth, int matteHeight, int matteChannels,
+				unsigned char *rgba) {
+	int iw = imageWidth, ih = imageHeight, ic = imageChannels, mw = matteWidth, mh = matteHeight, mc = matteChannels;
+	bool sameSize = iw == mw && ih == mh;
+	// resample tables: source columns/rows and weights, computed once rather than per pixel
+	vector<int> x0(iw), x1(iw), y0(ih), y1(ih);
+	vector<float> fx(iw), fy(ih);
+	for (int i = 0; i < iw; i++) {
+		float x = (float) i*mw/iw;
+		x0[i] = (int) x;
+		x1[i] = x0[i] < mw-1? x0[i]+1 : x0[i];
+		fx[i] = x-x0[i];
+	}
+	for (int j = 0; j < ih; j++) {
+		float y = (float) j*mh/ih;
+		y0[j] = (int) y;
+		y1[j] = y0[j] < mh-1? y0[j]+1 : y0[j];
+		fy[j] = y-y0[j];
+	}
+	ParallelRows(ih, [&](int row0, int row1) {
+		for (int j = row0; j < row1; j++) {
+			unsigned char *t = image+(size_t) j*iw*ic, *o = rgba+(size_t) j*iw*4;
+			for (int i = 0; i < iw; i++, t += ic, o += 4) {
+				o[0] = t[0];
+				o[1] = ic < 3? t[0] : t[1];
+				o[2] = ic < 3? t[0] : t[2];
+			}
+			o = rgba+(size_t) j*iw*4+3;
+			if (sameSize) {
+				unsigned char *m = matte+(size_t) j*mw*mc;
+				for (int i = 0; i < iw; i++)
+					o[4*i] = m[i*mc];
+			}
+			else {
+				unsigned char *m0 = matte+(size_t) y0[j]*mw*mc, *m1 = matte+(size_t) y1[j]*mw*mc;
+				float wy = fy[j];
+				for (int i = 0; i < iw; i++) {
+					int a = x0[i]*mc, b = x1[i]*mc;
+					float top = m0[a]+fx[i]*(m0[b]-m0[a]), bot = m1[a]+fx[i]*(m1[b]-m1[a]);
+					o[4*i] = (unsigned char) (top+wy*(bot-top));
+				}
+			}
+		}
+	});
+}
+
+// Bump map
+
+void DepthToNormals(unsigned char *depth, int width, int height, int depthChannels, float depthIncline,
+					unsigned char *normals) {
+	int w = width, h = height, dc = depthChannels;
+	float s = depthIncline/255;
+	ParallelRows(h, [=](int row0, int row1) {
+		vector<float> rows[3] = { vector<float>(w), vector<float>(w), vector<float>(w) }, nx(w), ny(w), nz(w);
+		auto Row = [=](int j, vector<float> &r) {
+			unsigned char *d = depth+(size_t) j*w*dc;
+			for (int i = 0; i < w; i++)
+				r[i] = s*d[i*dc];
+		};
+		int loaded[3] = {-1, -1, -1};
+		auto GetRow = [&](int j) -> float * {
+			// three-row window; each depth row is converted once per band
+			int k = j%3;
+			if (loaded[k] != j) {
+				Row(j, rows[k]);
+				loaded[k] = j;
+			}
+			return rows[k].data();
+		};
+		for (int j = row0; j < row1; j++) {
+			int j1 = j > 0? j-1 : j, j2 = j < h-1? j+1 : j;
+			float *below = GetRow(j1), *here = GetRow(j), *above = GetRow(j2);
+			// normal = cross((xs, 0, dzx), (0, ys, dzy)) = (-dzx*ys, -dzy*xs, xs*ys)
+			float ys = (float) (j2-j1)/h, xs = 2.f/w;
+			// interior columns are branch-free and unit-stride (vectorizable); edges use one-sided differences
+			for (int i = 1; i < w-1; i++) {
+				nx[i] = -(here[i+1]-here[i-1])*ys;
+				ny[i] = -(above[i]-below[i])*xs;
+				nz[i] = xs*ys;
+			}
+			if (w > 1) {
+				nx[0] = -(here[1]-here[0])*ys;
+				nx[w-1] = -(here[w-1]-here[w-2])*ys;
+				ny[0] = -(above[0]-below[0])/w;
+				ny[w-1] = -(above[w-1]-below[w-1])/w;
+				nz[0] = nz[w-1] = ys/w;
+			}
+			else
+				nx[0] = ny[0] = nz[0] = 0;
+			for (int i = 0; i < w; i++) {
+				float r = 1/sqrt(std::max(nx[i]*nx[i]+ny[i]*ny[i]+nz[i]*nz[i], 1e-20f));
+				nx[i] = 127.5f*(nx[i]*r+1);
+				ny[i] = 127.5f*(ny[i]*r+1);
+				nz[i] = 255.f*nz[i]*r;
+			}
+			unsigned char *n = normals+(size_t) j*w*3;
+			for (int i = 0; i < w; i++, n += 3) {
+				n[0] = (unsigned char) nx[i];
+				n[1] = (unsigned char) ny[i];
+				n[2] = (unsigned char) nz[i];
+			}
+		}
+	});
+}
+
+// Targa
+
+unsigned char *ReadTarga(const char *filename, int *width, int *height, int *bytesPerPixel) {
+	// read file with one call, then decode from memory
+	FILE *in = fopen(filename, "rb");
+	if (!in) {
+		printf("can't open %s\n", filename);
+		return NULL;
+	}
+	fseek(in, 0, SEEK_END);
+	vector<unsigned char> file(ftell(in));
+	fseek(in, 0, SEEK_SET);
+	bool ok = file.size() >= 18 && fread(file.data(), 1, file.size(), in) == file.size();
+	fclose(in);
+	if (!ok) {
+		printf("can't read %s\n", filename);
+		return NULL;
+	}
+	unsigned char *hdr = file.data();
+	int idLength = hdr[0], colorMapType = hdr[1], type = hdr[2];
+	int w = hdr[12] | (hdr[13] << 8), h = hdr[14] | (hdr[15] << 8), bpp = hdr[16]/8;
+	bool rle = type == 10 || type == 11, topDown = (hdr[17] & 0x20) != 0;
+	if (colorMapType != 0 || (type != 2 && type != 3 && !rle) || (bpp != 1 && bpp != 3 && bpp != 4) || w <= 0 || h <= 0) {
+		printf("%s: unsupported Targa (type %i, %i bits/pixel)\n", filename, type, 8*bpp);
+		return NULL;
+	}
+	size_t nBytes = (size_t) w*h*bpp;
+	if (18+idLength > (int) file.size()) {
+		printf("%s: truncated Targa\n", filename);
+		return NULL;
+	}
+	const unsigned char *src = file.data()+18+idLength, *end = file.data()+file.size();
+	unsigned char *pixels = new unsigned char[nBytes], *dst = pixels, *stop = pixels+nBytes;
+	if (!rle) {
+		ok = (size_t) (end-src) >= nBytes;
+		if (ok) memcpy(pixels, src, nBytes);
+	}
+	else
+		// packet: header byte, then one pixel repeated (high bit set) or (header & 0x7f)+1 raw pixels
+		while (ok && dst < stop) {
+			ok = src < end;
+			if (!ok) break;
+			int header = *src++, count = (header & 0x7f)+1;
+			size_t runBytes = (size_t) count*bpp, srcBytes = header & 0x80? bpp : runBytes;
+			ok = runBytes <= (size_t) (stop-dst) && srcBytes <= (size_t) (end-src);
+			if (!ok) break;
+			if (header & 0x80)
+				for (int k = 0; k < count; k++, dst += bpp)
+					memcpy(dst, src, bpp);
+			else {
+				memcpy(dst, src, runBytes);
+				dst += runBytes;
+			}
+			src += srcBytes;
+		}
+	if (!ok) {
+		printf("%s: truncated Targa\n", filename);
+		delete [] pixels;
+		return NULL;
+	}
+	if (topDown)
+		FlipVertical(pixels, w, h, bpp);
+	*width = w;
+	*height = h;
+	if (bytesPerPixel)
+		*bytesPerPixel = bpp;
+	return pixels;
+}
@@ -0,0 +1,101 @@
+// Jobs.cpp - persistent worker threads for data-parallel loops
+
+#include <algorithm>
+#include "Jobs.h"
+
+namespace {
+
+thread_local bool insideKernel = false;
+
+} // end namespace
+
+JobSystem::JobSystem(int nThreads) {
+	if (nThreads <= 0)
+		nThreads = std::max(1, (int) std::thread::hardware_concurrency());
+	for (int t = 1; t < nThreads; t++)
+		threads.emplace_back(&JobSystem::Worker, this, t);
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread &t : threads)
+		t.join();
+}
+
+void JobSystem::RunChunks(Job &j, int worker) {
+	bool wasInside = insideKernel;
+	insideKernel = true;
+	for (int c; (c = j.next.fetch_add(1)) < j.nChunks; ) {
+		int begin = c*j.grain;
+		(*j.kernel)(begin, std::min(j.n, begin+j.grain), worker);
+		j.done.fetch_add(1, std::memory_order_release);
+	}
+	insideKernel = wasInside;
+}
+
+void JobSystem::Worker(int worker) {
+	unsigned seen = 0;
+	for (;;) {
+		Job *j = NULL;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quit || (posted && generation != seen); });
+			if (quit)
+				return;
+			seen = generation;
+			j = posted;
+			// counted under the lock, so the caller can't retire the loop without waiting for us
+			active.fetch_add(1);
+		}
+		RunChunks(*j, worker);
+		active.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+void JobSystem::ParallelFor(int n, int grain, const RangeKernel &kernel) {
+	grain = std::max(1, grain);
+	int nChunks = Chunks(n, grain);
+	if (nChunks <= 0)
+		return;
+	std::unique_lock<std::mutex> call(callMutex, std::defer_lock);
+	if (nChunks == 1 || threads.empty() || insideKernel || !call.try_lock()) {
+		bool wasInside = insideKernel;
+		insideKernel = true;
+		for (int begin = 0; begin < n; begin += grain)
+			kernel(begin, std::min(n, begin+grain), 0);
+		insideKernel = wasInside;
+		return;
+	}
+	job.kernel = &kernel;
+	job.n = n;
+	job.grain = grain;
+	job.nChunks = nChunks;
+	job.next = 0;
+	job.done = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		posted = &job;
+		generation++;
+	}
+	// waking more threads than chunks only costs a context switch each
+	wake.notify_all();
+	RunChunks(job, 0);
+	while (job.done.load(std::memory_order_acquire) < nChunks)
+		std::this_thread::yield();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		posted = NULL;
+	}
+	// late arrivals find no chunks left, but still hold a pointer to job
+	while (active.load(std::memory_order_acquire) > 0)
+		std::this_thread::yield();
+}
+
+JobSystem &GetJobSystem() {
+	static JobSystem jobs;
+	return jobs;
+}
@@ -215,9 +215,8 @@ void Letter(int x, int y, char c, vec3 color, float ptSize) {
 }
 
 void Letters(int x, int y, const char *letters, vec3 color, float ptSize) {
-	int was = 0;
+	int was = CurrentProgram();
 	mat4 drawView = GetDrawView();
-	glGetIntegerv(GL_CURRENT_PROGRAM, &was);
 	for (int i = 0; i < (int) strlen(letters); i++)
 		Letter((int) (x+i*ptSize), y, letters[i], color, ptSize);
 	glUseProgram(was);
@@ -225,9 +224,8 @@ void Letters(int x, int y, const char *letters, vec3 color, float ptSize) {
 }
 
 void Letters(vec3 p, mat4 m, const char *letters, vec3 color, float ptSize) {
-	int was = 0;
+	int was = CurrentProgram();
 	mat4 drawView = GetDrawView();
-	glGetIntegerv(GL_CURRENT_PROGRAM, &was);
 	vec2 pp = ScreenPoint(p, m);
 	for (int i = 0; i < (int) strlen(letters); i++)
 	//	Letter((int) (pp.x+i*10.9f), (int) pp.y, letters[i], color, ptSize);
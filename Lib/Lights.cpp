@@ -0,0 +1,138 @@
+// Lights.cpp - clustered forward lighting
+
+#include <glad.h>
+#include <algorithm>
+#include <math.h>
+#include "GLXtras.h"
+#include "Lights.h"
+
+namespace {
+
+const int ClusterTextureUnit = 8;			// and 9, 10
+const char *samplerNames[] = { "clusterLights", "clusterRanges", "clusterIndices" };
+
+} // end namespace
+
+LightClusters::LightClusters(int tilesX, int tilesY, int slices, float nearDist, float farDist) :
+	nx(std::max(1, tilesX)), ny(std::max(1, tilesY)), nz(std::max(1, slices)), nearDist(nearDist), farDist(farDist) { }
+
+LightClusters::~LightClusters() {
+	if (buffers[0]) {
+		glDeleteBuffers(3, buffers);
+		glDeleteTextures(3, textures);
+	}
+}
+
+void LightClusters::Update(Camera &camera) {
+	int nLights = (int) lights.size(), nClusters = nx*ny*nz;
+	float logRatio = log(farDist/nearDist);
+	auto Slice = [this, logRatio](float z) {
+		int s = (int) floor(log(std::max(z, nearDist)/nearDist)/logRatio*nz);
+		return std::min(std::max(s, 0), nz-1);
+	};
+	auto Tile = [](float ndc, int n) { return std::min(std::max((int) floor((ndc*.5f+.5f)*n), 0), n-1); };
+	// eye-space lights; cluster box of each (x0, x1, y0, y1, z0, z1), x0 < 0 if none
+	lightTexels.resize(2*nLights);
+	boxes.resize(6*nLights);
+	for (int i = 0; i < nLights; i++) {
+		PointLight &l = lights[i];
+		vec3 p = Vec3(camera.modelview*vec4(l.position, 1));
+		float r = l.radius;
+		lightTexels[2*i] = vec4(p, r);
+		lightTexels[2*i+1] = vec4(l.color, 0);
+		int *b = &boxes[6*i];
+		float zNear = -p.z-r, zFar = -p.z+r;
+		b[0] = -1;
+		if (zFar < nearDist || r <= 0)
+			continue;
+		int x0 = 0, x1 = nx-1, y0 = 0, y1 = ny-1;
+		if (zNear > nearDist) {
+			// bound the projected corners of the light's box (all in front of the camera)
+			vec2 lo(1e9f), hi(-1e9f);
+			for (int c = 0; c < 8; c++) {
+				vec3 q(p.x+(c&1? r : -r), p.y+(c&2? r : -r), p.z+(c&4? r : -r));
+				vec4 h = camera.persp*vec4(q, 1);
+				vec2 ndc(h.x/h.w, h.y/h.w);
+				lo = vec2(std::min(lo.x, ndc.x), std::min(lo.y, ndc.y));
+				hi = vec2(std::max(hi.x, ndc.x), std::max(hi.y, ndc.y));
+			}
+			if (lo.x > 1 || lo.y > 1 || hi.x < -1 || hi.y < -1)
+				continue;
+			x0 = Tile(lo.x, nx); x1 = Tile(hi.x, nx);
+			y0 = Tile(lo.y, ny); y1 = Tile(hi.y, ny);
+		}
+		b[0] = x0; b[1] = x1; b[2] = y0; b[3] = y1; b[4] = Slice(zNear); b[5] = Slice(zFar);
+	}
+	// count lights per cluster, offsets by prefix sum, then fill indices
+	ranges.assign(2*nClusters, 0);
+	for (int i = 0; i < nLights; i++) {
+		int *b = &boxes[6*i];
+		if (b[0] >= 0)
+			for (int z = b[4]; z <= b[5]; z++)
+				for (int y = b[2]; y <= b[3]; y++)
+					for (int x = b[0]; x <= b[1]; x++)
+						ranges[2*((z*ny+y)*nx+x)+1]++;
+	}
+	indexCount = maxPerCluster = 0;
+	for (int c = 0; c < nClusters; c++) {
+		ranges[2*c] = indexCount;
+		indexCount += ranges[2*c+1];
+		maxPerCluster = std::max(maxPerCluster, ranges[2*c+1]);
+		ranges[2*c+1] = 0;
+	}
+	indices.resize(std::max(1, indexCount));
+	for (int i = 0; i < nLights; i++) {
+		int *b = &boxes[6*i];
+		if (b[0] >= 0)
+			for (int z = b[4]; z <= b[5]; z++)
+				for (int y = b[2]; y <= b[3]; y++)
+					for (int x = b[0]; x <= b[1]; x++) {
+						int *range = &ranges[2*((z*ny+y)*nx+x)];
+						indices[range[0]+range[1]++] = i;
+					}
+	}
+	// upload to texture buffers
+	if (!buffers[0]) {
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+	}
+	if (lightTexels.empty())
+		lightTexels.push_back(vec4(0.f));
+	size_t sizes[] = { lightTexels.size()*sizeof(vec4), ranges.size()*sizeof(int), indices.size()*sizeof(int) };
+	void *data[] = { lightTexels.data(), ranges.data(), indices.data() };
+	GLenum formats[] = { GL_RGBA32F, GL_RG32I, GL_R32I };
+	for (int i = 0; i < 3; i++) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizes[i], data[i], GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightClusters::Use(GLuint program) {
+	int vp[4];
+	glGetIntegerv(GL_VIEWPORT, vp);
+	for (int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0+ClusterTextureUnit+i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glUseProgram(program);
+	GLint counts[] = { nx, ny, nz };
+	glUniform3iv(glGetUniformLocation(program, "clusterCounts"), 1, counts);
+	SetUniform(program, "clusterViewport", vec4((float) vp[0], (float) vp[1], (float) vp[2], (float) vp[3]));
+	SetUniform(program, "clusterDepth", vec2(nearDist, log(farDist/nearDist)));
+	SetUniform(program, "useClusters", true);
+}
+
+void LightClusters::Unuse(GLuint program) {
+	glUseProgram(program);
+	SetUniform(program, "useClusters", false);
+}
+
+void SetClusterUnits(GLuint program) {
+	for (int i = 0; i < 3; i++)
+		glProgramUniform1i(program, glGetUniformLocation(program, samplerNames[i]), ClusterTextureUnit+i);
+}
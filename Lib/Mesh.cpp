@@ -1,38 +1,65 @@
 // Mesh.cpp - mesh operations (c) 2019-2023 Jules Bloomenthal
 
+#include <algorithm>
 #include "GLXtras.h"
 #include "Draw.h"
+#include "Lights.h"
 #include "Mesh.h"
+#include "Profiler.h"
+#include "TextureCache.h"
+#include "TextureStream.h"
+#include "stb_image.h"
 
 // Shaders
 
 namespace {
 
-GLuint meshShaderLines = 0, meshShaderNoLines = 0;
+GLuint meshShaderLines = 0, meshShaderNoLines = 0, meshShaderPulledLines = 0;
+MeshLines meshLines = MeshLines::GeometryShader;
+GLuint emptyVao = 0;							// pulled lines have no vertex attributes
+const int PulledLinesTextureUnit = 13;			// and 14, 15
+const int MaterialTextureUnit = 11, DrawBufferTextureUnit = 12;
 
 // vertex shader
 const char *meshVertexShader = R"(
 	#version 410 core
+	#extension GL_ARB_shader_draw_parameters : enable
 	layout (location = 0) in vec3 point;
 	layout (location = 1) in vec3 normal;
 	layout (location = 2) in vec2 uv;
 	layout (location = 3) in mat4 instance; // for use with glDrawArrays/ElementsInstanced
-											// uses locations 3,4,5,6 for 4 vec4s = mat4
+											// uses locations 3,4,5,6 for 4 vec4s = mat4 (rows, as mat4 in VecMat.h)
 	layout (location = 7) in vec3 color;	// for instanced color (vec4?)
+	layout (location = 8) in int drawIndex;	// for glMultiDrawElementsIndirect: baseInstance of the draw
 	out vec3 vPoint;
 	out vec3 vNormal;
 	out vec2 vUv;
+	out vec3 vColor;
+	flat out int vLayer;
+	uniform bool useMultiDraw = false;
+	uniform samplerBuffer drawBuffer;		// per draw: rgb color, texture layer
 	uniform mat4 modelview;
 	uniform mat4 persp;
 	uniform bool useInstance = false;
 	uniform bool useNormalMatrix = false;
 	uniform mat3 normalMatrix;
 	void main() {
-		mat4 m = useInstance? modelview*instance : modelview;
+		mat4 m = useInstance? modelview*transpose(instance) : modelview;
 		vPoint = (m*vec4(point, 1)).xyz;
 		vNormal = useNormalMatrix? normalMatrix*normal : (m*vec4(normal, 0)).xyz;
 		gl_Position = persp*vec4(vPoint, 1);
 		vUv = uv;
+		vColor = color;
+		vLayer = -1;
+		if (useMultiDraw) {
+		#ifdef GL_ARB_shader_draw_parameters
+			vec4 d = texelFetch(drawBuffer, gl_DrawIDARB);
+		#else
+			vec4 d = texelFetch(drawBuffer, drawIndex);
+		#endif
+			vColor = d.rgb;
+			vLayer = int(d.w);
+		}
 	}
 )";
 
@@ -41,12 +68,14 @@ const char *meshGeometryShader = R"(
 	#version 410 core
 	layout (triangles) in;
 	layout (triangle_strip, max_vertices = 3) out;
-	in vec3 vPoint[], vNormal[];
+	in vec3 vPoint[], vNormal[], vColor[];
 	in vec2 vUv[];
-	out vec3 gPoint, gNormal;
+	out vec3 gPoint, gNormal, gColor;
 	out vec2 gUv;
 	noperspective out vec3 gEdgeDistance;
 	uniform mat4 vp;
+	uniform int quadStart = 1 << 30;			// first triangle split from a quad
+	uniform int primitiveStart = 0;				// first triangle of the draw (gl_PrimitiveID restarts per draw)
 	vec3 ViewPoint(int i) { return vec3(vp*(gl_in[i].gl_Position/gl_in[i].gl_Position.w)); }
 	void main() {
 		float ha = 0, hb = 0, hc = 0;
@@ -59,12 +88,18 @@ const char *meshGeometryShader = R"(
 		ha = abs(c*sin(beta));
 		hb = abs(c*sin(alpha));
 		hc = abs(b*sin(alpha));
+		// no line along a quad's diagonal, as in meshPulledLinesVertexShader
+		int t = primitiveStart+gl_PrimitiveID;
+		int diagonal = t >= quadStart? ((t-quadStart)%2 == 0? 1 : 2) : -1;
 		// send triangle vertices and edge distances
 		for (int i = 0; i < 3; i++) {
 			gEdgeDistance = i==0? vec3(ha, 0, 0) : i==1? vec3(0, hb, 0) : vec3(0, 0, hc);
+			if (diagonal >= 0)
+				gEdgeDistance[diagonal] = 1e6;
 			gPoint = vPoint[i];
 			gNormal = vNormal[i];
 			gUv = vUv[i];
+			gColor = vColor[i];
 			gl_Position = gl_in[i].gl_Position;
 			EmitVertex();
 		}
@@ -72,10 +107,58 @@ const char *meshGeometryShader = R"(
 	}
 )";
 
+// vertex shader for lines without a geometry shader: vertex gl_VertexID of a non-indexed draw is corner
+// gl_VertexID%3 of triangle gl_VertexID/3; it fetches the triangle's three points from texture buffer views
+// of the vertex and element buffers, and its altitude in pixels is interpolated as by meshGeometryShader
+const char *meshPulledLinesVertexShader = R"(
+	#version 410 core
+	uniform samplerBuffer vec3Buffer;			// points, then normals
+	uniform samplerBuffer vec2Buffer;			// uvs
+	uniform isamplerBuffer triangleBuffer;
+	uniform int normalOffset = -1, uvOffset = -1;
+	uniform int quadStart = 1 << 30;			// first triangle split from a quad
+	out vec3 gPoint, gNormal, gColor;
+	out vec2 gUv;
+	noperspective out vec3 gEdgeDistance;
+	uniform mat4 modelview;
+	uniform mat4 persp;
+	uniform mat4 vp;
+	uniform bool useNormalMatrix = false;
+	uniform mat3 normalMatrix;
+	vec2 ViewPoint(vec4 p) { return (vp*(p/p.w)).xy; }
+	void main() {
+		int t = gl_VertexID/3, k = gl_VertexID-3*t;
+		ivec3 tri = ivec3(texelFetch(triangleBuffer, 3*t).r, texelFetch(triangleBuffer, 3*t+1).r, texelFetch(triangleBuffer, 3*t+2).r);
+		mat4 m = persp*modelview;
+		vec4 c0 = m*vec4(texelFetch(vec3Buffer, tri[0]).xyz, 1);
+		vec4 c1 = m*vec4(texelFetch(vec3Buffer, tri[1]).xyz, 1);
+		vec4 c2 = m*vec4(texelFetch(vec3Buffer, tri[2]).xyz, 1);
+		// altitude of corner k: twice the triangle area over the length of the opposite edge
+		vec2 p0 = ViewPoint(c0), p1 = ViewPoint(c1), p2 = ViewPoint(c2);
+		vec2 e1 = p1-p0, e2 = p2-p0;
+		float area2 = abs(e1.x*e2.y-e1.y*e2.x);
+		float opposite = length(k == 0? p2-p1 : k == 1? e2 : e1);
+		gEdgeDistance = vec3(0);
+		gEdgeDistance[k] = area2/opposite;
+		// no line along a quad's diagonal, opposite corner 1 of its first triangle and corner 2 of its second:
+		// its distance is large at all three corners, so never near zero
+		if (t >= quadStart)
+			gEdgeDistance[(t-quadStart)%2 == 0? 1 : 2] = 1e6;
+		int id = tri[k];
+		vec3 point = texelFetch(vec3Buffer, id).xyz;
+		vec3 normal = normalOffset >= 0? texelFetch(vec3Buffer, normalOffset+id).xyz : vec3(0);
+		gPoint = (modelview*vec4(point, 1)).xyz;
+		gNormal = useNormalMatrix? normalMatrix*normal : (modelview*vec4(normal, 0)).xyz;
+		gUv = uvOffset >= 0? texelFetch(vec2Buffer, uvOffset+id).xy : vec2(0);
+		gColor = vec3(0);
+		gl_Position = k == 0? c0 : k == 1? c1 : c2;
+	}
+)";
+
 // pixel shader
 const char *meshPixelShaderLines = R"(
 	#version 410 core
-	in vec3 gPoint, gNormal;
+	in vec3 gPoint, gNormal, gColor;
 	in vec2 gUv;
 	noperspective in vec3 gEdgeDistance;
 	uniform sampler2D textureImage;
@@ -83,6 +166,7 @@ const char *meshPixelShaderLines = R"(
 	uniform vec3 lights[20];
 	uniform vec3 defaultLight = vec3(1, 1, 1);
 	uniform vec3 color = vec3(1, 0, 1);
+	uniform bool useInstanceColor = false;
 	uniform float opacity = 1;
 	uniform float ambient = .2;
 	uniform bool useLight = true;
@@ -94,6 +178,24 @@ const char *meshPixelShaderLines = R"(
 	uniform float outlineWidth = 1;
 	uniform float outlineTransition = 1;
 	out vec4 pColor;
+	// clustered lights (see Lights.h)
+	uniform bool useClusters = false;
+	uniform samplerBuffer clusterLights;			// per light: eye-space position and radius, then color
+	uniform isamplerBuffer clusterRanges;			// per cluster: first index, count
+	uniform isamplerBuffer clusterIndices;			// lights of each cluster
+	uniform ivec3 clusterCounts;					// tiles in x, y, depth slices
+	uniform vec4 clusterViewport;					// x, y, width, height
+	uniform vec2 clusterDepth;						// near, log(far/near)
+	ivec2 ClusterRange(vec3 point) {
+		ivec2 tile = ivec2((gl_FragCoord.xy-clusterViewport.xy)*vec2(clusterCounts.xy)/clusterViewport.zw);
+		int slice = int(log(max(-point.z, clusterDepth.x)/clusterDepth.x)/clusterDepth.y*float(clusterCounts.z));
+		ivec3 c = clamp(ivec3(tile, slice), ivec3(0), clusterCounts-1);
+		return texelFetch(clusterRanges, (c.z*clusterCounts.y+c.y)*clusterCounts.x+c.x).rg;
+	}
+	float Falloff(vec3 point, vec4 light) {
+		float a = clamp(1-length(light.xyz-point)/light.w, 0, 1);
+		return a*a;
+	}
 	float Intensity(vec3 normalV, vec3 eyeV, vec3 point, vec3 light) {
 		vec3 lightV = normalize(light-point);		// light vector
 		vec3 reflectV = reflect(lightV, normalV);   // highlight vector
@@ -106,25 +208,36 @@ const char *meshPixelShaderLines = R"(
 		if (fwdFacingOnly && N.z < 0)
 			discard;
 		vec3 E = normalize(gPoint);					// eye vector
-		float intensity = useLight? 0 : 1;
+		vec3 intensity = vec3(useLight? 0 : 1);
 		if (useLight) {
-			if (nLights == 0)
+			if (useClusters) {
+				ivec2 range = ClusterRange(gPoint);
+				for (int i = range.x; i < range.x+range.y; i++) {
+					int l = texelFetch(clusterIndices, i).r;
+					vec4 light = texelFetch(clusterLights, 2*l);
+					float a = Falloff(gPoint, light);
+					if (a > 0)
+						intensity += a*texelFetch(clusterLights, 2*l+1).rgb*Intensity(N, E, gPoint, light.xyz);
+				}
+			}
+			else if (nLights == 0)
 				intensity += Intensity(N, E, gPoint, defaultLight);
 			else
 				for (int i = 0; i < nLights; i++)
 					intensity += Intensity(N, E, gPoint, lights[i]);
 		}
-		intensity = clamp(intensity, 0, 1);
+		intensity = clamp(intensity, vec3(0), vec3(1));
+		vec3 c = useInstanceColor? gColor : color;
 		if (useTexture) {
 			pColor = vec4(intensity*texture(textureImage, gUv).rgb, opacity);
 			if (useTint) {
-				pColor.r *= color.r;
-				pColor.g *= color.g;
-				pColor.b *= color.b;
+				pColor.r *= c.r;
+				pColor.g *= c.g;
+				pColor.b *= c.b;
 			}
 		}
 		else
-			pColor = vec4(intensity*color, opacity);
+			pColor = vec4(intensity*c, opacity);
 		float minDist = min(gEdgeDistance.x, gEdgeDistance.y);
 		minDist = min(minDist, gEdgeDistance.z);
 		float t = smoothstep(outlineWidth-outlineTransition, outlineWidth+outlineTransition, minDist);
@@ -135,13 +248,16 @@ const char *meshPixelShaderLines = R"(
 
 const char *meshPixelShaderNoLines = R"(
 	#version 410 core
-	in vec3 vPoint, vNormal;
+	in vec3 vPoint, vNormal, vColor;
 	in vec2 vUv;
+	flat in int vLayer;								// -2: untextured, -1: textureImage, else layer of textureArray
 	uniform sampler2D textureImage;
+	uniform sampler2DArray textureArray;
 	uniform int nLights = 0;
 	uniform vec3 lights[20];
 	uniform vec3 defaultLight = vec3(1, 1, 1);
 	uniform vec3 color = vec3(1, 0, 1);
+	uniform bool useInstanceColor = false;
 	uniform float opacity = 1;
 	uniform bool useLight = true;
 	uniform bool useTexture = true;
@@ -154,66 +270,272 @@ const char *meshPixelShaderNoLines = R"(
 	// special for Cleave.cpp
 	uniform vec4 cleaver;							// plane
 	uniform bool useCleaver = false;
-	float d = 0, s = 0;								// diffuse, specular terms
+	// clustered lights (see Lights.h)
+	uniform bool useClusters = false;
+	uniform samplerBuffer clusterLights;			// per light: eye-space position and radius, then color
+	uniform isamplerBuffer clusterRanges;			// per cluster: first index, count
+	uniform isamplerBuffer clusterIndices;			// lights of each cluster
+	uniform ivec3 clusterCounts;					// tiles in x, y, depth slices
+	uniform vec4 clusterViewport;					// x, y, width, height
+	uniform vec2 clusterDepth;						// near, log(far/near)
+	ivec2 ClusterRange(vec3 point) {
+		ivec2 tile = ivec2((gl_FragCoord.xy-clusterViewport.xy)*vec2(clusterCounts.xy)/clusterViewport.zw);
+		int slice = int(log(max(-point.z, clusterDepth.x)/clusterDepth.x)/clusterDepth.y*float(clusterCounts.z));
+		ivec3 c = clamp(ivec3(tile, slice), ivec3(0), clusterCounts-1);
+		return texelFetch(clusterRanges, (c.z*clusterCounts.y+c.y)*clusterCounts.x+c.x).rg;
+	}
+	float Falloff(vec3 point, vec4 light) {
+		float a = clamp(1-length(light.xyz-point)/light.w, 0, 1);
+		return a*a;
+	}
+	vec3 d = vec3(0), s = vec3(0);					// diffuse, specular terms
 	vec3 N, E;
-	void Intensity(vec3 light) {
+	void Intensity(vec3 light, vec3 lightColor) {
 		vec3 L = normalize(light-vPoint);
 		float dd = dot(L, N);
 		bool sideLight = dd > 0;
 		bool sideViewer = gl_FrontFacing;
 		if (twoSidedShading || sideLight == sideViewer) {
-			d += abs(dd);
+			d += lightColor*abs(dd);
 			vec3 R = reflect(L, N);					// highlight vector
 			float h = max(0, dot(R, E));			// highlight term
-			s += pow(h, 50);						// specular term
+			s += lightColor*pow(h, 50);				// specular term
 		}
 	}
+	void Intensity(vec3 light) {
+		Intensity(light, vec3(1));
+	}
 	void main() {
 		N = normalize(facetedShading? cross(dFdx(vPoint), dFdy(vPoint)) : vNormal);
 		if (fwdFacingOnly && N.z < 0)
 			discard;
 		E = normalize(vPoint);						// eye vector
-		float ads = 1;
+		vec3 ads = vec3(1);
 		if (useLight) {
-			if (nLights == 0)
+			if (useClusters) {
+				ivec2 range = ClusterRange(vPoint);
+				for (int i = range.x; i < range.x+range.y; i++) {
+					int l = texelFetch(clusterIndices, i).r;
+					vec4 light = texelFetch(clusterLights, 2*l);
+					float a = Falloff(vPoint, light);
+					if (a > 0)
+						Intensity(light.xyz, a*texelFetch(clusterLights, 2*l+1).rgb);
+				}
+			}
+			else if (nLights == 0)
 				Intensity(defaultLight);
 			else
 				for (int i = 0; i < nLights; i++)
 					Intensity(lights[i]);
-			ads = clamp(amb+dif*d, 0, 1)+spc*s;
+			ads = clamp(amb+dif*d, vec3(0), vec3(1))+spc*s;
 		}
 		if (useCleaver) {
 			vec3 col = dot(cleaver, vec4(vPoint, 1)) < 0? vec3(1,0,0) : vec3(0,0,1);
 			pColor = vec4(col, 1); // vec4(ads*col, opacity);
 		}
-		else if (useTexture) {
-			pColor = vec4(ads*texture(textureImage, vUv).rgb, opacity);
+		else if (useTexture && vLayer > -2) {
+			vec3 c = useInstanceColor? vColor : color;
+			vec3 texel = vLayer >= 0? texture(textureArray, vec3(vUv, vLayer)).rgb : texture(textureImage, vUv).rgb;
+			pColor = vec4(ads*texel, opacity);
 			if (useTint) {
-				pColor.r *= color.r;
-				pColor.g *= color.g;
-				pColor.b *= color.b;
+				pColor.r *= c.r;
+				pColor.g *= c.g;
+				pColor.b *= c.b;
 			}
 		}
 		else
-			pColor = vec4(ads*color, opacity);
+			pColor = vec4(ads*(useInstanceColor? vColor : color), opacity);
 	}
 )";
 
+GLuint MeshShader(bool lines, bool pulled) {
+	if (lines && pulled) {
+		if (!meshShaderPulledLines) {
+			GLuint p = meshShaderPulledLines = LinkProgramViaCode(&meshPulledLinesVertexShader, &meshPixelShaderLines);
+			glProgramUniform1i(p, glGetUniformLocation(p, "vec3Buffer"), PulledLinesTextureUnit);
+			glProgramUniform1i(p, glGetUniformLocation(p, "vec2Buffer"), PulledLinesTextureUnit+1);
+			glProgramUniform1i(p, glGetUniformLocation(p, "triangleBuffer"), PulledLinesTextureUnit+2);
+			SetClusterUnits(p);
+		}
+		return meshShaderPulledLines;
+	}
+	GLuint &p = lines? meshShaderLines : meshShaderNoLines;
+	if (!p) {
+		p = lines? LinkProgramViaCode(&meshVertexShader, NULL, NULL, &meshGeometryShader, &meshPixelShaderLines) :
+				   LinkProgramViaCode(&meshVertexShader, &meshPixelShaderNoLines);
+		// samplers of different type may not share a unit, even if unused
+		glProgramUniform1i(p, glGetUniformLocation(p, "drawBuffer"), DrawBufferTextureUnit);
+		glProgramUniform1i(p, glGetUniformLocation(p, "textureArray"), MaterialTextureUnit);
+		SetClusterUnits(p);
+	}
+	return p;
+}
+
+// Multi-draw
+
+struct DrawRange {
+	// triangles start, start+count drawn in color; layer -2: untextured, -1: Mesh textureName, else layer of
+	// MultiDraw::textures
+	int start = 0, count = 0;
+	vec3 color;
+	float layer = -2;
+	DrawRange(int s, int c, vec3 col, float l) : start(s), count(c), color(col), layer(l) { }
+};
+
+struct DrawCommand { GLuint count, instanceCount, firstIndex, baseVertex, baseInstance; };
+
+bool MultiDrawAvailable() {
+	return GLAD_GL_VERSION_4_3 != 0;
+}
+
+void GroupRanges(Mesh &m, vector<DrawRange> &ranges) {
+	// ungrouped triangles untextured in mesh color, groups in group colors, quads as ungrouped
+	int nTris = (int) m.triangles.size(), nGroups = (int) m.triangleGroups.size();
+	int nUngrouped = nGroups? m.triangleGroups[0].startTriangle : nTris;
+	ranges.push_back(DrawRange(0, nUngrouped, m.color, -2));
+	for (Group &g : m.triangleGroups)
+		ranges.push_back(DrawRange(g.startTriangle, g.nTriangles, g.color, -1));
+	ranges.push_back(DrawRange(nTris, 2*(int) m.quads.size(), m.color, -2));
+}
+
+void ReadMaterialTextures(Mesh &m) {
+	// one array layer per distinct map_Kd, each resampled to the largest width and height (at most 2048)
+	MultiDraw &md = m.multiDraw;
+	md.texturesRead = true;
+	vector<unsigned char *> images;
+	vector<int2> sizes;
+	int w = 0, h = 0;
+	stbi_set_flip_vertically_on_load(true);
+	for (Mtl &mtl : m.triangleMtls)
+		if (!mtl.mapKd.empty() && std::find(md.textureFiles.begin(), md.textureFiles.end(), mtl.mapKd) == md.textureFiles.end()) {
+			int iw, ih, n;
+			unsigned char *pixels = stbi_load(mtl.mapKd.c_str(), &iw, &ih, &n, 4);
+			if (!pixels) {
+				printf("ReadMaterialTextures: can't open %s\n", mtl.mapKd.c_str());
+				continue;
+			}
+			md.textureFiles.push_back(mtl.mapKd);
+			images.push_back(pixels);
+			sizes.push_back(int2(iw, ih));
+			w = std::min(2048, std::max(w, iw));
+			h = std::min(2048, std::max(h, ih));
+		}
+	if (images.empty())
+		return;
+	glGenTextures(1, &md.textures);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, md.textures);
+	TextureStorage(GL_TEXTURE_2D_ARRAY, MipCount(w, h), GL_RGBA8, w, h, (int) images.size());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	vector<unsigned char> layer(4*w*h);
+	for (size_t i = 0; i < images.size(); i++) {
+		// bilinear resample to w by h
+		int iw = sizes[i].i1, ih = sizes[i].i2;
+		unsigned char *src = images[i], *dst = layer.data();
+		for (int y = 0; y < h; y++) {
+			float fy = std::max(0.f, (y+.5f)*ih/h-.5f);
+			int y0 = std::min((int) fy, ih-1), y1 = std::min(y0+1, ih-1);
+			float ty = fy-y0;
+			for (int x = 0; x < w; x++) {
+				float fx = std::max(0.f, (x+.5f)*iw/w-.5f);
+				int x0 = std::min((int) fx, iw-1), x1 = std::min(x0+1, iw-1);
+				float tx = fx-x0;
+				unsigned char *p00 = src+4*(y0*iw+x0), *p01 = src+4*(y0*iw+x1), *p10 = src+4*(y1*iw+x0), *p11 = src+4*(y1*iw+x1);
+				for (int k = 0; k < 4; k++) {
+					float top = p00[k]+tx*(p01[k]-p00[k]), bottom = p10[k]+tx*(p11[k]-p10[k]);
+					*dst++ = (unsigned char) (top+ty*(bottom-top)+.5f);
+				}
+			}
+		}
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (int) i, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, layer.data());
+		stbi_image_free(images[i]);
+	}
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void MaterialRanges(Mesh &m, vector<DrawRange> &ranges) {
+	// triangles before the first material and quads untextured in mesh color, materials in kd with map_Kd
+	if (!m.multiDraw.texturesRead && m.uvs.size())
+		ReadMaterialTextures(m);
+	vector<string> &files = m.multiDraw.textureFiles;
+	int nTris = (int) m.triangles.size(), nMtls = (int) m.triangleMtls.size();
+	ranges.push_back(DrawRange(0, nMtls? m.triangleMtls[0].startTriangle : nTris, m.color, -2));
+	for (Mtl &mtl : m.triangleMtls) {
+		int layer = (int) (std::find(files.begin(), files.end(), mtl.mapKd)-files.begin());
+		ranges.push_back(DrawRange(mtl.startTriangle, mtl.nTriangles, mtl.kd, mtl.mapKd.empty() || layer == (int) files.size()? -2.f : (float) layer));
+	}
+	ranges.push_back(DrawRange(nTris, 2*(int) m.quads.size(), m.color, -2));
+}
+
+void MultiDrawRanges(Mesh &m, GLuint shader, vector<DrawRange> &ranges) {
+	// one glMultiDrawElementsIndirect: per-draw color and layer in a texture buffer, fetched by the vertex
+	// shader with gl_DrawIDARB, or else with the draw index, given per instance as the draw's baseInstance
+	MultiDraw &md = m.multiDraw;
+	int n = (int) ranges.size();
+	vector<DrawCommand> commands(n);
+	vector<vec4> parameters(n);
+	for (int i = 0; i < n; i++) {
+		DrawRange &r = ranges[i];
+		commands[i] = { 3*(GLuint) r.count, 1, 3*(GLuint) r.start, 0, (GLuint) i };
+		parameters[i] = vec4(r.color, r.layer);
+	}
+	if (!md.commands) {
+		glGenBuffers(1, &md.commands);
+		glGenBuffers(1, &md.parameters);
+		glGenBuffers(1, &md.indices);
+		glGenTextures(1, &md.parameterTexture);
+	}
+	if (n > md.capacity) {
+		md.capacity = std::max(n, 2*md.capacity);
+		vector<int> indices(md.capacity);
+		for (int i = 0; i < md.capacity; i++)
+			indices[i] = i;
+		glBindBuffer(GL_ARRAY_BUFFER, md.indices);
+		glBufferData(GL_ARRAY_BUFFER, md.capacity*sizeof(int), indices.data(), GL_STATIC_DRAW);
+		glVertexAttribIPointer(8, 1, GL_INT, 0, (void *) 0);
+		glVertexAttribDivisor(8, 1);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, md.commands);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, md.capacity*sizeof(DrawCommand), NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, md.parameters);
+		glBufferData(GL_TEXTURE_BUFFER, md.capacity*sizeof(vec4), NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, md.parameterTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, md.parameters);
+	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, md.commands);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, n*sizeof(DrawCommand), commands.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, md.parameters);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, n*sizeof(vec4), parameters.data());
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0+DrawBufferTextureUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, md.parameterTexture);
+	glActiveTexture(GL_TEXTURE0+MaterialTextureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, md.textures);
+	glActiveTexture(GL_TEXTURE0);
+	SetUniform(shader, "useMultiDraw", true);
+	SetUniform(shader, "useInstanceColor", true);
+	// draw indices only for this draw: left enabled, a DisplayInstanced of more than md.capacity instances
+	// would read past the end of md.indices
+	glEnableVertexAttribArray(8);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, n, 0);
+	glDisableVertexAttribArray(8);
+	SetUniform(shader, "useMultiDraw", false);
+	SetUniform(shader, "useInstanceColor", false);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
 } // end namespace
 
 const char *GetMeshPixelShaderNoLines() { return meshPixelShaderNoLines; }
 
+void SetMeshLines(MeshLines mode) { meshLines = mode; }
+
+MeshLines GetMeshLines() { return meshLines; }
+
 GLuint GetMeshShader(bool lines) {
-	if (lines) {
-		if (!meshShaderLines)
-			meshShaderLines = LinkProgramViaCode(&meshVertexShader, NULL, NULL, &meshGeometryShader, &meshPixelShaderLines);
-		return meshShaderLines;
-	}
-	else {
-		if (!meshShaderNoLines)
-			meshShaderNoLines = LinkProgramViaCode(&meshVertexShader, &meshPixelShaderNoLines);
-		return meshShaderNoLines;
-	}
+	return MeshShader(lines, meshLines == MeshLines::VertexPulling);
 }
 
 GLuint UseMeshShader(bool lines) {
@@ -302,49 +624,145 @@ void Mesh::Display(Camera camera, vec3 c, int textureUnit, bool lines) {
 	color = save;
 }
 
-void Mesh::Display(Camera camera, int textureUnit, bool lines, bool useGroupColor) {
-	int nTris = triangles.size(), nQuads = quads.size();
+namespace {
+
+void Render(Mesh &m, Camera &camera, int textureUnit, bool lines, vector<DrawRange> *ranges, bool materials = false) {
+	// draw all triangles and quads in m.color, or ranges in their colors
+	ProfileScope scope("mesh display", true);
+	int nTris = m.triangles.size(), nQuads = m.quads.size();
 	// enable shader and vertex array object
 	int shader = UseMeshShader(lines);
-	glBindVertexArray(vao);
+	bool pulled = lines && meshLines == MeshLines::VertexPulling;
+	if (pulled) {
+		// vertices fetched from texture buffer views of vbo and ebo
+		if (!emptyVao)
+			glGenVertexArrays(1, &emptyVao);
+		glBindVertexArray(emptyVao);
+		for (int i = 0; i < 3; i++) {
+			glActiveTexture(GL_TEXTURE0+PulledLinesTextureUnit+i);
+			glBindTexture(GL_TEXTURE_BUFFER, m.lineTextures[i]);
+		}
+		glActiveTexture(GL_TEXTURE0);
+		SetUniform(shader, "normalOffset", m.lineNormalOffset);
+		SetUniform(shader, "uvOffset", m.lineUvOffset);
+	}
+	else
+		glBindVertexArray(m.vao);
+	if (lines)
+		SetUniform(shader, "quadStart", nTris);
+	auto DrawTriangles = [pulled, lines, shader](int start, int n) {
+		if (pulled)
+			glDrawArrays(GL_TRIANGLES, 3*start, 3*n);
+		else {
+			if (lines)
+				SetUniform(shader, "primitiveStart", start);
+			glDrawElements(GL_TRIANGLES, 3*n, GL_UNSIGNED_INT, (void *) (3*start*sizeof(int)));
+		}
+	};
 	// texture
-	bool useTexture = textureName > 0 && uvs.size() > 0 && textureUnit >= 0;
+	bool useTexture = materials?
+		m.multiDraw.textures > 0 && !lines && MultiDrawAvailable() :
+		m.textureName > 0 && m.uvs.size() > 0 && textureUnit >= 0;
 	SetUniform(shader, "useTexture", useTexture);
-	if (useTexture) {
+	if (useTexture && !materials) {
 		glActiveTexture(GL_TEXTURE0+textureUnit);
-		glBindTexture(GL_TEXTURE_2D, textureName);
+		glBindTexture(GL_TEXTURE_2D, m.textureName);
 		SetUniform(shader, "textureImage", textureUnit); // but app can unset useTexture
 	}
 	// set matrices
-	SetUniform(shader, "modelview", camera.modelview*toWorld);
+	SetUniform(shader, "modelview", camera.modelview*m.toWorld);
 	SetUniform(shader, "persp", camera.persp);
 	if (lines)
 		SetUniform(shader, "vp", Viewport());
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	if (useGroupColor) {
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.ebo);
+	if (ranges && !lines && MultiDrawAvailable())
+		MultiDrawRanges(m, shader, *ranges);
+	else if (ranges) {
+		// a draw per range (material textures need the multi-draw)
 		int textureSet = 0;
 		glGetUniformiv(shader, glGetUniformLocation(shader, "useTexture"), &textureSet);
-		// show ungrouped triangles without texture mapping
-		int nGroups = triangleGroups.size(), nUngrouped = nGroups? triangleGroups[0].startTriangle : nTris;
-		SetUniform(shader, "useTexture", false);
-		glDrawElements(GL_TRIANGLES, 3*nUngrouped, GL_UNSIGNED_INT, 0); // triangles.data());
-		// show grouped triangles with texture mapping
-		SetUniform(shader, "useTexture", textureSet == 1);
-		for (int i = 0; i < nGroups; i++) {
-			Group g = triangleGroups[i];
-			SetUniform(shader, "color", g.color);
-			glDrawElements(GL_TRIANGLES, 3*g.nTriangles, GL_UNSIGNED_INT, (void *) (3*g.startTriangle*sizeof(int)));
-		}
+		for (DrawRange &r : *ranges)
+			if (r.count) {
+				SetUniform(shader, "useTexture", textureSet == 1 && r.layer == -1);
+				SetUniform(shader, "color", r.color);
+				DrawTriangles(r.start, r.count);
+			}
 	}
 	else {
-		SetUniform(shader, "color", color);
-		glDrawElements(GL_TRIANGLES, 3*nTris, GL_UNSIGNED_INT, 0);
-#ifdef GL_QUADS
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-		glDrawElements(GL_QUADS, 4*nQuads, GL_UNSIGNED_INT, quads.data());
-#endif
+		SetUniform(shader, "color", m.color);
+		DrawTriangles(0, nTris+2*nQuads);				// quads follow triangles in ebo, two triangles each
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+}
+
+} // end namespace
+
+void Mesh::Display(Camera camera, int textureUnit, bool lines, bool useGroupColor) {
+	vector<DrawRange> ranges;
+	if (useGroupColor)
+		GroupRanges(*this, ranges);
+	Render(*this, camera, textureUnit, lines, useGroupColor? &ranges : NULL);
+}
+
+void Mesh::DisplayMaterials(Camera camera, bool lines) {
+	vector<DrawRange> ranges;
+	MaterialRanges(*this, ranges);
+	Render(*this, camera, -1, lines, &ranges, true);
+}
+
+void Mesh::DisplayInstanced(Camera camera, int nInstances, mat4 *transforms, vec3 *colors, bool lines) {
+	if (nInstances <= 0 || !vao)
+		return;
+	// stream instance data: orphan the buffer (so the GPU may still read last frame's), then fill it
+	size_t sizeTransforms = nInstances*sizeof(mat4), sizeColors = colors? nInstances*sizeof(vec3) : 0;
+	size_t size = sizeTransforms+sizeColors;
+	glBindVertexArray(vao);
+	if (!instanceVbo) {
+		glGenBuffers(1, &instanceVbo);
+		instanceCapacity = 0;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+	if (size > instanceCapacity)
+		instanceCapacity = std::max(size, 2*instanceCapacity);
+	glBufferData(GL_ARRAY_BUFFER, instanceCapacity, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeTransforms, transforms);
+	if (colors)
+		glBufferSubData(GL_ARRAY_BUFFER, sizeTransforms, sizeColors, colors);
+	// one row of each transform per attribute (locations 3-6), color at 7; advance once per instance
+	for (int i = 0; i < 4; i++) {
+		glEnableVertexAttribArray(3+i);
+		glVertexAttribPointer(3+i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void *) (i*sizeof(vec4)));
+		glVertexAttribDivisor(3+i, 1);
+	}
+	if (colors) {
+		glEnableVertexAttribArray(7);
+		glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void *) sizeTransforms);
+		glVertexAttribDivisor(7, 1);
+	}
+	else
+		glDisableVertexAttribArray(7);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// uniforms as in Display, for all instances; lines by the geometry shader, which takes vertex attributes
+	int shader = MeshShader(lines, false);
+	glUseProgram(shader);
+	SetUniform(shader, "useTexture", false);
+	SetUniform(shader, "modelview", camera.modelview*toWorld);
+	SetUniform(shader, "persp", camera.persp);
+	if (lines) {
+		SetUniform(shader, "vp", Viewport());
+		SetUniform(shader, "quadStart", (int) triangles.size());
+		SetUniform(shader, "primitiveStart", 0);
 	}
+	SetUniform(shader, "color", color);
+	SetUniform(shader, "useInstance", true);
+	SetUniform(shader, "useInstanceColor", colors != NULL);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glDrawElementsInstanced(GL_TRIANGLES, 3*(triangles.size()+2*quads.size()), GL_UNSIGNED_INT, 0, nInstances);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	// leave the shader as Display expects it
+	SetUniform(shader, "useInstance", false);
+	SetUniform(shader, "useInstanceColor", false);
 	glBindVertexArray(0);
 }
 
@@ -364,24 +782,53 @@ void Mesh::Buffer(vector<vec3> &pts, vector<vec3> *nrms, vector<vec2> *tex) {
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	// allocate GPU memory for vertex position, texture, normals
 	size_t sizePoints = nPts*sizeof(vec3), sizeNormals = nNrms*sizeof(vec3), sizeUvs = nUvs*sizeof(vec2);
-	int bufferSize = sizePoints+sizeUvs+sizeNormals;
+	size_t uvStart = (sizePoints+sizeNormals+sizeof(vec2)-1)/sizeof(vec2)*sizeof(vec2);
+		// uvs start on a vec2 boundary, so the vec2 texel view below can address them
+	int bufferSize = uvStart+sizeUvs;
 	glBufferData(GL_ARRAY_BUFFER, bufferSize, NULL, GL_STATIC_DRAW);
 	// load vertex buffer
 	if (nPts) glBufferSubData(GL_ARRAY_BUFFER, 0, sizePoints, pts.data());
 	if (nNrms) glBufferSubData(GL_ARRAY_BUFFER, sizePoints, sizeNormals, nrms->data());
-	if (nUvs) glBufferSubData(GL_ARRAY_BUFFER, sizePoints+sizeNormals, sizeUvs, tex->data());
-	// create and load element buffer for triangles
-	size_t sizeTriangles = sizeof(int3)*triangles.size();
-	glGenBuffers(1, &ebo);
+	if (nUvs) glBufferSubData(GL_ARRAY_BUFFER, uvStart, sizeUvs, tex->data());
+	// create and load element buffer for triangles, then quads split along diagonal i1-i3
+	size_t nTris = triangles.size(), nQuads = quads.size();
+	size_t sizeTriangles = sizeof(int3)*nTris, sizeQuads = 2*sizeof(int3)*nQuads;
+	if (!ebo)
+		glGenBuffers(1, &ebo);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeTriangles, triangles.data(), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeTriangles+sizeQuads, NULL, GL_STATIC_DRAW);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeTriangles, triangles.data());
+	if (nQuads) {
+		vector<int3> split(2*nQuads);
+		for (size_t i = 0; i < nQuads; i++) {
+			int4 &q = quads[i];
+			split[2*i] = {q.i1, q.i2, q.i3};
+			split[2*i+1] = {q.i1, q.i3, q.i4};
+		}
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, sizeTriangles, sizeQuads, split.data());
+	}
+	// texture buffer views for lines by vertex pulling: points and normals as vec3, uvs as vec2, triangles
+	if (!lineTextures[0])
+		glGenTextures(3, lineTextures);
+	GLenum formats[] = { GL_RGB32F, GL_RG32F, GL_R32I };
+	GLuint buffers[] = { vbo, vbo, ebo };
+	for (int i = 0; i < 3; i++) {
+		glBindTexture(GL_TEXTURE_BUFFER, lineTextures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	lineNormalOffset = nNrms? (int) nPts : -1;
+	lineUvOffset = nUvs? (int) (uvStart/sizeof(vec2)) : -1;
 	// create vertex array object for mesh
-	glGenVertexArrays(1, &vao);
+	if (!vao)
+		glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 	// enable attributes
 	if (nPts) Enable(0, 3, 0);						// VertexAttribPointer(shader, "point", 3, 0, (void *) 0);
 	if (nNrms) Enable(1, 3, sizePoints);			// VertexAttribPointer(shader, "normal", 3, 0, (void *) sizePoints);
-	if (nUvs) Enable(2, 2, sizePoints+sizeNormals); // VertexAttribPointer(shader, "uv", 2, 0, (void *) (sizePoints+sizeNormals));
+	else glDisableVertexAttribArray(1);				// if rebuffered without
+	if (nUvs) Enable(2, 2, uvStart);				// VertexAttribPointer(shader, "uv", 2, 0, (void *) uvStart);
+	else glDisableVertexAttribArray(2);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 }
@@ -440,7 +887,7 @@ bool Mesh::Read(string objFile, string texFile, mat4 *m, bool standardize, bool
 		return false;
 	objFilename = objFile;
 	texFilename = texFile;
-	textureName = ReadTexture((char *) texFile.c_str());
+	textureName = ReadCompressedTexture(texFile.c_str());
 	if (!textureName)
 		printf("Mesh.Read: bad texture name\n");
 	return textureName > 0;
@@ -539,6 +986,24 @@ void BuildQuadInfos(vector<vec3> &points, vector<int4> &quads, vector<QuadInfo>
 		quadInfos[i] = QuadInfo(points[quads[i].i1], points[quads[i].i2], points[quads[i].i3], points[quads[i].i4]);
 }
 
+static void FacetBoxes(Mesh &m, vector<vec3> &lo, vector<vec3> &hi) {
+	// object-space bounds of triangles, then quads
+	size_t nt = m.triangles.size(), nq = m.quads.size();
+	lo.resize(nt+nq);
+	hi.resize(nt+nq);
+	for (size_t i = 0; i < nt+nq; i++) {
+		int n = i < nt? 3 : 4, *v = i < nt? &m.triangles[i].i1 : &m.quads[i-nt].i1;
+		vec3 a = m.points[v[0]], b = a;
+		for (int k = 1; k < n; k++)
+			for (int c = 0; c < 3; c++) {
+				a[c] = std::min(a[c], m.points[v[k]][c]);
+				b[c] = std::max(b[c], m.points[v[k]][c]);
+			}
+		lo[i] = a;
+		hi[i] = b;
+	}
+}
+
 void Mesh::BuildInfos() {
 	vec3 min, max;
 	Bounds(points.data(), points.size(), min, max);
@@ -553,6 +1018,21 @@ void Mesh::BuildInfos() {
 	bounds[5] = QuadInfo(lbf, ltf, rtf, rbf); // far
 	BuildTriInfos(points, triangles, triInfos);
 	BuildQuadInfos(points, quads, quadInfos);
+	vector<vec3> lo, hi;
+	FacetBoxes(*this, lo, hi);
+	facetBVH.Build(lo.data(), hi.data(), (int) lo.size(), 4);
+}
+
+void Mesh::RefitInfos() {
+	if (facetBVH.order.size() != triangles.size()+quads.size()) {
+		BuildInfos();
+		return;
+	}
+	BuildTriInfos(points, triangles, triInfos);
+	BuildQuadInfos(points, quads, quadInfos);
+	vector<vec3> lo, hi;
+	FacetBoxes(*this, lo, hi);
+	facetBVH.Refit(lo.data(), hi.data());
 }
 
 int IntersectWithLine(vec3 p1, vec3 p2, vector<TriInfo> &triInfos, float &retAlpha) {
@@ -592,28 +1072,130 @@ int IntersectWithLine(vec3 p1, vec3 p2, vector<QuadInfo> &quadInfos, float &retA
 	return picked;
 }
 
+static bool HitFacet(Mesh &m, int facet, vec3 p1, vec3 p2, float &alpha) {
+	// facet indexes triangles, then quads
+	vec3 inter;
+	int nt = (int) m.triInfos.size();
+	if (facet < nt) {
+		TriInfo &t = m.triInfos[facet];
+		return LineIntersectPlane(p1, p2, t.plane, &inter, &alpha) && IsInside(MajPln(inter, t.majorPlane), t.p1, t.p2, t.p3);
+	}
+	QuadInfo &q = m.quadInfos[facet-nt];
+	return LineIntersectPlane(p1, p2, q.plane, &inter, &alpha) &&
+		   (IsInside(MajPln(inter, q.majorPlane), q.p1, q.p2, q.p3) || IsInside(MajPln(inter, q.majorPlane), q.p1, q.p3, q.p4));
+}
+
+template<class Visit>
+static void TraverseFacets(Mesh &m, vec3 p1, vec3 p2, float aMin, float &aMax, Visit visit) {
+	// call visit(facet) for facets whose boxes meet p1+alpha*(p2-p1), aMin <= alpha <= aMax, nearer boxes first;
+	// visit returns false to stop, and may lower aMax to prune farther boxes
+	if (m.facetBVH.Empty())
+		return;
+	vector<BVHNode> &nodes = m.facetBVH.nodes;
+	vec3 d = p2-p1, inv(1/d.x, 1/d.y, 1/d.z);
+	int stack[64], nStack = 0;
+	float t0, t1;
+	if (!RayBox(nodes[0], p1, inv, aMax, t0, aMin))
+		return;
+	stack[nStack++] = 0;
+	while (nStack) {
+		BVHNode &n = nodes[stack[--nStack]];
+		if (n.Leaf()) {
+			for (int i = n.first; i < n.first+n.count; i++)
+				if (!visit(m.facetBVH.order[i]))
+					return;
+			continue;
+		}
+		bool h0 = RayBox(nodes[n.first], p1, inv, aMax, t0, aMin), h1 = RayBox(nodes[n.first+1], p1, inv, aMax, t1, aMin);
+		if (h0 && h1) {
+			stack[nStack++] = t0 <= t1? n.first+1 : n.first;
+			stack[nStack++] = t0 <= t1? n.first : n.first+1;
+		}
+		else if (h0 || h1)
+			stack[nStack++] = h0? n.first : n.first+1;
+	}
+}
+
+static MeshHit MakeHit(Mesh &m, int facet, float alpha) {
+	MeshHit h;
+	int nt = (int) m.triInfos.size();
+	(facet < nt? h.triangle : h.quad) = facet < nt? facet : facet-nt;
+	h.alpha = alpha;
+	return h;
+}
+
+static bool Nearest(Mesh &m, vec3 p1, vec3 p2, float aMin, float aMax, MeshHit &hit) {
+	if (m.triInfos.empty() && m.quadInfos.empty())
+		m.BuildInfos();
+	int best = -1;
+	float bestAlpha = aMax;
+	TraverseFacets(m, p1, p2, aMin, aMax, [&](int f) {
+		float a;
+		if (HitFacet(m, f, p1, p2, a) && a >= aMin && a <= aMax) {
+			best = f;
+			bestAlpha = aMax = a;
+		}
+		return true;
+	});
+	if (best >= 0)
+		hit = MakeHit(m, best, bestAlpha);
+	return best >= 0;
+}
+
 bool Mesh::IntersectWithLine(vec3 p1, vec3 p2, float *alpha) {
-	if (triInfos.size() == 0 && quadInfos.size() == 0)
-		BuildInfos();
-	float a;
-	if (::IntersectWithLine(p1, p2, bounds, a) < 0)
+	MeshHit h;
+	if (!Nearest(*this, p1, p2, -FLT_MAX, FLT_MAX, h))
 		return false;
-	if (::IntersectWithLine(p1, p2, triInfos, a) >= 0) {
-		if (alpha) *alpha = a;
-		return true;
-	}
-	if (::IntersectWithLine(p1, p2, quadInfos, a) >= 0) {
-		if (alpha) *alpha = a;
+	if (alpha) *alpha = h.alpha;
+	return true;
+}
+
+static void ToObject(Mesh &m, vec3 &p1, vec3 &p2) {
+	mat4 inv = Invert(m.toWorld);
+	vec4 a = inv*vec4(p1, 1), b = inv*vec4(p2, 1);
+	p1 = vec3(a.x, a.y, a.z)/a.w;
+	p2 = vec3(b.x, b.y, b.z)/b.w;
+}
+
+bool Mesh::NearestHit(vec3 p1, vec3 p2, MeshHit &hit, bool segment) {
+	ToObject(*this, p1, p2);
+	return Nearest(*this, p1, p2, segment? 0 : -FLT_MAX, segment? 1 : FLT_MAX, hit);
+}
+
+bool Mesh::AnyHit(vec3 p1, vec3 p2, bool segment) {
+	if (triInfos.empty() && quadInfos.empty())
+		BuildInfos();
+	ToObject(*this, p1, p2);
+	float aMin = segment? 0 : -FLT_MAX, aMax = segment? 1 : FLT_MAX;
+	bool hit = false;
+	TraverseFacets(*this, p1, p2, aMin, aMax, [&](int f) {
+		float a;
+		hit = HitFacet(*this, f, p1, p2, a) && a >= aMin && a <= aMax;
+		return !hit;
+	});
+	return hit;
+}
+
+int Mesh::AllHits(vec3 p1, vec3 p2, vector<MeshHit> &hits, bool segment) {
+	if (triInfos.empty() && quadInfos.empty())
+		BuildInfos();
+	ToObject(*this, p1, p2);
+	float aMin = segment? 0 : -FLT_MAX, aMax = segment? 1 : FLT_MAX;
+	hits.resize(0);
+	TraverseFacets(*this, p1, p2, aMin, aMax, [&](int f) {
+		float a;
+		if (HitFacet(*this, f, p1, p2, a) && a >= aMin && a <= aMax)
+			hits.push_back(MakeHit(*this, f, a));
 		return true;
-	}
-	return false;
+	});
+	std::sort(hits.begin(), hits.end(), [](const MeshHit &a, const MeshHit &b) { return a.alpha < b.alpha; });
+	return (int) hits.size();
 }
 
 bool Mesh::IntersectWithSegment(vec3 p1, vec3 p2, float *alpha) {
-	float a;
-	if (IntersectWithLine(p1, p2, &a) && a >= 0 && a <= 1) {
-		if (alpha) *alpha = a;
-		return true;
-	}
-	return false;
+	MeshHit h;
+	if (!Nearest(*this, p1, p2, 0, 1, h))
+		return false;
+	if (alpha) *alpha = h.alpha;
+	return true;
 }
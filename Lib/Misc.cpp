@@ -7,6 +7,7 @@
 #include <sys/stat.h>
 #include "stb_image.h"
 #include "Draw.h"
+#include "Image.h"
 #include "Misc.h"
 #include "Quaternion.h"
 
@@ -75,17 +76,8 @@ bool FileExists(const char *name) {
 	return fopen(name, "r") != NULL;
 }
 
-namespace Misc {
-
 // Matting
 
-float GetVal(unsigned char *data, int x, int y, int w, int nChannels) {
-	unsigned char c = data[nChannels == 1? y*w+x : 3*(y*w+x)];
-	return (float) c/255;
-}
-
-float Lerp(float a, float b, float t) { return a+t*(b-a); }
-
 unsigned char *MergeFiles(const char *imageName, const char *matteName, int &imageWidth, int &imageHeight) {
 	int imageNChannels, matteWidth, matteHeight, matteNChannels;
 	unsigned char *imageData = ReadPixels(imageName, imageWidth, imageHeight, imageNChannels);
@@ -93,90 +85,19 @@ unsigned char *MergeFiles(const char *imageName, const char *matteName, int &ima
 	printf("image: %i channels, matte: %i channels\n", imageNChannels, matteNChannels);
 	if (!imageData || !matteData)
 		return NULL;
-	bool sameSize = imageWidth == matteWidth && imageHeight == matteHeight;
 	unsigned char *oData = new unsigned char[4*imageWidth*imageHeight];
-	unsigned char *t = imageData, *m = matteData, *o = oData;
-	for (int j = 0; j < imageHeight; j++)
-		for (int i = 0; i < imageWidth; i++) {
-			for (int k = 0; k < 3; k++)
-				*o++ = *t++;
-			if (imageNChannels == 4) t++;
-			if (sameSize) {
-				*o++ = *m++;
-				if (matteNChannels == 3) m += 2;
-				if (matteNChannels == 4) m += 3;
-			}
-			else {
-				float txf = (float) i/(imageWidth), tyf = (float) j/(imageHeight);
-				float x = txf*matteWidth, y = tyf*matteHeight;
-				int x0 = (int) floor(x), y0 = (int) floor(y);
-				float mxf = x-x0, myf = y-y0;
-				bool lerpX = x0 < matteWidth-1, lerpY = y0 < matteHeight-1;
-				float v00 = GetVal(matteData, x0, y0, matteWidth, matteNChannels), v10, v11, v01;
-				if (lerpX) v10 = GetVal(matteData, x0+1, y0, matteWidth, matteNChannels);
-				if (lerpY) v01 = GetVal(matteData, x0, y0+1, matteWidth, matteNChannels);
-				if (lerpX && lerpY) v11 = GetVal(matteData, x0+1, y0+1, matteWidth, matteNChannels);
-				float v = v00;
-				if (lerpX && !lerpY)
-					v = Lerp(v00, v10, mxf);
-				if (!lerpX && lerpY)
-					v = Lerp(v00, v01, myf);
-				if (lerpX && lerpY) {
-					float v1 = Lerp(v00, v10, mxf), v2 = Lerp(v01, v11, mxf);
-					v = Lerp(v1, v2, myf);
-				}
-				*o++ = (unsigned char) (255.*v);
-			}
-		}
+	MergeMatte(imageData, imageWidth, imageHeight, imageNChannels, matteData, matteWidth, matteHeight, matteNChannels, oData);
 	delete [] imageData;
 	delete [] matteData;
 	return oData;
 }
 
-} // namespace Misc
-
 // Bump map
 
 unsigned char *GetNormals(unsigned char *depthPixels, int width, int height, float depthIncline) {
-	class Helper { public:
-		unsigned char *depthPixels, *bumpPixels;
-		int width = 0, height = 0;
-		float xscale = 1, yscale = 1, depthIncline = 1;
-		float GetDepth(int i, int j) {
-			unsigned char *v = depthPixels+3*(j*width+i); // depth pixels presumed 3 bytes/pixel, with r==g==b
-			return ((float) *v)/255.f;
-		}
-		float Dz(int i1, int j1, int i2, int j2) {
-			return GetDepth(i2, j2)-GetDepth(i1, j1);
-		}
-		vec3 Normal(int i, int j) {
-			int i1 = i > 0? i-1 : i, i2 = i < width-1? i+1 : i;
-			int j1 = j > 0? j-1 : j, j2 = j < height-1? j+1 : j;
-			vec3 vx((float)(i2-i1)*xscale, 0, depthIncline*Dz(i1, j, i2, j));
-			vec3 vy(0, (float)(j2-j1)*yscale, depthIncline*Dz(i, j1, i, j2));
-			vec3 v = cross(vx, vy);
-			v = normalize(v);
-			if (v.z < 0) printf("Normal: v=(%3.2f, %3.2f, %3.2f)!\n", v.x, v.y, v.z);
-			return v; // v.z < 0? -v : v;
-		}
-		Helper(unsigned char *depthPixels, int width, int height, float depthIncline) :
-			depthPixels(depthPixels), width(width), height(height), depthIncline(depthIncline) {
-				// xscale/yscale assumes quad maps to canonical (0,0) to (1,1)
-				xscale = 1/(float)width;
-				yscale = 1/(float)height;
-				int bytesPerPixel = 3, bytesPerImage = width*height*bytesPerPixel; // returned pixels 3 bytes/pixel
-				unsigned char *n = new unsigned char[bytesPerImage];
-				bumpPixels = n;
-				for (int j = 0; j < height; j++)                  // row
-					for (int i = 0; i < width; i++) {             // column
-						vec3 v = Normal(i, j);
-						*n++ = (unsigned char) (127.5f*(v[0]+1)); // red in [-1,1]
-						*n++ = (unsigned char) (127.5f*(v[1]+1)); // grn in [-1,1]
-						*n++ = (unsigned char) (255.f*v[2]);      // blu in [0,1]
-					}
-		}
-	} h(depthPixels, width, height, depthIncline);
-	return h.bumpPixels;
+	unsigned char *bumpPixels = new unsigned char[3*width*height];
+	DepthToNormals(depthPixels, width, height, 3, depthIncline, bumpPixels); // depth pixels presumed 3 bytes/pixel, r==g==b
+	return bumpPixels;
 }
 
 /* Wayside
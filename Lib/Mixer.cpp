@@ -0,0 +1,668 @@
+// Mixer.cpp - real-time software audio mixer with pluggable output
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "AudioDSP.h"
+#include "Mixer.h"
+
+#if defined(_WIN32)
+	#define NOMINMAX
+	#include <windows.h>
+	#include <mmeapi.h>
+	#pragma comment(lib, "winmm.lib")
+#endif
+#if defined(MIXER_ALSA)
+	#include <alsa/asoundlib.h>
+#endif
+#if defined(MIXER_PULSE)
+	#include <pulse/simple.h>
+	#include <pulse/error.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define MIXER_SSE
+#endif
+
+namespace {
+
+const float MinPitch = 1/64.f, MaxPitch = 64;
+
+float ClampPitch(float pitch) {
+	// Fetch walks forward only: a zero, negative or NaN pitch would stall or read before the samples
+	return pitch >= MinPitch? (pitch < MaxPitch? pitch : MaxPitch) : MinPitch;
+}
+
+// Kernels
+
+void MixMono(float *bus, const float *src, int n, float l, float r, float dl, float dr) {
+	// bus (stereo) += src (mono) with left, right gains ramped by dl, dr per frame
+	int i = 0;
+#ifdef MIXER_SSE
+	__m128 g = _mm_setr_ps(l, r, l+dl, r+dr), step = _mm_setr_ps(2*dl, 2*dr, 2*dl, 2*dr);
+	for (; i+4 <= n; i += 4) {
+		__m128 s = _mm_loadu_ps(src+i);
+		__m128 lo = _mm_unpacklo_ps(s, s), hi = _mm_unpackhi_ps(s, s);
+		_mm_storeu_ps(bus+2*i, _mm_add_ps(_mm_loadu_ps(bus+2*i), _mm_mul_ps(lo, g)));
+		g = _mm_add_ps(g, step);
+		_mm_storeu_ps(bus+2*i+4, _mm_add_ps(_mm_loadu_ps(bus+2*i+4), _mm_mul_ps(hi, g)));
+		g = _mm_add_ps(g, step);
+	}
+#endif
+	for (; i < n; i++) {
+		bus[2*i] += (l+i*dl)*src[i];
+		bus[2*i+1] += (r+i*dr)*src[i];
+	}
+}
+
+void MixStereo(float *bus, const float *src, int n, float l, float r, float dl, float dr) {
+	int i = 0;
+#ifdef MIXER_SSE
+	__m128 g = _mm_setr_ps(l, r, l+dl, r+dr), step = _mm_setr_ps(2*dl, 2*dr, 2*dl, 2*dr);
+	for (; i+2 <= n; i += 2) {
+		_mm_storeu_ps(bus+2*i, _mm_add_ps(_mm_loadu_ps(bus+2*i), _mm_mul_ps(_mm_loadu_ps(src+2*i), g)));
+		g = _mm_add_ps(g, step);
+	}
+#endif
+	for (; i < n; i++) {
+		bus[2*i] += (l+i*dl)*src[2*i];
+		bus[2*i+1] += (r+i*dr)*src[2*i+1];
+	}
+}
+
+// Outputs
+
+class NullOutput : public AudioOutput {
+public:
+	NullOutput(bool realTime) : realTime(realTime) { }
+	bool Open(int r, int nc, int) {
+		rate = r;
+		nChannels = nc;
+		next = std::chrono::steady_clock::now();
+		return true;
+	}
+	bool Write(const float *, int nFrames) {
+		Pace(nFrames);
+		return true;
+	}
+	const char *Name() { return "null"; }
+protected:
+	bool realTime;
+	int rate = 0, nChannels = 0;
+	std::chrono::steady_clock::time_point next;
+	void Pace(int nFrames) {
+		if (realTime) {
+			next += std::chrono::microseconds((long long) nFrames*1000000/rate);
+			std::this_thread::sleep_until(next);
+		}
+	}
+};
+
+class FileOutput : public NullOutput {
+public:
+	FileOutput(const char *filename, bool realTime) : NullOutput(realTime), filename(filename? filename : "") { }
+	bool Open(int r, int nc, int periodFrames) {
+		NullOutput::Open(r, nc, periodFrames);
+		file = fopen(filename.c_str(), "wb");
+		if (!file)
+			return false;
+		nBytes = 0;
+		WriteHeader();
+		return true;
+	}
+	bool Write(const float *frames, int nFrames) {
+		int n = nFrames*nChannels;
+		if ((int) shorts.size() < n)
+			shorts.resize(n);
+		FloatToShort(frames, shorts.data(), n);
+		if (fwrite(shorts.data(), sizeof(short), n, file) != (size_t) n)
+			return false;
+		nBytes += n*sizeof(short);
+		Pace(nFrames);
+		return true;
+	}
+	void Close() {
+		if (file) {
+			fseek(file, 0, SEEK_SET);
+			WriteHeader();
+			fclose(file);
+			file = NULL;
+		}
+	}
+	const char *Name() { return "file"; }
+private:
+	std::string filename;
+	FILE *file = NULL;
+	unsigned nBytes = 0;
+	vector<short> shorts;
+	void WriteHeader() {
+		// canonical 44-byte PCM header, sizes patched on Close
+		struct { char riff[4]; unsigned riffSize; char wave[4], fmt[4]; unsigned fmtSize; short format, nChannels;
+				 unsigned rate, bytesPerSec; short blockAlign, bits; char data[4]; unsigned dataSize; } h = {
+			{'R','I','F','F'}, 36+nBytes, {'W','A','V','E'}, {'f','m','t',' '}, 16, 1, (short) nChannels,
+			(unsigned) rate, (unsigned) (2*nChannels*rate), (short) (2*nChannels), 16, {'d','a','t','a'}, nBytes };
+		fwrite(&h, 44, 1, file);
+	}
+};
+
+#if defined(_WIN32)
+class WaveOutOutput : public AudioOutput {
+public:
+	static const int NBuffers = 4;
+	bool Open(int rate, int nc, int periodFrames) {
+		WAVEFORMATEX f = {};
+		f.wFormatTag = WAVE_FORMAT_PCM;
+		f.nChannels = nChannels = nc;
+		f.nSamplesPerSec = rate;
+		f.wBitsPerSample = 16;
+		f.nBlockAlign = 2*nc;
+		f.nAvgBytesPerSec = rate*f.nBlockAlign;
+		event = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if (waveOutOpen(&device, WAVE_MAPPER, &f, (DWORD_PTR) event, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR) {
+			CloseHandle(event);
+			event = NULL;
+			device = NULL;
+			return false;
+		}
+		// a few period-sized buffers queued round-robin; each is refilled as soon as the device returns it
+		for (int b = 0; b < NBuffers; b++) {
+			data[b].resize(periodFrames*nc);
+			headers[b] = {};
+			headers[b].lpData = (LPSTR) data[b].data();
+			headers[b].dwBufferLength = (DWORD) (data[b].size()*sizeof(short));
+			waveOutPrepareHeader(device, &headers[b], sizeof(WAVEHDR));
+			headers[b].dwFlags |= WHDR_DONE;
+		}
+		next = 0;
+		return true;
+	}
+	bool Write(const float *frames, int nFrames) {
+		WAVEHDR &h = headers[next];
+		while (!(((volatile DWORD &) h.dwFlags) & WHDR_DONE))
+			WaitForSingleObject(event, 100);
+		int n = std::min(nFrames*nChannels, (int) data[next].size());
+		FloatToShort(frames, data[next].data(), n);
+		h.dwBufferLength = n*sizeof(short);
+		if (waveOutWrite(device, &h, sizeof(WAVEHDR)) != MMSYSERR_NOERROR)
+			return false;
+		next = (next+1)%NBuffers;
+		return true;
+	}
+	void Close() {
+		if (device) {
+			waveOutReset(device);
+			for (int b = 0; b < NBuffers; b++)
+				waveOutUnprepareHeader(device, &headers[b], sizeof(WAVEHDR));
+			waveOutClose(device);
+			CloseHandle(event);
+			device = NULL;
+		}
+	}
+	const char *Name() { return "waveOut"; }
+private:
+	HWAVEOUT device = NULL;
+	HANDLE event = NULL;
+	WAVEHDR headers[NBuffers];
+	vector<short> data[NBuffers];
+	int nChannels = 2, next = 0;
+};
+#endif
+
+#if defined(MIXER_ALSA)
+class AlsaOutput : public AudioOutput {
+public:
+	bool Open(int rate, int nc, int periodFrames) {
+		nChannels = nc;
+		if (snd_pcm_open(&pcm, "default", SND_PCM_STREAM_PLAYBACK, 0) < 0) {
+			pcm = NULL;
+			return false;
+		}
+		// device buffer of three periods
+		unsigned latency = (unsigned) (3LL*periodFrames*1000000/rate);
+		if (snd_pcm_set_params(pcm, SND_PCM_FORMAT_FLOAT_LE, SND_PCM_ACCESS_RW_INTERLEAVED, nc, rate, 1, latency) < 0) {
+			Close();
+			return false;
+		}
+		return true;
+	}
+	bool Write(const float *frames, int nFrames) {
+		while (nFrames > 0) {
+			snd_pcm_sframes_t n = snd_pcm_writei(pcm, frames, nFrames);
+			if (n < 0) {
+				// underrun or suspend: recover and retry
+				if (snd_pcm_recover(pcm, (int) n, 1) < 0)
+					return false;
+				continue;
+			}
+			frames += n*nChannels;
+			nFrames -= (int) n;
+		}
+		return true;
+	}
+	void Close() {
+		if (pcm) {
+			snd_pcm_drain(pcm);
+			snd_pcm_close(pcm);
+			pcm = NULL;
+		}
+	}
+	const char *Name() { return "ALSA"; }
+private:
+	snd_pcm_t *pcm = NULL;
+	int nChannels = 2;
+};
+#endif
+
+#if defined(MIXER_PULSE)
+class PulseOutput : public AudioOutput {
+public:
+	bool Open(int rate, int nc, int periodFrames) {
+		pa_sample_spec spec = { PA_SAMPLE_FLOAT32LE, (uint32_t) rate, (uint8_t) nc };
+		uint32_t periodBytes = (uint32_t) (periodFrames*nc*sizeof(float));
+		pa_buffer_attr attr = { (uint32_t) -1, 3*periodBytes, (uint32_t) -1, periodBytes, (uint32_t) -1 };
+		int error = 0;
+		stream = pa_simple_new(NULL, "SpaceRocks", PA_STREAM_PLAYBACK, NULL, "mixer", &spec, NULL, &attr, &error);
+		if (!stream)
+			printf("PulseAudio: %s\n", pa_strerror(error));
+		nChannels = nc;
+		return stream != NULL;
+	}
+	bool Write(const float *frames, int nFrames) {
+		int error = 0;
+		return pa_simple_write(stream, frames, nFrames*nChannels*sizeof(float), &error) >= 0;
+	}
+	void Close() {
+		if (stream) {
+			int error = 0;
+			pa_simple_drain(stream, &error);
+			pa_simple_free(stream);
+			stream = NULL;
+		}
+	}
+	const char *Name() { return "PulseAudio"; }
+private:
+	pa_simple *stream = NULL;
+	int nChannels = 2;
+};
+#endif
+
+Mixer *sharedMixer = NULL;			// the mixer returned by GetMixer
+bool sharedMixerDestroyed = false;
+
+} // end namespace
+
+AudioOutput *NewAudioOutput(OutputType type, const char *filename, bool realTime) {
+	if (type == OutputType::Default) {
+#if defined(_WIN32)
+		type = OutputType::WaveOut;
+#elif defined(MIXER_PULSE)
+		type = OutputType::Pulse;
+#elif defined(MIXER_ALSA)
+		type = OutputType::ALSA;
+#else
+		type = OutputType::Null;
+#endif
+	}
+	switch (type) {
+		case OutputType::Null: return new NullOutput(realTime);
+		case OutputType::File: return new FileOutput(filename, realTime);
+#if defined(_WIN32)
+		case OutputType::WaveOut: return new WaveOutOutput();
+#endif
+#if defined(MIXER_ALSA)
+		case OutputType::ALSA: return new AlsaOutput();
+#endif
+#if defined(MIXER_PULSE)
+		case OutputType::Pulse: return new PulseOutput();
+#endif
+		default: return NULL;
+	}
+}
+
+// Ring
+
+void SampleRing::Allocate(int nSamples) {
+	data.assign(nSamples, 0);
+	writeCount = readCount = 0;
+}
+
+int SampleRing::Available() {
+	return (int) (writeCount.load(std::memory_order_acquire)-readCount.load(std::memory_order_acquire));
+}
+
+int SampleRing::Free() {
+	return (int) data.size()-Available();
+}
+
+int SampleRing::Write(const float *samples, int n) {
+	size_t w = writeCount.load(std::memory_order_relaxed), size = data.size();
+	n = std::min(n, (int) (size-(w-readCount.load(std::memory_order_acquire))));
+	// copy in at most two spans, around the end of data
+	int first = std::min(n, (int) (size-w%size));
+	memcpy(data.data()+w%size, samples, first*sizeof(float));
+	memcpy(data.data(), samples+first, (n-first)*sizeof(float));
+	writeCount.store(w+n, std::memory_order_release);
+	return n;
+}
+
+int SampleRing::Read(float *samples, int n) {
+	size_t r = readCount.load(std::memory_order_relaxed), size = data.size();
+	n = std::min(n, (int) (writeCount.load(std::memory_order_acquire)-r));
+	int first = std::min(n, (int) (size-r%size));
+	memcpy(samples, data.data()+r%size, first*sizeof(float));
+	memcpy(samples+first, data.data(), (n-first)*sizeof(float));
+	readCount.store(r+n, std::memory_order_release);
+	return n;
+}
+
+// Mixer: device
+
+Mixer::Mixer() {
+	for (int i = 0; i < MaxVoices; i++) {
+		slotIds[i] = 0;
+		slotTimes[i] = -1;
+	}
+	scratch.resize(2*ChunkFrames);
+}
+
+Mixer::~Mixer() {
+	if (this == sharedMixer)
+		sharedMixerDestroyed = true;
+	Close();
+}
+
+bool Mixer::Open(OutputType type, int rate, int periodFrames, const char *filename) {
+	if (Open(NewAudioOutput(type, filename), rate, periodFrames))
+		return true;
+	if (type != OutputType::Default)
+		return false;
+	printf("no audio device, continuing without sound\n");
+	return Open(NewAudioOutput(OutputType::Null), rate, periodFrames);
+}
+
+bool Mixer::Open(AudioOutput *o, int r, int period) {
+	Close();
+	if (!o) {
+		printf("audio output not built into this library\n");
+		return false;
+	}
+	if (!o->Open(r, 2, period)) {
+		printf("can't open %s audio output\n", o->Name());
+		delete o;
+		return false;
+	}
+	output = o;
+	rate = r;
+	periodFrames = period;
+	running = true;
+	thread = std::thread(&Mixer::Run, this);
+	return true;
+}
+
+void Mixer::Close() {
+	running = false;
+	if (thread.joinable())
+		thread.join();
+	if (output) {
+		output->Close();
+		delete output;
+		output = NULL;
+	}
+}
+
+void Mixer::Run() {
+#if defined(_WIN32)
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#endif
+	vector<float> buffer(2*periodFrames);
+	while (running) {
+		Render(buffer.data(), periodFrames);
+		if (!output->Write(buffer.data(), periodFrames)) {
+			printf("%s audio output failed\n", output->Name());
+			running = false;
+		}
+	}
+}
+
+// Mixer: commands
+
+bool Mixer::Push(const Command &c) {
+	unsigned h = head.load(std::memory_order_relaxed);
+	if (h-tail.load(std::memory_order_acquire) >= QueueSize)
+		return false;
+	queue[h%QueueSize] = c;
+	head.store(h+1, std::memory_order_release);
+	return true;
+}
+
+int Mixer::Play(const Sound *sound, float gain, float pan, float pitch, bool loop) {
+	if (!sound || !sound->Frames())
+		return 0;
+	Command c = { Command::Start, nextVoice, sound, NULL, gain, pan, ClampPitch(pitch), loop };
+	if (!Push(c))
+		return 0;
+	return nextVoice++;
+}
+
+int Mixer::PlayStream(AudioStream *stream, float gain, float pan) {
+	if (!stream)
+		return 0;
+	Command c = { Command::Start, nextVoice, NULL, stream, gain, pan, 1, false };
+	if (!Push(c))
+		return 0;
+	return nextVoice++;
+}
+
+void Mixer::Stop(int voice, float fadeSeconds) { Push({ Command::Stop, voice, NULL, NULL, fadeSeconds }); }
+
+void Mixer::Pause(int voice, bool pause) { Push({ Command::Pause, voice, NULL, NULL, 0, 0, 0, pause }); }
+
+void Mixer::SetGain(int voice, float gain) { Push({ Command::Gain, voice, NULL, NULL, gain }); }
+
+void Mixer::SetPan(int voice, float pan) { Push({ Command::Pan, voice, NULL, NULL, pan }); }
+
+void Mixer::SetPitch(int voice, float pitch) { Push({ Command::Pitch, voice, NULL, NULL, ClampPitch(pitch) }); }
+
+void Mixer::SetMasterGain(float gain) { Push({ Command::Master, 0, NULL, NULL, gain }); }
+
+void Mixer::StopAll(float fadeSeconds) { Push({ Command::StopAll, 0, NULL, NULL, fadeSeconds }); }
+
+bool Mixer::Playing(int voice) {
+	if (voice <= 0)
+		return false;
+	if (voice > lastStarted.load())
+		return true;
+	for (int i = 0; i < MaxVoices; i++)
+		if (slotIds[i].load() == voice)
+			return true;
+	return false;
+}
+
+float Mixer::Position(int voice) {
+	for (int i = 0; i < MaxVoices; i++)
+		if (voice > 0 && slotIds[i].load() == voice)
+			return slotTimes[i].load();
+	return voice > lastStarted.load()? 0 : -1;
+}
+
+int Mixer::NVoicesActive() {
+	int n = 0;
+	for (int i = 0; i < MaxVoices; i++)
+		n += slotIds[i].load() != 0;
+	return n;
+}
+
+void Mixer::Apply(const Command &c) {
+	if (c.type == Command::Master) {
+		masterGain = c.a;
+		return;
+	}
+	if (c.type == Command::Start) {
+		// free slot, else steal oldest one-shot, else oldest
+		int slot = -1;
+		for (int i = 0; i < MaxVoices && slot < 0; i++)
+			if (!voices[i].Active())
+				slot = i;
+		for (int pass = 0; pass < 2 && slot < 0; pass++) {
+			int oldest = 0;
+			for (int i = 0; i < MaxVoices; i++)
+				if ((pass || !voices[i].loop) && (slot < 0 || voices[i].id < oldest)) {
+					slot = i;
+					oldest = voices[i].id;
+				}
+		}
+		Voice &v = voices[slot];
+		v = Voice();
+		v.id = c.voice;
+		v.sound = c.sound;
+		v.stream = c.stream;
+		v.gain = c.a;
+		v.pan = c.b;
+		v.pitch = c.c;
+		v.loop = c.flag;
+		slotIds[slot] = v.id;
+		slotTimes[slot] = 0;
+		lastStarted = c.voice;
+		return;
+	}
+	for (Voice &v : voices) {
+		if (!v.Active() || (c.type != Command::StopAll && v.id != c.voice))
+			continue;
+		switch (c.type) {
+			case Command::Stop:
+			case Command::StopAll:
+				v.stopping = true;
+				v.fadeRate = c.a > 0? 1/(c.a*rate) : 1;
+				break;
+			case Command::Pause: v.paused = c.flag; break;
+			case Command::Gain: v.gain = c.a; break;
+			case Command::Pan: v.pan = c.a; break;
+			case Command::Pitch: if (!v.stream) v.pitch = c.a; break;
+			default: break;
+		}
+	}
+}
+
+// Mixer: rendering
+
+int Mixer::Fetch(Voice &v, float *dst, int n) {
+	// read n frames of (up to) two channels from v.sound at v.pitch, linearly interpolated
+	// return number of frames before a one-shot sound ended; remainder is zeroed
+	if (v.stream) {
+		// streams are decoded at the mixer rate; a short read is an underrun unless the stream has ended
+		int nc = v.stream->Channels() > 1? 2 : 1, i = v.stream->Read(dst, n);
+		memset(dst+i*nc, 0, (n-i)*nc*sizeof(float));
+		v.position += i;
+		if (i < n && !v.stream->Finished()) {
+			underruns++;
+			return n;
+		}
+		return i;
+	}
+	const Sound *s = v.sound;
+	int frames = s->Frames(), stride = s->nChannels, nc = stride > 1? 2 : 1;
+	const float *src = s->samples.data();
+	double step = (double) v.pitch*s->rate/rate;
+	int i = 0;
+	while (i < n) {
+		if (v.position >= frames) {
+			if (!v.loop)
+				break;
+			v.position = fmod(v.position, (double) frames);
+		}
+		int i0 = (int) v.position;
+		if (step == 1 && v.position == i0) {
+			// unit rate: copy span
+			int count = std::min(n-i, frames-i0);
+			if (stride == nc)
+				memcpy(dst+i*nc, src+i0*stride, count*nc*sizeof(float));
+			else
+				for (int k = 0; k < count; k++)
+					for (int c = 0; c < nc; c++)
+						dst[(i+k)*nc+c] = src[(i0+k)*stride+c];
+			i += count;
+			v.position += count;
+			continue;
+		}
+		int i1 = i0+1 < frames? i0+1 : v.loop? 0 : i0;
+		float f = (float) (v.position-i0);
+		for (int c = 0; c < nc; c++) {
+			float a = src[i0*stride+c], b = src[i1*stride+c];
+			dst[i*nc+c] = a+f*(b-a);
+		}
+		v.position += step;
+		i++;
+	}
+	if (i < n)
+		memset(dst+i*nc, 0, (n-i)*nc*sizeof(float));
+	return i;
+}
+
+void Mixer::MixVoice(Voice &v, int slot, float *bus, int n) {
+	if (v.paused)
+		return;
+	bool stereo = v.Stereo();
+	float pan = std::max(-1.f, std::min(1.f, v.pan)), l, r;
+	if (stereo) {
+		// balance
+		l = v.gain*std::min(1.f, 1-pan);
+		r = v.gain*std::min(1.f, 1+pan);
+	}
+	else {
+		// constant power, unity at center
+		l = v.gain*sqrt(1-pan);
+		r = v.gain*sqrt(1+pan);
+	}
+	float fadeEnd = v.stopping? std::max(0.f, v.fade-v.fadeRate*n) : 1;
+	l *= fadeEnd;
+	r *= fadeEnd;
+	if (v.fresh) {
+		v.l = l;
+		v.r = r;
+		v.fresh = false;
+	}
+	int nRead = Fetch(v, scratch.data(), n);
+	float dl = (l-v.l)/n, dr = (r-v.r)/n;
+	if (stereo)
+		MixStereo(bus, scratch.data(), nRead, v.l, v.r, dl, dr);
+	else
+		MixMono(bus, scratch.data(), nRead, v.l, v.r, dl, dr);
+	v.l = l;
+	v.r = r;
+	v.fade = fadeEnd;
+	if (nRead < n || (v.stopping && fadeEnd <= 0)) {
+		v = Voice();
+		slotIds[slot] = 0;
+		slotTimes[slot] = -1;
+	}
+	else
+		slotTimes[slot] = (float) (v.position/(v.stream? rate : v.sound->rate));
+}
+
+void Mixer::Render(float *out, int nFrames) {
+	unsigned t = tail.load(std::memory_order_relaxed), h = head.load(std::memory_order_acquire);
+	for (; t != h; t++)
+		Apply(queue[t%QueueSize]);
+	tail.store(t, std::memory_order_release);
+	while (nFrames > 0) {
+		int n = std::min(nFrames, (int) ChunkFrames);
+		memset(out, 0, 2*n*sizeof(float));
+		for (int i = 0; i < MaxVoices; i++)
+			if (voices[i].Active())
+				MixVoice(voices[i], i, out, n);
+		ScaleSamples(out, out, 2*n, masterGain);
+		out += 2*n;
+		nFrames -= n;
+	}
+}
+
+Mixer &GetMixer() {
+	static Mixer mixer;
+	sharedMixer = &mixer;
+	return mixer;
+}
+
+bool MixerAlive() { return !sharedMixerDestroyed; }
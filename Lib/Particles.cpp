@@ -0,0 +1,785 @@
+// Particles.cpp - ballistic particles: CPU (SoA, parallel SIMD) and GPU (compute shader) simulation, single-draw rendering
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include "GLXtras.h"
+#include "Jobs.h"
+#include "Particles.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define PARTICLES_SSE
+#endif
+
+namespace {
+
+const int ChunkSize = 16384;	// particles per job; a multiple of 4 so only the last chunk has a scalar tail
+const float MaxStep = .1f;		// longer frames (window drags, breakpoints) are clamped to avoid tunneling
+
+uint32_t PackColor(float r, float g, float b) {
+	auto Byte = [](float v) { return (uint32_t) (v <= 0? 0 : v >= 1? 255 : v*255.f+.5f); };
+	return Byte(r) | (Byte(g) << 8) | (Byte(b) << 16) | (255u << 24);
+}
+
+template<class T> void Copy(const int *dst, const int *src, int n, T *v) {
+	for (int k = 0; k < n; k++)
+		v[dst[k]] = v[src[k]];
+}
+
+struct PointVertex {
+	float x, y, z, size;
+	uint32_t color;
+	float remaining;			// seconds of life left
+};
+
+const char *pointVShader = R"(
+	#version 330 core
+	in vec4 point;
+	in vec4 color;
+	in float remaining;
+	out vec4 vColor;
+	uniform mat4 modelview, persp;
+	uniform float fade;
+	void main() {
+		gl_Position = persp*modelview*vec4(point.xyz, 1);
+		gl_PointSize = point.w;
+		vColor = vec4(color.rgb, color.a*(fade > 0? clamp(remaining/fade, 0, 1) : 1));
+	}
+)";
+
+const char *pointPShader = R"(
+	#version 330 core
+	in vec4 vColor;
+	out vec4 pColor;
+	void main() {
+		// round sprite, edge softened over the outer pixel or so
+		vec2 d = gl_PointCoord-vec2(.5);
+		float r2 = dot(d, d);
+		if (r2 > .25)
+			discard;
+		pColor = vec4(vColor.rgb, vColor.a*smoothstep(.25, .2, r2));
+	}
+)";
+
+} // end namespace
+
+// Random numbers
+
+void FastRandom::Seed(uint64_t seed) {
+	// splitmix64 expands the seed so nearby seeds give unrelated streams
+	for (int i = 0; i < 2; i++) {
+		uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27))*0x94d049bb133111ebull;
+		s[i] = z ^ (z >> 31);
+	}
+}
+
+// Storage
+
+void ParticleSystem::Arrays::Resize(int n) {
+	for (vector<float> *v : {&px, &py, &pz, &vx, &vy, &vz, &age, &life, &size, &free, &childRate, &nextChild})
+		v->resize(n);
+	color.resize(n);
+	level.resize(n);
+}
+
+ParticleSystem::ParticleSystem(int cap) : capacity(std::max(cap, 1)) {
+	a.Resize(capacity);
+	int nWorkers = GetJobSystem().NWorkers();
+	random.resize(nWorkers);
+	for (int w = 0; w < nWorkers; w++)
+		random[w].Seed(0x5eed0000+w);
+	spawns.resize(nWorkers);
+}
+
+ParticleSystem::~ParticleSystem() {
+	if (vbo)
+		glDeleteBuffers(1, &vbo);
+	if (vao)
+		glDeleteVertexArrays(1, &vao);
+}
+
+void ParticleSystem::Clear() {
+	count = 0;
+	emitDebt = 0;
+	for (vector<Spawn> &s : spawns)
+		s.clear();
+}
+
+// Spawning
+
+void ParticleSystem::Init(int i, const Spawn *parent, FastRandom &r) {
+	const ParticleEmitter &e = emitter;
+	int lev = parent? parent->level : 0;
+	// later generations are drawn from the lower part of each range, as in the original demo
+	float s = powf(e.levelDecay, (float) lev);
+	a.life[i] = e.minLifetime+s*r.Uniform()*(e.maxLifetime-e.minLifetime);
+	a.size[i] = e.minSize+s*r.Uniform()*(e.maxSize-e.minSize);
+	float speed = e.minSpeed+s*r.Uniform()*(e.maxSpeed-e.minSpeed);
+	float rate = e.minChildRate+s*r.Uniform()*(e.maxChildRate-e.minChildRate);
+	float azimuth = r.Uniform(0, 6.2831853f), elevation = r.Uniform(e.minElevation, e.maxElevation);
+	float ce = cosf(elevation);
+	a.vx[i] = speed*ce*cosf(azimuth);
+	a.vy[i] = speed*sinf(elevation);
+	a.vz[i] = speed*ce*sinf(azimuth);
+	if (parent) {
+		a.px[i] = parent->position.x;
+		a.py[i] = parent->position.y;
+		a.pz[i] = parent->position.z;
+		a.color[i] = parent->color;
+	}
+	else {
+		a.px[i] = e.position.x+e.jitter.x*r.Uniform(-1, 1);
+		a.py[i] = e.position.y+e.jitter.y*r.Uniform(-1, 1);
+		a.pz[i] = e.position.z+e.jitter.z*r.Uniform(-1, 1);
+		a.color[i] = PackColor(r.Uniform(e.minColor.x, e.maxColor.x), r.Uniform(e.minColor.y, e.maxColor.y),
+							   r.Uniform(e.minColor.z, e.maxColor.z));
+	}
+	a.age[i] = 0;
+	a.free[i] = 1;
+	a.childRate[i] = rate;
+	a.nextChild[i] = rate > 0? 1/rate : 0;
+	a.level[i] = (uint8_t) std::min(lev, 255);
+}
+
+int ParticleSystem::SpawnAll(int nEmit) {
+	// children from every worker's list follow the emitted particles, in worker order
+	vector<Spawn> children;
+	for (vector<Spawn> &s : spawns) {
+		children.insert(children.end(), s.begin(), s.end());
+		s.clear();
+	}
+	int n = std::min(capacity-count, nEmit+(int) children.size()), first = count;
+	GetJobSystem().ParallelFor(n, ChunkSize, [&](int begin, int end, int worker) {
+		FastRandom &r = random[worker];
+		for (int k = begin; k < end; k++)
+			Init(first+k, k < nEmit? NULL : &children[k-nEmit], r);
+	});
+	count += n;
+	return n;
+}
+
+int ParticleSystem::Emit(int n) {
+	return SpawnAll(std::max(0, n));
+}
+
+// Update
+
+void ParticleSystem::Move(int begin, int end, float dt) {
+	// gravity, Euler step, plane and cylinder bounces
+	int i = begin;
+	float gdt = gravity*dt, pe = planeRestitution, ce = cylinderRestitution;
+#ifdef PARTICLES_SSE
+	const __m128 zero = _mm_setzero_ps(), vdt = _mm_set1_ps(dt), vgdt = _mm_set1_ps(gdt);
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 vRest = _mm_set1_ps(restSpeed), vpe = _mm_set1_ps(-pe), vce = _mm_set1_ps(-ce);
+	auto Select = [](__m128 mask, __m128 a, __m128 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); };
+	for (; i+4 <= end; i += 4) {
+		__m128 px = _mm_loadu_ps(&a.px[i]), py = _mm_loadu_ps(&a.py[i]), pz = _mm_loadu_ps(&a.pz[i]);
+		__m128 vx = _mm_loadu_ps(&a.vx[i]), vy = _mm_loadu_ps(&a.vy[i]), vz = _mm_loadu_ps(&a.vz[i]);
+		__m128 free = _mm_loadu_ps(&a.free[i]);
+		vy = _mm_sub_ps(vy, _mm_mul_ps(vgdt, free));
+		px = _mm_add_ps(px, _mm_mul_ps(vx, vdt));
+		py = _mm_add_ps(py, _mm_mul_ps(vy, vdt));
+		pz = _mm_add_ps(pz, _mm_mul_ps(vz, vdt));
+		for (const ParticlePlane &p : planes) {
+			__m128 nx = _mm_set1_ps(p.normal.x), ny = _mm_set1_ps(p.normal.y), nz = _mm_set1_ps(p.normal.z);
+			__m128 d = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_mul_ps(nz, pz)), _mm_set1_ps(p.offset));
+			__m128 vn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, vx), _mm_mul_ps(ny, vy)), _mm_mul_ps(nz, vz));
+			__m128 hit = _mm_and_ps(_mm_cmplt_ps(d, zero), _mm_cmplt_ps(vn, zero));
+			if (!_mm_movemask_ps(hit))
+				continue;
+			// project onto plane, reflect normal velocity scaled by restitution
+			d = _mm_and_ps(hit, d);
+			px = _mm_sub_ps(px, _mm_mul_ps(d, nx));
+			py = _mm_sub_ps(py, _mm_mul_ps(d, ny));
+			pz = _mm_sub_ps(pz, _mm_mul_ps(d, nz));
+			__m128 vnNew = _mm_mul_ps(vpe, vn), dv = _mm_and_ps(hit, _mm_sub_ps(vnNew, vn));
+			vx = _mm_add_ps(vx, _mm_mul_ps(dv, nx));
+			vy = _mm_add_ps(vy, _mm_mul_ps(dv, ny));
+			vz = _mm_add_ps(vz, _mm_mul_ps(dv, nz));
+			__m128 rest = _mm_and_ps(hit, _mm_cmplt_ps(_mm_and_ps(vnNew, absMask), vRest));
+			vx = _mm_andnot_ps(rest, vx);
+			vy = _mm_andnot_ps(rest, vy);
+			vz = _mm_andnot_ps(rest, vz);
+			free = _mm_andnot_ps(rest, free);
+		}
+		for (const ParticleCylinder &c : cylinders) {
+			__m128 dx = _mm_sub_ps(px, _mm_set1_ps(c.base.x)), dz = _mm_sub_ps(pz, _mm_set1_ps(c.base.z));
+			__m128 top = _mm_set1_ps(c.base.y+c.height);
+			__m128 inside = _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), _mm_set1_ps(c.radius*c.radius));
+			inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmplt_ps(py, top), _mm_cmpgt_ps(py, _mm_set1_ps(c.base.y))));
+			inside = _mm_and_ps(inside, _mm_cmplt_ps(vy, zero));
+			py = Select(inside, top, py);
+			vy = Select(inside, _mm_mul_ps(vce, vy), vy);
+		}
+		_mm_storeu_ps(&a.px[i], px);
+		_mm_storeu_ps(&a.py[i], py);
+		_mm_storeu_ps(&a.pz[i], pz);
+		_mm_storeu_ps(&a.vx[i], vx);
+		_mm_storeu_ps(&a.vy[i], vy);
+		_mm_storeu_ps(&a.vz[i], vz);
+		_mm_storeu_ps(&a.free[i], free);
+		_mm_storeu_ps(&a.age[i], _mm_add_ps(_mm_loadu_ps(&a.age[i]), vdt));
+	}
+#endif
+	for (; i < end; i++) {
+		float &px = a.px[i], &py = a.py[i], &pz = a.pz[i], &vx = a.vx[i], &vy = a.vy[i], &vz = a.vz[i];
+		vy -= gdt*a.free[i];
+		px += vx*dt;
+		py += vy*dt;
+		pz += vz*dt;
+		for (const ParticlePlane &p : planes) {
+			float d = dot(p.normal, vec3(px, py, pz))-p.offset, vn = dot(p.normal, vec3(vx, vy, vz));
+			if (d < 0 && vn < 0) {
+				float vnNew = -pe*vn, dv = vnNew-vn;
+				px -= d*p.normal.x; py -= d*p.normal.y; pz -= d*p.normal.z;
+				vx += dv*p.normal.x; vy += dv*p.normal.y; vz += dv*p.normal.z;
+				if (fabsf(vnNew) < restSpeed) {
+					vx = vy = vz = 0;
+					a.free[i] = 0;
+				}
+			}
+		}
+		for (const ParticleCylinder &c : cylinders) {
+			float dx = px-c.base.x, dz = pz-c.base.z, top = c.base.y+c.height;
+			if (dx*dx+dz*dz < c.radius*c.radius && py < top && py > c.base.y && vy < 0) {
+				py = top;
+				vy = -ce*vy;
+			}
+		}
+		a.age[i] += dt;
+	}
+}
+
+int ParticleSystem::Compact() {
+	// dead particles below the new count are overwritten by survivors from above it, so the cost is
+	// proportional to the number that died; pairs are independent and copied in parallel, one array at a time
+	int nDead = 0;
+	for (vector<int> &d : chunkDead)
+		nDead += (int) d.size();
+	if (!nDead)
+		return 0;
+	int live = count-nDead;
+	vector<int> holes, donors;
+	holes.reserve(nDead);
+	for (vector<int> &d : chunkDead)
+		for (int i : d)
+			if (i < live)
+				holes.push_back(i);
+	for (int i = live; i < count && donors.size() < holes.size(); i++)
+		if (a.age[i] < a.life[i])
+			donors.push_back(i);
+	int nMoves = (int) holes.size();
+	GetJobSystem().ParallelFor(nMoves, ChunkSize, [&](int begin, int end, int) {
+		const int *dst = holes.data()+begin, *src = donors.data()+begin;
+		int n = end-begin;
+		Copy(dst, src, n, a.color.data());
+		Copy(dst, src, n, a.level.data());
+		for (vector<float> Arrays::*f : {&Arrays::px, &Arrays::py, &Arrays::pz, &Arrays::vx, &Arrays::vy, &Arrays::vz,
+				&Arrays::age, &Arrays::life, &Arrays::size, &Arrays::free, &Arrays::childRate, &Arrays::nextChild})
+			Copy(dst, src, n, (a.*f).data());
+	});
+	count = live;
+	return nDead;
+}
+
+void ParticleSystem::Update(float dt) {
+	dt = std::min(std::max(dt, 0.f), MaxStep);
+	chunkDead.resize(JobSystem::Chunks(count, ChunkSize));
+	int maxLevel = emitter.maxLevel;
+	GetJobSystem().ParallelFor(count, ChunkSize, [&](int begin, int end, int worker) {
+		Move(begin, end, dt);
+		// age out; particles at rest emit children
+		vector<Spawn> &children = spawns[worker];
+		vector<int> &dead = chunkDead[begin/ChunkSize];
+		dead.clear();
+		const float *age = a.age.data(), *life = a.life.data(), *free = a.free.data(), *rate = a.childRate.data();
+		float *next = a.nextChild.data();
+		for (int i = begin; i < end; i++) {
+			if (age[i] >= life[i]) {
+				dead.push_back(i);
+				continue;
+			}
+			if (free[i] == 0 && rate[i] > 0 && (next[i] -= dt) <= 0 && a.level[i] < maxLevel) {
+				next[i] += 1/rate[i];
+				children.push_back({vec3(a.px[i], a.py[i], a.pz[i]), a.color[i], a.level[i]+1});
+			}
+		}
+	});
+	Compact();
+	emitDebt += emitter.rate*dt;
+	int nEmit = (int) emitDebt;
+	emitDebt -= nEmit;
+	SpawnAll(nEmit);
+}
+
+// Rendering
+
+void ParticleSystem::Draw(mat4 modelview, mat4 persp, float fadeSeconds) {
+	if (!program) {
+		program = LinkProgramViaCode(&pointVShader, &pointPShader);
+		if (!program) {
+			printf("ParticleSystem: can't link point shader\n");
+			return;
+		}
+	}
+	if (!vao) {
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+	}
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	if (vboCapacity < count) {
+		vboCapacity = capacity;
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) vboCapacity*sizeof(PointVertex), NULL, GL_STREAM_DRAW);
+		GLint point = glGetAttribLocation(program, "point"), color = glGetAttribLocation(program, "color");
+		GLint remaining = glGetAttribLocation(program, "remaining");
+		glEnableVertexAttribArray(point);
+		glVertexAttribPointer(point, 4, GL_FLOAT, GL_FALSE, sizeof(PointVertex), (void *) 0);
+		glEnableVertexAttribArray(color);
+		glVertexAttribPointer(color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PointVertex), (void *) offsetof(PointVertex, color));
+		glEnableVertexAttribArray(remaining);
+		glVertexAttribPointer(remaining, 1, GL_FLOAT, GL_FALSE, sizeof(PointVertex), (void *) offsetof(PointVertex, remaining));
+	}
+	if (count > 0) {
+		// invalidating the range lets the driver hand back fresh storage instead of waiting on the last draw
+		PointVertex *v = (PointVertex *) glMapBufferRange(GL_ARRAY_BUFFER, 0, (GLsizeiptr) count*sizeof(PointVertex),
+														   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (!v)
+			return;
+		GetJobSystem().ParallelFor(count, ChunkSize, [&](int begin, int end, int) {
+			for (int i = begin; i < end; i++)
+				v[i] = {a.px[i], a.py[i], a.pz[i], a.size[i], a.color[i], a.life[i]-a.age[i]};
+		});
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	GLint prev = CurrentProgram();
+	glUseProgram(program);
+	SetUniform(program, "modelview", modelview);
+	SetUniform(program, "persp", persp);
+	SetUniform(program, "fade", fadeSeconds);
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	glDrawArrays(GL_POINTS, 0, count);
+	glUseProgram(prev);
+}
+
+// GPU particle system
+
+namespace {
+
+// shader storage bindings and counter layout shared by all GPU particle programs
+const char *gpuCommon = R"(
+	#version 430
+	struct Particle {
+		vec4 position;				// xyz, age
+		vec4 velocity;				// xyz, lifetime
+		vec4 state;					// size, free, child rate, seconds to next child
+		uvec4 info;					// RGBA8 color, level
+	};
+	struct Spawn {
+		vec4 position;
+		uvec4 info;
+	};
+	layout(std430, binding = 0) buffer Particles { Particle particles[]; };
+	layout(std430, binding = 1) buffer Dead { uint dead[]; };
+	layout(std430, binding = 2) buffer AliveIn { uint aliveIn[]; };
+	layout(std430, binding = 3) buffer AliveOut { uint aliveOut[]; };
+	layout(std430, binding = 4) buffer Spawns { Spawn spawns[]; };
+	layout(std430, binding = 5) buffer Counts { uint counts[]; };
+	uniform int cur;				// counts[cur] sizes aliveIn, counts[1-cur] sizes aliveOut
+	#define NAliveIn counts[cur]
+	#define NAliveOut counts[1-cur]
+	#define NDead counts[2]
+	#define NSpawn counts[3]
+	#define NEmit counts[4]
+	#define DrawArgs 8
+	#define EmitArgs 12
+	#define SimulateArgs 16
+)";
+
+// indirect command offsets, in bytes, matching the defines above
+const GLintptr DrawArgsOffset = 8*4, EmitArgsOffset = 12*4, SimulateArgsOffset = 16*4;
+const int NCounts = 20, GroupSize = 256;
+
+const char *gpuControl = R"(
+	layout(local_size_x = 1) in;
+	uniform int mode;
+	uniform uint nEmit, spawnCapacity;
+	void SetArgs(int at, uint n) { counts[at] = (n+255u)/256u; counts[at+1] = 1u; counts[at+2] = 1u; }
+	void main() {
+		if (mode == 0) {			// before simulate
+			NAliveOut = 0u;
+			NSpawn = 0u;
+			SetArgs(SimulateArgs, NAliveIn);
+		}
+		if (mode == 1) {			// before emit: emitter first, then children, limited by free slots
+			uint total = min(nEmit+min(NSpawn, spawnCapacity), NDead);
+			NEmit = total;
+			SetArgs(EmitArgs, total);
+		}
+		if (mode == 2) {			// draw alive list
+			counts[DrawArgs] = NAliveOut;
+			counts[DrawArgs+1] = 1u;
+			counts[DrawArgs+2] = 0u;
+			counts[DrawArgs+3] = 0u;
+		}
+	}
+)";
+
+const char *gpuSimulate = R"(
+	layout(local_size_x = 256) in;
+	uniform float dt, gravity, planeRestitution, cylinderRestitution, restSpeed;
+	uniform int nPlanes, nCylinders;
+	uniform vec4 planes[8];			// normal, offset
+	uniform vec4 cylinders[16];		// base, height; radius
+	uniform uint maxLevel, spawnCapacity;
+	void main() {
+		uint i = gl_GlobalInvocationID.x;
+		if (i >= NAliveIn)
+			return;
+		uint id = aliveIn[i];
+		Particle p = particles[id];
+		vec3 pos = p.position.xyz, vel = p.velocity.xyz;
+		float age = p.position.w+dt, free = p.state.y, next = p.state.w;
+		vel.y -= gravity*dt*free;
+		pos += vel*dt;
+		for (int k = 0; k < nPlanes; k++) {
+			vec3 n = planes[k].xyz;
+			float d = dot(n, pos)-planes[k].w, vn = dot(n, vel);
+			if (d < 0 && vn < 0) {
+				float vnNew = -planeRestitution*vn;
+				pos -= d*n;
+				vel += (vnNew-vn)*n;
+				if (abs(vnNew) < restSpeed) {
+					vel = vec3(0);
+					free = 0;
+				}
+			}
+		}
+		for (int k = 0; k < nCylinders; k++) {
+			vec4 c = cylinders[2*k];
+			float r = cylinders[2*k+1].x, top = c.y+c.w;
+			vec2 d = pos.xz-c.xz;
+			if (dot(d, d) < r*r && pos.y < top && pos.y > c.y && vel.y < 0) {
+				pos.y = top;
+				vel.y = -cylinderRestitution*vel.y;
+			}
+		}
+		if (age >= p.velocity.w) {
+			dead[atomicAdd(NDead, 1u)] = id;
+			return;
+		}
+		if (free == 0 && p.state.z > 0 && (next -= dt) <= 0 && p.info.y < maxLevel) {
+			next += 1/p.state.z;
+			uint s = atomicAdd(NSpawn, 1u);
+			if (s < spawnCapacity)
+				spawns[s] = Spawn(vec4(pos, 0), uvec4(p.info.x, p.info.y+1u, 0u, 0u));
+		}
+		particles[id].position = vec4(pos, age);
+		particles[id].velocity = vec4(vel, p.velocity.w);
+		particles[id].state = vec4(p.state.x, free, p.state.z, next);
+		aliveOut[atomicAdd(NAliveOut, 1u)] = id;
+	}
+)";
+
+const char *gpuEmit = R"(
+	layout(local_size_x = 256) in;
+	uniform uint nEmit, seed;
+	uniform vec3 position, jitter, minColor, maxColor;
+	uniform vec2 speed, elevation, lifetime, size, childRate;
+	uniform float levelDecay;
+	uint state;
+	float Uniform() {
+		// PCG hash
+		state = state*747796405u+2891336453u;
+		uint w = ((state >> ((state >> 28u)+4u)) ^ state)*277803737u;
+		return float(((w >> 22u) ^ w) >> 8)*(1./16777216.);
+	}
+	float Uniform(float a, float b) { return a+Uniform()*(b-a); }
+	float Range(vec2 r, float s) { return r.x+s*Uniform()*(r.y-r.x); }
+	void main() {
+		uint i = gl_GlobalInvocationID.x;
+		if (i >= NEmit)
+			return;
+		state = i*1664525u+seed;
+		uint id = dead[atomicAdd(NDead, 0xffffffffu)-1u];
+		bool child = i >= nEmit;
+		Spawn parent = child? spawns[i-nEmit] : Spawn(vec4(0), uvec4(0));
+		uint level = parent.info.y;
+		float s = pow(levelDecay, float(level));
+		float life = Range(lifetime, s), sz = Range(size, s), v = Range(speed, s), rate = Range(childRate, s);
+		float azimuth = Uniform(0, 6.2831853), e = Uniform(elevation.x, elevation.y);
+		vec3 vel = v*vec3(cos(e)*cos(azimuth), sin(e), cos(e)*sin(azimuth));
+		vec3 pos;
+		uint color;
+		if (child) {
+			pos = parent.position.xyz;
+			color = parent.info.x;
+		}
+		else {
+			pos = position+jitter*vec3(Uniform(-1, 1), Uniform(-1, 1), Uniform(-1, 1));
+			vec3 c = vec3(Uniform(minColor.r, maxColor.r), Uniform(minColor.g, maxColor.g), Uniform(minColor.b, maxColor.b));
+			color = packUnorm4x8(vec4(c, 1));
+		}
+		particles[id] = Particle(vec4(pos, 0), vec4(vel, life), vec4(sz, 1, rate, rate > 0? 1/rate : 0), uvec4(color, level, 0u, 0u));
+		aliveOut[atomicAdd(NAliveOut, 1u)] = id;
+	}
+)";
+
+const char *gpuVShader = R"(
+	out vec4 vColor;
+	uniform mat4 modelview, persp;
+	uniform float fade;
+	void main() {
+		Particle p = particles[aliveIn[gl_VertexID]];
+		float remaining = p.velocity.w-p.position.w;
+		vec4 color = unpackUnorm4x8(p.info.x);
+		gl_Position = persp*modelview*vec4(p.position.xyz, 1);
+		gl_PointSize = p.state.x;
+		vColor = vec4(color.rgb, color.a*(fade > 0? clamp(remaining/fade, 0, 1) : 1));
+	}
+)";
+
+GLuint LinkGPUProgram(const char *body, const char *pixel = NULL) {
+	std::string code = std::string(gpuCommon)+body;
+	const char *c = code.c_str();
+	return pixel? LinkProgramViaCode(&c, &pixel) : LinkProgramViaCode(&c);
+}
+
+} // end namespace
+
+GPUParticleSystem::GPUParticleSystem(int cap) : capacity(std::max(cap, 1)), spawnCapacity(std::max(cap/4, 1)) { }
+
+GPUParticleSystem::~GPUParticleSystem() {
+	if (!initialized)
+		return;
+	GLuint buffers[] = {particles, dead, alive[0], alive[1], spawns, counts, readback};
+	glDeleteBuffers(sizeof(buffers)/sizeof(GLuint), buffers);
+	glDeleteQueries(NReadback, queries);
+	for (GLsync f : fences)
+		if (f)
+			glDeleteSync(f);
+	glDeleteVertexArrays(1, &vao);
+}
+
+bool GPUParticleSystem::Supported() {
+#ifdef __APPLE__
+	return false;
+#else
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	return glDispatchComputeIndirect && (major > 4 || (major == 4 && minor >= 3));
+#endif
+}
+
+bool GPUParticleSystem::Initialize() {
+	if (initialized)
+		return valid;
+	initialized = true;
+	if (!Supported()) {
+		printf("GPUParticleSystem: compute shaders need OpenGL 4.3\n");
+		return false;
+	}
+	control = LinkGPUProgram(gpuControl);
+	simulate = LinkGPUProgram(gpuSimulate);
+	emit = LinkGPUProgram(gpuEmit);
+	render = LinkGPUProgram(gpuVShader, pointPShader);
+	if (!control || !simulate || !emit || !render) {
+		printf("GPUParticleSystem: can't link shaders\n");
+		return false;
+	}
+	// storage is only written by shaders, apart from Reset
+	GLuint *buffers[] = {&particles, &dead, &alive[0], &alive[1], &spawns, &counts};
+	GLsizeiptr sizes[] = {(GLsizeiptr) capacity*64, (GLsizeiptr) capacity*4, (GLsizeiptr) capacity*4,
+						  (GLsizeiptr) capacity*4, (GLsizeiptr) spawnCapacity*32, NCounts*4};
+	for (int i = 0; i < 6; i++) {
+		glGenBuffers(1, buffers[i]);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffers[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[i], NULL, GL_DYNAMIC_DRAW);
+	}
+	glGenBuffers(1, &readback);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, readback);
+	glBufferData(GL_COPY_WRITE_BUFFER, NReadback*4, NULL, GL_STREAM_READ);
+	glGenQueries(NReadback, queries);
+	glGenVertexArrays(1, &vao);
+	valid = true;
+	Reset();
+	return true;
+}
+
+void GPUParticleSystem::Reset() {
+	// every slot free, nothing alive
+	vector<GLuint> ids(capacity);
+	for (int i = 0; i < capacity; i++)
+		ids[i] = capacity-1-i;		// popped from the end, so slots fill from 0
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, dead);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, capacity*4, ids.data());
+	GLuint c[NCounts] = {};
+	c[2] = capacity;
+	c[DrawArgsOffset/4+1] = 1;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, counts);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(c), c);
+	count = 0;
+}
+
+void GPUParticleSystem::Clear() {
+	pendingEmit = 0;
+	emitDebt = 0;
+	if (valid)
+		Reset();
+}
+
+void GPUParticleSystem::Emit(int n) {
+	pendingEmit += std::max(0, n);
+}
+
+void GPUParticleSystem::Bind(int in) {
+	GLuint buffers[] = {particles, dead, alive[in], alive[1-in], spawns, counts};
+	for (int b = 0; b < 6; b++)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b, buffers[b]);
+}
+
+void GPUParticleSystem::Dispatch(GLuint program, GLintptr argsOffset) {
+	// program is current, with its other uniforms set
+	SetUniform(program, "cur", cur);
+	if (argsOffset < 0)
+		glDispatchCompute(1, 1, 1);
+	else
+		glDispatchComputeIndirect(argsOffset);
+	// later passes read counts as dispatch/draw arguments and storage written here
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void GPUParticleSystem::Poll() {
+	// collect results of earlier frames without waiting
+	for (int k = 0; k < NReadback; k++) {
+		if (fences[k] && glClientWaitSync(fences[k], 0, 0) != GL_TIMEOUT_EXPIRED) {
+			GLuint n = 0;
+			glBindBuffer(GL_COPY_READ_BUFFER, readback);
+			glGetBufferSubData(GL_COPY_READ_BUFFER, k*4, 4, &n);
+			count = (int) n;
+			glDeleteSync(fences[k]);
+			fences[k] = NULL;
+		}
+		GLint available = 0;
+		if (queryPending[k])
+			glGetQueryObjectiv(queries[k], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(queries[k], GL_QUERY_RESULT, &ns);
+			gpuMsec = ns/1.e6f;
+			queryPending[k] = false;
+		}
+	}
+}
+
+bool GPUParticleSystem::Update(float dt) {
+	if (!Initialize())
+		return false;
+	Poll();
+	dt = std::min(std::max(dt, 0.f), MaxStep);
+	emitDebt += emitter.rate*dt;
+	int nEmit = (int) emitDebt;
+	emitDebt -= nEmit;
+	nEmit = std::min(nEmit+pendingEmit, capacity);
+	pendingEmit = 0;
+	int slot = frame%NReadback;
+	bool timing = !queryPending[slot];
+	if (timing)
+		glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+	GLint prevProgram = CurrentProgram();
+	Bind(cur);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counts);
+	// reset output counts and size the simulate dispatch from the alive count
+	glUseProgram(control);
+	SetUniform(control, "mode", 0);
+	Dispatch(control, -1);
+	// move, collide, age; survivors to aliveOut, expired to the free list, children to spawns
+	glUseProgram(simulate);
+	SetUniform(simulate, "dt", dt);
+	SetUniform(simulate, "gravity", gravity);
+	SetUniform(simulate, "planeRestitution", planeRestitution);
+	SetUniform(simulate, "cylinderRestitution", cylinderRestitution);
+	SetUniform(simulate, "restSpeed", restSpeed);
+	int nPlanes = std::min((int) planes.size(), MaxPlanes), nCylinders = std::min((int) cylinders.size(), MaxCylinders);
+	vec4 p[MaxPlanes], c[2*MaxCylinders];
+	for (int i = 0; i < nPlanes; i++)
+		p[i] = vec4(planes[i].normal, planes[i].offset);
+	for (int i = 0; i < nCylinders; i++) {
+		c[2*i] = vec4(cylinders[i].base, cylinders[i].height);
+		c[2*i+1] = vec4(cylinders[i].radius, 0, 0, 0);
+	}
+	SetUniform(simulate, "nPlanes", nPlanes);
+	SetUniform(simulate, "nCylinders", nCylinders);
+	if (nPlanes)
+		SetUniform4v(simulate, "planes", nPlanes, (float *) p);
+	if (nCylinders)
+		SetUniform4v(simulate, "cylinders", 2*nCylinders, (float *) c);
+	SetUniform(simulate, "maxLevel", (GLuint) std::max(emitter.maxLevel, 0));
+	SetUniform(simulate, "spawnCapacity", (GLuint) spawnCapacity);
+	Dispatch(simulate, SimulateArgsOffset);
+	// size emission by free slots
+	glUseProgram(control);
+	SetUniform(control, "mode", 1);
+	SetUniform(control, "nEmit", (GLuint) nEmit);
+	SetUniform(control, "spawnCapacity", (GLuint) spawnCapacity);
+	Dispatch(control, -1);
+	// new particles from the emitter, then children, appended to aliveOut
+	const ParticleEmitter &e = emitter;
+	glUseProgram(emit);
+	SetUniform(emit, "nEmit", (GLuint) nEmit);
+	SetUniform(emit, "seed", (GLuint) (frame*2654435761u));
+	SetUniform(emit, "position", e.position);
+	SetUniform(emit, "jitter", e.jitter);
+	SetUniform(emit, "minColor", e.minColor);
+	SetUniform(emit, "maxColor", e.maxColor);
+	SetUniform(emit, "speed", vec2(e.minSpeed, e.maxSpeed));
+	SetUniform(emit, "elevation", vec2(e.minElevation, e.maxElevation));
+	SetUniform(emit, "lifetime", vec2(e.minLifetime, e.maxLifetime));
+	SetUniform(emit, "size", vec2(e.minSize, e.maxSize));
+	SetUniform(emit, "childRate", vec2(e.minChildRate, e.maxChildRate));
+	SetUniform(emit, "levelDecay", e.levelDecay);
+	Dispatch(emit, EmitArgsOffset);
+	// draw arguments
+	glUseProgram(control);
+	SetUniform(control, "mode", 2);
+	Dispatch(control, -1);
+	if (timing) {
+		glEndQuery(GL_TIME_ELAPSED);
+		queryPending[slot] = true;
+	}
+	// alive count for display, read back by Poll once the GPU has passed the fence
+	if (!fences[slot]) {
+		glBindBuffer(GL_COPY_READ_BUFFER, counts);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, readback);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, DrawArgsOffset, slot*4, 4);
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	glUseProgram(prevProgram);
+	cur = 1-cur;
+	frame++;
+	return true;
+}
+
+void GPUParticleSystem::Draw(mat4 modelview, mat4 persp, float fadeSeconds) {
+	if (!Initialize())
+		return;
+	GLint prevProgram = CurrentProgram();
+	Bind(cur);
+	glUseProgram(render);
+	SetUniform(render, "modelview", modelview);
+	SetUniform(render, "persp", persp);
+	SetUniform(render, "fade", fadeSeconds);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, counts);
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	glDrawArraysIndirect(GL_POINTS, (void *) DrawArgsOffset);
+	glBindVertexArray(0);
+	glUseProgram(prevProgram);
+}
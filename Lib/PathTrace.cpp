@@ -0,0 +1,546 @@
+// PathTrace.cpp - multithreaded CPU path tracer: planes, spheres, and triangle meshes in SAH bounding volume hierarchies
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <memory>
+#include "Jobs.h"
+#include "Mesh.h"
+#include "PathTrace.h"
+#include "STB_Image_Write.h"
+#include "VecMatBatch.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define RT_SSE
+#endif
+
+namespace {
+
+const float Epsilon = 1e-4f, Pi = 3.14159265f;
+enum { HitNone = -1, HitPlane, HitSphere, HitTriangle };
+
+// Random numbers
+
+uint32_t Hash(uint32_t x) {
+	// PCG output permutation
+	x = x*747796405u+2891336453u;
+	uint32_t w = ((x >> ((x >> 28u)+4u)) ^ x)*277803737u;
+	return (w >> 22u) ^ w;
+}
+
+float Random(uint32_t &state) {
+	state = Hash(state);
+	return (state >> 8)*(1.f/16777216.f);
+}
+
+void Basis(const vec3 &n, vec3 &a, vec3 &b) {
+	// orthonormal a, b perpendicular to unit n (Duff et al. 2017)
+	float s = n.z >= 0? 1.f : -1.f, p = -1/(s+n.z), q = n.x*n.y*p;
+	a = vec3(1+s*n.x*n.x*p, s*q, -s*n.x);
+	b = vec3(q, s+n.y*n.y*p, -n.y);
+}
+
+float RaySphereT(const RTRay &r, const vec4 &s) {
+	// least alpha > Epsilon, as RaySphere in 1-Demo-RayTrace; -1 if none
+	vec3 q = r.origin-vec3(s.x, s.y, s.z);
+	float b = dot(r.dir, q), disc = b*b-dot(q, q)+s.w*s.w;
+	if (disc < 0)
+		return -1;
+	float root = sqrtf(disc), t = -b-root;
+	if (t <= Epsilon)
+		t = -b+root;
+	return t > Epsilon? t : -1;
+}
+
+// Block tests: set tBest and lane of nearest hit closer than tBest; for occlusion, any hit suffices
+
+#ifdef RT_SSE
+
+struct RaySSE {
+	__m128 ox, oy, oz, dx, dy, dz;
+	RaySSE(const RTRay &r) : ox(_mm_set1_ps(r.origin.x)), oy(_mm_set1_ps(r.origin.y)), oz(_mm_set1_ps(r.origin.z)),
+							 dx(_mm_set1_ps(r.dir.x)), dy(_mm_set1_ps(r.dir.y)), dz(_mm_set1_ps(r.dir.z)) { }
+};
+
+inline int Nearest(__m128 hit, __m128 t, float &tBest) {
+	// lane of least t among hit lanes, or -1
+	int mask = _mm_movemask_ps(hit);
+	if (!mask)
+		return -1;
+	float ts[4];
+	_mm_storeu_ps(ts, t);
+	int lane = -1;
+	for (int i = 0; i < 4; i++)
+		if ((mask >> i) & 1 && ts[i] < tBest) {
+			tBest = ts[i];
+			lane = i;
+		}
+	return lane;
+}
+
+template<bool Any> int TestTriangles(const float *b, const RaySSE &r, float &tBest) {
+	// Moller-Trumbore on four triangles; b points at Block::x
+	__m128 e1x = _mm_loadu_ps(b+12), e1y = _mm_loadu_ps(b+16), e1z = _mm_loadu_ps(b+20);
+	__m128 e2x = _mm_loadu_ps(b+24), e2y = _mm_loadu_ps(b+28), e2z = _mm_loadu_ps(b+32);
+	__m128 px = _mm_sub_ps(_mm_mul_ps(r.dy, e2z), _mm_mul_ps(r.dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(r.dz, e2x), _mm_mul_ps(r.dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(r.dx, e2y), _mm_mul_ps(r.dy, e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.f), det);
+	__m128 inv = _mm_div_ps(_mm_set1_ps(1), det);
+	__m128 sx = _mm_sub_ps(r.ox, _mm_loadu_ps(b)), sy = _mm_sub_ps(r.oy, _mm_loadu_ps(b+4)), sz = _mm_sub_ps(r.oz, _mm_loadu_ps(b+8));
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r.dx, qx), _mm_mul_ps(r.dy, qy)), _mm_mul_ps(r.dz, qz)), inv);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+	__m128 zero = _mm_setzero_ps();
+	__m128 hit = _mm_and_ps(_mm_cmpgt_ps(absDet, _mm_set1_ps(1e-12f)), _mm_cmpge_ps(u, zero));
+	hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1))));
+	hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, _mm_set1_ps(Epsilon)), _mm_cmplt_ps(t, _mm_set1_ps(tBest))));
+	if (Any)
+		return _mm_movemask_ps(hit)? 0 : -1;
+	return Nearest(hit, t, tBest);
+}
+
+template<bool Any> int TestSpheres(const float *b, const RaySSE &r, float &tBest) {
+	// four spheres; e1x holds squared radius (negative in unused lanes)
+	__m128 qx = _mm_sub_ps(r.ox, _mm_loadu_ps(b)), qy = _mm_sub_ps(r.oy, _mm_loadu_ps(b+4)), qz = _mm_sub_ps(r.oz, _mm_loadu_ps(b+8));
+	__m128 bq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r.dx, qx), _mm_mul_ps(r.dy, qy)), _mm_mul_ps(r.dz, qz));
+	__m128 qq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_mul_ps(qz, qz));
+	__m128 disc = _mm_sub_ps(_mm_mul_ps(bq, bq), _mm_sub_ps(qq, _mm_loadu_ps(b+12)));
+	__m128 root = _mm_sqrt_ps(_mm_max_ps(disc, _mm_setzero_ps())), eps = _mm_set1_ps(Epsilon);
+	__m128 t0 = _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), bq), root), t1 = _mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), bq), root);
+	__m128 near = _mm_cmpgt_ps(t0, eps);
+	__m128 t = _mm_or_ps(_mm_and_ps(near, t0), _mm_andnot_ps(near, t1));
+	__m128 hit = _mm_and_ps(_mm_cmpge_ps(disc, _mm_setzero_ps()), _mm_cmpgt_ps(t, eps));
+	hit = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_set1_ps(tBest)));
+	if (Any)
+		return _mm_movemask_ps(hit)? 0 : -1;
+	return Nearest(hit, t, tBest);
+}
+
+#else
+
+struct RaySSE {
+	RTRay r;
+	RaySSE(const RTRay &ray) : r(ray) { }
+};
+
+template<bool Any> int TestTriangles(const float *b, const RaySSE &rs, float &tBest) {
+	const RTRay &r = rs.r;
+	int lane = -1;
+	for (int i = 0; i < 4; i++) {
+		vec3 e1(b[12+i], b[16+i], b[20+i]), e2(b[24+i], b[28+i], b[32+i]), p = cross(r.dir, e2);
+		float det = dot(e1, p);
+		if (fabsf(det) <= 1e-12f)
+			continue;
+		float inv = 1/det;
+		vec3 s = r.origin-vec3(b[i], b[4+i], b[8+i]), q = cross(s, e1);
+		float u = dot(s, p)*inv, v = dot(r.dir, q)*inv, t = dot(e2, q)*inv;
+		if (u >= 0 && v >= 0 && u+v <= 1 && t > Epsilon && t < tBest) {
+			if (Any)
+				return 0;
+			tBest = t;
+			lane = i;
+		}
+	}
+	return lane;
+}
+
+template<bool Any> int TestSpheres(const float *b, const RaySSE &rs, float &tBest) {
+	int lane = -1;
+	for (int i = 0; i < 4; i++) {
+		if (b[12+i] < 0)
+			continue;
+		float t = RaySphereT(rs.r, vec4(b[i], b[4+i], b[8+i], sqrtf(b[12+i])));
+		if (t > 0 && t < tBest) {
+			if (Any)
+				return 0;
+			tBest = t;
+			lane = i;
+		}
+	}
+	return lane;
+}
+
+#endif
+
+template<bool Any, class Test>
+int TraverseBVH(const BVH &bvh, const vector<int> &leafBlock, const RTRay &ray, float &tBest, Test test) {
+	// nearer child first; return primitive lane's block*4+lane of the best hit, or -1
+	if (bvh.Empty())
+		return -1;
+	vec3 inv(1/ray.dir.x, 1/ray.dir.y, 1/ray.dir.z);
+	int stack[64], nStack = 0, best = -1;
+	float tNear;
+	if (!RayBox(bvh.nodes[0], ray.origin, inv, tBest, tNear))
+		return -1;
+	stack[nStack++] = 0;
+	while (nStack) {
+		const BVHNode &n = bvh.nodes[stack[--nStack]];
+		if (n.Leaf()) {
+			int block = leafBlock[&n-&bvh.nodes[0]], lane = test(block, tBest);
+			if (lane >= 0) {
+				best = 4*block+lane;
+				if (Any)
+					return best;
+			}
+			continue;
+		}
+		float t0, t1;
+		bool h0 = RayBox(bvh.nodes[n.first], ray.origin, inv, tBest, t0);
+		bool h1 = RayBox(bvh.nodes[n.first+1], ray.origin, inv, tBest, t1);
+		if (h0 && h1) {
+			// push far child first
+			stack[nStack++] = t0 <= t1? n.first+1 : n.first;
+			stack[nStack++] = t0 <= t1? n.first : n.first+1;
+		}
+		else if (h0)
+			stack[nStack++] = n.first;
+		else if (h1)
+			stack[nStack++] = n.first+1;
+	}
+	return best;
+}
+
+} // end namespace
+
+// Scene
+
+int RTScene::AddMaterial(const RTMaterial &m) {
+	materials.push_back(m);
+	return (int) materials.size()-1;
+}
+
+void RTScene::AddPlane(vec4 plane, const RTMaterial &m) {
+	planes.push_back(plane);
+	planeMaterials.push_back(AddMaterial(m));
+}
+
+void RTScene::AddSphere(vec4 sphere, const RTMaterial &m) {
+	if (m.emission.x > 0 || m.emission.y > 0 || m.emission.z > 0)
+		lights.push_back((int) spheres.size());
+	spheres.push_back(sphere);
+	sphereMaterials.push_back(AddMaterial(m));
+}
+
+void RTScene::AddTriangle(vec3 a, vec3 b, vec3 c, const RTMaterial &m) {
+	triA.push_back(a);
+	triB.push_back(b);
+	triC.push_back(c);
+	triMaterials.push_back(AddMaterial(m));
+}
+
+void RTScene::AddMesh(const Mesh &mesh, const RTMaterial &m, const mat4 *xform) {
+	int mat = AddMaterial(m);
+	vector<vec3> p(mesh.points.size());
+	if (!p.empty())
+		TransformPoints(xform? *xform : mesh.toWorld, mesh.points.data(), p.data(), (int) p.size());
+	auto Add = [&](int i0, int i1, int i2) {
+		triA.push_back(p[i0]);
+		triB.push_back(p[i1]);
+		triC.push_back(p[i2]);
+		triMaterials.push_back(mat);
+	};
+	for (const int3 &t : mesh.triangles)
+		Add(t.i1, t.i2, t.i3);
+	for (const int4 &q : mesh.quads) {
+		Add(q.i1, q.i2, q.i3);
+		Add(q.i1, q.i3, q.i4);
+	}
+}
+
+void RTScene::Clear() {
+	*this = RTScene();
+}
+
+void RTScene::BuildBlocks(bool tris) {
+	// one SIMD block per leaf (leaves hold at most four primitives)
+	BVH &bvh = tris? triBVH : sphereBVH;
+	vector<Block> &blocks = tris? triBlocks : sphereBlocks;
+	vector<int> &leafBlock = tris? triLeafBlock : sphereLeafBlock;
+	blocks.clear();
+	leafBlock.assign(bvh.nodes.size(), -1);
+	for (size_t n = 0; n < bvh.nodes.size(); n++) {
+		const BVHNode &node = bvh.nodes[n];
+		if (!node.Leaf())
+			continue;
+		Block b = {};
+		for (int i = 0; i < 4; i++) {
+			b.id[i] = -1;
+			b.e1x[i] = tris? 0 : -1;
+		}
+		for (int i = 0; i < node.count; i++) {
+			int p = bvh.order[node.first+i];
+			b.id[i] = p;
+			if (tris) {
+				vec3 a = triA[p], e1 = triB[p]-a, e2 = triC[p]-a;
+				b.x[i] = a.x; b.y[i] = a.y; b.z[i] = a.z;
+				b.e1x[i] = e1.x; b.e1y[i] = e1.y; b.e1z[i] = e1.z;
+				b.e2x[i] = e2.x; b.e2y[i] = e2.y; b.e2z[i] = e2.z;
+			}
+			else {
+				vec4 s = spheres[p];
+				b.x[i] = s.x; b.y[i] = s.y; b.z[i] = s.z;
+				b.e1x[i] = s.w*s.w;
+			}
+		}
+		leafBlock[n] = (int) blocks.size();
+		blocks.push_back(b);
+	}
+}
+
+void RTScene::Build() {
+	int nt = (int) triA.size(), ns = (int) spheres.size();
+	vector<vec3> lo(std::max(nt, ns)), hi(std::max(nt, ns));
+	for (int i = 0; i < nt; i++)
+		for (int k = 0; k < 3; k++) {
+			lo[i][k] = std::min(triA[i][k], std::min(triB[i][k], triC[i][k]));
+			hi[i][k] = std::max(triA[i][k], std::max(triB[i][k], triC[i][k]));
+		}
+	triBVH.Build(lo.data(), hi.data(), nt, 4);
+	for (int i = 0; i < ns; i++) {
+		vec3 c(spheres[i].x, spheres[i].y, spheres[i].z);
+		lo[i] = c-vec3(spheres[i].w);
+		hi[i] = c+vec3(spheres[i].w);
+	}
+	sphereBVH.Build(lo.data(), hi.data(), ns, 4);
+	BuildBlocks(true);
+	BuildBlocks(false);
+}
+
+template<bool Any> bool RTScene::Trace(const RTRay &ray, float &tBest, int &kind, int &id) const {
+	kind = HitNone;
+	for (size_t i = 0; i < planes.size(); i++) {
+		// as RayPlane in 1-Demo-RayTrace: hit only if the ray heads toward the plane
+		const vec4 &p = planes[i];
+		float a = p.x*ray.dir.x+p.y*ray.dir.y+p.z*ray.dir.z;
+		float d = p.x*ray.origin.x+p.y*ray.origin.y+p.z*ray.origin.z+p.w;
+		if (a == 0 || (d > 0 && a > 0) || (d < 0 && a < 0))
+			continue;
+		float t = -d/a;
+		if (t > Epsilon && t < tBest) {
+			tBest = t;
+			kind = HitPlane;
+			id = (int) i;
+			if (Any)
+				return true;
+		}
+	}
+	RaySSE rs(ray);
+	int s = TraverseBVH<Any>(sphereBVH, sphereLeafBlock, ray, tBest, [&](int block, float &t) {
+		return TestSpheres<Any>(sphereBlocks[block].x, rs, t);
+	});
+	if (s >= 0) {
+		kind = HitSphere;
+		id = sphereBlocks[s/4].id[s%4];
+		if (Any)
+			return true;
+	}
+	int t = TraverseBVH<Any>(triBVH, triLeafBlock, ray, tBest, [&](int block, float &tb) {
+		return TestTriangles<Any>(triBlocks[block].x, rs, tb);
+	});
+	if (t >= 0) {
+		kind = HitTriangle;
+		id = triBlocks[t/4].id[t%4];
+	}
+	return kind != HitNone;
+}
+
+bool RTScene::Intersect(const RTRay &ray, RTHit &hit, float tMax) const {
+	int kind, id;
+	float t = tMax;
+	if (!Trace<false>(ray, t, kind, id))
+		return false;
+	hit.t = t;
+	hit.point = ray.origin+t*ray.dir;
+	vec3 n;
+	if (kind == HitPlane) {
+		n = vec3(planes[id].x, planes[id].y, planes[id].z);
+		hit.material = planeMaterials[id];
+	}
+	if (kind == HitSphere) {
+		n = (hit.point-vec3(spheres[id].x, spheres[id].y, spheres[id].z))/spheres[id].w;
+		hit.material = sphereMaterials[id];
+	}
+	if (kind == HitTriangle) {
+		n = normalize(cross(triB[id]-triA[id], triC[id]-triA[id]));
+		hit.material = triMaterials[id];
+	}
+	hit.normal = dot(n, ray.dir) > 0? -n : n;
+	return true;
+}
+
+bool RTScene::Occluded(const RTRay &ray, float tMax) const {
+	int kind, id;
+	float t = tMax;
+	return Trace<true>(ray, t, kind, id);
+}
+
+// Renderer
+
+void PathTracer::Resize(int w, int h) {
+	width = std::max(w, 1);
+	height = std::max(h, 1);
+	Reset();
+}
+
+void PathTracer::Reset() {
+	accum.assign((size_t) 3*width*height, 0);
+	nSamples = 0;
+}
+
+vec3 PathTracer::Radiance(const RTScene &scene, RTRay ray, uint32_t &rng, long long &nRays) {
+	// next-event estimation at diffuse hits, so emission is counted on a hit only after a camera or mirror ray
+	vec3 radiance(0.f), throughput(1.f);
+	bool specular = true;
+	for (int depth = 0; depth < maxDepth; depth++) {
+		RTHit hit;
+		nRays++;
+		if (!scene.Intersect(ray, hit))
+			break;
+		const RTMaterial &m = scene.Material(hit.material);
+		if (m.emission.x > 0 || m.emission.y > 0 || m.emission.z > 0) {
+			if (specular)
+				radiance += throughput*m.emission;
+			break;
+		}
+		vec3 n = hit.normal;
+		if (m.mirror > 0 && Random(rng) < m.mirror) {
+			throughput = throughput*m.color;
+			ray = RTRay(hit.point+Epsilon*n, ray.dir-2*dot(ray.dir, n)*n);
+			specular = true;
+			continue;
+		}
+		// direct light: sample the cone each spherical light subtends
+		for (int l : scene.Lights()) {
+			vec4 s = scene.Sphere(l);
+			vec3 c(s.x, s.y, s.z), toLight = c-hit.point;
+			float d2 = dot(toLight, toLight);
+			if (d2 <= s.w*s.w)
+				continue;
+			float cosMax = sqrtf(std::max(0.f, 1-s.w*s.w/d2)), cosT = 1-Random(rng)*(1-cosMax);
+			float sinT = sqrtf(std::max(0.f, 1-cosT*cosT)), phi = 2*Pi*Random(rng);
+			vec3 w = toLight/sqrtf(d2), a, b;
+			Basis(w, a, b);
+			vec3 dir = cosT*w+sinT*(cosf(phi)*a+sinf(phi)*b);
+			float cosN = dot(dir, n);
+			if (cosN <= 0)
+				continue;
+			RTRay shadow(hit.point+Epsilon*n, dir);
+			float tLight = RaySphereT(shadow, s);
+			nRays++;
+			if (tLight < 0 || scene.Occluded(shadow, tLight*(1-1e-4f)))
+				continue;
+			float pdf = 1/(2*Pi*(1-cosMax));
+			radiance += throughput*m.color*scene.SphereMaterial(l).emission*(cosN/(Pi*pdf));
+		}
+		// indirect: cosine-weighted bounce, whose pdf cancels the Lambertian cos/pi
+		float u1 = Random(rng), u2 = Random(rng), r = sqrtf(u1), phi = 2*Pi*u2;
+		vec3 a, b;
+		Basis(n, a, b);
+		ray = RTRay(hit.point+Epsilon*n, normalize(r*cosf(phi)*a+r*sinf(phi)*b+sqrtf(std::max(0.f, 1-u1))*n));
+		throughput = throughput*m.color;
+		specular = false;
+		if (depth >= 2) {
+			float q = std::min(.95f, std::max(throughput.x, std::max(throughput.y, throughput.z)));
+			if (Random(rng) >= q)
+				break;
+			throughput = throughput/q;
+		}
+	}
+	return radiance;
+}
+
+void PathTracer::Render(const RTScene &scene, const RTCamera &camera, int spp) {
+	auto start = std::chrono::steady_clock::now();
+	if (accum.size() != (size_t) 3*width*height)
+		Reset();
+	int ts = std::max(tileSize, 1), nx = (width+ts-1)/ts, ny = (height+ts-1)/ts, nTiles = nx*ny;
+	JobSystem &jobs = GetJobSystem();
+	// each queue is a tile range [head, tail) packed in one word: the owner takes from the head, thieves from the tail
+	int nQueues = std::min(jobs.NWorkers(), nTiles);
+	std::unique_ptr<std::atomic<uint64_t>[]> queues(new std::atomic<uint64_t>[nQueues]);
+	for (int q = 0; q < nQueues; q++) {
+		uint64_t head = (uint64_t) q*nTiles/nQueues, tail = (uint64_t) (q+1)*nTiles/nQueues;
+		queues[q] = head | (tail << 32);
+	}
+	auto Pop = [&](int q, bool front, int &tile) {
+		uint64_t r = queues[q].load();
+		for (;;) {
+			uint32_t head = (uint32_t) r, tail = (uint32_t) (r >> 32);
+			if (head >= tail)
+				return false;
+			uint64_t next = front? (uint64_t) (head+1) | ((uint64_t) tail << 32) : (uint64_t) head | ((uint64_t) (tail-1) << 32);
+			if (queues[q].compare_exchange_weak(r, next)) {
+				tile = front? head : tail-1;
+				return true;
+			}
+		}
+	};
+	std::atomic<long long> totalRays{0};
+	int sample0 = nSamples;
+	auto RenderTile = [&](int tile) {
+		long long nRays = 0;
+		int x0 = (tile%nx)*ts, y0 = (tile/nx)*ts, x1 = std::min(width, x0+ts), y1 = std::min(height, y0+ts);
+		for (int y = y0; y < y1; y++)
+			for (int x = x0; x < x1; x++) {
+				uint32_t pixel = (uint32_t) (y*width+x);
+				vec3 sum(0.f);
+				for (int s = sample0; s < sample0+spp; s++) {
+					uint32_t rng = Hash(pixel*0x9e3779b9u ^ Hash((uint32_t) s));
+					float xf = 2*(x+Random(rng))/width-1, yf = 2*(y+Random(rng))/height-1;
+					vec3 c = Radiance(scene, RTRay(camera.eye, normalize(camera.dir+xf*camera.right+yf*camera.up)), rng, nRays);
+					if (c.x == c.x && c.y == c.y && c.z == c.z)
+						sum += c;
+				}
+				float *a = &accum[3*pixel];
+				a[0] += sum.x; a[1] += sum.y; a[2] += sum.z;
+			}
+		totalRays += nRays;
+	};
+	jobs.ParallelFor(nQueues, 1, [&](int q0, int q1, int) {
+		for (int q = q0; q < q1; q++) {
+			int tile;
+			while (Pop(q, true, tile))
+				RenderTile(tile);
+			// own queue empty: steal from the others, nearest first
+			for (int k = 1; k < nQueues; k++)
+				while (Pop((q+k)%nQueues, false, tile))
+					RenderTile(tile);
+		}
+	});
+	nSamples += spp;
+	rays = totalRays;
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+void PathTracer::GetImage(vector<unsigned char> &rgb, float exposure, bool topDown) {
+	rgb.resize((size_t) 3*width*height);
+	float scale = nSamples? exposure/nSamples : 0;
+	GetJobSystem().ParallelFor(height, 16, [&](int y0, int y1, int) {
+		for (int y = y0; y < y1; y++) {
+			const float *a = &accum[(size_t) 3*y*width];
+			unsigned char *p = &rgb[(size_t) 3*(topDown? height-1-y : y)*width];
+			for (int i = 0; i < 3*width; i++) {
+				float v = std::min(1.f, std::max(0.f, a[i]*scale));
+				p[i] = (unsigned char) (255.f*powf(v, 1/2.2f)+.5f);
+			}
+		}
+	});
+}
+
+bool PathTracer::SavePng(const char *filename, float exposure) {
+	vector<unsigned char> rgb;
+	GetImage(rgb, exposure, true);
+	if (!stbi_write_png(filename, width, height, 3, rgb.data(), 3*width)) {
+		printf("can't write %s\n", filename);
+		return false;
+	}
+	return true;
+}
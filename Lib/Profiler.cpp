@@ -0,0 +1,358 @@
+// Profiler.cpp - CPU and GPU scope timing, per-frame histories, overlay, Chrome trace
+
+#include <glad.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include "Draw.h"
+#include "Letters.h"
+#include "Profiler.h"
+
+namespace {
+
+const int NHistory = 120;				// frames of history per scope
+const int MaxGpuFramesInFlight = 4;		// beyond this, ProfilerFrame waits for the oldest GPU results
+
+long long Now() {
+	// nanoseconds, wall clock
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool enabled = false;
+
+// CPU events, buffered per thread until ProfilerFrame
+
+struct Event {
+	const char *name;
+	long long start, end;
+	int depth;
+};
+
+struct ThreadEvents {
+	std::mutex mutex;
+	vector<Event> events;
+	int tid = 0, depth = 0;				// depth touched only by the owning thread
+};
+
+std::mutex threadsMutex;
+vector<ThreadEvents *> threads;			// kept after a thread exits, so its last events are still read
+thread_local ThreadEvents *local = NULL;
+
+ThreadEvents &Local() {
+	if (!local) {
+		local = new ThreadEvents;
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		local->tid = (int) threads.size();
+		threads.push_back(local);
+	}
+	return *local;
+}
+
+// GPU events: a pair of timestamp queries each, resolved once the frame's last query is available
+
+struct GpuEvent {
+	const char *name;
+	GLuint begin, end;
+	int depth;
+};
+
+struct GpuFrame {
+	vector<GpuEvent> events;
+	GLuint last = 0;					// most recently issued query; timestamps complete in order
+};
+
+GpuFrame gpuCurrent;
+std::deque<GpuFrame> gpuPending;
+vector<GLuint> freeQueries;
+unsigned gpuFrameCount = 1;
+int gpuDepth = 0;
+long long gpuToCpu = 0;					// add to a GL timestamp to get Now() time
+
+bool GpuAvailable() { return glad_glQueryCounter != NULL && glad_glGetQueryObjectui64v != NULL; }
+
+GLuint NewQuery() {
+	GLuint q;
+	if (freeQueries.empty())
+		glGenQueries(1, &q);
+	else {
+		q = freeQueries.back();
+		freeQueries.pop_back();
+	}
+	return q;
+}
+
+GLuint Timestamp() {
+	GLuint q = NewQuery();
+	glQueryCounter(q, GL_TIMESTAMP);
+	gpuCurrent.last = q;
+	return q;
+}
+
+// Per-scope accumulation and history
+
+struct Scope {
+	const char *name;
+	bool gpu;
+	int depth = 0, calls = 0, frameCalls = 0;
+	double sum = 0;						// ms this frame
+	float history[NHistory] = {};
+	int nHistory = 0, next = 0;			// ring of most recent frames
+	void Push() {
+		history[next] = (float) sum;
+		next = (next+1)%NHistory;
+		nHistory = nHistory < NHistory? nHistory+1 : NHistory;
+		calls = frameCalls;
+		sum = 0;
+		frameCalls = 0;
+	}
+};
+
+vector<Scope> scopes;
+
+Scope &Find(const char *name, bool gpu) {
+	for (Scope &s : scopes)
+		if (s.gpu == gpu && (s.name == name || !strcmp(s.name, name)))
+			return s;
+	Scope s;
+	s.name = name;
+	s.gpu = gpu;
+	scopes.push_back(s);
+	return scopes.back();
+}
+
+void Add(const char *name, bool gpu, double ms, int depth) {
+	Scope &s = Find(name, gpu);
+	s.sum += ms;
+	s.frameCalls++;
+	s.depth = depth;
+}
+
+// Trace
+
+struct TraceEvent {
+	const char *name;
+	long long start, end;
+	int tid;							// -1 for the GPU
+};
+
+bool tracing = false;
+int maxTraceEvents = 0;
+vector<TraceEvent> trace;
+
+void Record(const char *name, long long start, long long end, int tid) {
+	if (tracing && (int) trace.size() < maxTraceEvents)
+		trace.push_back({name, start, end, tid});
+}
+
+void ResolveGpu(GpuFrame &f) {
+	for (GpuEvent &e : f.events) {
+		if (!e.end)
+			continue;					// scope still open at ProfilerFrame
+		GLuint64 t0 = 0, t1 = 0;
+		glGetQueryObjectui64v(e.begin, GL_QUERY_RESULT, &t0);
+		glGetQueryObjectui64v(e.end, GL_QUERY_RESULT, &t1);
+		Add(e.name, true, (t1-t0)/1.e6, e.depth);
+		Record(e.name, (long long) t0+gpuToCpu, (long long) t1+gpuToCpu, -1);
+		freeQueries.push_back(e.end);
+	}
+	for (GpuEvent &e : f.events)
+		freeQueries.push_back(e.begin);
+	for (Scope &s : scopes)
+		if (s.gpu)
+			s.Push();
+}
+
+} // end namespace
+
+// Scopes
+
+ProfileScope::ProfileScope(const char *name, bool gpu) : name(name) {
+	if (!enabled)
+		return;
+	ThreadEvents &t = Local();
+	t.depth++;
+	if (gpu && GpuAvailable()) {
+		gpuEvent = (int) gpuCurrent.events.size();
+		gpuFrame = gpuFrameCount;
+		gpuCurrent.events.push_back({name, Timestamp(), 0, gpuDepth++});
+	}
+	start = Now();
+}
+
+ProfileScope::~ProfileScope() {
+	if (!start)
+		return;
+	long long end = Now();
+	if (gpuEvent >= 0) {
+		gpuDepth--;
+		if (gpuFrame == gpuFrameCount)
+			gpuCurrent.events[gpuEvent].end = Timestamp();
+	}
+	ThreadEvents &t = Local();
+	t.depth--;
+	std::lock_guard<std::mutex> lock(t.mutex);
+	t.events.push_back({name, start, end, t.depth});
+}
+
+// Frames
+
+void EnableProfiler(bool on) { enabled = on; }
+
+bool ProfilerEnabled() { return enabled; }
+
+void ProfilerFrame() {
+	static long long frameStart = 0;
+	long long now = Now();
+	if (!enabled) {
+		frameStart = 0;
+		return;
+	}
+	ThreadEvents &main = Local();
+	// CPU: gather every thread's events
+	if (frameStart) {
+		Add("frame", false, (now-frameStart)/1.e6, 0);
+		Record("frame", frameStart, now, main.tid);
+	}
+	else
+		Find("frame", false);			// listed first
+	frameStart = now;
+	std::unique_lock<std::mutex> lockThreads(threadsMutex);
+	for (ThreadEvents *t : threads) {
+		std::lock_guard<std::mutex> lock(t->mutex);
+		// events are buffered as scopes close, inner first; in order of opening, a new scope follows its parent
+		std::sort(t->events.begin(), t->events.end(), [](const Event &a, const Event &b) { return a.start < b.start; });
+		for (Event &e : t->events) {
+			Add(e.name, false, (e.end-e.start)/1.e6, e.depth);
+			Record(e.name, e.start, e.end, t->tid);
+		}
+		t->events.clear();
+	}
+	lockThreads.unlock();
+	for (Scope &s : scopes)
+		if (!s.gpu)
+			s.Push();
+	// GPU: queue this frame's queries, resolve frames whose queries have completed
+	if (!GpuAvailable())
+		return;
+	GLint64 gpuNow = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	gpuToCpu = Now()-gpuNow;
+	gpuPending.push_back(gpuCurrent);
+	gpuCurrent = GpuFrame();
+	gpuFrameCount++;
+	gpuDepth = 0;
+	while (!gpuPending.empty()) {
+		GpuFrame &f = gpuPending.front();
+		if (f.last && (int) gpuPending.size() <= MaxGpuFramesInFlight) {
+			GLint available = 0;
+			glGetQueryObjectiv(f.last, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+		}
+		ResolveGpu(f);
+		gpuPending.pop_front();
+	}
+}
+
+// Statistics
+
+vector<ProfileStats> GetProfileStats() {
+	vector<ProfileStats> stats;
+	for (int gpu = 0; gpu < 2; gpu++)
+		for (Scope &s : scopes) {
+			if (s.gpu != (gpu == 1))
+				continue;
+			ProfileStats p;
+			p.name = s.name;
+			p.gpu = s.gpu;
+			p.depth = s.depth;
+			p.calls = s.calls;
+			for (int i = 0; i < s.nHistory; i++) {
+				float ms = s.history[(s.next-s.nHistory+i+NHistory)%NHistory];
+				p.history.push_back(ms);
+				p.average += ms;
+				p.max = ms > p.max? ms : p.max;
+			}
+			if (s.nHistory) {
+				p.average /= s.nHistory;
+				p.last = p.history.back();
+			}
+			stats.push_back(p);
+		}
+	return stats;
+}
+
+// Overlay
+
+void DisplayProfiler(int x, int y, float ptSize) {
+	vector<ProfileStats> stats = GetProfileStats();
+	int4 vp = VPi();
+	if (y < 0)
+		y = vp[1]+vp[3]-(int) (2*ptSize);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	glDisable(GL_DEPTH_TEST);
+	GLuint was = UseDrawShader(ScreenMode());
+	float lineHeight = 1.6f*ptSize, graphX = x+53*ptSize, graphH = 1.2f*ptSize;
+	for (ProfileStats &s : stats) {
+		char name[40], buf[100];
+		snprintf(name, sizeof(name), "%*s%s", 2*s.depth, "", s.name.c_str());
+		snprintf(buf, sizeof(buf), "%-26.26s %s %6.2f %6.2f %6.2f", name, s.gpu? "gpu" : "cpu", s.last, s.average, s.max);
+		vec3 color = s.gpu? vec3(.5f, 1, .5f) : vec3(1, 1, 1);
+		Letters(x, y, buf, color, ptSize);
+		// history, scaled to the scope's maximum
+		int n = (int) s.history.size();
+		if (n > 1 && s.max > 0) {
+			vector<vec3> points(n);
+			for (int i = 0; i < n; i++)
+				points[i] = vec3(graphX+i, y+graphH*s.history[i]/s.max, 0);
+			UseDrawShader(ScreenMode());
+			Line(vec2(graphX, (float) y), vec2(graphX+NHistory, (float) y), 1, vec3(.4f, .4f, .4f));
+			LineStrip(n, points.data(), color, 1, 1);
+		}
+		y -= (int) lineHeight;
+	}
+	glUseProgram(was);
+	if (depthTest)
+		glEnable(GL_DEPTH_TEST);
+}
+
+// Trace
+
+void StartProfileTrace(int maxEvents) {
+	trace.clear();
+	trace.reserve(maxEvents < 100000? maxEvents : 100000);
+	maxTraceEvents = maxEvents;
+	tracing = true;
+}
+
+bool SaveProfileTrace(const char *filename) {
+	tracing = false;
+	FILE *file = fopen(filename, "w");
+	if (!file) {
+		printf("can't write %s\n", filename);
+		return false;
+	}
+	long long origin = trace.empty()? 0 : trace[0].start;
+	for (TraceEvent &e : trace)
+		origin = e.start < origin? e.start : origin;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":-1,\"args\":{\"name\":\"GPU\"}}");
+	for (size_t i = 0; i < threads.size(); i++)
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"thread %i\"}}",
+			(int) i, (int) i);
+	for (TraceEvent &e : trace) {
+		fprintf(file, ",\n{\"name\":\"");
+		for (const char *c = e.name; *c; c++)
+			fprintf(file, *c == '"' || *c == '\\'? "\\%c" : "%c", *c);
+		fprintf(file, "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f}",
+			e.tid < 0? "gpu" : "cpu", e.tid, (e.start-origin)/1.e3, (e.end-e.start)/1.e3);
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	printf("saved %i events to %s\n", (int) trace.size(), filename);
+	trace.clear();
+	return true;
+}
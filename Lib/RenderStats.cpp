@@ -0,0 +1,346 @@
+// RenderStats.cpp - counts of submitted GL work, from hooked glad entry points
+
+#include <glad.h>
+#include <stdio.h>
+#include "Draw.h"
+#include "GLState.h"
+#include "Letters.h"
+#include "RenderStats.h"
+
+namespace {
+
+RenderStats frame, last;
+GLStateStats stateAtFrameStart;
+
+// GL entry points, as loaded by glad
+PFNGLDRAWARRAYSPROC realDrawArrays;
+PFNGLDRAWELEMENTSPROC realDrawElements;
+PFNGLDRAWELEMENTSBASEVERTEXPROC realDrawElementsBaseVertex;
+PFNGLDRAWARRAYSINSTANCEDPROC realDrawArraysInstanced;
+PFNGLDRAWELEMENTSINSTANCEDPROC realDrawElementsInstanced;
+PFNGLDRAWARRAYSINDIRECTPROC realDrawArraysIndirect;
+PFNGLDRAWELEMENTSINDIRECTPROC realDrawElementsIndirect;
+PFNGLMULTIDRAWARRAYSINDIRECTPROC realMultiDrawArraysIndirect;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC realMultiDrawElementsIndirect;
+PFNGLDISPATCHCOMPUTEPROC realDispatchCompute;
+PFNGLBUFFERDATAPROC realBufferData;
+PFNGLBUFFERSUBDATAPROC realBufferSubData;
+PFNGLMAPBUFFERRANGEPROC realMapBufferRange;
+PFNGLTEXIMAGE2DPROC realTexImage2D;
+PFNGLTEXIMAGE3DPROC realTexImage3D;
+PFNGLTEXSUBIMAGE2DPROC realTexSubImage2D;
+PFNGLTEXSUBIMAGE3DPROC realTexSubImage3D;
+PFNGLCOMPRESSEDTEXIMAGE2DPROC realCompressedTexImage2D;
+PFNGLCOMPRESSEDTEXIMAGE3DPROC realCompressedTexImage3D;
+PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC realCompressedTexSubImage2D;
+PFNGLCOMPRESSEDTEXSUBIMAGE3DPROC realCompressedTexSubImage3D;
+PFNGLREADPIXELSPROC realReadPixels;
+PFNGLGETBUFFERSUBDATAPROC realGetBufferSubData;
+PFNGLGETTEXIMAGEPROC realGetTexImage;
+PFNGLCOMPILESHADERPROC realCompileShader;
+PFNGLLINKPROGRAMPROC realLinkProgram;
+PFNGLPROGRAMBINARYPROC realProgramBinary;
+
+bool BufferBound(GLenum binding) {
+	// answered by the state cache once known
+	GLint b = 0;
+	glGetIntegerv(binding, &b);
+	return b != 0;
+}
+
+long long PixelBytes(GLenum format, GLenum type) {
+	switch (type) {
+		case GL_UNSIGNED_BYTE_3_3_2: case GL_UNSIGNED_BYTE_2_3_3_REV: return 1;
+		case GL_UNSIGNED_SHORT_5_6_5: case GL_UNSIGNED_SHORT_5_6_5_REV: case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_4_4_4_4_REV: case GL_UNSIGNED_SHORT_5_5_5_1: case GL_UNSIGNED_SHORT_1_5_5_5_REV: return 2;
+		case GL_UNSIGNED_INT_8_8_8_8: case GL_UNSIGNED_INT_8_8_8_8_REV: case GL_UNSIGNED_INT_10_10_10_2:
+		case GL_UNSIGNED_INT_2_10_10_10_REV: case GL_UNSIGNED_INT_24_8: case GL_UNSIGNED_INT_10F_11F_11F_REV:
+		case GL_UNSIGNED_INT_5_9_9_9_REV: return 4;
+	}
+	int components = 4;
+	switch (format) {
+		case GL_RED: case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX: components = 1; break;
+		case GL_RG: case GL_RG_INTEGER: case GL_DEPTH_STENCIL: components = 2; break;
+		case GL_RGB: case GL_BGR: case GL_RGB_INTEGER: case GL_BGR_INTEGER: components = 3; break;
+	}
+	int size = 4;
+	switch (type) {
+		case GL_UNSIGNED_BYTE: case GL_BYTE: size = 1; break;
+		case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: size = 2; break;
+	}
+	return components*size;
+}
+
+void CountTexture(GLsizei w, GLsizei h, GLsizei d, GLenum format, GLenum type, const void *pixels) {
+	// pixels NULL without a pixel unpack buffer only allocates
+	if (pixels || BufferBound(GL_PIXEL_UNPACK_BUFFER_BINDING))
+		frame.textureBytes += (long long) w*h*d*PixelBytes(format, type);
+}
+
+void CountCompressed(GLsizei imageSize, const void *data) {
+	if (data || BufferBound(GL_PIXEL_UNPACK_BUFFER_BINDING))
+		frame.textureBytes += imageSize;
+}
+
+void CountDraw(long long vertices, long long instances = 0) {
+	frame.drawCalls++;
+	frame.vertices += vertices*(instances? instances : 1);
+	frame.instances += instances;
+}
+
+void CountIndirect(GLsizei commands) {
+	frame.drawCalls++;
+	frame.indirectDraws += commands;
+}
+
+// Draws
+
+void APIENTRY DrawArrays(GLenum mode, GLint first, GLsizei count) {
+	CountDraw(count);
+	realDrawArrays(mode, first, count);
+}
+
+void APIENTRY DrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices) {
+	CountDraw(count);
+	realDrawElements(mode, count, type, indices);
+}
+
+void APIENTRY DrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void *indices, GLint base) {
+	CountDraw(count);
+	realDrawElementsBaseVertex(mode, count, type, indices, base);
+}
+
+void APIENTRY DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei n) {
+	CountDraw(count, n);
+	realDrawArraysInstanced(mode, first, count, n);
+}
+
+void APIENTRY DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei n) {
+	CountDraw(count, n);
+	realDrawElementsInstanced(mode, count, type, indices, n);
+}
+
+void APIENTRY DrawArraysIndirect(GLenum mode, const void *indirect) {
+	CountIndirect(1);
+	realDrawArraysIndirect(mode, indirect);
+}
+
+void APIENTRY DrawElementsIndirect(GLenum mode, GLenum type, const void *indirect) {
+	CountIndirect(1);
+	realDrawElementsIndirect(mode, type, indirect);
+}
+
+void APIENTRY MultiDrawArraysIndirect(GLenum mode, const void *indirect, GLsizei n, GLsizei stride) {
+	CountIndirect(n);
+	realMultiDrawArraysIndirect(mode, indirect, n, stride);
+}
+
+void APIENTRY MultiDrawElementsIndirect(GLenum mode, GLenum type, const void *indirect, GLsizei n, GLsizei stride) {
+	CountIndirect(n);
+	realMultiDrawElementsIndirect(mode, type, indirect, n, stride);
+}
+
+void APIENTRY DispatchCompute(GLuint x, GLuint y, GLuint z) {
+	frame.dispatches++;
+	realDispatchCompute(x, y, z);
+}
+
+// Uploads
+
+void APIENTRY BufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+	if (data)
+		frame.bufferBytes += size;
+	realBufferData(target, size, data, usage);
+}
+
+void APIENTRY BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) {
+	frame.bufferBytes += size;
+	realBufferSubData(target, offset, size, data);
+}
+
+void *APIENTRY MapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) {
+	// a pixel unpack buffer is counted when its texture is specified
+	if ((access & GL_MAP_WRITE_BIT) && target != GL_PIXEL_UNPACK_BUFFER)
+		frame.bufferBytes += length;
+	return realMapBufferRange(target, offset, length, access);
+}
+
+void APIENTRY TexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei w, GLsizei h, GLint border,
+						 GLenum format, GLenum type, const void *pixels) {
+	CountTexture(w, h, 1, format, type, pixels);
+	realTexImage2D(target, level, internalFormat, w, h, border, format, type, pixels);
+}
+
+void APIENTRY TexImage3D(GLenum target, GLint level, GLint internalFormat, GLsizei w, GLsizei h, GLsizei d,
+						 GLint border, GLenum format, GLenum type, const void *pixels) {
+	CountTexture(w, h, d, format, type, pixels);
+	realTexImage3D(target, level, internalFormat, w, h, d, border, format, type, pixels);
+}
+
+void APIENTRY TexSubImage2D(GLenum target, GLint level, GLint x, GLint y, GLsizei w, GLsizei h,
+							GLenum format, GLenum type, const void *pixels) {
+	CountTexture(w, h, 1, format, type, pixels);
+	realTexSubImage2D(target, level, x, y, w, h, format, type, pixels);
+}
+
+void APIENTRY TexSubImage3D(GLenum target, GLint level, GLint x, GLint y, GLint z, GLsizei w, GLsizei h, GLsizei d,
+							GLenum format, GLenum type, const void *pixels) {
+	CountTexture(w, h, d, format, type, pixels);
+	realTexSubImage3D(target, level, x, y, z, w, h, d, format, type, pixels);
+}
+
+void APIENTRY CompressedTexImage2D(GLenum target, GLint level, GLenum internalFormat, GLsizei w, GLsizei h, GLint border,
+								   GLsizei imageSize, const void *data) {
+	CountCompressed(imageSize, data);
+	realCompressedTexImage2D(target, level, internalFormat, w, h, border, imageSize, data);
+}
+
+void APIENTRY CompressedTexImage3D(GLenum target, GLint level, GLenum internalFormat, GLsizei w, GLsizei h, GLsizei d,
+								   GLint border, GLsizei imageSize, const void *data) {
+	CountCompressed(imageSize, data);
+	realCompressedTexImage3D(target, level, internalFormat, w, h, d, border, imageSize, data);
+}
+
+void APIENTRY CompressedTexSubImage2D(GLenum target, GLint level, GLint x, GLint y, GLsizei w, GLsizei h,
+									  GLenum format, GLsizei imageSize, const void *data) {
+	CountCompressed(imageSize, data);
+	realCompressedTexSubImage2D(target, level, x, y, w, h, format, imageSize, data);
+}
+
+void APIENTRY CompressedTexSubImage3D(GLenum target, GLint level, GLint x, GLint y, GLint z, GLsizei w, GLsizei h,
+									  GLsizei d, GLenum format, GLsizei imageSize, const void *data) {
+	CountCompressed(imageSize, data);
+	realCompressedTexSubImage3D(target, level, x, y, z, w, h, d, format, imageSize, data);
+}
+
+// Readbacks
+
+void APIENTRY ReadPixels(GLint x, GLint y, GLsizei w, GLsizei h, GLenum format, GLenum type, void *pixels) {
+	// into a pixel pack buffer is asynchronous (see GetDataAsync in Headless.h)
+	if (!BufferBound(GL_PIXEL_PACK_BUFFER_BINDING)) {
+		frame.readbacks++;
+		frame.readbackBytes += (long long) w*h*PixelBytes(format, type);
+	}
+	realReadPixels(x, y, w, h, format, type, pixels);
+}
+
+void APIENTRY GetBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, void *data) {
+	frame.readbacks++;
+	frame.readbackBytes += size;
+	realGetBufferSubData(target, offset, size, data);
+}
+
+void APIENTRY GetTexImage(GLenum target, GLint level, GLenum format, GLenum type, void *pixels) {
+	frame.readbacks++;
+	realGetTexImage(target, level, format, type, pixels);
+}
+
+// Shaders
+
+void APIENTRY CompileShader(GLuint shader) {
+	frame.shaderCompiles++;
+	realCompileShader(shader);
+}
+
+void APIENTRY LinkProgram(GLuint program) {
+	frame.programLinks++;
+	realLinkProgram(program);
+}
+
+void APIENTRY ProgramBinary(GLuint program, GLenum format, const void *binary, GLsizei length) {
+	frame.programBinaries++;
+	realProgramBinary(program, format, binary, length);
+}
+
+template<class F> void Hook(F &entry, F &real, F counted) {
+	// redirect entry to counted, unless already
+	if (entry && entry != counted) {
+		real = entry;
+		entry = counted;
+	}
+}
+
+RenderStats WithState(RenderStats s) {
+	// add state calls issued since the frame started
+	GLStateStats now = GetGLStateTotals();
+	auto Issued = [&now](GLStateCall c) {
+		int i = (int) c;
+		return (now.calls[i]-now.skipped[i])-(stateAtFrameStart.calls[i]-stateAtFrameStart.skipped[i]);
+	};
+	s.programBinds = Issued(GLStateCall::Program);
+	s.textureBinds = Issued(GLStateCall::Texture);
+	for (int i = 0; i < (int) GLStateCall::Count; i++)
+		if (i != (int) GLStateCall::Query)
+			s.stateChanges += Issued((GLStateCall) i);
+	return s;
+}
+
+} // end namespace
+
+void InitRenderStats() {
+	Hook(glad_glDrawArrays, realDrawArrays, DrawArrays);
+	Hook(glad_glDrawElements, realDrawElements, DrawElements);
+	Hook(glad_glDrawElementsBaseVertex, realDrawElementsBaseVertex, DrawElementsBaseVertex);
+	Hook(glad_glDrawArraysInstanced, realDrawArraysInstanced, DrawArraysInstanced);
+	Hook(glad_glDrawElementsInstanced, realDrawElementsInstanced, DrawElementsInstanced);
+	Hook(glad_glDrawArraysIndirect, realDrawArraysIndirect, DrawArraysIndirect);
+	Hook(glad_glDrawElementsIndirect, realDrawElementsIndirect, DrawElementsIndirect);
+	Hook(glad_glMultiDrawArraysIndirect, realMultiDrawArraysIndirect, MultiDrawArraysIndirect);
+	Hook(glad_glMultiDrawElementsIndirect, realMultiDrawElementsIndirect, MultiDrawElementsIndirect);
+	Hook(glad_glDispatchCompute, realDispatchCompute, DispatchCompute);
+	Hook(glad_glBufferData, realBufferData, BufferData);
+	Hook(glad_glBufferSubData, realBufferSubData, BufferSubData);
+	Hook(glad_glMapBufferRange, realMapBufferRange, MapBufferRange);
+	Hook(glad_glTexImage2D, realTexImage2D, TexImage2D);
+	Hook(glad_glTexImage3D, realTexImage3D, TexImage3D);
+	Hook(glad_glTexSubImage2D, realTexSubImage2D, TexSubImage2D);
+	Hook(glad_glTexSubImage3D, realTexSubImage3D, TexSubImage3D);
+	Hook(glad_glCompressedTexImage2D, realCompressedTexImage2D, CompressedTexImage2D);
+	Hook(glad_glCompressedTexImage3D, realCompressedTexImage3D, CompressedTexImage3D);
+	Hook(glad_glCompressedTexSubImage2D, realCompressedTexSubImage2D, CompressedTexSubImage2D);
+	Hook(glad_glCompressedTexSubImage3D, realCompressedTexSubImage3D, CompressedTexSubImage3D);
+	Hook(glad_glReadPixels, realReadPixels, ReadPixels);
+	Hook(glad_glGetBufferSubData, realGetBufferSubData, GetBufferSubData);
+	Hook(glad_glGetTexImage, realGetTexImage, GetTexImage);
+	Hook(glad_glCompileShader, realCompileShader, CompileShader);
+	Hook(glad_glLinkProgram, realLinkProgram, LinkProgram);
+	Hook(glad_glProgramBinary, realProgramBinary, ProgramBinary);
+	stateAtFrameStart = GetGLStateTotals();
+}
+
+void RenderStatsFrame() {
+	last = WithState(frame);
+	frame = RenderStats();
+	stateAtFrameStart = GetGLStateTotals();
+}
+
+RenderStats GetRenderStats(bool current) {
+	return current? WithState(frame) : last;
+}
+
+void DisplayRenderStats(int x, int y, float ptSize, vec3 color) {
+	Letters(x, y, last.Line(), color, ptSize);
+}
+
+// Output
+
+const char *RenderStats::Line() {
+	static char buf[200];
+	snprintf(buf, sizeof(buf), "draws %i verts %.1fk prog %i tex %i state %i up %.2f mb readbacks %i compiles %i",
+		drawCalls, vertices/1000., programBinds, textureBinds, stateChanges, (bufferBytes+textureBytes)/1.e6,
+		readbacks, shaderCompiles+programLinks);
+	return buf;
+}
+
+void RenderStats::Print(const char *title) {
+	printf("%s%s%i draw calls\n", title? title : "", title? ": " : "", drawCalls);
+	struct { const char *name; long long n; } counts[] = {
+		{"indirect draws", indirectDraws}, {"vertices", vertices}, {"instances", instances}, {"dispatches", dispatches},
+		{"program binds", programBinds}, {"texture binds", textureBinds}, {"state changes", stateChanges},
+		{"buffer bytes", bufferBytes}, {"texture bytes", textureBytes}, {"readbacks", readbacks},
+		{"readback bytes", readbackBytes}, {"shader compiles", shaderCompiles}, {"program links", programLinks},
+		{"program binaries", programBinaries} };
+	for (auto &c : counts)
+		if (c.n)
+			printf("  %-18s %lli\n", c.name, c.n);
+}
@@ -3,7 +3,10 @@
 #include "Draw.h"
 #include "GLXtras.h"
 #include "IO.h"
+#include "Profiler.h"
 #include "Sprite.h"
+#include "TextureCache.h"
+#include "VecMatBatch.h"
 #include <algorithm>
 #include <iostream>
 
@@ -35,11 +38,14 @@ int BuildSpriteShader(bool collisionTest = false) {
 		out vec4 pColor;
 		uniform mat4 uvTransform;
 		uniform sampler2D textureImage, textureMat;
-		uniform bool useMat;
-		uniform int nTexChannels = 3;
+		uniform sampler2DArray textureFrames;
+		uniform bool useMat, useFrames = false;
+		uniform int nTexChannels = 3, frameLayer = 0;
 		void main() {
 			vec2 st = (uvTransform*vec4(uv, 0, 1)).xy;
-			if (nTexChannels == 4)
+			if (useFrames)
+				pColor = texture(textureFrames, vec3(st, frameLayer));
+			else if (nTexChannels == 4)
 				pColor = texture(textureImage, st);
 			else {
 				pColor.rgb = texture(textureImage, st).rgb;
@@ -58,13 +64,16 @@ int BuildSpriteShader(bool collisionTest = false) {
 		in vec2 uv;
 		out vec4 pColor;
 		uniform vec4 vp;
-		uniform bool showOccupy = false, useMat = false;
+		uniform bool showOccupy = false, useMat = false, useFrames = false;
 		uniform sampler2D textureImage, textureMat;
+		uniform sampler2DArray textureFrames;
 		uniform mat4 uvTransform;
-		uniform int spriteId = 0, nTexChannels = 3;
+		uniform int spriteId = 0, nTexChannels = 3, frameLayer = 0;
 		void main() {
 			vec2 st = (uvTransform*vec4(uv, 0, 1)).xy;
-			if (nTexChannels == 4)
+			if (useFrames)
+				pColor = texture(textureFrames, vec3(st, frameLayer));
+			else if (nTexChannels == 4)
 				pColor = texture(textureImage, st);
 			else {
 				pColor.rgb = texture(textureImage, st).rgb;
@@ -107,6 +116,13 @@ bool CrossPositive(vec2 a, vec2 b, vec2 c) {
 	return cross(vec2(b-a), vec2(c-b)) > 0;
 }
 
+vec2 Aspect() {
+	// scale that compensates for window aspect ratio
+	vec4 vp = VP();
+	float w = vp[2], h = vp[3];
+	return w > h? vec2(h/w, 1.f) : vec2(1.f, w/h);
+}
+
 } // end namespace
 
 // Collision
@@ -179,6 +195,7 @@ void GetCollided(int nsprites, Sprite *s) {
 bool ZCompare(Sprite *s1, Sprite *s2) { return s1->z > s2->z; }
 
 int TestCollisions(vector<Sprite *> &sprites) {
+	ProfileScope scope("test collisions", true);
 	int nsprites = sprites.size();
 	if (nsprites != nCollisionSprites) {
 		nCollisionSprites = nsprites;
@@ -227,7 +244,7 @@ bool Intersect(mat4 m1, mat4 m2) {
 }
 
 bool Sprite::Intersect(Sprite &s) {
-	return ::Intersect(ptTransform, s.ptTransform);
+	return ::Intersect(GetPtTransform(), s.GetPtTransform());
 }
 
 void Sprite::Initialize(GLuint texName, float z) {
@@ -241,7 +258,7 @@ void Sprite::Initialize(GLuint texName, float z) {
 void Sprite::Initialize(string imageFile, float z, bool compensateAspectRatio) {
 	this->z = z;
 	this->compensateAspectRatio = compensateAspectRatio;
-	textureName = ReadTexture(imageFile.c_str(), true, &nTexChannels, &imgWidth, &imgHeight);
+	textureName = ReadCompressedTexture(imageFile.c_str(), true, &nTexChannels, &imgWidth, &imgHeight);
 	glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 	UpdateTransform();
@@ -258,7 +275,7 @@ void Sprite::Initialize(vector<string> &imageFiles, string matFile, float z, flo
 	images.resize(nFrames);
 	for (int i = 0; i < nFrames; i++) {
 		int nTexChannels;
-		GLuint textureName = ReadTexture(imageFiles[i].c_str(), true, &nTexChannels);
+		GLuint textureName = ReadCompressedTexture(imageFiles[i].c_str(), true, &nTexChannels);
 		images[i] = ImageInfo(textureName, nTexChannels, frameDuration);
 	}
 	if (!matFile.empty())
@@ -270,14 +287,12 @@ void Sprite::Initialize(vector<string> &imageFiles, string matFile, float z, flo
 }
 
 void Sprite::InitializeGIF(string gifFile, float z) {
-	int nChannels = 0;
-	vector<GLuint> textureNames;
 	vector<float> frameDurations;
 	this->z = z;
-	nFrames = ReadGIF(gifFile.c_str(), textureNames, &nChannels, &frameDurations);
+	frameArray = ReadCompressedGIFArray(gifFile.c_str(), &nFrames, &frameDurations);
 	images.resize(nFrames);
 	for (int i = 0; i < nFrames; i++)
-		images[i] = ImageInfo(textureNames[i], nChannels, frameDurations[i]);
+		images[i] = ImageInfo(frameArray, 4, frameDurations[i]);
 	UpdateTransform();
 }
 
@@ -296,9 +311,9 @@ bool Sprite::Hit(double x, double y) {
 	return true;
 }
 
-void Sprite::SetRotation(float angle) { rotation = angle; UpdateTransform(); }
+void Sprite::SetRotation(float angle) { rotation = angle; transformDirty = true; }
 
-void Sprite::SetPosition(vec2 p) { position = p; UpdateTransform(); }
+void Sprite::SetPosition(vec2 p) { position = p; transformDirty = true; }
 
 void Sprite::SetScreenPosition(int x, int y) {
 	vec4 vp = VP();
@@ -317,15 +332,55 @@ void Sprite::UpdateTransform() {
 	vec3 s(scale.x, scale.y, 1);
 	ptTransform = Translate(position.x, position.y, 0)*RotateZ(rotation)*Scale(s);
 	if (compensateAspectRatio) {
-		vec4 vp = VP();
-		float w = vp[2], h = vp[3];
-		vec3 scale = w > h? vec3(h/w, 1.f, 1.f) : vec3(1.f, w/h, 1.f);
-		ptTransform = Scale(scale)*ptTransform;
+		vec2 a = SpriteSpace::Aspect();
+		ptTransform = Scale(a.x, a.y, 1.f)*ptTransform;
+	}
+	transformDirty = false;
+}
+
+mat4 &Sprite::GetPtTransform() {
+	if (transformDirty)
+		UpdateTransform();
+	return ptTransform;
+}
+
+void UpdateTransforms(vector<Sprite *> &sprites) {
+	// gather dirty sprites by aspect compensation, as structure of arrays
+	vector<Sprite *> dirty[2];
+	for (Sprite *s : sprites)
+		if (s->transformDirty)
+			dirty[s->compensateAspectRatio].push_back(s);
+	vector<float> x, y, degrees, sx, sy;
+	vector<mat4> transforms;
+	for (int c = 0; c < 2; c++) {
+		int n = (int) dirty[c].size();
+		if (!n)
+			continue;
+		x.resize(n); y.resize(n); degrees.resize(n); sx.resize(n); sy.resize(n); transforms.resize(n);
+		for (int i = 0; i < n; i++) {
+			Sprite *s = dirty[c][i];
+			x[i] = s->position.x; y[i] = s->position.y;
+			degrees[i] = s->rotation;
+			sx[i] = s->scale.x; sy[i] = s->scale.y;
+		}
+		PlanarTransforms(x.data(), y.data(), degrees.data(), sx.data(), sy.data(), c? SpriteSpace::Aspect() : vec2(1, 1), transforms.data(), n);
+		for (int i = 0; i < n; i++) {
+			dirty[c][i]->ptTransform = transforms[i];
+			dirty[c][i]->transformDirty = false;
+		}
+	}
+}
+
+void MoveSprites(vector<Sprite *> &sprites, const vec2 *deltas) {
+	for (size_t i = 0; i < sprites.size(); i++) {
+		sprites[i]->position += deltas[i];
+		sprites[i]->transformDirty = true;
 	}
+	UpdateTransforms(sprites);
 }
 
 vec2 Sprite::PtTransform(vec2 p) {
-	vec4 q = ptTransform*vec4(p, 0, 1);
+	vec4 q = GetPtTransform()*vec4(p, 0, 1);
 	return vec2(q.x, q.y); // /q.w
 }
 
@@ -351,15 +406,15 @@ void Sprite::Wheel(double spin, bool scaleNotRotate) {
 	}
 	else
 		rotation += 10*(float) spin;
-	UpdateTransform();
+	transformDirty = true;
 }
 
 void Sprite::SetScale(vec2 s) {
 	scale = s;
-	UpdateTransform();
+	transformDirty = true;
 }
 
-void Sprite::SetPtTransform(mat4 m) { ptTransform = m; }
+void Sprite::SetPtTransform(mat4 m) { ptTransform = m; transformDirty = false; }
 
 void Sprite::SetUvTransform(mat4 m) { uvTransform = m; }
 
@@ -377,18 +432,38 @@ void Sprite::Outline(vec3 color, float width) {
 
 void Sprite::SetFrame(int n) {
 	ImageInfo i = images[frame = n];
+	if (frameArray)
+		return;					// frame selects array layer in Display
 	textureName = i.textureName;
 	nTexChannels = i.nChannels;
 }
 
 void Sprite::Display(mat4 *fullview, int textureUnit) {
+	ProfileScope scope("sprite display", true);
 	int s = CurrentProgram();
 	glBindVertexArray(vao);
 	if (s <= 0 || (s != spriteShader && s != spriteCollisionShader))
 		s = SpriteSpace::GetShader();
 	glUseProgram(s);
 	glActiveTexture(GL_TEXTURE0+textureUnit);
-	if (nFrames && autoAnimate) {
+	SetUniform(s, "useFrames", frameArray > 0);
+	SetUniform(s, "textureFrames", (int) textureUnit+2);
+		// array sampler never shares a unit with textureImage, even when unused
+	if (frameArray) {
+		// all frames in one array texture: animation only changes the layer uniform
+		if (nFrames && autoAnimate) {
+			time_t now = clock();
+			if (now > change) {
+				frame = (frame+1)%nFrames;
+				change = now+(time_t)(images[frame].duration*CLOCKS_PER_SEC);
+			}
+		}
+		glActiveTexture(GL_TEXTURE0+textureUnit+2);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, frameArray);
+		SetUniform(s, "frameLayer", frame);
+		SetUniform(s, "nTexChannels", 4);
+	}
+	else if (nFrames && autoAnimate) {
 		time_t now = clock();
 		ImageInfo i = images[frame];
 		if (now > change) {
@@ -410,7 +485,8 @@ void Sprite::Display(mat4 *fullview, int textureUnit) {
 		glBindTexture(GL_TEXTURE_2D, matName);
 		SetUniform(s, "textureMat", (int) textureUnit+1);
 	}
-	SetUniform(s, "view", fullview? *fullview*ptTransform : ptTransform);
+	mat4 &m = GetPtTransform();
+	SetUniform(s, "view", fullview? *fullview*m : m);
 	SetUniform(s, "uvTransform", uvTransform);
 #ifndef __APPLE__
 	glDrawArrays(GL_QUADS, 0, 4);
@@ -427,4 +503,6 @@ void Sprite::SetFrameDuration(float dt) {
 void Sprite::Release() {
 	glDeleteBuffers(1, &textureName);
 	if (matName > 0) glDeleteBuffers(1, &matName);
+	if (frameArray > 0) glDeleteTextures(1, &frameArray);
+	frameArray = 0;
 }
@@ -0,0 +1,564 @@
+// TextureCache.cpp - block-compressed (BC1/BC3/BC7) texture cache
+
+#include <glad.h>
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include "stb_image.h"
+#include "IO.h"
+#include "TextureCache.h"
+#include "TextureStream.h"
+
+using std::string;
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace {
+
+// Block encoding
+
+typedef unsigned char Texel[4];
+
+void GatherBlock(unsigned char *pixels, int width, int height, int bpp, int bx, int by, Texel block[16]) {
+	// expand to rgba; repeat edge pixels for partial blocks
+	for (int j = 0; j < 4; j++)
+		for (int i = 0; i < 4; i++) {
+			int x = std::min(4*bx+i, width-1), y = std::min(4*by+j, height-1);
+			unsigned char *p = pixels+((size_t) y*width+x)*bpp, *t = block[4*j+i];
+			t[0] = p[0];
+			t[1] = bpp < 3? p[0] : p[1];
+			t[2] = bpp < 3? p[0] : p[2];
+			t[3] = bpp == 2? p[1] : bpp == 4? p[3] : 255;
+		}
+}
+
+void PrincipalEndpoints(Texel block[16], int nChannels, float lo[4], float hi[4]) {
+	// endpoints are the extreme projections of the block onto its principal axis
+	float mean[4] = {0, 0, 0, 0}, cov[4][4] = {}, axis[4] = {1, 1, 1, 1};
+	for (int i = 0; i < 16; i++)
+		for (int k = 0; k < nChannels; k++)
+			mean[k] += block[i][k]/16.f;
+	for (int i = 0; i < 16; i++)
+		for (int a = 0; a < nChannels; a++)
+			for (int b = 0; b < nChannels; b++)
+				cov[a][b] += (block[i][a]-mean[a])*(block[i][b]-mean[b]);
+	for (int iter = 0; iter < 8; iter++) {
+		float v[4] = {0, 0, 0, 0}, len = 0;
+		for (int a = 0; a < nChannels; a++) {
+			for (int b = 0; b < nChannels; b++)
+				v[a] += cov[a][b]*axis[b];
+			len += v[a]*v[a];
+		}
+		if (len < 1e-12f)
+			break;
+		len = sqrt(len);
+		for (int a = 0; a < nChannels; a++)
+			axis[a] = v[a]/len;
+	}
+	float len = 0, tMin = 0, tMax = 0;
+	for (int a = 0; a < nChannels; a++)
+		len += axis[a]*axis[a];
+	len = sqrt(len);
+	for (int i = 0; i < 16; i++) {
+		float t = 0;
+		for (int a = 0; a < nChannels; a++)
+			t += (block[i][a]-mean[a])*axis[a]/len;
+		tMin = std::min(tMin, t);
+		tMax = std::max(tMax, t);
+	}
+	for (int a = 0; a < nChannels; a++) {
+		lo[a] = std::max(0.f, std::min(255.f, mean[a]+tMin*axis[a]/len));
+		hi[a] = std::max(0.f, std::min(255.f, mean[a]+tMax*axis[a]/len));
+	}
+}
+
+int Distance(const int *a, const unsigned char *b, int nChannels) {
+	int d = 0;
+	for (int k = 0; k < nChannels; k++)
+		d += (a[k]-b[k])*(a[k]-b[k]);
+	return d;
+}
+
+void Put16(unsigned char *out, unsigned int v) { out[0] = v&255; out[1] = (v>>8)&255; }
+
+unsigned int Pack565(const float c[3]) {
+	int r = (int) (c[0]*31/255+.5f), g = (int) (c[1]*63/255+.5f), b = (int) (c[2]*31/255+.5f);
+	return (r << 11) | (g << 5) | b;
+}
+
+void Unpack565(unsigned int v, int c[3]) {
+	int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+void EncodeColor(Texel block[16], unsigned char *out) {
+	// BC1 color block, always in four-color mode
+	float lo[4], hi[4];
+	PrincipalEndpoints(block, 3, lo, hi);
+	unsigned int c0 = Pack565(hi), c1 = Pack565(lo), bits = 0;
+	if (c0 < c1)
+		std::swap(c0, c1);
+	if (c0 != c1) {
+		int p[4][3];
+		Unpack565(c0, p[0]);
+		Unpack565(c1, p[1]);
+		for (int k = 0; k < 3; k++) {
+			p[2][k] = (2*p[0][k]+p[1][k])/3;
+			p[3][k] = (p[0][k]+2*p[1][k])/3;
+		}
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestD = Distance(p[0], block[i], 3);
+			for (int n = 1; n < 4; n++) {
+				int d = Distance(p[n], block[i], 3);
+				if (d < bestD) { best = n; bestD = d; }
+			}
+			bits |= best << (2*i);
+		}
+	}
+	Put16(out, c0);
+	Put16(out+2, c1);
+	Put16(out+4, bits & 0xffff);
+	Put16(out+6, bits >> 16);
+}
+
+void EncodeAlpha(Texel block[16], unsigned char *out) {
+	// BC3 alpha block, eight-value mode
+	int a0 = 0, a1 = 255;
+	for (int i = 0; i < 16; i++) {
+		a0 = std::max(a0, (int) block[i][3]);
+		a1 = std::min(a1, (int) block[i][3]);
+	}
+	unsigned long long bits = 0;
+	if (a0 != a1) {
+		int p[8] = {a0, a1};
+		for (int n = 1; n < 7; n++)
+			p[n+1] = ((7-n)*a0+n*a1)/7;
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestD = 256;
+			for (int n = 0; n < 8; n++) {
+				int d = abs(p[n]-block[i][3]);
+				if (d < bestD) { best = n; bestD = d; }
+			}
+			bits |= (unsigned long long) best << (3*i);
+		}
+	}
+	out[0] = a0;
+	out[1] = a1;
+	for (int b = 0; b < 6; b++)
+		out[2+b] = (bits >> (8*b)) & 255;
+}
+
+struct BitWriter {
+	unsigned char *out;
+	int bit = 0;
+	BitWriter(unsigned char *o) : out(o) { memset(out, 0, 16); }
+	void Put(unsigned int v, int nBits) {
+		for (int i = 0; i < nBits; i++, bit++)
+			if ((v >> i) & 1)
+				out[bit >> 3] |= 1 << (bit & 7);
+	}
+};
+
+void QuantizeBC7(const float c[4], int q[4], int &pBit) {
+	// 7-bit rgba endpoint with shared p-bit; choose p-bit with least error
+	int bestErr = 1 << 30;
+	for (int p = 0; p < 2; p++) {
+		int qp[4], err = 0;
+		for (int k = 0; k < 4; k++) {
+			qp[k] = std::max(0, std::min(127, (int) ((c[k]-p)/2+.5f)));
+			float e = ((qp[k] << 1) | p)-c[k];
+			err += (int) (e*e);
+		}
+		if (err < bestErr) {
+			bestErr = err;
+			pBit = p;
+			memcpy(q, qp, sizeof(qp));
+		}
+	}
+}
+
+void EncodeBC7(Texel block[16], unsigned char *out) {
+	// mode 6: single subset, rgba 7.7.7.7 endpoints plus p-bits, 4-bit indices
+	static const int weights[] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+	float lo[4], hi[4];
+	PrincipalEndpoints(block, 4, lo, hi);
+	int q[2][4], p[2], e[2][4], palette[16][4], indices[16];
+	QuantizeBC7(lo, q[0], p[0]);
+	QuantizeBC7(hi, q[1], p[1]);
+	for (int n = 0; n < 2; n++)
+		for (int k = 0; k < 4; k++)
+			e[n][k] = (q[n][k] << 1) | p[n];
+	for (int n = 0; n < 16; n++)
+		for (int k = 0; k < 4; k++)
+			palette[n][k] = ((64-weights[n])*e[0][k]+weights[n]*e[1][k]+32) >> 6;
+	for (int i = 0; i < 16; i++) {
+		int best = 0, bestD = Distance(palette[0], block[i], 4);
+		for (int n = 1; n < 16; n++) {
+			int d = Distance(palette[n], block[i], 4);
+			if (d < bestD) { best = n; bestD = d; }
+		}
+		indices[i] = best;
+	}
+	if (indices[0] & 8) {
+		// anchor index msb is implicit zero: swap endpoints, invert indices
+		std::swap(q[0], q[1]);
+		std::swap(p[0], p[1]);
+		for (int i = 0; i < 16; i++)
+			indices[i] = 15-indices[i];
+	}
+	BitWriter w(out);
+	w.Put(1 << 6, 7);
+	for (int k = 0; k < 4; k++) {
+		w.Put(q[0][k], 7);
+		w.Put(q[1][k], 7);
+	}
+	w.Put(p[0], 1);
+	w.Put(p[1], 1);
+	w.Put(indices[0], 3);
+	for (int i = 1; i < 16; i++)
+		w.Put(indices[i], 4);
+}
+
+// GL formats
+
+GLenum GLFormat(BlockFormat format) {
+	return format == BlockFormat::BC1? GL_COMPRESSED_RGB_S3TC_DXT1_EXT :
+		   format == BlockFormat::BC3? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_BPTC_UNORM;
+}
+
+bool FormatListed(GLenum glFormat) {
+	// the context's formats, queried once
+	static vector<GLint> formats;
+	static bool queried = false;
+	if (!queried) {
+		GLint n = 0;
+		glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &n);
+		formats.resize(n);
+		if (n)
+			glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+		queried = true;
+	}
+	return std::find(formats.begin(), formats.end(), (GLint) glFormat) != formats.end();
+}
+
+int LevelBytes(BlockFormat format, int width, int height, int level) {
+	int w = std::max(1, width >> level), h = std::max(1, height >> level);
+	return ((w+3)/4)*((h+3)/4)*BlockBytes(format);
+}
+
+// Cache file
+
+const int cacheVersion = 1;
+
+struct CacheHeader {
+	char magic[4] = {'B', 'C', 'T', 'C'};
+	int version = cacheVersion;
+	long long modified = 0;		// source modification time
+	int format = 0, width = 0, height = 0, nChannels = 0, nLevels = 0, nFrames = 0, pathLength = 0;
+};
+
+struct CacheImage {
+	BlockFormat format = BlockFormat::BC1;
+	int width = 0, height = 0, nChannels = 0, nLevels = 0, nFrames = 0;
+	vector<float> durations;
+	vector<unsigned char> data;	// frame-major, then level
+	int FrameBytes() {
+		int n = 0;
+		for (int l = 0; l < nLevels; l++)
+			n += LevelBytes(format, width, height, l);
+		return n;
+	}
+};
+
+bool Modified(const char *filename, long long &modified) {
+	struct stat info;
+	if (stat(filename, &info) != 0)
+		return false;
+	modified = (long long) info.st_mtime;
+	return true;
+}
+
+bool cacheEnabled = false;
+string cacheDirectory;
+
+string CacheName(const char *filename) {
+	if (cacheDirectory.empty())
+		return string(filename)+".bct";
+	// flatten the source path into one name within the cache directory
+	string name(filename);
+	for (char &c : name)
+		if (c == '/' || c == '\\' || c == ':')
+			c = '_';
+	return cacheDirectory+"/"+name+".bct";
+}
+
+bool IsGIF(const char *filename) {
+	const char *dot = strrchr(filename, '.');
+	return dot && (!strcmp(dot, ".gif") || !strcmp(dot, ".GIF"));
+}
+
+bool ReadCache(const char *filename, BlockFormat format, CacheImage &c) {
+	FILE *in = fopen(CacheName(filename).c_str(), "rb");
+	if (!in)
+		return false;
+	CacheHeader h;
+	long long modified = 0;
+	bool ok = fread(&h, sizeof(h), 1, in) == 1 && !strncmp(h.magic, "BCTC", 4) && h.version == cacheVersion &&
+			  (format == BlockFormat::Auto || (int) format == h.format) && h.pathLength == (int) strlen(filename);
+	if (ok) {
+		// key: source path and, if source present, its modification time (cache may ship without source)
+		string path(h.pathLength, 0);
+		ok = fread(&path[0], 1, h.pathLength, in) == (size_t) h.pathLength && path == filename &&
+			 (!Modified(filename, modified) || modified == h.modified);
+	}
+	if (ok && !CompressedTexturesAvailable((BlockFormat) h.format))
+		ok = false;					// eg, BC7 cached for Auto, but the context can't sample it: re-encode
+	if (ok) {
+		c.format = (BlockFormat) h.format;
+		c.width = h.width;
+		c.height = h.height;
+		c.nChannels = h.nChannels;
+		c.nLevels = h.nLevels;
+		c.nFrames = h.nFrames;
+		c.durations.resize(h.nFrames);
+		c.data.resize((size_t) c.nFrames*c.FrameBytes());
+		ok = fread(c.durations.data(), sizeof(float), h.nFrames, in) == (size_t) h.nFrames &&
+			 fread(c.data.data(), 1, c.data.size(), in) == c.data.size();
+	}
+	fclose(in);
+	return ok;
+}
+
+bool WriteCache(const char *filename, CacheImage &c) {
+	FILE *out = fopen(CacheName(filename).c_str(), "wb");
+	if (!out) {
+		printf("TextureCache: can't write %s\n", CacheName(filename).c_str());
+		return false;
+	}
+	CacheHeader h;
+	Modified(filename, h.modified);
+	h.format = (int) c.format;
+	h.width = c.width;
+	h.height = c.height;
+	h.nChannels = c.nChannels;
+	h.nLevels = c.nLevels;
+	h.nFrames = c.nFrames;
+	h.pathLength = (int) strlen(filename);
+	bool ok = fwrite(&h, sizeof(h), 1, out) == 1 &&
+			  fwrite(filename, 1, h.pathLength, out) == (size_t) h.pathLength &&
+			  fwrite(c.durations.data(), sizeof(float), c.nFrames, out) == (size_t) c.nFrames &&
+			  fwrite(c.data.data(), 1, c.data.size(), out) == c.data.size();
+	fclose(out);
+	return ok;
+}
+
+void EncodeFrame(CacheImage &c, unsigned char *pixels) {
+	// append blocks for all levels of one frame
+	vector<unsigned char> blocks;
+	vector<MipLevel> levels;
+	EncodeBlocks(pixels, c.width, c.height, c.nChannels, c.format, blocks);
+	c.data.insert(c.data.end(), blocks.begin(), blocks.end());
+	BuildMipChain(pixels, c.width, c.height, c.nChannels, levels);
+	for (MipLevel &m : levels) {
+		EncodeBlocks(m.pixels.data(), m.width, m.height, c.nChannels, c.format, blocks);
+		c.data.insert(c.data.end(), blocks.begin(), blocks.end());
+	}
+}
+
+void EncodeGIFFrame(unsigned char *pixels, int width, int height, int frame, int nFrames, float duration, void *data) {
+	CacheImage &c = *(CacheImage *) data;
+	if (!frame) {
+		c.width = width;
+		c.height = height;
+		c.nLevels = MipCount(width, height);
+		c.data.reserve((size_t) nFrames*c.FrameBytes());
+	}
+	c.durations.push_back(duration);
+	EncodeFrame(c, pixels);
+	c.nFrames = frame+1;
+}
+
+bool Encode(const char *filename, BlockFormat format, CacheImage &c) {
+	// decode source (image, or GIF a frame at a time), encode each frame's full mip chain
+	bool gif = IsGIF(filename);
+	c.data.clear();
+	c.durations.clear();
+	if (gif) {
+		c.nChannels = 4;
+		c.format = format == BlockFormat::Auto? BlockFormat::BC3 : format;
+		return DecodeGIF(filename, EncodeGIFFrame, &c) > 0;
+	}
+	stbi_set_flip_vertically_on_load(true);
+	unsigned char *pixels = stbi_load(filename, &c.width, &c.height, &c.nChannels, 0);
+	if (!pixels) {
+		printf("TextureCache: can't open %s (%s)\n", filename, stbi_failure_reason());
+		return false;
+	}
+	if (format == BlockFormat::Auto)
+		format = c.nChannels == 2 || c.nChannels == 4? BlockFormat::BC3 : BlockFormat::BC1;
+	c.format = format;
+	c.nLevels = MipCount(c.width, c.height);
+	c.nFrames = 1;
+	c.durations.assign(1, 0);
+	EncodeFrame(c, pixels);
+	stbi_image_free(pixels);
+	return true;
+}
+
+bool Load(const char *filename, BlockFormat format, CacheImage &c) {
+	if (ReadCache(filename, format, c))
+		return true;
+	if (!Encode(filename, format, c))
+		return false;
+	WriteCache(filename, c);
+	return true;
+}
+
+void CompressedStorage(GLenum target, int nLevels, GLenum glFormat, BlockFormat format, int width, int height, int depth = 1) {
+	// immutable if GL 4.2, else each level specified without data (GL 4.1, eg macOS)
+	bool array = target == GL_TEXTURE_2D_ARRAY;
+	if (GLAD_GL_VERSION_4_2 && glTexStorage2D != NULL && glTexStorage3D != NULL) {
+		if (array)
+			glTexStorage3D(target, nLevels, glFormat, width, height, depth);
+		else
+			glTexStorage2D(target, nLevels, glFormat, width, height);
+		return;
+	}
+	for (int l = 0; l < nLevels; l++) {
+		int w = std::max(1, width >> l), h = std::max(1, height >> l), nBytes = LevelBytes(format, width, height, l);
+		if (array)
+			glCompressedTexImage3D(target, l, glFormat, w, h, depth, 0, nBytes*depth, NULL);
+		else
+			glCompressedTexImage2D(target, l, glFormat, w, h, 0, nBytes, NULL);
+	}
+}
+
+GLuint Upload(CacheImage &c, int frame, bool mipmap) {
+	int nLevels = mipmap? c.nLevels : 1;
+	GLenum glFormat = GLFormat(c.format);
+	GLuint textureName = 0;
+	glGenTextures(1, &textureName);
+	glBindTexture(GL_TEXTURE_2D, textureName);
+	CompressedStorage(GL_TEXTURE_2D, nLevels, glFormat, c.format, c.width, c.height);
+	unsigned char *data = c.data.data()+(size_t) frame*c.FrameBytes();
+	for (int l = 0; l < nLevels; l++) {
+		int w = std::max(1, c.width >> l), h = std::max(1, c.height >> l), nBytes = LevelBytes(c.format, c.width, c.height, l);
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, w, h, glFormat, nBytes, data);
+		data += nBytes;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmap? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, nLevels-1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return textureName;
+}
+
+GLuint UploadArray(CacheImage &c, bool mipmap) {
+	int nLevels = mipmap? c.nLevels : 1;
+	GLenum glFormat = GLFormat(c.format);
+	GLuint arrayName = 0;
+	glGenTextures(1, &arrayName);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, arrayName);
+	CompressedStorage(GL_TEXTURE_2D_ARRAY, nLevels, glFormat, c.format, c.width, c.height, c.nFrames);
+	for (int f = 0; f < c.nFrames; f++) {
+		unsigned char *data = c.data.data()+(size_t) f*c.FrameBytes();
+		for (int l = 0; l < nLevels; l++) {
+			int w = std::max(1, c.width >> l), h = std::max(1, c.height >> l), nBytes = LevelBytes(c.format, c.width, c.height, l);
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, l, 0, 0, f, w, h, 1, glFormat, nBytes, data);
+			data += nBytes;
+		}
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmap? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, nLevels-1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return arrayName;
+}
+
+} // end namespace
+
+void SetTextureCache(bool on, const char *directory) {
+	cacheEnabled = on;
+	cacheDirectory = directory? directory : "";
+}
+
+bool TextureCacheEnabled() { return cacheEnabled; }
+
+bool CompressedTexturesAvailable(BlockFormat format) {
+	if (format == BlockFormat::BC7)
+		return GLAD_GL_VERSION_4_2 != 0;
+	if (format == BlockFormat::Auto)
+		return FormatListed(GLFormat(BlockFormat::BC1)) && FormatListed(GLFormat(BlockFormat::BC3));
+	return FormatListed(GLFormat(format));
+}
+
+int BlockBytes(BlockFormat format) { return format == BlockFormat::BC1? 8 : 16; }
+
+void EncodeBlocks(unsigned char *pixels, int width, int height, int bpp, BlockFormat format, vector<unsigned char> &blocks) {
+	int nx = (width+3)/4, ny = (height+3)/4, blockBytes = BlockBytes(format);
+	blocks.resize((size_t) nx*ny*blockBytes);
+	unsigned char *out = blocks.data();
+	Texel block[16];
+	for (int by = 0; by < ny; by++)
+		for (int bx = 0; bx < nx; bx++, out += blockBytes) {
+			GatherBlock(pixels, width, height, bpp, bx, by, block);
+			if (format == BlockFormat::BC7)
+				EncodeBC7(block, out);
+			else if (format == BlockFormat::BC3) {
+				EncodeAlpha(block, out);
+				EncodeColor(block, out+8);
+			}
+			else
+				EncodeColor(block, out);
+		}
+}
+
+bool EncodeTextureCache(const char *filename, BlockFormat format) {
+	CacheImage c;
+	return Encode(filename, format, c) && WriteCache(filename, c);
+}
+
+GLuint ReadCompressedTexture(const char *filename, bool mipmap, int *nChannels, int *width, int *height, BlockFormat format) {
+	CacheImage c;
+	if (!cacheEnabled || !CompressedTexturesAvailable(format) || !Load(filename, format, c))
+		return ReadTexture(filename, mipmap, nChannels, width, height);
+	if (nChannels) *nChannels = c.nChannels;
+	if (width) *width = c.width;
+	if (height) *height = c.height;
+	return Upload(c, 0, mipmap);
+}
+
+int ReadCompressedGIF(const char *filename, vector<GLuint> &textureNames, int *nChannels, vector<float> *frameDurations, BlockFormat format) {
+	CacheImage c;
+	if (!cacheEnabled || !CompressedTexturesAvailable(format) || !Load(filename, format, c))
+		return ReadGIF(filename, textureNames, nChannels, frameDurations);
+	if (nChannels)
+		*nChannels = c.nChannels;
+	if (frameDurations)
+		*frameDurations = c.durations;
+	textureNames.resize(c.nFrames);
+	for (int i = 0; i < c.nFrames; i++)
+		textureNames[i] = Upload(c, i, true);
+	return c.nFrames;
+}
+
+GLuint ReadCompressedGIFArray(const char *filename, int *nFrames, vector<float> *frameDurations, BlockFormat format) {
+	CacheImage c;
+	if (!cacheEnabled || !CompressedTexturesAvailable(format) || !Load(filename, format, c))
+		return ReadGIFArray(filename, nFrames, frameDurations);
+	if (nFrames)
+		*nFrames = c.nFrames;
+	if (frameDurations)
+		*frameDurations = c.durations;
+	return UploadArray(c, true);
+}
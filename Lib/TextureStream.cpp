@@ -0,0 +1,314 @@
+// TextureStream.cpp - immutable texture storage, uploaded through pixel buffer objects
+
+#include <glad.h>
+#include <stdio.h>
+#include <string.h>
+#include "TextureStream.h"
+
+namespace {
+
+GLenum InternalFormat(int bpp) {
+	return bpp == 1? GL_R8 : bpp == 2? GL_RG8 : bpp == 3? GL_RGB8 : GL_RGBA8;
+}
+
+GLenum Format(int bpp, bool bgr) {
+	return bpp == 1? GL_RED : bpp == 2? GL_RG : bpp == 3? (bgr? GL_BGR : GL_RGB) : (bgr? GL_BGRA : GL_RGBA);
+}
+
+GLuint Allocate(int width, int height, int bpp, int nLevels, bool mipmapped) {
+	GLuint textureName = 0;
+	glGenTextures(1, &textureName);
+	glBindTexture(GL_TEXTURE_2D, textureName);
+	TextureStorage(GL_TEXTURE_2D, nLevels, InternalFormat(bpp), width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+		// levels beyond 0 hold undefined data until uploaded or generated
+	if (bpp < 3) {
+		// present grayscale (and grayscale+alpha) as rgb(a), as glTexImage2D(GL_RGB) did
+		GLint swizzle[] = { GL_RED, GL_RED, GL_RED, bpp == 2? GL_GREEN : GL_ONE };
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+	}
+	return textureName;
+}
+
+void Complete(GLenum target, GLuint textureName, int nLevels, MipPolicy mips) {
+	glBindTexture(target, textureName);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, nLevels-1);
+		// before glGenerateMipmap, which fills levels base+1 through max only
+	if (mips == MipPolicy::GPU)
+		glGenerateMipmap(target);
+	glBindTexture(target, 0);
+}
+
+bool queuedLoads = false;
+
+} // end namespace
+
+// Storage
+
+void TextureStorage(GLenum target, int nLevels, GLenum internalFormat, int width, int height, int depth) {
+	bool array = target == GL_TEXTURE_2D_ARRAY;
+	if (GLAD_GL_VERSION_4_2 && glTexStorage2D != NULL && glTexStorage3D != NULL) {
+		if (array)
+			glTexStorage3D(target, nLevels, internalFormat, width, height, depth);
+		else
+			glTexStorage2D(target, nLevels, internalFormat, width, height);
+		return;
+	}
+	// GL 4.1 (eg, macOS): mutable levels, clamped as immutable storage would be
+	GLenum format = internalFormat == GL_R8? GL_RED : internalFormat == GL_RG8? GL_RG :
+					internalFormat == GL_RGB8? GL_RGB : GL_RGBA;
+	for (int l = 0; l < nLevels; l++) {
+		int w = width >> l > 1? width >> l : 1, h = height >> l > 1? height >> l : 1;
+		if (array)
+			glTexImage3D(target, l, internalFormat, w, h, depth, 0, format, GL_UNSIGNED_BYTE, NULL);
+		else
+			glTexImage2D(target, l, internalFormat, w, h, 0, format, GL_UNSIGNED_BYTE, NULL);
+	}
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, nLevels-1);
+}
+
+// Mipmaps
+
+int MipCount(int width, int height) {
+	int n = 1;
+	for (int s = width > height? width : height; s > 1; s >>= 1)
+		n++;
+	return n;
+}
+
+void BuildMipChain(unsigned char *pixels, int width, int height, int bpp, vector<MipLevel> &levels) {
+	int nLevels = MipCount(width, height);
+	levels.resize(nLevels-1);
+	unsigned char *src = pixels;
+	int w = width, h = height;
+	for (int l = 1; l < nLevels; l++) {
+		int lw = w > 1? w/2 : 1, lh = h > 1? h/2 : 1;
+		MipLevel &m = levels[l-1];
+		m = MipLevel(lw, lh, bpp);
+		unsigned char *dst = m.pixels.data();
+		for (int j = 0; j < lh; j++) {
+			int j0 = h > 1? 2*j : 0, j1 = h > 1? 2*j+1 : 0;
+			unsigned char *r0 = src+(size_t) j0*w*bpp, *r1 = src+(size_t) j1*w*bpp;
+			for (int i = 0; i < lw; i++) {
+				int i0 = w > 1? 2*i : 0, i1 = w > 1? 2*i+1 : 0;
+				for (int k = 0; k < bpp; k++) {
+					int sum = r0[i0*bpp+k]+r0[i1*bpp+k]+r1[i0*bpp+k]+r1[i1*bpp+k];
+					*dst++ = (unsigned char) ((sum+2)/4);
+				}
+			}
+		}
+		src = m.pixels.data();
+		w = lw;
+		h = lh;
+	}
+}
+
+// Streamer
+
+TextureStreamer::TextureStreamer(int nSlots, int slotBytes) : slots(nSlots > 0? nSlots : 1), slotBytes(slotBytes) { }
+
+TextureStreamer::~TextureStreamer() { }
+
+void TextureStreamer::Initialize() {
+	// persistent mapping needs glBufferStorage (GL 4.4); otherwise orphan each staging buffer per copy
+	persistent = GLAD_GL_VERSION_4_4 && glBufferStorage != NULL;
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	for (Slot &s : slots) {
+		glGenBuffers(1, &s.buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+		if (persistent) {
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, slotBytes, NULL, flags);
+			s.mapped = (unsigned char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, slotBytes, flags);
+		}
+		else
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, slotBytes, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	initialized = true;
+}
+
+void TextureStreamer::Release() {
+	if (!initialized)
+		return;
+	for (Slot &s : slots) {
+		if (s.fence) glDeleteSync(s.fence);
+		if (s.mapped) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		glDeleteBuffers(1, &s.buffer);
+		s = Slot();
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	initialized = false;
+}
+
+unsigned char *TextureStreamer::Map(Slot &s, int nBytes) {
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s.buffer);
+	if (persistent) {
+		// wait only if the GPU has not yet consumed this slot's previous copy (ring of nSlots)
+		if (s.fence) {
+			while (glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+				;
+			glDeleteSync(s.fence);
+			s.fence = 0;
+		}
+		return s.mapped;
+	}
+	// orphan: driver hands back fresh memory while any prior transfer completes
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, slotBytes, NULL, GL_STREAM_DRAW);
+	return (unsigned char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, nBytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void TextureStreamer::Unmap() {
+	if (!persistent)
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+}
+
+int TextureStreamer::Band(GLuint textureName, int level, int layer, unsigned char *pixels, int width, int height, int bpp, bool bgr, int row, int maxBytes) {
+	// copy rows [row, row+n) to next staging slot, transfer to texture (or array layer, if layer >= 0); return n
+	int rowBytes = width*bpp;
+	if (rowBytes > slotBytes) {
+		// a single row must fit a slot
+		Release();
+		slotBytes = rowBytes;
+	}
+	if (!initialized)
+		Initialize();
+	int budget = maxBytes < slotBytes? maxBytes : slotBytes;
+	int nRows = budget/rowBytes;
+	nRows = nRows < 1? 1 : nRows > height-row? height-row : nRows;
+	int nBytes = nRows*rowBytes;
+	Slot &s = slots[current];
+	current = (current+1)%slots.size();
+	unsigned char *dst = Map(s, nBytes);
+	if (!dst) {
+		printf("TextureStreamer: can't map staging buffer\n");
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return height-row;
+	}
+	memcpy(dst, pixels+(size_t) row*rowBytes, nBytes);
+	Unmap();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (layer < 0) {
+		glBindTexture(GL_TEXTURE_2D, textureName);
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, row, width, nRows, Format(bpp, bgr), GL_UNSIGNED_BYTE, (void *) 0);
+	}
+	else {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureName);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, row, layer, width, nRows, 1, Format(bpp, bgr), GL_UNSIGNED_BYTE, (void *) 0);
+	}
+		// source is offset 0 of the bound unpack buffer; the call returns without waiting for the copy
+	if (persistent)
+		s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	return nRows;
+}
+
+void TextureStreamer::SubImage(GLuint textureName, int level, unsigned char *pixels, int width, int height, int bpp, bool bgr) {
+	for (int row = 0; row < height; )
+		row += Band(textureName, level, -1, pixels, width, height, bpp, bgr, row, slotBytes);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void TextureStreamer::SubLayer(GLuint arrayName, int layer, unsigned char *pixels, int width, int height, int bpp, bool bgr) {
+	for (int row = 0; row < height; )
+		row += Band(arrayName, 0, layer, pixels, width, height, bpp, bgr, row, slotBytes);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+GLuint TextureStreamer::Upload(unsigned char *pixels, int width, int height, int bpp, bool bgr, MipPolicy mips, vector<MipLevel> *levels) {
+	vector<MipLevel> built;
+	if (mips == MipPolicy::Precomputed && !levels) {
+		BuildMipChain(pixels, width, height, bpp, built);
+		levels = &built;
+	}
+	int nLevels = mips == MipPolicy::None? 1 :
+				  mips == MipPolicy::GPU? MipCount(width, height) : 1+(int) levels->size();
+	GLuint textureName = Allocate(width, height, bpp, nLevels, nLevels > 1);
+	SubImage(textureName, 0, pixels, width, height, bpp, bgr);
+	if (mips == MipPolicy::Precomputed)
+		for (int l = 1; l < nLevels; l++) {
+			MipLevel &m = (*levels)[l-1];
+			SubImage(textureName, l, m.pixels.data(), m.width, m.height, bpp, bgr);
+		}
+	Complete(GL_TEXTURE_2D, textureName, nLevels, mips);
+	return textureName;
+}
+
+GLuint TextureStreamer::Queue(vector<unsigned char> &pixels, int width, int height, int bpp, bool bgr, MipPolicy mips) {
+	if (mips == MipPolicy::Precomputed)
+		mips = MipPolicy::GPU; // queued levels are produced on the GPU once level 0 lands
+	int nLevels = mips == MipPolicy::None? 1 : MipCount(width, height);
+	Job j;
+	j.textureName = Allocate(width, height, bpp, nLevels, nLevels > 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	j.nLevels = nLevels;
+	j.width = width;
+	j.height = height;
+	j.bpp = bpp;
+	j.bgr = bgr;
+	j.mips = mips;
+	j.pixels.swap(pixels);
+	pixels.clear();
+	jobs.push_back(std::move(j));
+	return jobs.back().textureName;
+}
+
+void TextureStreamer::QueueLayer(GLuint arrayName, int layer, vector<unsigned char> &pixels, int width, int height, int bpp, bool bgr, bool mipmap) {
+	Job j;
+	j.textureName = arrayName;
+	j.layer = layer;
+	j.nLevels = mipmap? MipCount(width, height) : 1;
+	j.width = width;
+	j.height = height;
+	j.bpp = bpp;
+	j.bgr = bgr;
+	j.mips = mipmap? MipPolicy::GPU : MipPolicy::None;
+	j.pixels.swap(pixels);
+	pixels.clear();
+	if (jobs.empty() || jobs.back().textureName != arrayName) {
+		// until its layers land, sample only level 0 of the array
+		glBindTexture(GL_TEXTURE_2D_ARRAY, arrayName);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+	jobs.push_back(std::move(j));
+}
+
+bool TextureStreamer::Pump(int byteBudget) {
+	while (!jobs.empty() && byteBudget > 0) {
+		Job &j = jobs[0];
+		int n = Band(j.textureName, 0, j.layer, j.pixels.data(), j.width, j.height, j.bpp, j.bgr, j.nextRow, byteBudget);
+		j.nextRow += n;
+		byteBudget -= n*j.width*j.bpp;
+		if (j.nextRow >= j.height) {
+			// an array is complete with its last queued layer
+			bool last = j.layer < 0 || jobs.size() == 1 || jobs[1].textureName != j.textureName;
+			if (last)
+				Complete(j.layer < 0? GL_TEXTURE_2D : GL_TEXTURE_2D_ARRAY, j.textureName, j.nLevels, j.mips);
+			jobs.erase(jobs.begin());
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return !jobs.empty();
+}
+
+int TextureStreamer::Pending() { return (int) jobs.size(); }
+
+TextureStreamer &GetTextureStreamer() {
+	static TextureStreamer streamer;
+	return streamer;
+}
+
+void SetQueuedTextureLoads(bool on) { queuedLoads = on; }
+
+bool QueuedTextureLoads() { return queuedLoads; }
+
+GLuint LoadTextureStorage(unsigned char *pixels, int width, int height, int bpp, bool bgr, MipPolicy mips, vector<MipLevel> *levels) {
+	return GetTextureStreamer().Upload(pixels, width, height, bpp, bgr, mips, levels);
+}
@@ -0,0 +1,252 @@
+// VecMatBatch.cpp - SIMD point transforms and bounds
+
+#include <math.h>
+#include "VecMatBatch.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BATCH_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BATCH_SSE
+#endif
+
+namespace {
+
+#ifdef BATCH_SSE
+
+// (a[i0], a[i1], b[i2], b[i3])
+#define SHUF(a, b, i0, i1, i2, i3) _mm_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0))
+
+inline __m128 MulAdd(__m128 a, __m128 b, __m128 c) {
+#ifdef BATCH_AVX2
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+inline void Deinterleave(const float *p, __m128 &x, __m128 &y, __m128 &z) {
+	// four packed vec3 as a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+	__m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p+4), c = _mm_loadu_ps(p+8);
+	x = SHUF(a, SHUF(b, c, 2, 0, 1, 0), 0, 3, 0, 2);
+	y = SHUF(SHUF(a, b, 1, 0, 0, 0), SHUF(b, c, 3, 0, 2, 0), 0, 2, 0, 2);
+	z = SHUF(SHUF(a, b, 2, 0, 1, 0), c, 0, 2, 0, 3);
+}
+
+inline void Interleave(float *p, __m128 x, __m128 y, __m128 z) {
+	_mm_storeu_ps(p, SHUF(SHUF(x, y, 0, 0, 0, 0), SHUF(z, x, 0, 0, 1, 0), 0, 2, 0, 2));
+	_mm_storeu_ps(p+4, SHUF(SHUF(y, z, 1, 0, 1, 0), SHUF(x, y, 2, 0, 2, 0), 0, 2, 0, 2));
+	_mm_storeu_ps(p+8, SHUF(SHUF(z, x, 2, 0, 3, 0), SHUF(y, z, 3, 0, 3, 0), 0, 2, 0, 2));
+}
+
+struct Rows4 {
+	// first three matrix rows, each element broadcast
+	__m128 m[3][4];
+	Rows4(const mat4 &mat) {
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 4; j++)
+				m[i][j] = _mm_set1_ps(mat[i][j]);
+	}
+	__m128 Row(int i, __m128 x, __m128 y, __m128 z) const {
+		// summed in the order of dot(row, vec4(x, y, z, 1))
+		return _mm_add_ps(MulAdd(m[i][2], z, MulAdd(m[i][1], y, _mm_mul_ps(m[i][0], x))), m[i][3]);
+	}
+};
+
+inline float HMin(__m128 v) {
+	v = _mm_min_ps(v, SHUF(v, v, 2, 3, 0, 1));
+	return _mm_cvtss_f32(_mm_min_ps(v, SHUF(v, v, 1, 0, 3, 2)));
+}
+
+inline float HMax(__m128 v) {
+	v = _mm_max_ps(v, SHUF(v, v, 2, 3, 0, 1));
+	return _mm_cvtss_f32(_mm_max_ps(v, SHUF(v, v, 1, 0, 3, 2)));
+}
+
+#endif
+
+#ifdef BATCH_AVX2
+
+struct Rows8 {
+	__m256 m[3][4];
+	Rows8(const mat4 &mat) {
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 4; j++)
+				m[i][j] = _mm256_set1_ps(mat[i][j]);
+	}
+	__m256 Row(int i, __m256 x, __m256 y, __m256 z) const {
+		return _mm256_add_ps(_mm256_fmadd_ps(m[i][2], z, _mm256_fmadd_ps(m[i][1], y, _mm256_mul_ps(m[i][0], x))), m[i][3]);
+	}
+};
+
+inline __m128 Min8(__m256 v) { return _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)); }
+inline __m128 Max8(__m256 v) { return _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)); }
+
+#endif
+
+float Extent(vec3 min, vec3 max) {
+	vec3 dif = max-min;
+	return dif.x > dif.y? (dif.z > dif.x? dif.z : dif.x) : (dif.z > dif.y? dif.z : dif.y);
+}
+
+} // end namespace
+
+// Array of structures
+
+void TransformPoints(const mat4 &m, const vec3 *in, vec3 *out, int n) {
+	int i = 0;
+#ifdef BATCH_SSE
+	// four points per step: deinterleave to coordinate registers, transform, reinterleave
+	Rows4 r(m);
+	for (; i+4 <= n; i += 4) {
+		__m128 x, y, z;
+		Deinterleave(&in[i].x, x, y, z);
+		Interleave(&out[i].x, r.Row(0, x, y, z), r.Row(1, x, y, z), r.Row(2, x, y, z));
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = Vec3(m*vec4(in[i]));
+}
+
+float PointBounds(const vec3 *points, int n, vec3 &min, vec3 &max) {
+	max = -(min = vec3(FLT_MAX));
+	int i = 0;
+#ifdef BATCH_SSE
+	if (n >= 4) {
+		__m128 x, y, z;
+		Deinterleave(&points[0].x, x, y, z);
+		__m128 xMin = x, yMin = y, zMin = z, xMax = x, yMax = y, zMax = z;
+		for (i = 4; i+4 <= n; i += 4) {
+			Deinterleave(&points[i].x, x, y, z);
+			xMin = _mm_min_ps(xMin, x); yMin = _mm_min_ps(yMin, y); zMin = _mm_min_ps(zMin, z);
+			xMax = _mm_max_ps(xMax, x); yMax = _mm_max_ps(yMax, y); zMax = _mm_max_ps(zMax, z);
+		}
+		min = vec3(HMin(xMin), HMin(yMin), HMin(zMin));
+		max = vec3(HMax(xMax), HMax(yMax), HMax(zMax));
+	}
+#endif
+	for (; i < n; i++) {
+		vec3 p = points[i];
+		min = vec3(min.x < p.x? min.x : p.x, min.y < p.y? min.y : p.y, min.z < p.z? min.z : p.z);
+		max = vec3(max.x > p.x? max.x : p.x, max.y > p.y? max.y : p.y, max.z > p.z? max.z : p.z);
+	}
+	return Extent(min, max);
+}
+
+// Structure of arrays
+
+void TransformPoints(const mat4 &m, const float *x, const float *y, const float *z,
+					 float *xOut, float *yOut, float *zOut, int n) {
+	int i = 0;
+#ifdef BATCH_AVX2
+	Rows8 r8(m);
+	for (; i+8 <= n; i += 8) {
+		__m256 xi = _mm256_loadu_ps(x+i), yi = _mm256_loadu_ps(y+i), zi = _mm256_loadu_ps(z+i);
+		__m256 xo = r8.Row(0, xi, yi, zi), yo = r8.Row(1, xi, yi, zi), zo = r8.Row(2, xi, yi, zi);
+		_mm256_storeu_ps(xOut+i, xo);
+		_mm256_storeu_ps(yOut+i, yo);
+		_mm256_storeu_ps(zOut+i, zo);
+	}
+#endif
+#ifdef BATCH_SSE
+	Rows4 r4(m);
+	for (; i+4 <= n; i += 4) {
+		__m128 xi = _mm_loadu_ps(x+i), yi = _mm_loadu_ps(y+i), zi = _mm_loadu_ps(z+i);
+		__m128 xo = r4.Row(0, xi, yi, zi), yo = r4.Row(1, xi, yi, zi), zo = r4.Row(2, xi, yi, zi);
+		_mm_storeu_ps(xOut+i, xo);
+		_mm_storeu_ps(yOut+i, yo);
+		_mm_storeu_ps(zOut+i, zo);
+	}
+#endif
+	for (; i < n; i++) {
+		vec3 p = Vec3(m*vec4(x[i], y[i], z[i], 1));
+		xOut[i] = p.x;
+		yOut[i] = p.y;
+		zOut[i] = p.z;
+	}
+}
+
+float PointBounds(const float *x, const float *y, const float *z, int n, vec3 &min, vec3 &max) {
+	max = -(min = vec3(FLT_MAX));
+	int i = 0;
+#ifdef BATCH_SSE
+	__m128 lo[3], hi[3];
+	for (int k = 0; k < 3; k++) {
+		lo[k] = _mm_set1_ps(FLT_MAX);
+		hi[k] = _mm_set1_ps(-FLT_MAX);
+	}
+#ifdef BATCH_AVX2
+	if (n >= 8) {
+		__m256 lo8[3], hi8[3];
+		for (int k = 0; k < 3; k++) {
+			lo8[k] = _mm256_set1_ps(FLT_MAX);
+			hi8[k] = _mm256_set1_ps(-FLT_MAX);
+		}
+		for (; i+8 <= n; i += 8) {
+			__m256 v[3] = {_mm256_loadu_ps(x+i), _mm256_loadu_ps(y+i), _mm256_loadu_ps(z+i)};
+			for (int k = 0; k < 3; k++) {
+				lo8[k] = _mm256_min_ps(lo8[k], v[k]);
+				hi8[k] = _mm256_max_ps(hi8[k], v[k]);
+			}
+		}
+		for (int k = 0; k < 3; k++) {
+			lo[k] = Min8(lo8[k]);
+			hi[k] = Max8(hi8[k]);
+		}
+	}
+#endif
+	for (; i+4 <= n; i += 4) {
+		__m128 v[3] = {_mm_loadu_ps(x+i), _mm_loadu_ps(y+i), _mm_loadu_ps(z+i)};
+		for (int k = 0; k < 3; k++) {
+			lo[k] = _mm_min_ps(lo[k], v[k]);
+			hi[k] = _mm_max_ps(hi[k], v[k]);
+		}
+	}
+	min = vec3(HMin(lo[0]), HMin(lo[1]), HMin(lo[2]));
+	max = vec3(HMax(hi[0]), HMax(hi[1]), HMax(hi[2]));
+#endif
+	for (; i < n; i++) {
+		min = vec3(min.x < x[i]? min.x : x[i], min.y < y[i]? min.y : y[i], min.z < z[i]? min.z : z[i]);
+		max = vec3(max.x > x[i]? max.x : x[i], max.y > y[i]? max.y : y[i], max.z > z[i]? max.z : z[i]);
+	}
+	return Extent(min, max);
+}
+
+// Planar transforms
+
+void PlanarTransforms(const float *x, const float *y, const float *degrees, const float *sx, const float *sy,
+					  vec2 aspect, mat4 *out, int n) {
+	int i = 0;
+#ifdef BATCH_SSE
+	// element (r, c) of four matrices per register, transposed to the rows of each
+	__m128 ax = _mm_set1_ps(aspect.x), ay = _mm_set1_ps(aspect.y), zero = _mm_setzero_ps();
+	__m128 row2 = _mm_set_ps(0, 1, 0, 0), row3 = _mm_set_ps(1, 0, 0, 0);
+	for (; i+4 <= n; i += 4) {
+		float c[4], s[4];
+		for (int k = 0; k < 4; k++) {
+			float a = DegreesToRadians*degrees[i+k];
+			c[k] = cos(a);
+			s[k] = sin(a);
+		}
+		__m128 cos4 = _mm_loadu_ps(c), sin4 = _mm_loadu_ps(s);
+		__m128 sx4 = _mm_loadu_ps(sx+i), sy4 = _mm_loadu_ps(sy+i);
+		__m128 m00 = _mm_mul_ps(ax, _mm_mul_ps(cos4, sx4)), m01 = _mm_mul_ps(ax, _mm_mul_ps(_mm_sub_ps(zero, sin4), sy4));
+		__m128 m10 = _mm_mul_ps(ay, _mm_mul_ps(sin4, sx4)), m11 = _mm_mul_ps(ay, _mm_mul_ps(cos4, sy4));
+		__m128 m03 = _mm_mul_ps(ax, _mm_loadu_ps(x+i)), m13 = _mm_mul_ps(ay, _mm_loadu_ps(y+i));
+		__m128 r0a = m00, r0b = m01, r0c = zero, r0d = m03, r1a = m10, r1b = m11, r1c = zero, r1d = m13;
+		_MM_TRANSPOSE4_PS(r0a, r0b, r0c, r0d);
+		_MM_TRANSPOSE4_PS(r1a, r1b, r1c, r1d);
+		__m128 row0[] = { r0a, r0b, r0c, r0d }, row1[] = { r1a, r1b, r1c, r1d };
+		for (int k = 0; k < 4; k++) {
+			_mm_storeu_ps(&out[i+k].row[0].x, row0[k]);
+			_mm_storeu_ps(&out[i+k].row[1].x, row1[k]);
+			_mm_storeu_ps(&out[i+k].row[2].x, row2);
+			_mm_storeu_ps(&out[i+k].row[3].x, row3);
+		}
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = Scale(aspect.x, aspect.y, 1)*(Translate(x[i], y[i], 0)*RotateZ(degrees[i])*Scale(sx[i], sy[i], 1));
+}
@@ -0,0 +1,253 @@
+// WavFile.cpp - RIFF/WAVE parsing, PCM decoding, and streaming playback
+
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include "WavFile.h"
+
+namespace {
+
+unsigned U16(const unsigned char *b) { return b[0] | (b[1] << 8); }
+
+unsigned U32(const unsigned char *b) { return b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned) b[3] << 24); }
+
+const int FormatPCM = 1, FormatFloat = 3, FormatExtensible = 0xfffe;
+
+} // end namespace
+
+// Format
+
+bool ReadWavHeader(FILE *in, WavFormat &f, const char *name, bool verbose) {
+	unsigned char riff[12];
+	if (fread(riff, 12, 1, in) != 1 || memcmp(riff, "RIFF", 4) || memcmp(riff+8, "WAVE", 4)) {
+		printf("%s: not a RIFF/WAVE file\n", name);
+		return false;
+	}
+	fseek(in, 0, SEEK_END);
+	long fileSize = ftell(in), pos = 12;
+	bool haveFormat = false;
+	f = WavFormat();
+	// each chunk: 4-byte id, 4-byte little-endian size, data padded to even length
+	for (unsigned char hdr[8]; pos+8 <= fileSize; ) {
+		fseek(in, pos, SEEK_SET);
+		if (fread(hdr, 8, 1, in) != 1)
+			break;
+		long size = (long) U32(hdr+4), start = pos+8;
+		if (verbose)
+			printf("%s: chunk %.4s, %li bytes\n", name, (char *) hdr, size);
+		if (!memcmp(hdr, "fmt ", 4)) {
+			unsigned char fmt[40] = {};
+			if (size < 16 || fread(fmt, std::min(size, 40L), 1, in) != 1) {
+				printf("%s: bad fmt chunk\n", name);
+				return false;
+			}
+			int tag = U16(fmt);
+			if (tag == FormatExtensible && size >= 40)
+				tag = U16(fmt+24);	// first two bytes of sub-format GUID
+			f.nChannels = U16(fmt+2);
+			f.rate = (int) U32(fmt+4);
+			f.blockAlign = U16(fmt+12);
+			f.bitsPerSample = U16(fmt+14);
+			f.isFloat = tag == FormatFloat;
+			bool intOK = tag == FormatPCM && (f.bitsPerSample == 8 || f.bitsPerSample == 16 || f.bitsPerSample == 24 || f.bitsPerSample == 32);
+			bool floatOK = f.isFloat && (f.bitsPerSample == 32 || f.bitsPerSample == 64);
+			if ((!intOK && !floatOK) || f.nChannels < 1 || f.rate < 1 || f.blockAlign != f.nChannels*f.bitsPerSample/8) {
+				printf("%s: unsupported format (code %i, %i bits, %i channels)\n", name, tag, f.bitsPerSample, f.nChannels);
+				return false;
+			}
+			haveFormat = true;
+		}
+		if (!memcmp(hdr, "data", 4)) {
+			if (!haveFormat) {
+				printf("%s: data before fmt chunk\n", name);
+				return false;
+			}
+			// size may be 0 or too large in files written by a streaming recorder
+			f.dataOffset = start;
+			f.dataBytes = std::min(size, fileSize-start);
+			f.dataBytes -= f.dataBytes%f.blockAlign;
+			fseek(in, start, SEEK_SET);
+			if (verbose)
+				printf("%s: %i channels, %i Hz, %i-bit %s, %i frames (%3.2f secs)\n", name, f.nChannels, f.rate,
+					f.bitsPerSample, f.isFloat? "float" : "integer", f.Frames(), f.Duration());
+			return true;
+		}
+		pos = start+size+(size & 1);
+	}
+	printf("%s: no %s chunk\n", name, haveFormat? "data" : "fmt");
+	return false;
+}
+
+void DecodeSamples(const unsigned char *b, const WavFormat &f, int nFrames, float *s) {
+	int n = nFrames*f.nChannels;
+	switch (f.isFloat? -f.bitsPerSample : f.bitsPerSample) {
+		case 8:
+			// unsigned, 128 is zero
+			for (int i = 0; i < n; i++)
+				s[i] = (b[i]-128)/128.f;
+			break;
+		case 16:
+			for (int i = 0; i < n; i++, b += 2)
+				s[i] = (short) U16(b)/32768.f;
+			break;
+		case 24:
+			for (int i = 0; i < n; i++, b += 3)
+				s[i] = (float) ((int) (((unsigned) b[0] << 8) | ((unsigned) b[1] << 16) | ((unsigned) b[2] << 24)) >> 8)/8388608.f;
+			break;
+		case 32:
+			for (int i = 0; i < n; i++, b += 4)
+				s[i] = (float) ((int) U32(b)/2147483648.);
+			break;
+		case -32:
+			memcpy(s, b, n*sizeof(float));
+			break;
+		case -64:
+			for (int i = 0; i < n; i++, b += 8) {
+				double d;
+				memcpy(&d, b, 8);
+				s[i] = (float) d;
+			}
+			break;
+	}
+}
+
+bool ReadWavFile(const char *filename, Sound &sound, bool verbose) {
+	FILE *in = fopen(filename, "rb");
+	if (!in) {
+		printf("can't open %s\n", filename);
+		return false;
+	}
+	WavFormat f;
+	bool ok = ReadWavHeader(in, f, filename, verbose);
+	if (ok) {
+		vector<unsigned char> bytes(f.dataBytes);
+		ok = fread(bytes.data(), 1, bytes.size(), in) == bytes.size();
+		if (!ok)
+			printf("%s: can't read samples\n", filename);
+		else {
+			sound.nChannels = f.nChannels;
+			sound.rate = f.rate;
+			sound.samples.resize((size_t) f.Frames()*f.nChannels);
+			DecodeSamples(bytes.data(), f, f.Frames(), sound.samples.data());
+		}
+	}
+	fclose(in);
+	return ok;
+}
+
+// Stream
+
+WavStream::~WavStream() {
+	Close();
+}
+
+bool WavStream::Open(const char *name, int rate, bool loopStream, float bufferSeconds, ResampleQuality quality) {
+	Close();
+	file = fopen(name, "rb");
+	if (!file) {
+		printf("can't open %s\n", name);
+		return false;
+	}
+	if (!ReadWavHeader(file, format, name)) {
+		Close();
+		return false;
+	}
+	filename = name;
+	outputRate = rate;
+	loop = loopStream;
+	nChannels = std::min(format.nChannels, 2);
+	resampler.Initialize(format.rate, outputRate, nChannels, quality);
+	// ring holds bufferSeconds at the output rate, and at least four decode blocks
+	int blockOut = (int) ((long long) blockFrames*outputRate/format.rate)+2;
+	ring.Allocate(nChannels*std::max((int) (bufferSeconds*outputRate), 4*blockOut));
+	bytes.resize((size_t) blockFrames*format.blockAlign);
+	decoded.resize((size_t) blockFrames*format.nChannels);
+	return Restart();
+}
+
+bool WavStream::Restart() {
+	if (!file)
+		return false;
+	StopDecoder();
+	ring.Allocate(ring.Free()+ring.Available());
+	fseek(file, format.dataOffset, SEEK_SET);
+	bytesLeft = format.dataBytes;
+	resampler.Reset();
+	endOfFile = false;
+	// first block here, so the mixer has frames at its next period
+	if (!DecodeBlock())
+		endOfFile = true;
+	quit = false;
+	decoder = std::thread(&WavStream::Decode, this);
+	return true;
+}
+
+void WavStream::StopDecoder() {
+	quit = true;
+	if (decoder.joinable())
+		decoder.join();
+}
+
+void WavStream::Close() {
+	StopDecoder();
+	if (file)
+		fclose(file);
+	file = NULL;
+}
+
+bool WavStream::DecodeBlock() {
+	// read, decode, select channels, and convert rate for one block; return false at end of data
+	if (bytesLeft <= 0 && loop && format.dataBytes > 0) {
+		fseek(file, format.dataOffset, SEEK_SET);
+		bytesLeft = format.dataBytes;
+	}
+	int nFrames = (int) std::min((long) blockFrames, bytesLeft/format.blockAlign);
+	if (nFrames > 0)
+		nFrames = (int) fread(bytes.data(), format.blockAlign, nFrames, file);
+	if (nFrames <= 0) {
+		// emit what the filter still holds
+		if (format.rate != outputRate) {
+			resampled.clear();
+			resampler.Flush(resampled);
+			ring.Write(resampled.data(), (int) resampled.size());
+		}
+		return false;
+	}
+	bytesLeft -= (long) nFrames*format.blockAlign;
+	DecodeSamples(bytes.data(), format, nFrames, decoded.data());
+	const float *src = decoded.data();
+	if (format.nChannels != nChannels) {
+		// keep first two channels
+		channels.resize((size_t) nFrames*nChannels);
+		for (int i = 0; i < nFrames; i++)
+			for (int c = 0; c < nChannels; c++)
+				channels[i*nChannels+c] = decoded[i*format.nChannels+c];
+		src = channels.data();
+	}
+	if (format.rate == outputRate) {
+		ring.Write(src, nFrames*nChannels);
+		return true;
+	}
+	resampled.clear();
+	resampler.Process(src, nFrames, resampled);
+	ring.Write(resampled.data(), (int) resampled.size());
+	return true;
+}
+
+void WavStream::Decode() {
+	int blockOut = nChannels*((int) ((long long) blockFrames*outputRate/format.rate)+2);
+	while (!quit && !endOfFile) {
+		if (ring.Free() < blockOut)
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		else if (!DecodeBlock())
+			endOfFile = true;
+	}
+}
+
+int WavStream::Read(float *frames, int nFrames) {
+	return ring.Read(frames, nFrames*nChannels)/nChannels;
+}
+
+bool WavStream::Finished() {
+	return endOfFile && ring.Available() < nChannels;
+}
@@ -6,6 +6,7 @@
 #include "IO.h"
 #include "Misc.h"
 #include "Text.h"
+#include "VecMatBatch.h"
 #include "Widgets.h"
 
 // Mouse
@@ -38,8 +39,7 @@ bool MouseOver(int x, int y, vec2 p, int proximity) {
 // Matrix Support
 
 int TransformArray(vec3 *in, vec3 *out, int n, mat4 m) {
-	for (int i = 0; i < n; i++)
-		out[i] = Vec3(m*vec4(in[i]));
+	TransformPoints(m, in, out, n);
 	return n;
 }
 
@@ -7,7 +7,11 @@
 #include "resources.h"
 #include <unordered_map>
 #include <chrono>
+#include "Mixer.h"
+#include "Profiler.h"
+#include "RenderStats.h"
 #include "Text.h"
+#include "TextureStream.h"
 
 const string BASE_PATH = "C:/repos/SpaceRocks/SpaceRocks/Assets/";
 
@@ -37,6 +41,13 @@ time_t	keydownTime = 0;
 bool gravityEnabled = true;
 bool gameRunning = true;
 
+// Profiling: P toggles the overlay and render statistics, T starts a trace and saves it on the next press
+bool showProfiler = false, tracing = false;
+
+// Sound
+Sound explosionSound, engineSound;
+int engineVoice = 0;
+
 // Application
 
 double distance(double x1, double y1, double x2, double y2) {
@@ -100,6 +111,44 @@ void MoveActor(float speed) {
 	actor.SetPosition(actor.position + vec2(dx, dy));
 }
 
+// Sound
+
+void SynthesizeSounds(int rate) {
+	// explosion: low-passed noise burst with exponential decay
+	// engine: low-passed noise with a 55 Hz hum, crossfaded end into start so it loops without a click
+	srand(1);
+	auto Noise = []() { return 2.f*rand()/RAND_MAX-1; };
+	int nExplosion = 2*rate, nEngine = rate, nFade = rate/10;
+	explosionSound.rate = engineSound.rate = rate;
+	explosionSound.samples.resize(nExplosion);
+	float lp = 0;
+	for (int i = 0; i < nExplosion; i++) {
+		float t = (float) i/rate, cutoff = .02f+.3f*exp(-6*t);
+		lp += cutoff*(Noise()-lp);
+		explosionSound.samples[i] = 2.5f*lp*exp(-2.5f*t);
+	}
+	vector<float> e(nEngine+nFade);
+	lp = 0;
+	for (int i = 0; i < nEngine+nFade; i++) {
+		lp += .05f*(Noise()-lp);
+		e[i] = .6f*lp+.15f*(float) sin(2*3.14159*55*i/rate);
+	}
+	engineSound.samples.resize(nEngine);
+	for (int i = 0; i < nEngine; i++)
+		engineSound.samples[i] = i < nFade? (e[i]*i+e[nEngine+i]*(nFade-i))/nFade : e[i];
+}
+
+void UpdateEngineSound(bool thrust) {
+	if (thrust && !engineVoice)
+		engineVoice = GetMixer().Play(&engineSound, .5f, 0, 1, true);
+	if (!thrust && engineVoice) {
+		GetMixer().Stop(engineVoice, .15f);
+		engineVoice = 0;
+	}
+	if (engineVoice)
+		GetMixer().SetPan(engineVoice, actor.position[0]);
+}
+
 void RotateActor(float angle)
 {
 	actor.SetRotation(actor.rotation + angle);
@@ -116,12 +165,23 @@ void TestKey()
 	if (kb.count(GLFW_KEY_RIGHT)) RotateActor(-roationalSpeed);
 	if (kb.count(GLFW_KEY_DOWN)) MoveActor(d);
 	if (kb.count(GLFW_KEY_UP)) MoveActor(-d);
+	UpdateEngineSound(gameRunning && (kb.count(GLFW_KEY_UP) || kb.count(GLFW_KEY_DOWN)));
 }
 
 void Keyboard(int k, bool press, bool shift, bool control) {
 	key = press ? k : 0;
 	if (press) {
 		kb[k] = clock();
+		if (k == GLFW_KEY_P)
+			showProfiler = !showProfiler;
+		if (k == GLFW_KEY_T) {
+			if (tracing)
+				SaveProfileTrace("SpaceRocks-trace.json");
+			else
+				StartProfileTrace();
+			tracing = !tracing;
+		}
+		EnableProfiler(showProfiler || tracing);	// scopes cost a test when neither is on
 		return;
 	}
 	kb.erase(k);
@@ -129,6 +189,7 @@ void Keyboard(int k, bool press, bool shift, bool control) {
 
 void StartGravity()
 {
+	ProfileScope scope("gravity");
 	if (gravityEnabled)
 	{
 		for (Planet x : planets)
@@ -199,12 +260,14 @@ void gameDisplay() {
 	const int nShuttleSensors = sizeof(shuttleSensors) / sizeof(vec2);
 	vec3 shuttleProbes[nShuttleSensors];
 	for (int i = 0; i < nShuttleSensors; i++)
-		shuttleProbes[i] = Probe(shuttleSensors[i], actor.ptTransform);
+		shuttleProbes[i] = Probe(shuttleSensors[i], actor.GetPtTransform());
 
 	for (int i = 0; i < nShuttleSensors; i++)
 	{
 		if (abs(shuttleProbes[i].z - planets[0].z) < 0.05f)
 		{
+			if (!playerDead)
+				GetMixer().Play(&explosionSound, 1, actor.position[0]);
 			playerDead = true;
 			gravityEnabled = false;
 		}
@@ -241,6 +304,8 @@ void SetupGameWorld()
 	death.InitializeGIF(BASE_PATH + "Images/DeathExplosion.gif");
 	death.SetScale(vec2(0.15f, 0.15f));
 	death.SetPosition(vec2(actor.position[0], actor.position[1]));
+	GetMixer().Open();
+	SynthesizeSounds(GetMixer().Rate());
 }
 
 int main(int ac, char** av) {
@@ -250,11 +315,17 @@ int main(int ac, char** av) {
 	glfwMakeContextCurrent(mainGame);
 	
 	cout << "Starting up world generator" << endl;
+	EnableProfiler(true);				// record the one-off "world generation" scope, before P or T can be pressed
 	frames = gen.getData();
+	ProfilerFrame();
+	EnableProfiler(showProfiler || tracing);
 	actorFrameX = 1;
 	actorFrameY = 1;
 	frameMax = 2;
-	cout << "Finished World Gen" << endl;
+	for (ProfileStats &s : GetProfileStats())
+		if (s.name == "world generation")
+			cout << "Finished World Gen in " << s.last << " ms" << endl;
+	SetQueuedTextureLoads(true);	// textures stream in over the first frames
 	SetupGameWorld();
 	cout << "Finished game setup" << endl;
 
@@ -264,6 +335,7 @@ int main(int ac, char** av) {
 	while (!glfwWindowShouldClose(mainGame)) {
 		while (gameStart == false) {
 			StartScreen();
+			GetTextureStreamer().Pump();
 			glfwSwapBuffers(mainGame);
 			if (GetAsyncKeyState(VK_SPACE) & 0x8001) {
 				gameStart = true;
@@ -280,7 +352,15 @@ int main(int ac, char** av) {
 
 		StartGravity();
 		TestKey();
+		if (showProfiler) {
+			DisplayProfiler();
+			DisplayRenderStats();
+		}
+		ProfilerFrame();
+		RenderStatsFrame();
+		GetTextureStreamer().Pump();
 		glfwSwapBuffers(mainGame);
 		glfwPollEvents();
 	}
+	GetTextureStreamer().Release();
 }
@@ -1,10 +1,12 @@
 #include "WorldGenerator.h"
+#include "Profiler.h"
 
 WorldGenerator::WorldGenerator()
 { }
 
 WorldFrame** WorldGenerator::getData()
 {
+	ProfileScope scope("world generation");
 	WorldFrame** frames = new WorldFrame * [3];
 
 	// Dynamically allocate memory for each row